@@ -0,0 +1,67 @@
+#include "board.h"
+
+#include <string.h> // memset, memmove
+
+void clear_board(Board *board)
+{
+  memset(board->rows, 0, sizeof(board->rows));
+}
+
+void board_place_piece(Board *board, const Piece *piece)
+{
+  for(int i = 0; i < 4; i++)
+  {
+    v2i p = piece->position + piece->points[i];
+    if(p.x < 0 || p.x >= BOARD_COLUMNS || p.y < 0 || p.y >= BOARD_ROWS) continue;
+
+    board->rows[p.y] |= (uint16_t)(1 << p.x);
+  }
+}
+
+int board_full_rows(const Board *board, int rows_out[4])
+{
+  int num_rows = 0;
+  for(int row = 0; row < BOARD_ROWS && num_rows < 4; row++)
+  {
+    if(board->rows[row] == FULL_ROW) rows_out[num_rows++] = row;
+  }
+
+  return num_rows;
+}
+
+void board_clear_rows(Board *board, const int *rows, int num_rows)
+{
+  // Top-most first so the lower indices stay valid
+  for(int i = num_rows - 1; i >= 0; i--)
+  {
+    int target = rows[i];
+    memmove(&board->rows[target], &board->rows[target + 1], sizeof(uint16_t) * (BOARD_ROWS - 1 - target));
+    board->rows[BOARD_ROWS - 1] = 0;
+  }
+}
+
+bool board_try_kick(const Board *board, Piece *piece, RotationState prev_rotation)
+{
+  int num_tests = num_kick_tests(piece->type);
+  for(int i = 0; i < num_tests; i++)
+  {
+    v2i test_offset = kick_offset(piece->type, prev_rotation, piece->rotation, i);
+
+    piece->position += test_offset;
+    if(!board_collides(board, piece)) return true;
+    piece->position -= test_offset;
+  }
+
+  return false;
+}
+
+void board_hard_drop(const Board *board, Piece *piece)
+{
+  do
+  {
+    piece->position.y -= 1;
+  } while(!board_collides(board, piece));
+
+  piece->position.y += 1;
+}
+
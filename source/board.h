@@ -0,0 +1,57 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Which cells of the playfield are filled, one bit per cell. Row 0 is the
+// bottom, bit 0 of a row is the left column. Cells above the top row are open,
+// everything left, right and below the playfield is solid.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "piece.h"
+
+#include <stdint.h>
+
+static const int BOARD_COLUMNS = 10;
+static const int BOARD_ROWS = 24;
+static const uint16_t FULL_ROW = (1 << BOARD_COLUMNS) - 1;
+
+struct Board
+{
+  uint16_t rows[BOARD_ROWS];
+};
+
+static bool board_cell_filled(const Board *board, v2i p)
+{
+  if(p.x < 0 || p.x >= BOARD_COLUMNS || p.y < 0) return true;
+  if(p.y >= BOARD_ROWS) return false;
+  return (board->rows[p.y] >> p.x) & 1;
+}
+
+// True if the piece overlaps a filled cell, a wall or the floor
+static bool board_collides(const Board *board, const Piece *piece)
+{
+  for(int i = 0; i < 4; i++)
+  {
+    if(board_cell_filled(board, piece->position + piece->points[i])) return true;
+  }
+
+  return false;
+}
+
+void clear_board(Board *board);
+
+// Fills the piece's cells, parts above the top row are dropped
+void board_place_piece(Board *board, const Piece *piece);
+
+// Fills rows_out with the full rows, bottom-up, and returns how many
+int board_full_rows(const Board *board, int rows_out[4]);
+
+// Removes the given rows (ordered bottom-up) and drops everything above them
+void board_clear_rows(Board *board, const int *rows, int num_rows);
+
+// Rotates the already turned piece into place with the SRS kick tests. Returns
+// false, leaving the piece where it was, if none of them fit.
+bool board_try_kick(const Board *board, Piece *piece, RotationState prev_rotation);
+
+// Moves the piece straight down as far as it goes
+void board_hard_drop(const Board *board, Piece *piece);
+
@@ -0,0 +1,213 @@
+#include "board_evaluator.h"
+
+#include <string.h> // memcpy, memset
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EVALUATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Every feature is gathered in one pass from the top row down. Full rows are
+// skipped, which is the same as clearing them first. Runs of well cells count
+// 1, 2, 3, 4, 4, ... going down, so the scalar and SIMD paths only need to
+// remember the last three rows.
+
+EvaluatorWeights default_evaluator_weights()
+{
+  EvaluatorWeights w;
+  w.weights[FEATURE_AGGREGATE_HEIGHT]   = -0.51f;
+  w.weights[FEATURE_HOLES]              = -0.36f;
+  w.weights[FEATURE_BUMPINESS]          = -0.18f;
+  w.weights[FEATURE_ROW_TRANSITIONS]    = -0.32f;
+  w.weights[FEATURE_COLUMN_TRANSITIONS] = -0.93f;
+  w.weights[FEATURE_WELLS]              = -0.34f;
+  w.weights[FEATURE_COMPLETED_LINES]    =  0.76f;
+  return w;
+}
+
+static int count_bits(uint32_t x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  return (int)((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+static const uint32_t LEFT_WALL = 1;
+static const uint32_t RIGHT_WALL = 1 << (BOARD_COLUMNS - 1);
+static const uint32_t WALLED_ROW = (1 << (BOARD_COLUMNS + 1)) - 1; // Cells shifted up one, plus both walls
+
+void board_features(const Board *board, int features[NUM_BOARD_FEATURES])
+{
+  memset(features, 0, sizeof(int) * NUM_BOARD_FEATURES);
+
+  uint32_t covered = 0; // Columns with something in or above the current row
+  uint32_t above = 0;   // Previous kept row
+  uint32_t well_1 = 0, well_2 = 0, well_3 = 0;
+
+  for(int r = BOARD_ROWS - 1; r >= 0; r--)
+  {
+    uint32_t row = board->rows[r];
+    if(row == FULL_ROW)
+    {
+      features[FEATURE_COMPLETED_LINES]++;
+      continue;
+    }
+
+    features[FEATURE_HOLES] += count_bits(~row & covered & FULL_ROW);
+
+    uint32_t left = (row << 1) | LEFT_WALL;
+    uint32_t right = (row >> 1) | RIGHT_WALL;
+    uint32_t well = ~row & ~covered & left & right & FULL_ROW;
+    features[FEATURE_WELLS] += count_bits(well) + count_bits(well & well_1) + count_bits(well & well_2) + count_bits(well & well_3);
+    well_3 = well & well_2;
+    well_2 = well & well_1;
+    well_1 = well;
+
+    covered |= row;
+    features[FEATURE_AGGREGATE_HEIGHT] += count_bits(covered);
+    features[FEATURE_BUMPINESS] += count_bits((covered ^ (covered >> 1)) & (FULL_ROW >> 1));
+
+    if(row)
+    {
+      uint32_t walled = (row << 1) | 1 | (1 << (BOARD_COLUMNS + 1));
+      features[FEATURE_ROW_TRANSITIONS] += count_bits((walled ^ (walled >> 1)) & WALLED_ROW);
+    }
+
+    features[FEATURE_COLUMN_TRANSITIONS] += count_bits(row ^ above);
+    above = row;
+  }
+
+  features[FEATURE_COLUMN_TRANSITIONS] += count_bits(above ^ FULL_ROW);
+}
+
+float evaluate_board(const Board *board, const EvaluatorWeights *weights)
+{
+  int features[NUM_BOARD_FEATURES];
+  board_features(board, features);
+
+  float score = 0.0f;
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++) score += weights->weights[i] * (float)features[i];
+
+  return score;
+}
+
+
+
+#if EVALUATOR_SSE2
+
+static __m128i count_bits_epi16(__m128i x)
+{
+  x = _mm_sub_epi16(x, _mm_and_si128(_mm_srli_epi16(x, 1), _mm_set1_epi16(0x5555)));
+  x = _mm_add_epi16(_mm_and_si128(x, _mm_set1_epi16(0x3333)), _mm_and_si128(_mm_srli_epi16(x, 2), _mm_set1_epi16(0x3333)));
+  x = _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 4)), _mm_set1_epi16(0x0F0F));
+  return _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), _mm_set1_epi16(0x001F));
+}
+
+// Picks a where mask is set, b elsewhere
+static __m128i select_epi16(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Same as board_features for eight boards, one per lane
+static void board_features_x8(const Board *boards, __m128i features[NUM_BOARD_FEATURES])
+{
+  const __m128i ones = _mm_set1_epi16(-1);
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i full_row = _mm_set1_epi16(FULL_ROW);
+
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++) features[i] = _mm_setzero_si128();
+
+  __m128i covered = _mm_setzero_si128();
+  __m128i above = _mm_setzero_si128();
+  __m128i well_1 = _mm_setzero_si128();
+  __m128i well_2 = _mm_setzero_si128();
+  __m128i well_3 = _mm_setzero_si128();
+
+  for(int r = BOARD_ROWS - 1; r >= 0; r--)
+  {
+    __m128i row = _mm_set_epi16(boards[7].rows[r], boards[6].rows[r], boards[5].rows[r], boards[4].rows[r],
+                                boards[3].rows[r], boards[2].rows[r], boards[1].rows[r], boards[0].rows[r]);
+
+    __m128i full = _mm_cmpeq_epi16(row, full_row);
+    __m128i keep = _mm_andnot_si128(full, ones);
+    features[FEATURE_COMPLETED_LINES] = _mm_add_epi16(features[FEATURE_COMPLETED_LINES], _mm_and_si128(full, one));
+
+    __m128i empty = _mm_andnot_si128(row, full_row);
+    __m128i holes = count_bits_epi16(_mm_and_si128(empty, covered));
+    features[FEATURE_HOLES] = _mm_add_epi16(features[FEATURE_HOLES], _mm_and_si128(holes, keep));
+
+    __m128i left = _mm_or_si128(_mm_slli_epi16(row, 1), _mm_set1_epi16(LEFT_WALL));
+    __m128i right = _mm_or_si128(_mm_srli_epi16(row, 1), _mm_set1_epi16(RIGHT_WALL));
+    __m128i well = _mm_and_si128(_mm_andnot_si128(covered, empty), _mm_and_si128(left, right));
+    well = _mm_and_si128(well, keep);
+    __m128i wells = _mm_add_epi16(_mm_add_epi16(count_bits_epi16(well), count_bits_epi16(_mm_and_si128(well, well_1))),
+                                  _mm_add_epi16(count_bits_epi16(_mm_and_si128(well, well_2)), count_bits_epi16(_mm_and_si128(well, well_3))));
+    features[FEATURE_WELLS] = _mm_add_epi16(features[FEATURE_WELLS], wells);
+    well_3 = select_epi16(keep, _mm_and_si128(well, well_2), well_3);
+    well_2 = select_epi16(keep, _mm_and_si128(well, well_1), well_2);
+    well_1 = select_epi16(keep, well, well_1);
+
+    covered = _mm_or_si128(covered, _mm_and_si128(row, keep));
+    features[FEATURE_AGGREGATE_HEIGHT] = _mm_add_epi16(features[FEATURE_AGGREGATE_HEIGHT], _mm_and_si128(count_bits_epi16(covered), keep));
+    __m128i steps = _mm_and_si128(_mm_xor_si128(covered, _mm_srli_epi16(covered, 1)), _mm_set1_epi16(FULL_ROW >> 1));
+    features[FEATURE_BUMPINESS] = _mm_add_epi16(features[FEATURE_BUMPINESS], _mm_and_si128(count_bits_epi16(steps), keep));
+
+    __m128i walled = _mm_or_si128(_mm_slli_epi16(row, 1), _mm_set1_epi16(1 | (1 << (BOARD_COLUMNS + 1))));
+    __m128i row_transitions = count_bits_epi16(_mm_and_si128(_mm_xor_si128(walled, _mm_srli_epi16(walled, 1)), _mm_set1_epi16(WALLED_ROW)));
+    __m128i non_empty = _mm_andnot_si128(_mm_cmpeq_epi16(row, _mm_setzero_si128()), keep);
+    features[FEATURE_ROW_TRANSITIONS] = _mm_add_epi16(features[FEATURE_ROW_TRANSITIONS], _mm_and_si128(row_transitions, non_empty));
+
+    __m128i column_transitions = count_bits_epi16(_mm_xor_si128(row, above));
+    features[FEATURE_COLUMN_TRANSITIONS] = _mm_add_epi16(features[FEATURE_COLUMN_TRANSITIONS], _mm_and_si128(column_transitions, keep));
+    above = select_epi16(keep, row, above);
+  }
+
+  features[FEATURE_COLUMN_TRANSITIONS] = _mm_add_epi16(features[FEATURE_COLUMN_TRANSITIONS], count_bits_epi16(_mm_xor_si128(above, full_row)));
+}
+
+static void evaluate_boards_x8(const Board *boards, const EvaluatorWeights *weights, float *scores)
+{
+  __m128i features[NUM_BOARD_FEATURES];
+  board_features_x8(boards, features);
+
+  __m128 low = _mm_setzero_ps();
+  __m128 high = _mm_setzero_ps();
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++)
+  {
+    __m128 weight = _mm_set1_ps(weights->weights[i]);
+    __m128i low_features = _mm_unpacklo_epi16(features[i], _mm_setzero_si128());
+    __m128i high_features = _mm_unpackhi_epi16(features[i], _mm_setzero_si128());
+    low = _mm_add_ps(low, _mm_mul_ps(weight, _mm_cvtepi32_ps(low_features)));
+    high = _mm_add_ps(high, _mm_mul_ps(weight, _mm_cvtepi32_ps(high_features)));
+  }
+
+  _mm_storeu_ps(scores, low);
+  _mm_storeu_ps(scores + 4, high);
+}
+
+void evaluate_boards(const Board *boards, int num_boards, const EvaluatorWeights *weights, float *scores)
+{
+  int i = 0;
+  for(; i + 8 <= num_boards; i += 8) evaluate_boards_x8(boards + i, weights, scores + i);
+
+  if(i < num_boards)
+  {
+    Board tail[8];
+    float tail_scores[8];
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, boards + i, sizeof(Board) * (num_boards - i));
+
+    evaluate_boards_x8(tail, weights, tail_scores);
+    memcpy(scores + i, tail_scores, sizeof(float) * (num_boards - i));
+  }
+}
+
+#else
+
+void evaluate_boards(const Board *boards, int num_boards, const EvaluatorWeights *weights, float *scores)
+{
+  for(int i = 0; i < num_boards; i++) scores[i] = evaluate_board(&boards[i], weights);
+}
+
+#endif
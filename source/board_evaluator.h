@@ -0,0 +1,50 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Heuristic board scores for the bots, a weighted sum of the usual features.
+// Boards are scored the way they look after their full rows are cleared, so
+// candidates can be evaluated straight after board_place_piece.
+//
+// evaluate_boards scores many boards at once, eight per SSE2 vector with one
+// board in each 16 bit lane. Builds without SSE2 fall back to the scalar path.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+enum BoardFeature
+{
+  FEATURE_AGGREGATE_HEIGHT,   // Sum of column heights
+  FEATURE_HOLES,              // Empty cells with something above them
+  FEATURE_BUMPINESS,          // Sum of height differences between neighbouring columns
+  FEATURE_ROW_TRANSITIONS,    // Filled/empty changes along rows, walls count as filled
+  FEATURE_COLUMN_TRANSITIONS, // Filled/empty changes up columns, the floor counts as filled
+  FEATURE_WELLS,              // Open cells between two filled ones, deeper cells count more
+  FEATURE_COMPLETED_LINES,
+
+  NUM_BOARD_FEATURES
+};
+
+static const char *BOARD_FEATURE_NAMES[NUM_BOARD_FEATURES] =
+{
+  "aggregate height",
+  "holes",
+  "bumpiness",
+  "row transitions",
+  "column transitions",
+  "wells",
+  "completed lines",
+};
+
+struct EvaluatorWeights
+{
+  float weights[NUM_BOARD_FEATURES];
+};
+
+// Higher is better
+EvaluatorWeights default_evaluator_weights();
+
+void board_features(const Board *board, int features[NUM_BOARD_FEATURES]);
+float evaluate_board(const Board *board, const EvaluatorWeights *weights);
+
+// scores[i] is evaluate_board(&boards[i], weights)
+void evaluate_boards(const Board *boards, int num_boards, const EvaluatorWeights *weights, float *scores);
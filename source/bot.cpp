@@ -0,0 +1,670 @@
+#include "bot.h"
+
+#include "input.h"
+#include "latency.h"
+#include "zobrist.h"
+#include "transposition_table.h"
+
+#include <stdlib.h> // malloc
+#include <string.h>
+
+#include <algorithm> // nth_element, sort
+#include <new>       // placement new
+
+struct BotNode
+{
+  uint64_t hash; // Of the board
+  PieceType current;
+  PieceType hold;
+  int next_index; // Into the queue
+  int root;       // Which root move this line of play started with
+  float line_score;
+};
+
+struct RootMove
+{
+  bool hold;
+  Placement placement;
+};
+
+struct BotSearch
+{
+  BotView view;
+  bool speculative;
+  bool done;
+
+  int depth;     // Finished layers
+  int next_node; // Next beam node to expand
+  uint64_t time_spent;
+
+  BotDecision best; // From the deepest finished layer
+};
+
+struct Bot
+{
+  BotSettings settings;
+
+  // Search. Only root moves need their inputs, deeper pieces just positions.
+  Placement placements[MAX_PLACEMENTS];
+  Piece lock_positions[MAX_PLACEMENTS];
+  Board quick_boards[MAX_PLACEMENTS];
+  float quick_scores[MAX_PLACEMENTS];
+
+  RootMove *root_moves;
+  int num_root_moves;
+
+  Board *beam_boards;
+  BotNode *beam;
+  int beam_size;
+
+  // Children are scored in one evaluate_boards call, so their boards are kept
+  // apart from the rest
+  Board *child_boards;
+  BotNode *children;
+  float *child_scores;
+  int *child_order;
+  int num_children;
+  int child_capacity;
+
+  // Game states already in the beam, lines of play that meet up again are
+  // only searched once. Entries hold the layer they were seen in.
+  TranspositionTable seen_states;
+  uint64_t layer_stamp;
+
+  // Search in progress, either for the falling piece or a guess at the next
+  // one while the falling piece is moved into place
+  BotSearch search;
+
+  // Controller
+  bool thinking; // Waiting on the search before moving the piece
+  bool have_plan;
+  BotDecision plan;
+  unsigned plan_piece_number;
+  Piece plan_states[MAX_PATH_INPUTS]; // Where the piece should be after each input
+  int next_input;
+  bool hold_pending;
+
+  unsigned last_buttons;
+};
+
+// Room for every placement of both pieces of a node, more than any board has
+static const int MAX_CHILDREN_PER_NODE = 256;
+
+static const int SEEN_STATES_SIZE_LOG2 = 16;
+
+
+
+BotSettings default_bot_settings()
+{
+  BotSettings settings;
+  settings.beam_width = 32;
+  settings.depth = 3;
+  settings.time_budget = 4.0f;
+  settings.frame_budget = 1000.0f;
+  settings.weights = default_evaluator_weights();
+  return settings;
+}
+
+Bot *create_bot(const BotSettings *settings)
+{
+  // Value-initialized, so everything starts out zero
+  Bot *bot = new(malloc(sizeof(Bot))) Bot();
+  bot->search.done = true;
+  bot->settings = *settings;
+  if(bot->settings.beam_width < 1) bot->settings.beam_width = 1;
+  if(bot->settings.depth < 1) bot->settings.depth = 1;
+
+  int beam_width = bot->settings.beam_width;
+  bot->child_capacity = beam_width * MAX_CHILDREN_PER_NODE;
+
+  bot->root_moves = (RootMove *)malloc(sizeof(RootMove) * MAX_CHILDREN_PER_NODE);
+  bot->beam_boards = (Board *)malloc(sizeof(Board) * beam_width);
+  bot->beam = (BotNode *)malloc(sizeof(BotNode) * beam_width);
+  bot->child_boards = (Board *)malloc(sizeof(Board) * bot->child_capacity);
+  bot->children = (BotNode *)malloc(sizeof(BotNode) * bot->child_capacity);
+  bot->child_scores = (float *)malloc(sizeof(float) * bot->child_capacity);
+  bot->child_order = (int *)malloc(sizeof(int) * bot->child_capacity);
+
+  init_transposition_table(&bot->seen_states, SEEN_STATES_SIZE_LOG2);
+
+  return bot;
+}
+
+void destroy_bot(Bot *bot)
+{
+  if(!bot) return;
+
+  free(bot->root_moves);
+  free(bot->beam_boards);
+  free(bot->beam);
+  free(bot->child_boards);
+  free(bot->children);
+  free(bot->child_scores);
+  free(bot->child_order);
+  free_transposition_table(&bot->seen_states);
+  free(bot);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Search
+////////////////////////////////////////////////////////////////////////////////
+
+static PieceType queue_piece(const BotView *view, int index)
+{
+  return (index < view->queue_length) ? view->queue[index] : NO_PIECE;
+}
+
+// Adds a child for every placement of one piece. start is where the piece
+// begins, next_index where the queue stands once it is placed.
+static void expand_piece(Bot *bot, const BotView *view, const Board *board, const BotNode *node, const Piece *start,
+                         PieceType hold_after, int next_index, bool root_hold)
+{
+  bool root = node->root < 0;
+  int num_placements = root ? generate_placements(board, start, bot->placements, MAX_PLACEMENTS)
+                            : generate_lock_positions(board, start, bot->lock_positions, MAX_PLACEMENTS);
+  for(int i = 0; i < num_placements && bot->num_children < bot->child_capacity; i++)
+  {
+    if(root && bot->num_root_moves >= MAX_CHILDREN_PER_NODE) break;
+
+    const Piece *piece = root ? &bot->placements[i].piece : &bot->lock_positions[i];
+
+    int child = bot->num_children++;
+    bot->child_boards[child] = *board;
+    board_place_piece(&bot->child_boards[child], piece);
+
+    BotNode *info = &bot->children[child];
+    info->hash = node->hash ^ zobrist_piece(board, piece);
+    info->current = queue_piece(view, next_index);
+    info->hold = hold_after;
+    info->next_index = next_index + 1;
+    info->line_score = node->line_score;
+
+    if(root)
+    {
+      info->root = bot->num_root_moves++;
+      bot->root_moves[info->root].hold = root_hold;
+      bot->root_moves[info->root].placement = bot->placements[i];
+    }
+    else
+    {
+      info->root = node->root;
+    }
+  }
+}
+
+// Both ways of playing a node, with and without hold
+static void expand_node(Bot *bot, const BotView *view, const Board *board, const BotNode *node)
+{
+  bool root = node->root < 0;
+  if(node->current == NO_PIECE) return;
+
+  Piece start;
+  if(root) start = view->falling_piece;
+  else make_spawned_piece(&start, node->current);
+  expand_piece(bot, view, board, node, &start, node->hold, node->next_index, false);
+
+  bool can_hold = root ? view->can_hold : true;
+  if(!can_hold || node->hold == node->current) return;
+
+  if(node->hold == NO_PIECE)
+  {
+    PieceType next = queue_piece(view, node->next_index);
+    if(next == NO_PIECE) return;
+
+    make_spawned_piece(&start, next);
+    expand_piece(bot, view, board, node, &start, node->current, node->next_index + 1, true);
+  }
+  else
+  {
+    make_spawned_piece(&start, node->hold);
+    expand_piece(bot, view, board, node, &start, node->current, node->next_index, true);
+  }
+}
+
+// Puts the best children from index sorted up to count in order. Everything
+// before sorted is already in order and no worse than anything after it, so
+// the prefix can be grown a chunk at a time.
+static int sort_children(Bot *bot, int sorted, int count)
+{
+  if(count > bot->num_children) count = bot->num_children;
+
+  const float *scores = bot->child_scores;
+  auto better = [scores](int a, int b) { return scores[a] > scores[b]; };
+  int *order = bot->child_order;
+  if(count < bot->num_children) std::nth_element(order + sorted, order + count, order + bot->num_children, better);
+  std::sort(order + sorted, order + count, better);
+
+  return count;
+}
+
+// Scores the children and keeps the best of them as the next beam, skipping
+// games already in it. Returns the best child.
+static int select_beam(Bot *bot, const BotView *view)
+{
+  const EvaluatorWeights *weights = &bot->settings.weights;
+  evaluate_boards(bot->child_boards, bot->num_children, weights, bot->child_scores);
+
+  int best = 0;
+  for(int i = 0; i < bot->num_children; i++)
+  {
+    bot->child_scores[i] += bot->children[i].line_score;
+    if(bot->child_scores[i] > bot->child_scores[best]) best = i;
+    bot->child_order[i] = i;
+  }
+
+  // Best first, with some spare for duplicates. If duplicates use up the
+  // spare too, the next best are sorted in after them.
+  int chunk = bot->settings.beam_width * 2;
+  int num_sorted = sort_children(bot, 0, chunk);
+
+  uint64_t stamp = ++bot->layer_stamp;
+  int keep = 0;
+  for(int i = 0; i < bot->num_children && keep < bot->settings.beam_width; i++)
+  {
+    if(i == num_sorted) num_sorted = sort_children(bot, num_sorted, num_sorted + chunk);
+
+    int child = bot->child_order[i];
+    Board *board = &bot->beam_boards[keep];
+    BotNode *node = &bot->beam[keep];
+    *board = bot->child_boards[child];
+    *node = bot->children[child];
+
+    int rows[4];
+    int num_rows = board_full_rows(board, rows);
+    node->hash = zobrist_clear_rows(board, node->hash, rows, num_rows);
+    node->line_score += num_rows * weights->weights[FEATURE_COMPLETED_LINES];
+
+    int queue_index = (node->next_index < view->queue_length) ? node->next_index : view->queue_length;
+    uint64_t key = zobrist_state(node->hash, node->current, node->hold, true,
+                                 view->queue + queue_index, view->queue_length - queue_index);
+
+    uint64_t seen_in;
+    if(transposition_probe(&bot->seen_states, key, &seen_in) && seen_in == stamp) continue;
+    transposition_store(&bot->seen_states, key, stamp);
+
+    keep++;
+  }
+  bot->beam_size = keep;
+
+  return best;
+}
+
+// Finishes the children of the current layer: picks the next beam and makes
+// the best of them the move to play
+static void finish_layer(Bot *bot)
+{
+  BotSearch *search = &bot->search;
+  if(bot->num_children == 0)
+  {
+    search->done = true;
+    return;
+  }
+
+  int best = select_beam(bot, &search->view);
+
+  const RootMove *move = &bot->root_moves[bot->children[best].root];
+  search->best.found = true;
+  search->best.hold = move->hold;
+  search->best.placement = move->placement;
+  search->best.depth_reached = ++search->depth;
+  search->best.score = bot->child_scores[best];
+
+  search->next_node = 0;
+  bot->num_children = 0;
+  if(search->depth >= bot->settings.depth) search->done = true;
+}
+
+// Starts a search with the root layer done, so there is a move right away
+static void begin_search(Bot *bot, const BotView *view, bool speculative)
+{
+  BotSearch *search = &bot->search;
+  search->best = BotDecision();
+  search->view = *view;
+  search->speculative = speculative;
+  search->depth = 0;
+  search->next_node = 0;
+  search->time_spent = 0;
+  search->done = true;
+
+  bot->num_root_moves = 0;
+  bot->num_children = 0;
+  if(view->falling_piece.type == NO_PIECE) return;
+
+  BotNode root;
+  root.hash = view->board_hash;
+  root.current = view->falling_piece.type;
+  root.hold = view->held_piece;
+  root.next_index = 0;
+  root.root = -1;
+  root.line_score = 0.0f;
+
+  expand_node(bot, &search->view, &search->view.board, &root);
+
+  search->done = false;
+  finish_layer(bot);
+}
+
+// Expands nodes until the deadline. A layer left unfinished when the decision
+// runs out of time is thrown away, it would favour the boards that got
+// expanded first.
+static void continue_search(Bot *bot, uint64_t deadline)
+{
+  BotSearch *search = &bot->search;
+  uint64_t start = latency_now_ns();
+  uint64_t decision_budget = (uint64_t)(bot->settings.time_budget * 1e6f);
+
+  while(!search->done)
+  {
+    if(search->next_node >= bot->beam_size)
+    {
+      finish_layer(bot);
+    }
+    else
+    {
+      int node = search->next_node++;
+      expand_node(bot, &search->view, &bot->beam_boards[node], &bot->beam[node]);
+    }
+
+    uint64_t now = latency_now_ns();
+    if(search->time_spent + (now - start) >= decision_budget) search->done = true;
+    if(now >= deadline) break;
+  }
+
+  search->time_spent += latency_now_ns() - start;
+}
+
+void bot_decide(Bot *bot, const BotView *view, BotDecision *decision)
+{
+  begin_search(bot, view, false);
+  continue_search(bot, ~0ull);
+  *decision = bot->search.best;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Controller
+////////////////////////////////////////////////////////////////////////////////
+
+static const unsigned INPUT_BUTTONS[NUM_MOVE_INPUTS] =
+{
+  BUTTON_LEFT,       // MOVE_LEFT
+  BUTTON_RIGHT,      // MOVE_RIGHT
+  BUTTON_ROTATE_CCW, // MOVE_ROTATE_CCW
+  BUTTON_ROTATE_CW,  // MOVE_ROTATE_CW
+  BUTTON_SOFT_DROP,  // MOVE_SOFT_DROP
+  BUTTON_HARD_DROP,  // MOVE_HARD_DROP
+};
+
+// What the game does with one input, false if it would not move the piece
+static bool apply_input(const Board *board, Piece *piece, int input)
+{
+  Piece moved = *piece;
+  switch(input)
+  {
+    case MOVE_LEFT:      { moved.position.x -= 1; break; }
+    case MOVE_RIGHT:     { moved.position.x += 1; break; }
+    case MOVE_SOFT_DROP: { moved.position.y -= 1; break; }
+    case MOVE_HARD_DROP: { board_hard_drop(board, &moved); break; }
+
+    case MOVE_ROTATE_CCW:
+    case MOVE_ROTATE_CW:
+    {
+      RotationState prev_rotation = moved.rotation;
+      rotate(&moved, (input == MOVE_ROTATE_CW) ? 1 : -1);
+      if(!board_try_kick(board, &moved, prev_rotation)) return false;
+      break;
+    }
+  }
+
+  if(board_collides(board, &moved)) return false;
+
+  *piece = moved;
+  return true;
+}
+
+static bool same_spot(const Piece *a, const Piece *b)
+{
+  return a->position.x == b->position.x && a->position.y == b->position.y && a->rotation == b->rotation;
+}
+
+// Whether the rest of the plan still ends up at the planned placement from
+// where the piece really is. Gravity may already have done some of the soft
+// drops, but it must not have gone past them.
+static bool plan_still_works(const Bot *bot, const Board *board, const Piece *piece)
+{
+  Piece at = *piece;
+  const Placement *placement = &bot->plan.placement;
+
+  for(int i = bot->next_input; i < placement->num_inputs; i++)
+  {
+    int input = placement->inputs[i];
+    if(input == MOVE_SOFT_DROP)
+    {
+      int target = bot->plan_states[i].position.y;
+      if(at.position.y < target) return false;
+      while(at.position.y > target)
+      {
+        if(!apply_input(board, &at, MOVE_SOFT_DROP)) return false;
+      }
+    }
+    else if(!apply_input(board, &at, input))
+    {
+      return false;
+    }
+  }
+
+  return same_spot(&at, &placement->piece);
+}
+
+// Records where the piece should be after every input of the plan
+static void trace_plan(Bot *bot, const Board *board, Piece start)
+{
+  const Placement *placement = &bot->plan.placement;
+  for(int i = 0; i < placement->num_inputs; i++)
+  {
+    apply_input(board, &start, placement->inputs[i]);
+    bot->plan_states[i] = start;
+  }
+}
+
+static void start_plan(Bot *bot, const BotView *view, const BotDecision *decision)
+{
+  bot->plan = *decision;
+  bot->have_plan = true;
+  bot->next_input = 0;
+  bot->hold_pending = decision->hold;
+
+  Piece start = bot->search.view.falling_piece;
+  if(decision->hold)
+  {
+    PieceType type = (view->held_piece == NO_PIECE) ? view->queue[0] : view->held_piece;
+    make_spawned_piece(&start, type);
+  }
+
+  trace_plan(bot, &view->board, start);
+}
+
+// A new path from where the piece is now to the cells the plan wanted
+static bool retarget_plan(Bot *bot, const BotView *view)
+{
+  Placement placement;
+  if(!find_placement_path(&view->board, &view->falling_piece, &bot->plan.placement.piece, &placement)) return false;
+
+  bot->plan.placement = placement;
+  bot->plan.hold = false;
+  bot->next_input = 0;
+  trace_plan(bot, &view->board, view->falling_piece);
+  return true;
+}
+
+// The best placement from where the piece is now, without looking ahead. For
+// when the planned cells can't be reached any more.
+static bool quick_plan(Bot *bot, const BotView *view)
+{
+  int num_placements = generate_placements(&view->board, &view->falling_piece, bot->placements, MAX_PLACEMENTS);
+  if(num_placements == 0) return false;
+
+  for(int i = 0; i < num_placements; i++)
+  {
+    bot->quick_boards[i] = view->board;
+    board_place_piece(&bot->quick_boards[i], &bot->placements[i].piece);
+  }
+  evaluate_boards(bot->quick_boards, num_placements, &bot->settings.weights, bot->quick_scores);
+
+  int best = 0;
+  for(int i = 1; i < num_placements; i++)
+  {
+    if(bot->quick_scores[i] > bot->quick_scores[best]) best = i;
+  }
+
+  bot->plan.placement = bot->placements[best];
+  bot->plan.hold = false;
+  bot->next_input = 0;
+  trace_plan(bot, &view->board, view->falling_piece);
+  return true;
+}
+
+// What the game will look like when the next piece spawns, if the plan goes
+// through. False if the queue doesn't say what comes next.
+static bool predict_next_view(const BotView *view, const BotDecision *plan, BotView *next)
+{
+  next->board = view->board;
+  next->board_hash = view->board_hash ^ zobrist_piece(&view->board, &plan->placement.piece);
+  board_place_piece(&next->board, &plan->placement.piece);
+
+  int rows[4];
+  int num_rows = board_full_rows(&next->board, rows);
+  next->board_hash = zobrist_clear_rows(&next->board, next->board_hash, rows, num_rows);
+
+  int queue_index = 0;
+  next->held_piece = view->held_piece;
+  if(plan->hold)
+  {
+    if(view->held_piece == NO_PIECE) queue_index++;
+    next->held_piece = view->falling_piece.type;
+  }
+  if(queue_index >= view->queue_length) return false;
+
+  make_spawned_piece(&next->falling_piece, view->queue[queue_index++]);
+  next->can_hold = true;
+
+  next->queue_length = view->queue_length - queue_index;
+  for(int i = 0; i < next->queue_length; i++) next->queue[i] = view->queue[queue_index + i];
+  next->piece_number = 0;
+
+  return true;
+}
+
+// Whether a speculative search was about the game as it turned out. The real
+// queue has one more piece at the end, which the search didn't know about.
+static bool view_matches(const BotView *predicted, const BotView *view)
+{
+  if(predicted->board_hash != view->board_hash) return false;
+  if(memcmp(&predicted->board, &view->board, sizeof(Board))) return false;
+  if(predicted->falling_piece.type != view->falling_piece.type) return false;
+  if(!same_spot(&predicted->falling_piece, &view->falling_piece)) return false;
+  if(predicted->held_piece != view->held_piece || predicted->can_hold != view->can_hold) return false;
+  if(predicted->queue_length > view->queue_length) return false;
+
+  for(int i = 0; i < predicted->queue_length; i++)
+  {
+    if(predicted->queue[i] != view->queue[i]) return false;
+  }
+
+  return true;
+}
+
+// Taps need a tick with the button up in between, the game only acts on the
+// tick a button goes down
+static unsigned tap(Bot *bot, unsigned button)
+{
+  if(bot->last_buttons & button) return 0;
+  return button;
+}
+
+static unsigned next_buttons(Bot *bot, const BotView *view, uint64_t deadline)
+{
+  BotSearch *search = &bot->search;
+
+  if(view->falling_piece.type == NO_PIECE)
+  {
+    bot->have_plan = false;
+    return 0;
+  }
+
+  // New piece, carry on with the search that guessed it or start over
+  if(view->piece_number != bot->plan_piece_number || (!bot->have_plan && !bot->thinking))
+  {
+    bot->plan_piece_number = view->piece_number;
+    bot->have_plan = false;
+    bot->thinking = true;
+
+    if(search->speculative && view_matches(&search->view, view)) search->speculative = false;
+    else begin_search(bot, view, false);
+  }
+
+  if(bot->thinking)
+  {
+    // The piece keeps falling while the search takes its time, that is what
+    // the plan checks below are for
+    continue_search(bot, deadline);
+    if(!search->done) return 0;
+
+    bot->thinking = false;
+    if(!search->best.found) return tap(bot, BUTTON_RESTART); // Topped out, start over
+
+    start_plan(bot, view, &search->best);
+
+    BotView next;
+    if(predict_next_view(view, &bot->plan, &next)) begin_search(bot, &next, true);
+  }
+
+  if(bot->hold_pending)
+  {
+    unsigned buttons = tap(bot, BUTTON_HOLD);
+    if(buttons)
+    {
+      bot->hold_pending = false;
+      bot->plan_piece_number++;
+    }
+    return buttons;
+  }
+
+  if(!plan_still_works(bot, &view->board, &view->falling_piece))
+  {
+    if(!retarget_plan(bot, view) && !quick_plan(bot, view)) return tap(bot, BUTTON_HARD_DROP);
+  }
+
+  const Placement *placement = &bot->plan.placement;
+  while(bot->next_input < placement->num_inputs)
+  {
+    int input = placement->inputs[bot->next_input];
+    if(input != MOVE_SOFT_DROP) break;
+
+    // Hold soft drop until the piece is down at the row the plan wants
+    if(view->falling_piece.position.y > bot->plan_states[bot->next_input].position.y) return BUTTON_SOFT_DROP;
+    bot->next_input++;
+  }
+
+  if(bot->next_input >= placement->num_inputs) return 0;
+
+  unsigned buttons = tap(bot, INPUT_BUTTONS[placement->inputs[bot->next_input]]);
+  if(buttons) bot->next_input++;
+  return buttons;
+}
+
+unsigned bot_buttons(Bot *bot, const BotView *view)
+{
+  uint64_t deadline = latency_now_ns() + (uint64_t)(bot->settings.frame_budget * 1e3f);
+
+  unsigned buttons = next_buttons(bot, view, deadline);
+
+  // Whatever is left of the tick's budget goes to thinking about the next piece
+  if(!bot->thinking && !bot->search.done) continue_search(bot, deadline);
+
+  bot->last_buttons = buttons;
+  return buttons;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Autoplay. A beam search over the falling piece, the held piece and the
+// preview queue picks a placement, then a controller presses the buttons that
+// get the piece there, one tick at a time, through the same button mask the
+// game reads from the keyboard. After every press it checks where the piece
+// actually went and plans again if gravity or a failed kick got in the way.
+//
+// The search never takes more than frame_budget per tick. It picks up where
+// it left off next tick and always has the best move of its deepest finished
+// layer ready. While a piece is being moved into place, the rest of the tick
+// goes to searching for the next piece on the board the plan will leave.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "move_generator.h"
+#include "board_evaluator.h"
+
+static const int MAX_BOT_QUEUE = 8;
+
+struct BotSettings
+{
+  int beam_width;     // Boards kept per search layer
+  int depth;          // Pieces placed per plan, including the falling one
+  float time_budget;  // Thinking per decision, in ms
+  float frame_budget; // Thinking per game tick, in us
+  EvaluatorWeights weights;
+};
+
+BotSettings default_bot_settings();
+
+// What the bot gets to see of the game
+struct BotView
+{
+  Board board;
+  uint64_t board_hash; // zobrist_board(&board)
+
+  Piece falling_piece; // NO_PIECE while lines are clearing
+  PieceType held_piece;
+  bool can_hold;
+
+  PieceType queue[MAX_BOT_QUEUE]; // queue[0] spawns next
+  int queue_length;
+
+  unsigned piece_number; // Goes up with every spawned piece
+};
+
+struct BotDecision
+{
+  bool found; // False once the falling piece has nowhere to go
+
+  bool hold; // Hold first, the placement is for the piece that comes out
+  Placement placement;
+
+  int depth_reached;
+  float score;
+};
+
+struct Bot;
+
+Bot *create_bot(const BotSettings *settings);
+void destroy_bot(Bot *bot);
+
+// Runs a full search for the falling piece in one go, up to time_budget
+void bot_decide(Bot *bot, const BotView *view, BotDecision *decision);
+
+// GameButton bits to hold down for the next tick. Call once a tick, a tap is
+// one call long.
+unsigned bot_buttons(Bot *bot, const BotView *view);
@@ -0,0 +1,163 @@
+#include "dataset.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <stdlib.h>
+#include <string.h>
+#include <cstdio>
+
+struct DatasetWriter
+{
+  FILE *file;
+  std::thread thread;
+
+  // Held for a whole dataset_write, so one call's records go out in one piece
+  std::mutex append_lock;
+
+  std::mutex lock;
+  std::condition_variable ready; // A buffer is waiting to be written, or closing
+  std::condition_variable done;  // The written buffer is free again
+
+  DatasetRecord *buffers[2];
+  int capacity;
+  int active;        // The buffer callers fill
+  int fill;
+  int pending_count; // Records in the other buffer still to write, 0 if none
+  bool closing;
+  bool failed;
+
+  uint64_t records_written;
+};
+
+void dataset_record_position(DatasetRecord *record, const SimState *state)
+{
+  memset(record, 0, sizeof(*record));
+
+  for(int row = 0; row < BOARD_ROWS; row++) record->rows[row] = state->board.rows[row];
+  record->current = (uint8_t)state->current;
+  record->hold = (uint8_t)state->hold;
+  record->can_hold = state->can_hold;
+  for(int i = 0; i < SIM_QUEUE_LENGTH; i++) record->queue[i] = (uint8_t)state->queue[i];
+}
+
+static void writer_thread(DatasetWriter *writer)
+{
+  std::unique_lock<std::mutex> guard(writer->lock);
+  for(;;)
+  {
+    writer->ready.wait(guard, [writer] { return writer->pending_count > 0 || writer->closing; });
+    if(writer->pending_count == 0) break;
+
+    // Callers only touch the active buffer, so the pending one is ours
+    // without the lock
+    const DatasetRecord *buffer = writer->buffers[writer->active ^ 1];
+    int count = writer->pending_count;
+
+    guard.unlock();
+    size_t written = fwrite(buffer, sizeof(DatasetRecord), count, writer->file);
+    guard.lock();
+
+    if(written != (size_t)count) writer->failed = true;
+    writer->pending_count = 0;
+    writer->done.notify_all();
+  }
+}
+
+// Hands the active buffer to the writer thread. Waits if it is still busy
+// with the other one.
+static void swap_buffers(DatasetWriter *writer, std::unique_lock<std::mutex> &guard)
+{
+  writer->done.wait(guard, [writer] { return writer->pending_count == 0; });
+
+  writer->pending_count = writer->fill;
+  writer->active ^= 1;
+  writer->fill = 0;
+  writer->ready.notify_one();
+}
+
+DatasetWriter *create_dataset_writer(const char *path, uint64_t seed, int buffer_records)
+{
+  FILE *file = fopen(path, "wb");
+  if(!file) return 0;
+
+  DatasetHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+  header.version = DATASET_VERSION;
+  header.record_size = sizeof(DatasetRecord);
+  header.board_rows = BOARD_ROWS;
+  header.queue_length = SIM_QUEUE_LENGTH;
+  header.seed = seed;
+
+  if(fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    fclose(file);
+    return 0;
+  }
+
+  if(buffer_records < 1) buffer_records = 1;
+
+  DatasetWriter *writer = new DatasetWriter;
+  writer->file = file;
+  writer->capacity = buffer_records;
+  writer->buffers[0] = (DatasetRecord *)malloc(sizeof(DatasetRecord) * buffer_records);
+  writer->buffers[1] = (DatasetRecord *)malloc(sizeof(DatasetRecord) * buffer_records);
+  writer->active = 0;
+  writer->fill = 0;
+  writer->pending_count = 0;
+  writer->closing = false;
+  writer->failed = false;
+  writer->records_written = 0;
+  writer->thread = std::thread(writer_thread, writer);
+
+  return writer;
+}
+
+bool destroy_dataset_writer(DatasetWriter *writer)
+{
+  {
+    std::unique_lock<std::mutex> guard(writer->lock);
+    if(writer->fill > 0) swap_buffers(writer, guard);
+
+    writer->closing = true;
+    writer->ready.notify_one();
+  }
+  writer->thread.join();
+
+  bool ok = !writer->failed;
+  if(fclose(writer->file) != 0) ok = false;
+
+  free(writer->buffers[0]);
+  free(writer->buffers[1]);
+  delete writer;
+  return ok;
+}
+
+void dataset_write(DatasetWriter *writer, const DatasetRecord *records, int num_records)
+{
+  std::lock_guard<std::mutex> append_guard(writer->append_lock);
+  std::unique_lock<std::mutex> guard(writer->lock);
+
+  writer->records_written += num_records;
+
+  while(num_records > 0)
+  {
+    int count = writer->capacity - writer->fill;
+    if(count > num_records) count = num_records;
+
+    memcpy(writer->buffers[writer->active] + writer->fill, records, sizeof(DatasetRecord) * count);
+    writer->fill += count;
+    records += count;
+    num_records -= count;
+
+    if(writer->fill == writer->capacity) swap_buffers(writer, guard);
+  }
+}
+
+uint64_t dataset_records_written(DatasetWriter *writer)
+{
+  std::lock_guard<std::mutex> guard(writer->lock);
+  return writer->records_written;
+}
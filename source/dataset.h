@@ -0,0 +1,78 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Self-play dataset files. A 64 byte header, then one 64 byte record per move:
+// the position the bot saw, the move it chose and how the game went from
+// there. Every record is the same size and nothing is variable length, so a
+// file can be memory-mapped and indexed as an array, and the record count is
+// (file size - header) / record size.
+//
+// Records are written through a double-buffered writer: callers copy into
+// one buffer while a thread of its own writes the other to disk. A caller only
+// waits if the disk falls a whole buffer behind.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "sim_state.h"
+
+#include <stdint.h>
+
+static const char DATASET_MAGIC[4] = {'T', 'S', 'P', 'D'};
+static const uint32_t DATASET_VERSION = 1;
+
+struct DatasetHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t board_rows;
+  uint32_t queue_length;
+  uint32_t reserved;
+  uint64_t seed;        // What the games were dealt from
+  uint8_t padding[32];
+};
+
+// Flags
+static const uint8_t DATASET_HOLD = 1 << 0;      // The move held first
+static const uint8_t DATASET_TOPPED_OUT = 1 << 1; // The game ended topping out
+
+struct DatasetRecord
+{
+  // Position
+  uint16_t rows[BOARD_ROWS];
+  uint8_t current;
+  uint8_t hold;        // NO_PIECE when empty
+  uint8_t can_hold;
+  uint8_t queue[SIM_QUEUE_LENGTH];
+
+  // Move, where the piece locks
+  uint8_t flags;
+  int8_t x;
+  int8_t y;
+  uint8_t rotation;
+
+  // Outcome
+  uint8_t lines;        // Cleared by this move
+  uint16_t lines_to_go; // Cleared from this move to the end of the game
+};
+
+static_assert(sizeof(DatasetHeader) == 64, "dataset header is 64 bytes");
+static_assert(sizeof(DatasetRecord) == 64, "dataset records are 64 bytes");
+
+// The position part of a record
+void dataset_record_position(DatasetRecord *record, const SimState *state);
+
+struct DatasetWriter;
+
+// Writes the header, null if the file can't be opened. Each of the two
+// buffers holds buffer_records records.
+DatasetWriter *create_dataset_writer(const char *path, uint64_t seed, int buffer_records);
+
+// Flushes, closes the file and returns false if any write failed
+bool destroy_dataset_writer(DatasetWriter *writer);
+
+// Safe to call from any number of threads. Records from one call stay
+// together in the file.
+void dataset_write(DatasetWriter *writer, const DatasetRecord *records, int num_records);
+
+// Records handed to dataset_write so far
+uint64_t dataset_records_written(DatasetWriter *writer);
@@ -0,0 +1,404 @@
+#include "finesse.h"
+
+#include "game_timer.h"
+
+#include <string.h>
+
+// Tap or rotation: press, and a frame to let go before the next press
+static const int TAP_FRAMES = 2;
+static const int HARD_DROP_FRAMES = 1;
+
+// Piece positions the search can be at, a little past the walls and floor
+// since the points of some rotations are off center
+static const int STATE_X_OFFSET = 3;
+static const int STATE_Y_OFFSET = 3;
+static const int NUM_STATE_X = BOARD_COLUMNS + 2 * STATE_X_OFFSET;
+static const int NUM_STATE_Y = BOARD_ROWS + STATE_Y_OFFSET;
+static const int NUM_FINESSE_STATES = 4 * NUM_STATE_Y * NUM_STATE_X;
+
+static const unsigned char UNREACHED = 0xFF;
+
+struct FinesseSearch
+{
+  unsigned char presses[NUM_FINESSE_STATES];
+  short frames[NUM_FINESSE_STATES];
+  short parent[NUM_FINESSE_STATES];
+  unsigned char input[NUM_FINESSE_STATES]; // The press that got here from parent
+
+  short layer[2][NUM_FINESSE_STATES];
+  int layer_size[2];
+};
+
+struct FinesseTable
+{
+  // By type, rotation and column + STATE_X_OFFSET, num_inputs 0 where the
+  // piece can't be
+  FinessePath paths[NO_PIECE][4][NUM_STATE_X];
+};
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Frame counts, stepped the way update_tetris steps its counters each tick
+////////////////////////////////////////////////////////////////////////////////
+
+// Holding left or right until the piece has moved distance columns
+static int das_frames(int distance)
+{
+  float delay_counter = 0.0f;
+  float move_counter = 0.0f;
+
+  int moved = 0;
+  int frames = 0;
+  while(moved < distance)
+  {
+    frames++;
+    if(frames == 1) moved++; // The press itself
+
+    delay_counter += TICK_TIME;
+    if(delay_counter >= DAS_DELAY)
+    {
+      move_counter += TICK_TIME;
+      if(move_counter >= AUTO_REPEAT_INTERVAL)
+      {
+        moved++;
+        move_counter -= AUTO_REPEAT_INTERVAL;
+      }
+    }
+  }
+
+  return frames + 1;
+}
+
+// Holding soft drop until the piece has fallen distance rows
+static int soft_drop_frames(int distance)
+{
+  float fall_counter = 0.0f;
+
+  int fallen = 0;
+  int frames = 0;
+  while(fallen < distance)
+  {
+    frames++;
+
+    fall_counter += TICK_TIME * SPEED_UP_MODIFIER;
+    if(fall_counter >= FALL_INTERVAL)
+    {
+      fallen++;
+      fall_counter -= FALL_INTERVAL;
+    }
+  }
+
+  return frames + 1;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Search
+////////////////////////////////////////////////////////////////////////////////
+
+static int finesse_state(const Piece *piece)
+{
+  int x = piece->position.x + STATE_X_OFFSET;
+  int y = piece->position.y + STATE_Y_OFFSET;
+  if(x < 0 || x >= NUM_STATE_X || y < 0 || y >= NUM_STATE_Y) return -1;
+
+  return (piece->rotation * NUM_STATE_Y + y) * NUM_STATE_X + x;
+}
+
+static void finesse_state_piece(const Piece rotations[4], int index, Piece *piece)
+{
+  int x = index % NUM_STATE_X;
+  int y = (index / NUM_STATE_X) % NUM_STATE_Y;
+  int rotation = index / (NUM_STATE_X * NUM_STATE_Y);
+
+  *piece = rotations[rotation];
+  piece->position = v2i(x - STATE_X_OFFSET, y - STATE_Y_OFFSET);
+}
+
+// Where one press takes the piece, false if it goes nowhere
+static bool press_input(const Board *board, Piece *piece, int input, int *frames)
+{
+  switch(input)
+  {
+    case FINESSE_TAP_LEFT:
+    case FINESSE_TAP_RIGHT:
+    {
+      piece->position.x += (input == FINESSE_TAP_LEFT) ? -1 : 1;
+      *frames = TAP_FRAMES;
+      return !board_collides(board, piece);
+    }
+
+    case FINESSE_DAS_LEFT:
+    case FINESSE_DAS_RIGHT:
+    {
+      int direction = (input == FINESSE_DAS_LEFT) ? -1 : 1;
+
+      int distance = 0;
+      for(;;)
+      {
+        piece->position.x += direction;
+        if(board_collides(board, piece)) break;
+        distance++;
+      }
+      piece->position.x -= direction;
+
+      // A one column DAS is a slower tap
+      *frames = das_frames(distance);
+      return distance > 1;
+    }
+
+    case FINESSE_ROTATE_CCW:
+    case FINESSE_ROTATE_CW:
+    {
+      RotationState prev_rotation = piece->rotation;
+      rotate(piece, (input == FINESSE_ROTATE_CCW) ? -1 : 1);
+      *frames = TAP_FRAMES;
+      return board_try_kick(board, piece, prev_rotation);
+    }
+
+    case FINESSE_SOFT_DROP:
+    {
+      int start_y = piece->position.y;
+      board_hard_drop(board, piece);
+
+      int distance = start_y - piece->position.y;
+      *frames = soft_drop_frames(distance);
+      return distance > 0;
+    }
+  }
+
+  return false;
+}
+
+// Fewest presses, then fewest frames, to every position the piece can reach
+// from its spawn. One layer of positions per press.
+static void search_states(const Board *board, PieceType type, const Piece rotations[4], FinesseSearch *search)
+{
+  memset(search->presses, UNREACHED, sizeof(search->presses));
+
+  Piece spawned;
+  make_spawned_piece(&spawned, type);
+  int start = finesse_state(&spawned);
+  if(start < 0 || board_collides(board, &spawned)) return;
+
+  search->presses[start] = 0;
+  search->frames[start] = 0;
+  search->parent[start] = -1;
+  search->layer[0][0] = (short)start;
+  search->layer_size[0] = 1;
+
+  for(int presses = 0; search->layer_size[presses & 1] > 0; presses++)
+  {
+    short *current = search->layer[presses & 1];
+    int num_current = search->layer_size[presses & 1];
+    short *next = search->layer[(presses + 1) & 1];
+    int num_next = 0;
+
+    for(int i = 0; i < num_current; i++)
+    {
+      int from = current[i];
+
+      Piece piece;
+      finesse_state_piece(rotations, from, &piece);
+
+      for(int input = 0; input < FINESSE_HARD_DROP; input++)
+      {
+        Piece moved = piece;
+        int frames;
+        if(!press_input(board, &moved, input, &frames)) continue;
+
+        int to = finesse_state(&moved);
+        if(to < 0) continue;
+
+        int total_frames = search->frames[from] + frames;
+        if(search->presses[to] != UNREACHED)
+        {
+          // Only an equal number of presses in fewer frames is better
+          if(search->presses[to] != presses + 1 || search->frames[to] <= total_frames) continue;
+        }
+        else
+        {
+          next[num_next++] = (short)to;
+        }
+
+        search->presses[to] = (unsigned char)(presses + 1);
+        search->frames[to] = (short)total_frames;
+        search->parent[to] = (short)from;
+        search->input[to] = (unsigned char)input;
+      }
+    }
+
+    search->layer_size[(presses + 1) & 1] = num_next;
+    if(presses + 1 >= MAX_FINESSE_INPUTS - 1) break;
+  }
+}
+
+static void trace_path(const FinesseSearch *search, int state, FinessePath *path)
+{
+  int num_inputs = search->presses[state];
+  path->num_inputs = num_inputs + 1;
+  path->frames = search->frames[state] + HARD_DROP_FRAMES;
+  path->inputs[num_inputs] = FINESSE_HARD_DROP;
+
+  for(int i = num_inputs - 1; i >= 0; i--)
+  {
+    path->inputs[i] = search->input[state];
+    state = search->parent[state];
+  }
+}
+
+static bool covers_same_cells(const Piece *a, const Piece *b)
+{
+  for(int i = 0; i < 4; i++)
+  {
+    v2i cell = a->position + a->points[i];
+
+    bool found = false;
+    for(int j = 0; j < 4; j++)
+    {
+      v2i other = b->position + b->points[j];
+      found = found || (cell.x == other.x && cell.y == other.y);
+    }
+    if(!found) return false;
+  }
+
+  return true;
+}
+
+// Best path over every reached state that lands on target's cells
+static bool best_path_to(const Board *board, const FinesseSearch *search, const Piece rotations[4],
+                         const Piece *target, FinessePath *path)
+{
+  int best = -1;
+  for(int state = 0; state < NUM_FINESSE_STATES; state++)
+  {
+    if(search->presses[state] == UNREACHED) continue;
+    if(best >= 0)
+    {
+      if(search->presses[state] > search->presses[best]) continue;
+      if(search->presses[state] == search->presses[best] && search->frames[state] >= search->frames[best]) continue;
+    }
+
+    Piece landed;
+    finesse_state_piece(rotations, state, &landed);
+    board_hard_drop(board, &landed);
+    if(covers_same_cells(&landed, target)) best = state;
+  }
+
+  if(best < 0) return false;
+
+  trace_path(search, best, path);
+  return true;
+}
+
+static void make_rotations(PieceType type, Piece rotations[4])
+{
+  make_spawned_piece(&rotations[0], type);
+  for(int i = 1; i < 4; i++)
+  {
+    rotations[i] = rotations[i - 1];
+    rotate(&rotations[i], 1);
+  }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Empty field table
+////////////////////////////////////////////////////////////////////////////////
+
+static FinesseTable *make_finesse_table()
+{
+  static FinesseTable table;
+  static FinesseSearch search;
+  memset(&table, 0, sizeof(table));
+
+  Board empty;
+  clear_board(&empty);
+
+  for(int type = 0; type < NO_PIECE; type++)
+  {
+    Piece rotations[4];
+    make_rotations((PieceType)type, rotations);
+    search_states(&empty, (PieceType)type, rotations, &search);
+
+    for(int rotation = 0; rotation < 4; rotation++)
+    {
+      for(int column = 0; column < NUM_STATE_X; column++)
+      {
+        // Spawn height, then straight down
+        Piece spawned;
+        make_spawned_piece(&spawned, (PieceType)type);
+
+        Piece target = rotations[rotation];
+        target.position = v2i(column - STATE_X_OFFSET, spawned.position.y);
+        if(board_collides(&empty, &target)) continue;
+        board_hard_drop(&empty, &target);
+
+        best_path_to(&empty, &search, rotations, &target, &table.paths[type][rotation][column]);
+      }
+    }
+  }
+
+  return &table;
+}
+
+static const FinesseTable *finesse_table()
+{
+  static FinesseTable *table = make_finesse_table();
+  return table;
+}
+
+const FinessePath *finesse_table_path(PieceType type, RotationState rotation, int column)
+{
+  int index = column + STATE_X_OFFSET;
+  if(type >= NO_PIECE || index < 0 || index >= NUM_STATE_X) return 0;
+
+  const FinessePath *path = &finesse_table()->paths[type][rotation][index];
+  return path->num_inputs ? path : 0;
+}
+
+// The table holds if nothing is in the way at spawn height, where its paths
+// do all their moving, and placed is straight below where they leave it
+static bool table_applies(const Board *board, const Piece *placed)
+{
+  Piece spawned;
+  make_spawned_piece(&spawned, placed->type);
+
+  // Kicks can move the piece two rows down, points reach two below center
+  for(int row = spawned.position.y - 4; row < BOARD_ROWS; row++)
+  {
+    if(row >= 0 && board->rows[row]) return false;
+  }
+
+  Piece dropped = *placed;
+  dropped.position.y = spawned.position.y;
+  if(board_collides(board, &dropped)) return false;
+  board_hard_drop(board, &dropped);
+
+  return dropped.position.y == placed->position.y;
+}
+
+bool finesse_path(const Board *board, const Piece *placed, FinessePath *path)
+{
+  if(placed->type >= NO_PIECE) return false;
+
+  if(table_applies(board, placed))
+  {
+    const FinessePath *table_path = finesse_table_path(placed->type, placed->rotation, placed->position.x);
+    if(table_path)
+    {
+      *path = *table_path;
+      return true;
+    }
+  }
+
+  Piece rotations[4];
+  make_rotations(placed->type, rotations);
+
+  FinesseSearch search;
+  search_states(board, placed->type, rotations, &search);
+  return best_path_to(board, &search, rotations, placed, path);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Finesse: the fewest button presses that take a freshly spawned piece to a
+// placement, in the game's own inputs. Tapping A/D moves one column, holding
+// them (DAS) slides until something is in the way, J/L rotate with kicks, S
+// held drops to the floor and W locks. Ties go to the path that takes fewer
+// frames, counted with the DAS, auto-repeat and soft drop timings
+// update_tetris runs on, one frame a tick. Gravity while keys are held
+// isn't counted.
+//
+// On an empty field every placement is a handful of presses at spawn height
+// and a hard drop, so those come from a table built once. finesse_path uses
+// it whenever the rows the piece moves through are clear and the placement
+// is straight below, and searches the board otherwise (tucks, spins, high
+// stacks).
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+enum FinesseInput
+{
+  FINESSE_TAP_LEFT,
+  FINESSE_TAP_RIGHT,
+  FINESSE_DAS_LEFT,   // Held until the piece stops
+  FINESSE_DAS_RIGHT,
+  FINESSE_ROTATE_CCW,
+  FINESSE_ROTATE_CW,
+  FINESSE_SOFT_DROP,  // Held until the piece lands
+  FINESSE_HARD_DROP,
+
+  NUM_FINESSE_INPUTS
+};
+
+static const char *FINESSE_INPUT_NAMES[NUM_FINESSE_INPUTS] =
+{
+  "tap left",
+  "tap right",
+  "DAS left",
+  "DAS right",
+  "rotate CCW",
+  "rotate CW",
+  "soft drop",
+  "hard drop",
+};
+
+static const int MAX_FINESSE_INPUTS = 16;
+
+struct FinessePath
+{
+  int num_inputs; // Presses, always ends with FINESSE_HARD_DROP
+  unsigned char inputs[MAX_FINESSE_INPUTS];
+  int frames;     // From the first press to the lock
+};
+
+// Empty field path to where a piece of type at (column, rotation) lands,
+// or 0 if it can't be there. Rotations that cover the same cells share a path.
+const FinessePath *finesse_table_path(PieceType type, RotationState rotation, int column);
+
+// Fewest presses from spawn to placed, a piece locked on board. False if there
+// is no way to get it there.
+bool finesse_path(const Board *board, const Piece *placed, FinessePath *path);
@@ -0,0 +1,100 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Lock-free single-producer/single-consumer ring of fixed-size frames.
+//
+// The producer (game thread) draws straight into frame_queue_write_slot() and
+// commits it with frame_queue_publish(). The consumer (network thread) picks
+// up the newest committed frame with frame_queue_read_latest() and hands it
+// back with frame_queue_release(). Older frames the consumer never got to are
+// dropped, the LEDs only care about the latest picture.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+
+// Must be a power of two
+static const unsigned FRAME_QUEUE_SLOTS = 8;
+
+struct FrameQueue
+{
+  unsigned frame_bytes;
+  unsigned char *slots;
+
+  // head is only written by the producer, tail only by the consumer. Keep them
+  // on separate cache lines so the two threads don't fight over one.
+  std::atomic<unsigned> head;
+  char pad0[64 - sizeof(std::atomic<unsigned>)];
+  std::atomic<unsigned> tail;
+  char pad1[64 - sizeof(std::atomic<unsigned>)];
+};
+
+static void init_frame_queue(FrameQueue *queue, unsigned frame_bytes)
+{
+  queue->frame_bytes = frame_bytes;
+  queue->slots = (unsigned char *)malloc(frame_bytes * FRAME_QUEUE_SLOTS);
+  memset(queue->slots, 0, frame_bytes * FRAME_QUEUE_SLOTS);
+
+  queue->head.store(0, std::memory_order_relaxed);
+  queue->tail.store(0, std::memory_order_relaxed);
+}
+
+static void shutdown_frame_queue(FrameQueue *queue)
+{
+  free(queue->slots);
+  queue->slots = 0;
+}
+
+static unsigned char *frame_queue_slot(FrameQueue *queue, unsigned index)
+{
+  return queue->slots + (index & (FRAME_QUEUE_SLOTS - 1)) * queue->frame_bytes;
+}
+
+// Producer side. The slot at head is never touched by the consumer.
+static unsigned char *frame_queue_write_slot(FrameQueue *queue)
+{
+  return frame_queue_slot(queue, queue->head.load(std::memory_order_relaxed));
+}
+
+// Producer side. Commits the write slot and clears the next one. Returns false
+// if the consumer is too far behind, in which case the frame is dropped and the
+// same slot is cleared for reuse.
+static bool frame_queue_publish(FrameQueue *queue)
+{
+  unsigned head = queue->head.load(std::memory_order_relaxed);
+  unsigned tail = queue->tail.load(std::memory_order_acquire);
+
+  bool published = false;
+  if(head + 1 - tail < FRAME_QUEUE_SLOTS)
+  {
+    head++;
+    queue->head.store(head, std::memory_order_release);
+    published = true;
+  }
+
+  memset(frame_queue_slot(queue, head), 0, queue->frame_bytes);
+  return published;
+}
+
+// Consumer side. Skips to the newest committed frame, returns 0 if there is
+// nothing new. The frame belongs to the consumer until frame_queue_release().
+static unsigned char *frame_queue_read_latest(FrameQueue *queue, unsigned *out_index)
+{
+  unsigned tail = queue->tail.load(std::memory_order_relaxed);
+  unsigned head = queue->head.load(std::memory_order_acquire);
+  if(tail == head) return 0;
+
+  // Give the stale frames back to the producer right away
+  unsigned latest = head - 1;
+  if(latest != tail) queue->tail.store(latest, std::memory_order_release);
+
+  *out_index = latest;
+  return frame_queue_slot(queue, latest);
+}
+
+static void frame_queue_release(FrameQueue *queue, unsigned index)
+{
+  queue->tail.store(index + 1, std::memory_order_release);
+}
+
@@ -2,6 +2,8 @@
 
 #include "my_math.h"
 
+#include <stdint.h>
+
 struct Color
 {
   float r, g, b, a;
@@ -15,4 +17,8 @@ void draw_cell(v2i position, Color color);
 void draw_cell_in_left_bar(v2i position, Color color);
 void draw_cell_in_right_bar(v2i position, Color color);
 
+// Tags the frame being drawn with when its input arrived (0 if it had none) and
+// when the tick drawing it started, see latency.h
+void present_frame_timing(uint64_t input_time, uint64_t tick_time);
+
 
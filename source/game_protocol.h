@@ -0,0 +1,116 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// What goes over UDP between players and the game server. The server runs
+// every game itself on fixed ticks, players only send their buttons.
+//
+// A player sends a GameInputPacket every time its buttons change, numbered
+// one up from the last change, and sends the latest one again every
+// GAME_KEEPALIVE_MS so a lost change is made up for. Each change the server
+// takes is held for at least a tick, so a tap shorter than a tick still
+// counts. The first packet from an address starts a game for it, and a game
+// nothing has been heard from for GAME_TIMEOUT_MS ends.
+//
+// Every GAME_STATE_INTERVAL ticks the server sends each player a
+// GameStatePacket of its game. Structs go out as they are, little endian.
+//
+// Anyone can watch a game by its id. A spectator sends a GameSpectatePacket
+// to port GAME_SPECTATOR_PORT plus the game's worker (the top byte of the id)
+// and repeats it every GAME_KEEPALIVE_MS. It gets a GameSnapshotPacket of the
+// game straight away, then a GameEventsHeader and that tick's events on
+// every tick something happens, and plays them on its own copy of the game
+// (spectator.h). Events are numbered; a spectator that misses one waits for
+// the next snapshot, which comes every GAME_SNAPSHOT_INTERVAL ticks and
+// after a restart.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+#include <stdint.h>
+
+// "TIN1", "TST1", "TSP1", "TSN1", "TEV1"
+static const uint32_t GAME_INPUT_MAGIC = 0x314e4954;
+static const uint32_t GAME_STATE_MAGIC = 0x31545354;
+static const uint32_t GAME_SPECTATE_MAGIC = 0x31505354;
+static const uint32_t GAME_SNAPSHOT_MAGIC = 0x314e5354;
+static const uint32_t GAME_EVENTS_MAGIC = 0x31564554;
+
+static const int GAME_SERVER_PORT = 4343;
+static const int GAME_SPECTATOR_PORT = 4400;
+static const int GAME_STATE_INTERVAL = 2;      // 30 a second
+static const int GAME_SNAPSHOT_INTERVAL = 120; // Every 2 seconds
+static const int GAME_KEEPALIVE_MS = 250;
+static const int GAME_TIMEOUT_MS = 5000;
+
+struct GameInputPacket
+{
+  uint32_t magic;
+  uint32_t sequence; // Of the change, repeats don't count up
+  uint32_t buttons;  // GameButton bits held from the change on
+};
+
+struct GameStatePacket
+{
+  uint32_t magic;
+  uint32_t tick;
+  uint32_t input_sequence; // Last change the game has run on
+  uint32_t game_id;        // For spectators
+  uint32_t score;
+
+  // Piece type per cell, two to a byte with the lower column in the low bits,
+  // bottom row first. 7 is empty.
+  uint8_t cells[BOARD_ROWS * BOARD_COLUMNS / 2];
+
+  int8_t falling_type;
+  int8_t falling_rotation;
+  int8_t falling_x;
+  int8_t falling_y;
+  int8_t held_piece;
+  int8_t next_pieces[6];
+  uint8_t pad;
+};
+
+struct GameSpectatePacket
+{
+  uint32_t magic;
+  uint32_t game_id;
+};
+
+// One row of a snapshot
+struct GameSnapshotRow
+{
+  uint8_t filled[2];                 // Board bits, low byte first
+  uint8_t cells[BOARD_COLUMNS / 2]; // As in GameStatePacket
+};
+
+// Only the rows up to the highest one with anything in it are sent, the ones
+// above are empty
+struct GameSnapshotPacket
+{
+  uint32_t magic;
+  uint32_t game_id;
+  uint32_t tick;
+  uint32_t next_event; // Number of the first event after it
+  uint32_t score;
+
+  int8_t falling_type;
+  int8_t falling_rotation;
+  int8_t falling_x;
+  int8_t falling_y;
+  int8_t held_piece;
+  int8_t next_pieces[6];
+  uint8_t num_rows;
+
+  GameSnapshotRow rows[BOARD_ROWS];
+};
+
+// Followed by num_events events packed by encode_game_events
+struct GameEventsHeader
+{
+  uint32_t magic;
+  uint32_t game_id;
+  uint32_t tick;        // They happened on, counted from 0 like GameStatePacket's
+  uint32_t first_event; // Number of the first of them
+  uint8_t num_events;
+  uint8_t pad[3];
+};
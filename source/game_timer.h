@@ -2,3 +2,10 @@
 
 float get_dt();
 
+
+// Game timings, in ms
+static const float TICK_TIME = 1000.0f / 60.0f;    // The game steps in fixed ticks, however long frames take
+static const float DAS_DELAY = 125.0f;            // Holding left/right this long starts auto-shift
+static const float AUTO_REPEAT_INTERVAL = 50.0f;  // Then it moves once per interval
+static const float FALL_INTERVAL = 200.0f;
+static const float SPEED_UP_MODIFIER = 5.0f;      // Gravity multiplier while soft dropping
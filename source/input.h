@@ -1,3 +1,6 @@
+#pragma once
+
+#include <stdint.h>
 
 void init_input();
 
@@ -6,3 +9,25 @@ bool button_toggled_up(unsigned char key);
 
 bool button_state(unsigned char key);
 
+// When the newest key press was received, on the latency_now_ns() clock
+uint64_t last_key_press_time();
+
+
+// The buttons the game reads, one bit each, so other sources of input (like
+// autoplay) can stand in for button_state
+enum GameButton
+{
+  BUTTON_HARD_DROP  = 1 << 0,
+  BUTTON_LEFT       = 1 << 1,
+  BUTTON_SOFT_DROP  = 1 << 2,
+  BUTTON_RIGHT      = 1 << 3,
+  BUTTON_ROTATE_CCW = 1 << 4,
+  BUTTON_ROTATE_CW  = 1 << 5,
+  BUTTON_RESTART    = 1 << 6,
+  BUTTON_HOLD       = 1 << 7,
+};
+
+static const int NUM_GAME_BUTTONS = 8;
+
+// Key for each GameButton bit, in order
+static const unsigned char GAME_BUTTON_KEYS[NUM_GAME_BUTTONS] = { 'W', 'A', 'S', 'D', 'J', 'L', 'R', ' ' };
@@ -0,0 +1,36 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// What goes over UDP from a remote controller to a game, so a game with no
+// keyboard of its own (a Pi driving LEDs, say) can be played from another
+// machine. See remote_input.h for the game's end.
+//
+// The controller sends a RemoteButtonsPacket every time its buttons change,
+// numbered one up from the last change, and sends the latest one again every
+// REMOTE_KEEPALIVE_MS. Both times in it are on the controller's
+// latency_now_ns() clock; the game only needs the clocks to tick at the same
+// rate, not to agree. Structs go out as they are, little endian.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+// "RBT1"
+static const uint32_t REMOTE_BUTTONS_MAGIC = 0x31544252;
+
+static const int REMOTE_INPUT_PORT = 4500;
+static const int REMOTE_KEEPALIVE_MS = 250;
+
+// A controller silent this long has its buttons let go, and another one can
+// take over
+static const int REMOTE_TIMEOUT_MS = 1000;
+
+struct RemoteButtonsPacket
+{
+  uint32_t magic;
+  uint32_t sequence; // Of the change, repeats don't count up
+  uint32_t buttons;  // GameButton bits held from the change on
+  uint32_t pad;
+
+  uint64_t changed_ns; // When the key went down or up, from the input device if it says
+  uint64_t sent_ns;    // When this packet went out
+};
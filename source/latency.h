@@ -0,0 +1,65 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Input to LED latency measurement. Every streamed frame carries a stamp for
+// each stage it went through, all taken from latency_now_ns(). A stamp of 0
+// means the stage was not recorded, e.g. frames that consumed no key press
+// have no input stamp.
+//
+// Stamps from different machines are only comparable if their clocks are, so
+// the full breakdown is meant to be read off a loopback run.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+enum LatencyStage
+{
+  LATENCY_INPUT,    // Key press received from evdev/X11/the window
+  LATENCY_TICK,     // Start of the simulation tick that consumed it
+  LATENCY_SNAPSHOT, // Frame handed to the network client
+  LATENCY_SEND,     // Just before sendto
+  LATENCY_DECODE,   // Receiver finished decoding into the strip buffer
+  LATENCY_LED,      // Receiver calls render_to_led
+
+  LATENCY_STAGE_COUNT
+};
+
+static const char *LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] =
+{
+  "input",
+  "tick",
+  "snapshot",
+  "send",
+  "decode",
+  "led",
+};
+
+// What the receiver logs per displayed frame
+struct LatencyRecord
+{
+  uint32_t frame_id;
+  uint32_t pad;
+  uint64_t stamps[LATENCY_STAGE_COUNT];
+};
+
+static uint64_t latency_now_ns()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER t;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&t);
+  return (uint64_t)((double)t.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+#endif
+}
+
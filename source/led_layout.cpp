@@ -0,0 +1,227 @@
+#include "led_layout.h"
+
+#include <stdlib.h> // malloc, strtol
+#include <string.h>
+#include <cstdio>
+
+enum LedWiring
+{
+  WIRING_ROW_MAJOR,
+  WIRING_SERPENTINE,
+  WIRING_COLUMN_MAJOR,
+  WIRING_COLUMN_SERPENTINE,
+};
+
+struct LayoutDescription
+{
+  LedWiring wiring = WIRING_SERPENTINE;
+  bool mirror_x = false;
+  bool mirror_y = false;
+  int rotation = 0;
+  int offset = 0;
+
+  // Only for explicit index lists
+  int *indices = 0;
+  int num_indices = 0;
+};
+
+
+
+// Splits the next token off, skipping whitespace and comments
+static const char *next_token(const char *at, char *token, int max_length)
+{
+  for(;;)
+  {
+    while(*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r') at++;
+    if(*at != '#') break;
+    while(*at && *at != '\n') at++;
+  }
+
+  int length = 0;
+  while(*at && *at != ' ' && *at != '\t' && *at != '\n' && *at != '\r' && *at != '#')
+  {
+    if(length < max_length - 1) token[length++] = *at;
+    at++;
+  }
+  token[length] = 0;
+
+  return at;
+}
+
+static bool parse_int(const char *token, int *out)
+{
+  char *end;
+  long value = strtol(token, &end, 10);
+  if(*token == 0 || *end != 0) return false;
+
+  *out = (int)value;
+  return true;
+}
+
+static bool parse_description(LayoutDescription *desc, const char *text, int num_cells)
+{
+  char token[32];
+  const char *at = text;
+
+  for(;;)
+  {
+    at = next_token(at, token, sizeof(token));
+    if(!token[0]) return true;
+
+    if(!strcmp(token, "row_major"))              desc->wiring = WIRING_ROW_MAJOR;
+    else if(!strcmp(token, "serpentine"))        desc->wiring = WIRING_SERPENTINE;
+    else if(!strcmp(token, "column_major"))      desc->wiring = WIRING_COLUMN_MAJOR;
+    else if(!strcmp(token, "column_serpentine")) desc->wiring = WIRING_COLUMN_SERPENTINE;
+    else if(!strcmp(token, "mirror"))
+    {
+      at = next_token(at, token, sizeof(token));
+      if(!strcmp(token, "x"))      desc->mirror_x = true;
+      else if(!strcmp(token, "y")) desc->mirror_y = true;
+      else
+      {
+        fprintf(stderr, "Led layout: mirror takes x or y, got '%s'\n", token);
+        return false;
+      }
+    }
+    else if(!strcmp(token, "rotate"))
+    {
+      at = next_token(at, token, sizeof(token));
+      if(!parse_int(token, &desc->rotation) || desc->rotation % 90 != 0)
+      {
+        fprintf(stderr, "Led layout: rotate takes 0, 90, 180 or 270, got '%s'\n", token);
+        return false;
+      }
+      desc->rotation = ((desc->rotation % 360) + 360) % 360;
+    }
+    else if(!strcmp(token, "offset"))
+    {
+      at = next_token(at, token, sizeof(token));
+      if(!parse_int(token, &desc->offset) || desc->offset < 0)
+      {
+        fprintf(stderr, "Led layout: bad offset '%s'\n", token);
+        return false;
+      }
+    }
+    else if(!strcmp(token, "indices"))
+    {
+      desc->indices = (int *)malloc(sizeof(int) * num_cells);
+      for(desc->num_indices = 0; desc->num_indices < num_cells; desc->num_indices++)
+      {
+        at = next_token(at, token, sizeof(token));
+        if(!parse_int(token, &desc->indices[desc->num_indices]))
+        {
+          fprintf(stderr, "Led layout: expected %i indices, got %i\n", num_cells, desc->num_indices);
+          return false;
+        }
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Led layout: unknown keyword '%s'\n", token);
+      return false;
+    }
+  }
+}
+
+// LED index for a board cell, or -1 if it has none
+static int cell_to_led(const LayoutDescription *desc, int x, int y, int width, int height)
+{
+  if(desc->indices) return desc->indices[y * width + x];
+
+  if(desc->mirror_x) x = (width - 1) - x;
+  if(desc->mirror_y) y = (height - 1) - y;
+
+  // Board to panel coordinates
+  int px = x, py = y;
+  int panel_width = width, panel_height = height;
+  switch(desc->rotation)
+  {
+    case 90:  { px = y;                py = (width - 1) - x;  panel_width = height; panel_height = width; break; }
+    case 180: { px = (width - 1) - x;  py = (height - 1) - y; break; }
+    case 270: { px = (height - 1) - y; py = x;                panel_width = height; panel_height = width; break; }
+  }
+
+  int index = 0;
+  switch(desc->wiring)
+  {
+    case WIRING_ROW_MAJOR:         { index = py * panel_width + px; break; }
+    case WIRING_SERPENTINE:        { index = py * panel_width + ((py % 2 == 1) ? (panel_width - 1) - px : px); break; }
+    case WIRING_COLUMN_MAJOR:      { index = px * panel_height + py; break; }
+    case WIRING_COLUMN_SERPENTINE: { index = px * panel_height + ((px % 2 == 1) ? (panel_height - 1) - py : py); break; }
+  }
+
+  return index + desc->offset;
+}
+
+static void compile_layout(LedLayout *layout, const LayoutDescription *desc)
+{
+  int num_cells = layout->width * layout->height;
+
+  // Everything starts out dark
+  for(int led = 0; led < layout->num_leds; led++) layout->gather[led] = num_cells;
+
+  for(int y = 0; y < layout->height; y++)
+  {
+    for(int x = 0; x < layout->width; x++)
+    {
+      int led = cell_to_led(desc, x, y, layout->width, layout->height);
+      if(led < 0 || led >= layout->num_leds) continue;
+
+      layout->gather[led] = y * layout->width + x;
+    }
+  }
+}
+
+
+
+bool build_led_layout(LedLayout *layout, const char *description, int width, int height, int num_leds)
+{
+  layout->width = width;
+  layout->height = height;
+  layout->num_leds = num_leds;
+  layout->gather = (int *)malloc(sizeof(int) * num_leds);
+
+  LayoutDescription desc;
+  bool success = parse_description(&desc, description, width * height);
+  if(!success)
+  {
+    free(desc.indices);
+    desc = LayoutDescription();
+  }
+
+  compile_layout(layout, &desc);
+
+  free(desc.indices);
+  return success;
+}
+
+bool load_led_layout(LedLayout *layout, const char *path, int width, int height, int num_leds)
+{
+  FILE *file = fopen(path, "rb");
+  if(!file)
+  {
+    fprintf(stderr, "Could not open led layout %s\n", path);
+    build_led_layout(layout, "", width, height, num_leds);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char *text = (char *)malloc(size + 1);
+  size_t bytes_read = fread(text, 1, size, file);
+  text[bytes_read] = 0;
+  fclose(file);
+
+  bool success = build_led_layout(layout, text, width, height, num_leds);
+  free(text);
+  return success;
+}
+
+void free_led_layout(LedLayout *layout)
+{
+  free(layout->gather);
+  layout->gather = 0;
+}
+
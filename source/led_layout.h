@@ -0,0 +1,47 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Board cell to LED index mapping. Panels are wired in different ways, so the
+// mapping is read from a layout description at startup and compiled into a
+// flat gather table. Converting a row-major board frame to strip order is then
+// one pass with no branches:
+//
+//   strip[led] = frame[gather[led]]
+//
+// Layout descriptions are whitespace separated, # starts a comment:
+//
+//   row_major | serpentine | column_major | column_serpentine
+//                      How the strip snakes through the panel. Default is
+//                      serpentine, every odd row runs right to left.
+//   mirror x | mirror y
+//   rotate 0 | 90 | 180 | 270
+//                      Panel orientation relative to the board, clockwise.
+//                      Mirroring is applied before rotating.
+//   offset N           Index of the first LED, for strips shared by panels.
+//   indices i0 i1 ...  Arbitrary wiring. One LED index per board cell,
+//                      row-major from the bottom left, -1 for unconnected.
+//                      Overrides everything above.
+////////////////////////////////////////////////////////////////////////////////
+
+struct LedLayout
+{
+  int width, height;
+  int num_leds;
+
+  // Index into a row-major width * height frame for every LED. LEDs without a
+  // cell point at width * height, so frames need one spare zero word there.
+  int *gather;
+};
+
+// Returns false and leaves a plain serpentine layout on parse errors
+bool build_led_layout(LedLayout *layout, const char *description, int width, int height, int num_leds);
+bool load_led_layout(LedLayout *layout, const char *path, int width, int height, int num_leds);
+void free_led_layout(LedLayout *layout);
+
+// frame must hold width * height + 1 words, the last one zero
+static void apply_led_layout(const LedLayout *layout, const unsigned *frame, unsigned *strip)
+{
+  const int *gather = layout->gather;
+  for(int led = 0; led < layout->num_leds; led++) strip[led] = frame[gather[led]];
+}
+
@@ -0,0 +1,86 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// What goes over UDP from the game client to the LED receivers. A frame is one
+// LedFrameHeader followed by width * height words, 0x00BBGGRR, in row-major
+// board order from the bottom left. Receivers map cells to their own strip
+// wiring, see led_layout.h.
+//
+// Anything past a few hundred LEDs won't fit a 1500 byte MTU, and switches
+// drop IP fragments when they're busy, so frames are cut up here instead. Each
+// datagram is an LedFragmentHeader and the next LED_FRAGMENT_BYTES of the
+// frame, the last one shorter. Receivers put the pieces back together and
+// give up on a frame that's missing some after LED_REASSEMBLY_TIMEOUT_MS. A
+// datagram can also be a whole frame on its own, which is what the Windows
+// client still sends.
+//
+// A wall of panels is several receivers, each showing its part of the same
+// frame. So that they all show it at once, frames say when to show them on the
+// sender's clock, and every receiver keeps track of how far its own clock is
+// from the sender's NTP style: it sends an LedClockPacket back to wherever the
+// frames come from, the sender fills in when it got it and when it answered,
+// and the receiver stamps when the answer came back. Of those four times
+//
+//   offset      = ((received - requested) + (answered - returned)) / 2
+//   round trip  = (returned - requested) - (answered - received)
+//
+// and the offset of the shortest recent round trip is the one to trust, a
+// packet that sat in a queue on either side makes for a long one.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "latency.h"
+
+#include <stdint.h>
+
+// "LED1"
+static const uint32_t LED_FRAME_MAGIC = 0x3144454c;
+
+// "LCK1"
+static const uint32_t LED_CLOCK_MAGIC = 0x314b434c;
+
+// "LFR1"
+static const uint32_t LED_FRAGMENT_MAGIC = 0x3152464c;
+
+// Frame bytes per fragment, so a fragment is 1500 bytes of IP less the IP and
+// UDP headers. A multiple of 4, no LED is ever split.
+static const unsigned LED_FRAGMENT_BYTES = 1500 - 20 - 8 - 16;
+
+// 256x256 LEDs and then some
+static const unsigned LED_MAX_FRAGMENTS = 256;
+
+static const int LED_REASSEMBLY_TIMEOUT_MS = 100;
+
+struct LedFrameHeader
+{
+  uint32_t magic;
+  uint32_t frame_id;
+  uint16_t width;
+  uint16_t height;
+  uint32_t reserved;
+
+  // When all panels put it up, on the sender's latency_now_ns() clock. 0 for
+  // as soon as it arrives.
+  uint64_t present_ns;
+
+  // The sender fills in up to LATENCY_SEND, the receiver the rest
+  uint64_t stamps[LATENCY_STAGE_COUNT];
+};
+
+struct LedFragmentHeader
+{
+  uint32_t magic;
+  uint32_t frame_id;    // As in the frame's LedFrameHeader
+  uint16_t index;       // Starts LED_FRAGMENT_BYTES * index bytes into the frame
+  uint16_t count;       // Fragments in the frame
+  uint32_t frame_bytes; // Whole frame, header and LEDs
+};
+
+struct LedClockPacket
+{
+  uint32_t magic;
+  uint32_t pad;
+
+  uint64_t requested_ns; // Receiver's clock, echoed back
+  uint64_t received_ns;  // Sender's clock, 0 in the request
+  uint64_t answered_ns;  // Sender's clock, 0 in the request
+};
@@ -0,0 +1,798 @@
+#include "move_generator.h"
+
+#include <string.h> // memset
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MOVE_GENERATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Search space, wide enough for every in-bounds position of every rotation
+static const int X_MIN = -2;
+static const int X_COUNT = 16;
+static const int Y_MIN = -2;
+static const int Y_COUNT = 32;
+static const int NUM_STATES = X_COUNT * Y_COUNT * 4;
+
+// The board is copied into wider rows with solid walls and floor around it,
+// so a collision test is four ANDs and no bounds checks
+static const int X_OFFSET = 4;
+static const int Y_OFFSET = 4;
+static const int PADDED_ROWS = Y_OFFSET + Y_COUNT + 4;
+static const uint32_t WALLS = ~((uint32_t)FULL_ROW << X_OFFSET);
+
+static const int PLACEMENT_HASH_SIZE = 1024;
+
+// Rows of the whole-row search are y - Y_MIN + KICK_ROWS, with rows nothing
+// fits in on either side for kicks out of the search space to land in
+static const int KICK_ROWS = 2;
+static const int ROWS = Y_COUNT + 2 * KICK_ROWS;
+
+// Positions along one row of the search space, bit i is x = X_MIN + i. Rows of
+// all four rotations go side by side in a uint64_t, rotation r from bit
+// X_COUNT * r. The top bit of each is x = 13, never free, so fills along a
+// row never run into the next rotation's.
+static const uint32_t ROW_POSITIONS = (1u << X_COUNT) - 1;
+
+struct ShapeRotation
+{
+  Piece piece;
+
+  int min_dx, min_dy;
+  uint32_t rows[4]; // Bottom-up, bit 0 is column min_dx
+
+  // Per cell, its padded row relative to y + Y_OFFSET and the right shift that
+  // brings its padded column down to the position bit
+  int cell_dy[4];
+  int cell_shift[4];
+};
+
+// Rotations a kick test moves the same number of rows, which try it together.
+// Counter-clockwise and clockwise turns side by side, each lined up with the
+// rotation it turns into so a fit is an AND with the row it's kicked into.
+struct KickGroup
+{
+  int dy;
+
+  // Positions moving 2 left .. 2 right, only those that stay in the search
+  // space so that shifts never carry into the next rotation's row
+  uint64_t lanes[5][2];
+
+  // Positions this fits from when it lands above the stack, where only the
+  // walls are in the way
+  uint64_t open_fits[2];
+};
+
+struct KickTest
+{
+  int num_groups;
+  KickGroup groups[5];
+};
+
+struct ShapeTable
+{
+  ShapeRotation shapes[NO_PIECE][4];
+
+  // Kick offsets per type, from rotation, counter-clockwise or clockwise
+  int num_kicks[NO_PIECE];
+  v2i kicks[NO_PIECE][4][2][NUM_KICK_TESTS];
+
+  // The same kicks for trying a test from all four rotations and both turns
+  // at once. SRS never kicks more than two columns or rows.
+  KickTest kick_tests[NO_PIECE][NUM_KICK_TESTS];
+
+  // Whether a turn that fits without a kick ever covers different cells, not
+  // so for O. Turns that can't move a piece needn't be searched.
+  bool turns_move_cells[NO_PIECE];
+
+  // The first rotation covering the same cells as this one, -1 if it is the
+  // first, and what to add to a position for the same cells in that rotation
+  int same_cells_as[NO_PIECE][4];
+  v2i same_cells_offset[NO_PIECE][4];
+
+  // How far below its position any rotation reaches, and the positions of all
+  // four rotations clear of the walls
+  int reach_down[NO_PIECE];
+  uint64_t open_free[NO_PIECE];
+};
+
+
+
+static uint32_t lane(uint64_t rows, int rotation)
+{
+  return (uint32_t)(rows >> (rotation * X_COUNT)) & ROW_POSITIONS;
+}
+
+static uint64_t to_lane(uint32_t positions, int rotation)
+{
+  return (uint64_t)positions << (rotation * X_COUNT);
+}
+
+// Moves each rotation's row to rotation + steps, wrapping around
+static uint64_t rotate_lanes(uint64_t rows, int steps)
+{
+  int shift = (steps & 3) * X_COUNT;
+  return shift ? (rows << shift) | (rows >> (64 - shift)) : rows;
+}
+
+static ShapeTable build_shape_table()
+{
+  ShapeTable table;
+  for(int type = 0; type < NO_PIECE; type++)
+  {
+    Piece piece;
+    make_piece(&piece, (PieceType)type);
+    piece.position = v2i(0, 0);
+    piece.rotation = RS_0;
+
+    table.reach_down[type] = 0;
+    table.open_free[type] = 0;
+    for(int rotation = 0; rotation < 4; rotation++)
+    {
+      ShapeRotation *shape = &table.shapes[type][rotation];
+      shape->piece = piece;
+
+      shape->min_dx = piece.points[0].x;
+      shape->min_dy = piece.points[0].y;
+      for(int i = 1; i < 4; i++)
+      {
+        if(piece.points[i].x < shape->min_dx) shape->min_dx = piece.points[i].x;
+        if(piece.points[i].y < shape->min_dy) shape->min_dy = piece.points[i].y;
+      }
+
+      memset(shape->rows, 0, sizeof(shape->rows));
+      for(int i = 0; i < 4; i++)
+      {
+        v2i p = piece.points[i];
+        shape->rows[p.y - shape->min_dy] |= 1 << (p.x - shape->min_dx);
+        shape->cell_dy[i] = p.y;
+        shape->cell_shift[i] = p.x + X_OFFSET + X_MIN;
+      }
+
+      if(-shape->min_dy > table.reach_down[type]) table.reach_down[type] = -shape->min_dy;
+      for(int x = X_MIN; x < X_MIN + X_COUNT; x++)
+      {
+        bool inside = true;
+        for(int i = 0; i < 4; i++) inside = inside && (unsigned)(x + piece.points[i].x) < (unsigned)BOARD_COLUMNS;
+        if(inside) table.open_free[type] |= to_lane(1u << (x - X_MIN), rotation);
+      }
+
+      rotate_right(&piece);
+    }
+
+    table.num_kicks[type] = num_kick_tests((PieceType)type);
+    for(int rotation = 0; rotation < 4; rotation++)
+    {
+      for(int test = 0; test < table.num_kicks[type]; test++)
+      {
+        table.kicks[type][rotation][0][test] = kick_offset((PieceType)type, (RotationState)rotation, (RotationState)((rotation + 3) & 3), test);
+        table.kicks[type][rotation][1][test] = kick_offset((PieceType)type, (RotationState)rotation, (RotationState)((rotation + 1) & 3), test);
+      }
+    }
+
+    table.turns_move_cells[type] = false;
+    for(int rotation = 0; rotation < 4; rotation++)
+    {
+      for(int turn = 0; turn < 2; turn++)
+      {
+        v2i first = table.kicks[type][rotation][turn][0];
+        const ShapeRotation *from = &table.shapes[type][rotation];
+        const ShapeRotation *to = &table.shapes[type][(rotation + (turn ? 1 : 3)) & 3];
+        bool same = memcmp(from->rows, to->rows, sizeof(from->rows)) == 0 &&
+                    to->min_dx + first.x == from->min_dx && to->min_dy + first.y == from->min_dy;
+        if(!same) table.turns_move_cells[type] = true;
+      }
+    }
+
+    for(int test = 0; test < table.num_kicks[type]; test++)
+    {
+      KickTest *kick_test = &table.kick_tests[type][test];
+      memset(kick_test, 0, sizeof(*kick_test));
+
+      for(int turn = 0; turn < 2; turn++)
+      {
+        for(int rotation = 0; rotation < 4; rotation++)
+        {
+          v2i kick = table.kicks[type][rotation][turn][test];
+
+          KickGroup *group = 0;
+          for(int i = 0; i < kick_test->num_groups; i++)
+          {
+            if(kick_test->groups[i].dy == kick.y) group = &kick_test->groups[i];
+          }
+          if(!group)
+          {
+            group = &kick_test->groups[kick_test->num_groups++];
+            group->dy = kick.y;
+          }
+
+          int new_rotation = (rotation + (turn ? 1 : 3)) & 3;
+          uint32_t staying = (kick.x >= 0) ? ROW_POSITIONS >> kick.x : (ROW_POSITIONS << -kick.x) & ROW_POSITIONS;
+          group->lanes[kick.x + 2][turn] |= to_lane(staying, new_rotation);
+        }
+      }
+
+      uint64_t open = table.open_free[type];
+      for(int i = 0; i < kick_test->num_groups; i++)
+      {
+        KickGroup *group = &kick_test->groups[i];
+        for(int turn = 0; turn < 2; turn++)
+        {
+          group->open_fits[turn] = (group->lanes[0][turn] & (open << 2)) | (group->lanes[1][turn] & (open << 1)) | (group->lanes[2][turn] & open) |
+                                   (group->lanes[3][turn] & (open >> 1)) | (group->lanes[4][turn] & (open >> 2));
+        }
+      }
+    }
+
+    for(int rotation = 0; rotation < 4; rotation++)
+    {
+      const ShapeRotation *shape = &table.shapes[type][rotation];
+      table.same_cells_as[type][rotation] = -1;
+      for(int earlier = 0; earlier < rotation; earlier++)
+      {
+        const ShapeRotation *other = &table.shapes[type][earlier];
+        if(memcmp(shape->rows, other->rows, sizeof(shape->rows)) != 0) continue;
+
+        table.same_cells_as[type][rotation] = earlier;
+        table.same_cells_offset[type][rotation] = v2i(shape->min_dx - other->min_dx, shape->min_dy - other->min_dy);
+        break;
+      }
+    }
+  }
+
+  return table;
+}
+
+static const ShapeTable *shape_table()
+{
+  static ShapeTable table = build_shape_table();
+  return &table;
+}
+
+// Pads the bottom num_rows rows
+static void pad_board(const Board *board, uint32_t *padded, int num_rows)
+{
+  for(int i = 0; i < num_rows; i++)
+  {
+    int row = i - Y_OFFSET;
+    if(row < 0)               padded[i] = ~0u;
+    else if(row < BOARD_ROWS) padded[i] = ((uint32_t)board->rows[row] << X_OFFSET) | WALLS;
+    else                      padded[i] = WALLS;
+  }
+}
+
+static bool in_search_space(int x, int y)
+{
+  return x >= X_MIN && x < X_MIN + X_COUNT && y >= Y_MIN && y < Y_MIN + Y_COUNT;
+}
+
+static bool collides(const uint32_t *padded, const ShapeRotation *shape, int x, int y)
+{
+  const uint32_t *rows = padded + y + shape->min_dy + Y_OFFSET;
+  int shift = x + shape->min_dx + X_OFFSET;
+
+  return ((rows[0] & (shape->rows[0] << shift)) |
+          (rows[1] & (shape->rows[1] << shift)) |
+          (rows[2] & (shape->rows[2] << shift)) |
+          (rows[3] & (shape->rows[3] << shift))) != 0;
+}
+
+static int state_index(int x, int y, int rotation)
+{
+  return ((y - Y_MIN) * X_COUNT + (x - X_MIN)) * 4 + rotation;
+}
+
+// Identifies the cells a locked piece covers, never zero
+static uint64_t cells_key(const ShapeRotation *shape, int x, int y)
+{
+  int shift = x + shape->min_dx;
+
+  uint64_t key = (uint64_t)(y + shape->min_dy + 1);
+  for(int r = 0; r < 4; r++)
+  {
+    key |= (uint64_t)(shape->rows[r] << shift) << (6 + r * BOARD_COLUMNS);
+  }
+
+  return key;
+}
+
+// Kept between calls so that starting a search doesn't mean clearing 10 KB of
+// tables. Entries only count if they carry the current search's generation.
+// One per thread, rollouts generate from every worker at once.
+struct SearchScratch
+{
+  uint32_t generation;
+
+  uint32_t visited[NUM_STATES];
+  uint16_t parent[NUM_STATES];
+  unsigned char parent_input[NUM_STATES];
+  uint16_t queue[NUM_STATES];
+
+  uint32_t seen_generation[PLACEMENT_HASH_SIZE];
+  uint64_t seen_cells[PLACEMENT_HASH_SIZE];
+};
+
+static thread_local SearchScratch search_scratch;
+
+static SearchScratch *begin_search()
+{
+  SearchScratch *scratch = &search_scratch;
+  if(++scratch->generation == 0)
+  {
+    memset(scratch, 0, sizeof(*scratch));
+    scratch->generation = 1;
+  }
+
+  return scratch;
+}
+
+// Returns false if the key was already seen this search
+static bool insert_key(SearchScratch *scratch, uint64_t key)
+{
+  unsigned slot = (unsigned)((key * 0x9E3779B97F4A7C15ull) >> 54);
+  for(;;)
+  {
+    if(scratch->seen_generation[slot] != scratch->generation)
+    {
+      scratch->seen_generation[slot] = scratch->generation;
+      scratch->seen_cells[slot] = key;
+      return true;
+    }
+    if(scratch->seen_cells[slot] == key) return false;
+    slot = (slot + 1) & (PLACEMENT_HASH_SIZE - 1);
+  }
+}
+
+// Everything above the stack moves the same at any height, so searches start
+// just above it. Kicks reach two rows down and shapes two more.
+static int stack_top(const Board *board)
+{
+  int top = BOARD_ROWS;
+  while(top > 0 && board->rows[top - 1] == 0) top--;
+  return top;
+}
+
+// Every position in row y where shape doesn't collide
+static uint32_t free_positions(const uint32_t *padded, const ShapeRotation *shape, int y)
+{
+  const uint32_t *rows = padded + y + Y_OFFSET;
+  return ~((rows[shape->cell_dy[0]] >> shape->cell_shift[0]) |
+           (rows[shape->cell_dy[1]] >> shape->cell_shift[1]) |
+           (rows[shape->cell_dy[2]] >> shape->cell_shift[2]) |
+           (rows[shape->cell_dy[3]] >> shape->cell_shift[3])) & ROW_POSITIONS;
+}
+
+// Everything left and right moves reach from the positions in from without
+// leaving free, a doubling fill each way
+static uint64_t slide(uint64_t from, uint64_t free)
+{
+  uint64_t left = from;
+  uint64_t open = free;
+  left |= open & (left << 1);
+  open &= open << 1;
+  left |= open & (left << 2);
+  open &= open << 2;
+  left |= open & (left << 4);
+  open &= open << 4;
+  left |= open & (left << 8);
+
+  uint64_t right = from;
+  open = free;
+  right |= open & (right >> 1);
+  open &= open >> 1;
+  right |= open & (right >> 2);
+  open &= open >> 2;
+  right |= open & (right >> 4);
+  open &= open >> 4;
+  right |= open & (right >> 8);
+
+  return left | right;
+}
+
+// Breadth first over every state, so each placement gets the shortest path.
+// With a target, stops at the first placement covering the same cells.
+static int search_paths(const Board *board, const Piece *start, const Piece *target,
+                        Placement *placements, int max_placements)
+{
+  if(start->type == NO_PIECE) return 0;
+  if(!in_search_space(start->position.x, start->position.y)) return 0;
+
+  const ShapeTable *table = shape_table();
+  const ShapeRotation *shapes = table->shapes[start->type];
+
+  uint32_t padded[PADDED_ROWS];
+  pad_board(board, padded, PADDED_ROWS);
+
+  if(collides(padded, &shapes[start->rotation], start->position.x, start->position.y)) return 0;
+
+  uint64_t target_key = 0;
+  if(target)
+  {
+    if(target->type != start->type) return 0;
+    if(!in_search_space(target->position.x, target->position.y)) return 0;
+    target_key = cells_key(&shapes[target->rotation], target->position.x, target->position.y);
+  }
+
+  int top = stack_top(board);
+  Piece lowered = *start;
+  int skipped_rows = 0;
+  if(lowered.position.y > top + 4)
+  {
+    skipped_rows = lowered.position.y - (top + 4);
+    lowered.position.y = top + 4;
+  }
+  start = &lowered;
+
+  SearchScratch *scratch = begin_search();
+  uint32_t generation = scratch->generation;
+  uint32_t *visited = scratch->visited;
+  uint16_t *parent = scratch->parent;
+  unsigned char *parent_input = scratch->parent_input;
+  uint16_t *queue = scratch->queue;
+
+  int start_index = state_index(start->position.x, start->position.y, start->rotation);
+  visited[start_index] = generation;
+  parent[start_index] = (uint16_t)start_index;
+  queue[0] = (uint16_t)start_index;
+  int queue_head = 0;
+  int queue_tail = 1;
+
+  int num_placements = 0;
+  int num_kicks = table->num_kicks[start->type];
+
+  while(queue_head < queue_tail)
+  {
+    int index = queue[queue_head++];
+    int rotation = index & 3;
+    int x = (index >> 2) % X_COUNT + X_MIN;
+    int y = (index >> 2) / X_COUNT + Y_MIN;
+    const ShapeRotation *shape = &shapes[rotation];
+
+    // Neighbours, sideways and turning before dropping so paths do as much as
+    // they can up top
+    int next[NUM_MOVE_INPUTS];
+    for(int i = 0; i < NUM_MOVE_INPUTS; i++) next[i] = -1;
+
+    if(in_search_space(x - 1, y) && !collides(padded, shape, x - 1, y)) next[MOVE_LEFT] = state_index(x - 1, y, rotation);
+    if(in_search_space(x + 1, y) && !collides(padded, shape, x + 1, y)) next[MOVE_RIGHT] = state_index(x + 1, y, rotation);
+
+    for(int turn = MOVE_ROTATE_CCW; turn <= MOVE_ROTATE_CW; turn++)
+    {
+      int new_rotation = (turn == MOVE_ROTATE_CW) ? (rotation + 1) & 3 : (rotation + 3) & 3;
+      const v2i *kicks = table->kicks[start->type][rotation][turn - MOVE_ROTATE_CCW];
+      for(int test = 0; test < num_kicks; test++)
+      {
+        v2i offset = kicks[test];
+        int kx = x + offset.x;
+        int ky = y + offset.y;
+        if(in_search_space(kx, ky) && !collides(padded, &shapes[new_rotation], kx, ky))
+        {
+          next[turn] = state_index(kx, ky, new_rotation);
+          break;
+        }
+      }
+    }
+
+    bool resting = collides(padded, shape, x, y - 1);
+    if(!resting) next[MOVE_SOFT_DROP] = state_index(x, y - 1, rotation);
+
+    for(int input = 0; input < NUM_MOVE_INPUTS; input++)
+    {
+      int n = next[input];
+      if(n < 0 || visited[n] == generation) continue;
+
+      visited[n] = generation;
+      parent[n] = (uint16_t)index;
+      parent_input[n] = (unsigned char)input;
+      queue[queue_tail++] = (uint16_t)n;
+    }
+
+    if(!resting) continue;
+    if(num_placements >= max_placements) continue;
+
+    uint64_t key = cells_key(shape, x, y);
+    if(target && key != target_key) continue;
+    if(!insert_key(scratch, key)) continue;
+
+    // Walk back to the start for the inputs. Tucks, moves after a drop, only
+    // line up from the real start with the skipped rows dropped first.
+    int path_length = 0;
+    bool tuck = false;
+    bool moved_after = false;
+    for(int i = index; i != start_index; i = parent[i])
+    {
+      if(parent_input[i] == MOVE_SOFT_DROP) tuck = tuck || moved_after;
+      else moved_after = true;
+      path_length++;
+    }
+
+    int num_prefix = tuck ? skipped_rows : 0;
+    if(num_prefix + path_length + 1 > MAX_PATH_INPUTS) continue;
+
+    Placement *placement = &placements[num_placements++];
+    placement->piece = shape->piece;
+    placement->piece.position = v2i(x, y);
+    placement->piece.rotation = (RotationState)rotation;
+
+    for(int i = 0; i < num_prefix; i++) placement->inputs[i] = MOVE_SOFT_DROP;
+    path_length += num_prefix;
+
+    int at = path_length;
+    for(int i = index; i != start_index; i = parent[i]) placement->inputs[--at] = parent_input[i];
+
+    // Drops at the end are what a hard drop does anyway
+    while(path_length > 0 && placement->inputs[path_length - 1] == MOVE_SOFT_DROP) path_length--;
+    placement->inputs[path_length++] = MOVE_HARD_DROP;
+    placement->num_inputs = path_length;
+
+    if(target) break;
+  }
+
+  return num_placements;
+}
+
+int generate_placements(const Board *board, const Piece *start, Placement *placements, int max_placements)
+{
+  return search_paths(board, start, 0, placements, max_placements);
+}
+
+bool find_placement_path(const Board *board, const Piece *start, const Piece *target, Placement *placement)
+{
+  return search_paths(board, start, target, placement, 1) == 1;
+}
+
+// Fills in free rows from known_from down to row, every position of all four
+// rotations that fits
+static void fill_free_rows(const uint32_t *padded, const ShapeRotation *shapes, uint64_t *free, int *known_from, int row)
+{
+  for(; *known_from > row; (*known_from)--)
+  {
+    int fill = *known_from - 1;
+    int y = fill - KICK_ROWS + Y_MIN;
+
+    free[fill] = 0;
+    if(y < Y_MIN) continue;
+    for(int rotation = 0; rotation < 4; rotation++) free[fill] |= to_lane(free_positions(padded, &shapes[rotation], y), rotation);
+  }
+}
+
+// Where the search stands in generate_lock_positions, for kicks to add to
+struct RowSearch
+{
+  const uint64_t *free;
+  uint64_t *reach;
+  uint64_t dirty;
+  int top;
+
+  // Rows from here up are all reached already, kicks into them add nothing
+  int settled_row;
+};
+
+static void add_kicked(RowSearch *search, int row, int kicked_row, uint64_t landed)
+{
+  if((landed & ~search->reach[kicked_row]) == 0) return;
+
+  search->reach[kicked_row] |= landed;
+  if(kicked_row != row) search->dirty |= 1ull << kicked_row;
+  if(kicked_row > search->top) search->top = kicked_row;
+}
+
+#if MOVE_GENERATOR_SSE2
+
+// Both turns at once, counter-clockwise in the low half and clockwise in the
+// high, each positions' tests in order until one fits
+static void turn_positions(RowSearch *search, const KickTest *kick_tests, int num_kicks, int row, uint64_t pending)
+{
+  __m128i remaining = _mm_set_epi64x((long long)rotate_lanes(pending, 1), (long long)rotate_lanes(pending, 3));
+  for(int test = 0; test < num_kicks; test++)
+  {
+    const KickTest *kick_test = &kick_tests[test];
+
+    __m128i hits = _mm_setzero_si128();
+    for(int i = 0; i < kick_test->num_groups; i++)
+    {
+      const KickGroup *group = &kick_test->groups[i];
+      int kicked_row = row + group->dy;
+      if(kicked_row >= search->settled_row)
+      {
+        hits = _mm_or_si128(hits, _mm_and_si128(remaining, _mm_loadu_si128((const __m128i *)group->open_fits)));
+        continue;
+      }
+
+      __m128i target_free = _mm_set1_epi64x((long long)search->free[kicked_row]);
+      __m128i fit_left_2 = _mm_and_si128(_mm_and_si128(remaining, _mm_loadu_si128((const __m128i *)group->lanes[0])), _mm_slli_epi64(target_free, 2));
+      __m128i fit_left_1 = _mm_and_si128(_mm_and_si128(remaining, _mm_loadu_si128((const __m128i *)group->lanes[1])), _mm_slli_epi64(target_free, 1));
+      __m128i fit_still = _mm_and_si128(_mm_and_si128(remaining, _mm_loadu_si128((const __m128i *)group->lanes[2])), target_free);
+      __m128i fit_right_1 = _mm_and_si128(_mm_and_si128(remaining, _mm_loadu_si128((const __m128i *)group->lanes[3])), _mm_srli_epi64(target_free, 1));
+      __m128i fit_right_2 = _mm_and_si128(_mm_and_si128(remaining, _mm_loadu_si128((const __m128i *)group->lanes[4])), _mm_srli_epi64(target_free, 2));
+      hits = _mm_or_si128(hits, _mm_or_si128(_mm_or_si128(fit_left_2, fit_left_1), _mm_or_si128(fit_still, _mm_or_si128(fit_right_1, fit_right_2))));
+
+      __m128i landed = _mm_or_si128(_mm_or_si128(_mm_srli_epi64(fit_left_2, 2), _mm_srli_epi64(fit_left_1, 1)),
+                                    _mm_or_si128(fit_still, _mm_or_si128(_mm_slli_epi64(fit_right_1, 1), _mm_slli_epi64(fit_right_2, 2))));
+      landed = _mm_or_si128(landed, _mm_unpackhi_epi64(landed, landed));
+      add_kicked(search, row, kicked_row, (uint64_t)_mm_cvtsi128_si64(landed));
+    }
+
+    remaining = _mm_andnot_si128(hits, remaining);
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(remaining, _mm_setzero_si128())) == 0xFFFF) break;
+  }
+}
+
+#else
+
+static void turn_positions(RowSearch *search, const KickTest *kick_tests, int num_kicks, int row, uint64_t pending)
+{
+  for(int turn = 0; turn < 2; turn++)
+  {
+    uint64_t remaining = rotate_lanes(pending, turn ? 1 : 3);
+    for(int test = 0; test < num_kicks && remaining != 0; test++)
+    {
+      const KickTest *kick_test = &kick_tests[test];
+
+      uint64_t hits = 0;
+      for(int i = 0; i < kick_test->num_groups; i++)
+      {
+        const KickGroup *group = &kick_test->groups[i];
+        int kicked_row = row + group->dy;
+        if(kicked_row >= search->settled_row)
+        {
+          hits |= remaining & group->open_fits[turn];
+          continue;
+        }
+
+        uint64_t target_free = search->free[kicked_row];
+        uint64_t fit_left_2 = remaining & group->lanes[0][turn] & (target_free << 2);
+        uint64_t fit_left_1 = remaining & group->lanes[1][turn] & (target_free << 1);
+        uint64_t fit_still = remaining & group->lanes[2][turn] & target_free;
+        uint64_t fit_right_1 = remaining & group->lanes[3][turn] & (target_free >> 1);
+        uint64_t fit_right_2 = remaining & group->lanes[4][turn] & (target_free >> 2);
+        hits |= fit_left_2 | fit_left_1 | fit_still | fit_right_1 | fit_right_2;
+
+        uint64_t landed = (fit_left_2 >> 2) | (fit_left_1 >> 1) | fit_still | (fit_right_1 << 1) | (fit_right_2 << 2);
+        add_kicked(search, row, kicked_row, landed);
+      }
+
+      remaining &= ~hits;
+    }
+  }
+}
+
+#endif
+
+// The same moves as search_paths, but a whole row of positions at a time for
+// all four rotations: slides are a fill along the row, drops an AND with the
+// row below, and kicks a shift of the positions whose earlier tests all
+// failed. Rows are worked through top down, only kicks go back up.
+int generate_lock_positions(const Board *board, const Piece *start, Piece *pieces, int max_pieces)
+{
+  if(start->type == NO_PIECE) return 0;
+  if(!in_search_space(start->position.x, start->position.y)) return 0;
+
+  const ShapeTable *table = shape_table();
+  const ShapeRotation *shapes = table->shapes[start->type];
+  int num_kicks = table->turns_move_cells[start->type] ? table->num_kicks[start->type] : 0;
+
+  int open_y = stack_top(board) + table->reach_down[start->type];
+
+  // Only as far up as the rows below open_y's shapes reach
+  uint32_t padded[PADDED_ROWS];
+  pad_board(board, padded, open_y + 2 + Y_OFFSET + 1);
+
+  // From open_y up every shape is clear of the stack and only the walls are
+  // in the way. Rows below are filled in as the search gets down to them, it
+  // rarely gets far into the stack.
+  int open_row = open_y - Y_MIN + KICK_ROWS;
+  uint64_t free[ROWS];
+  for(int row = open_row; row < ROWS; row++)
+  {
+    int y = row - KICK_ROWS + Y_MIN;
+    free[row] = (y < Y_MIN + Y_COUNT) ? table->open_free[start->type] : 0;
+  }
+  int known_from = open_row;
+
+  int start_row = start->position.y - Y_MIN + KICK_ROWS;
+  fill_free_rows(padded, shapes, free, &known_from, start_row);
+
+  uint64_t start_position = to_lane(1u << (start->position.x - X_MIN), start->rotation);
+  if((free[start_row] & start_position) == 0) return 0;
+
+  uint64_t reach[ROWS];
+  uint64_t turned[ROWS]; // Positions already tried turning from
+  memset(reach, 0, sizeof(reach));
+  memset(turned, 0, sizeof(turned));
+
+  RowSearch search;
+  search.free = free;
+  search.reach = reach;
+
+  // Coming down from two rows above open_y, everything clear of the walls is
+  // reached in open_y's row and the next, SRS kicks move at most a row down
+  // between rotations. Nothing from open_y up needs searching then, only
+  // kicks from those two rows down into the stack.
+  if(num_kicks != 0 && start->position.y >= open_y + 2)
+  {
+    search.settled_row = open_row;
+    search.top = open_row + 1;
+    reach[open_row] = reach[open_row + 1] = reach[open_row + 2] = free[open_row];
+  }
+  else
+  {
+    int start_y = start->position.y;
+    if(start_y > open_y + 2) start_y = open_y + 2;
+
+    search.settled_row = ROWS;
+    search.top = start_y - Y_MIN + KICK_ROWS;
+    reach[search.top] = start_position;
+  }
+
+  // Rows with positions nothing has moved from yet, highest first so drops
+  // carry everything down in one go
+  search.dirty = 1ull << search.top;
+  int bottom = search.top; // Lowest row reached
+  while(search.dirty != 0)
+  {
+    int row = 63 - __builtin_clzll(search.dirty);
+    search.dirty &= ~(1ull << row);
+
+    if(row < bottom) bottom = row;
+    fill_free_rows(padded, shapes, free, &known_from, row - KICK_ROWS);
+
+    // What the row held last time, kicks may have added to it since
+    uint64_t before = turned[row];
+
+    for(;;)
+    {
+      reach[row] = slide(reach[row] | (reach[row + 1] & free[row]), free[row]);
+
+      uint64_t pending = reach[row] & ~turned[row];
+      if(pending == 0 || num_kicks == 0) break;
+      turned[row] |= pending;
+
+      turn_positions(&search, table->kick_tests[start->type], num_kicks, row, pending);
+    }
+
+    if(row > KICK_ROWS && reach[row] != before) search.dirty |= 1ull << (row - 1);
+  }
+  int top = search.top;
+
+  uint64_t resting[ROWS];
+  for(int row = bottom; row <= top; row++) resting[row] = reach[row] & ~free[row - 1];
+
+  // Rotations covering the same cells as an earlier one only add what that
+  // one couldn't get to
+  for(int rotation = 1; rotation < 4; rotation++)
+  {
+    int same = table->same_cells_as[start->type][rotation];
+    if(same < 0) continue;
+
+    v2i offset = table->same_cells_offset[start->type][rotation];
+    for(int row = bottom; row <= top; row++)
+    {
+      int same_row = row + offset.y;
+      if(same_row < bottom || same_row > top) continue;
+
+      uint32_t taken = lane(resting[same_row], same);
+      taken = (offset.x >= 0) ? taken >> offset.x : taken << -offset.x;
+      resting[row] &= ~to_lane(taken & ROW_POSITIONS, rotation);
+    }
+  }
+
+  int num_pieces = 0;
+  for(int row = bottom; row <= top; row++)
+  {
+    for(uint64_t left = resting[row]; left != 0; left &= left - 1)
+    {
+      if(num_pieces >= max_pieces) return num_pieces;
+
+      int bit = __builtin_ctzll(left);
+      int rotation = bit / X_COUNT;
+
+      Piece *piece = &pieces[num_pieces++];
+      *piece = shapes[rotation].piece;
+      piece->position = v2i(bit % X_COUNT + X_MIN, row - KICK_ROWS + Y_MIN);
+      piece->rotation = (RotationState)rotation;
+    }
+  }
+
+  return num_pieces;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Finds every place a piece can lock on a board, using the same movement rules
+// as the game: one column moves, SRS rotations with kicks, and soft drops that
+// let pieces slide and spin under overhangs. Each placement comes with the
+// shortest input sequence that gets it there.
+//
+// Searches that only need to know where a piece can go, rollouts and the bot
+// past its first piece, should use generate_lock_positions. It finds the same
+// positions several times faster by moving whole rows of positions at once,
+// and find_placement_path gets the inputs for the one that gets picked.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+enum MoveInput
+{
+  MOVE_LEFT,
+  MOVE_RIGHT,
+  MOVE_ROTATE_CCW,
+  MOVE_ROTATE_CW,
+  MOVE_SOFT_DROP,  // One row down
+  MOVE_HARD_DROP,  // Down as far as it goes and lock
+
+  NUM_MOVE_INPUTS
+};
+
+static const int MAX_PATH_INPUTS = 64;
+static const int MAX_PLACEMENTS = 512;
+
+struct Placement
+{
+  Piece piece; // Where the piece locks
+
+  // Always ends with MOVE_HARD_DROP
+  int num_inputs;
+  unsigned char inputs[MAX_PATH_INPUTS];
+};
+
+// Writes up to max_placements distinct lock positions reachable from start,
+// two placements never cover the same cells. Returns how many were written.
+int generate_placements(const Board *board, const Piece *start, Placement *placements, int max_placements);
+
+// The shortest input sequence from start to a lock on the same cells as
+// target. False if there is none.
+bool find_placement_path(const Board *board, const Piece *start, const Piece *target, Placement *placement);
+
+// The lock positions generate_placements finds, without the inputs. Returns
+// how many were written.
+int generate_lock_positions(const Board *board, const Piece *start, Piece *pieces, int max_pieces);
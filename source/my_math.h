@@ -135,8 +135,8 @@ struct v2i
   v2i() {}
   v2i(int inX, int inY) : x(inX), y(inY) {}
 
-  v2i operator+(const v2i &rhs) { return v2i(x + rhs.x, y + rhs.y); }
-  v2i operator-(const v2i &rhs) { return v2i(x - rhs.x, y - rhs.y); }
+  v2i operator+(const v2i &rhs) const { return v2i(x + rhs.x, y + rhs.y); }
+  v2i operator-(const v2i &rhs) const { return v2i(x - rhs.x, y - rhs.y); }
 
   v2i &operator+=(const v2i &rhs) { x += rhs.x; y += rhs.y; return *this; }
   v2i &operator-=(const v2i &rhs) { x -= rhs.x; y -= rhs.y; return *this; }
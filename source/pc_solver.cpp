@@ -0,0 +1,477 @@
+#include "pc_solver.h"
+
+#include "move_generator.h"
+#include "thread_pool.h"
+#include "transposition_table.h"
+
+#include <stdlib.h> // malloc
+#include <string.h>
+
+#include <atomic>
+#include <climits>
+#include <mutex>
+
+static const int MAX_PC_PIECES = MAX_PC_QUEUE + 1; // Falling piece and the queue
+
+// What one worker needs for its searches
+struct PcScratch
+{
+  Piece positions[MAX_PLACEMENTS];
+  Piece candidates[MAX_PC_MOVES][MAX_PLACEMENTS]; // Per search depth
+  PcMove path[MAX_PC_MOVES];
+  int path_length;
+
+  PcStats stats;
+};
+
+// The problem as the search sees it: the falling piece and the queue as one
+// sequence, with what's left of it from each index on summarised
+struct PcSequence
+{
+  PieceType pieces[MAX_PC_PIECES];
+  int length;
+
+  uint64_t suffix_hash[MAX_PC_PIECES + 1]; // Of pieces[i..length)
+  int suffix_column_imbalance[MAX_PC_PIECES + 1];
+};
+
+struct PcFirstMove
+{
+  PcMove move;
+  PieceType hold_after;
+  int next_after;
+};
+
+struct PcSolver
+{
+  ThreadPool *pool;
+  PcScratch *scratch; // One per worker
+
+  // Board, height, hold and rest of the queue of every position searched
+  // without finding a clear. Keys cover the rest of the queue, so entries stay
+  // good from one problem to the next.
+  TranspositionTable dead_ends;
+
+  // The batch solve_perfect_clear hands to the pool
+  Board board;
+  PcSequence sequence;
+  int height;
+  PcFirstMove *first_moves;
+
+  std::atomic<int> solved_task; // Earliest first move with a clear so far
+  std::mutex solution_lock;
+  PcSolution solution;
+};
+
+enum PcResult
+{
+  PC_NONE,
+  PC_FOUND,
+  PC_ABORTED, // An earlier first move found a clear, this one doesn't matter any more
+};
+
+static uint64_t mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static int bit_count(uint64_t bits)
+{
+  return __builtin_popcountll(bits);
+}
+
+// Rows 0..h-1 of a board packed into one word, bit row * 10 + column
+static uint64_t height_cells(int height)
+{
+  return (1ull << (height * BOARD_COLUMNS)) - 1;
+}
+
+static uint64_t column_cells(int column)
+{
+  uint64_t cells = 0;
+  for(int row = 0; row < MAX_PC_HEIGHT; row++) cells |= 1ull << (row * BOARD_COLUMNS + column);
+  return cells;
+}
+
+static uint64_t even_column_cells()
+{
+  uint64_t cells = 0;
+  for(int column = 0; column < BOARD_COLUMNS; column += 2) cells |= column_cells(column);
+  return cells;
+}
+
+static const uint64_t EVEN_COLUMN_CELLS = even_column_cells();
+
+// Most a piece can change how many more cells are filled in even columns than
+// in odd ones: a standing I 4, L and J always 2, a standing T 2, the rest 0
+static int column_imbalance(PieceType type)
+{
+  switch(type)
+  {
+    case I_PIECE: return 4;
+    case J_PIECE:
+    case L_PIECE:
+    case T_PIECE: return 2;
+    default: return 0;
+  }
+}
+
+static uint64_t pack_board(const Board *board, int height)
+{
+  uint64_t packed = 0;
+  for(int row = 0; row < height; row++) packed |= (uint64_t)board->rows[row] << (row * BOARD_COLUMNS);
+  return packed;
+}
+
+static int stack_height(const Board *board)
+{
+  for(int row = BOARD_ROWS; row > 0; row--)
+  {
+    if(board->rows[row - 1]) return row;
+  }
+
+  return 0;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Pruning
+////////////////////////////////////////////////////////////////////////////////
+
+// Pieces can't cross a column that is filled all the way up, and line clears
+// keep it filled all the way up, so the empty cells between two of them have
+// to be filled by whole pieces
+static bool walled_areas_fit_pieces(uint64_t empty, int height)
+{
+  uint64_t all_rows = height_cells(height);
+
+  int area_cells = 0;
+  for(int column = 0; column < BOARD_COLUMNS; column++)
+  {
+    uint64_t column_empty = empty & column_cells(column) & all_rows;
+    if(!column_empty)
+    {
+      if(area_cells % 4) return false;
+      area_cells = 0;
+    }
+
+    area_cells += bit_count(column_empty);
+  }
+
+  return area_cells % 4 == 0;
+}
+
+static bool can_still_clear(const Board *board, int height, int pieces_left, int column_pieces_left)
+{
+  uint64_t empty = ~pack_board(board, height) & height_cells(height);
+
+  int empty_cells = bit_count(empty);
+  if(empty_cells % 4 || empty_cells / 4 > pieces_left) return false;
+
+  // Empty cells in even columns against odd ones. Rows moving down on a clear
+  // don't change this, and each piece can only even it out so much, see
+  // column_imbalance.
+  int imbalance = bit_count(empty & EVEN_COLUMN_CELLS) - bit_count(empty & ~EVEN_COLUMN_CELLS);
+  if(imbalance < 0) imbalance = -imbalance;
+  if(imbalance > column_pieces_left) return false;
+
+  return walled_areas_fit_pieces(empty, height);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Search
+////////////////////////////////////////////////////////////////////////////////
+
+static void make_sequence(const PcProblem *problem, PcSequence *sequence)
+{
+  sequence->pieces[0] = problem->current;
+  int queue_length = problem->queue_length < MAX_PC_QUEUE ? problem->queue_length : MAX_PC_QUEUE;
+  for(int i = 0; i < queue_length; i++) sequence->pieces[i + 1] = problem->queue[i];
+  sequence->length = queue_length + 1;
+
+  sequence->suffix_hash[sequence->length] = 0x5C3A7E;
+  sequence->suffix_column_imbalance[sequence->length] = 0;
+  for(int i = sequence->length - 1; i >= 0; i--)
+  {
+    sequence->suffix_hash[i] = mix(sequence->suffix_hash[i + 1] * 8 + sequence->pieces[i] + 1);
+    sequence->suffix_column_imbalance[i] = sequence->suffix_column_imbalance[i + 1] +
+                                          column_imbalance(sequence->pieces[i]);
+  }
+}
+
+static uint64_t position_key(const Board *board, int height, PieceType hold, const PcSequence *sequence, int next)
+{
+  uint64_t rest = mix(sequence->suffix_hash[next] + (uint64_t)(hold + 1) * 16 + height);
+  uint64_t key = mix(pack_board(board, height) ^ rest);
+  return key ? key : 1;
+}
+
+// The placements of type that stay below height, lowest first
+static int fitting_placements(PcScratch *scratch, const Board *board, PieceType type, int height, Piece *out)
+{
+  Piece start;
+  make_spawned_piece(&start, type);
+
+  int num_placements = generate_lock_positions(board, &start, scratch->positions, MAX_PLACEMENTS);
+
+  // Bucketed by top row, filling from the bottom finds clears sooner
+  int num_out = 0;
+  for(int top = 0; top < height; top++)
+  {
+    for(int i = 0; i < num_placements; i++)
+    {
+      const Piece *piece = &scratch->positions[i];
+
+      int piece_top = 0;
+      for(int j = 0; j < 4; j++)
+      {
+        int y = piece->position.y + piece->points[j].y;
+        if(y > piece_top) piece_top = y;
+      }
+
+      if(piece_top == top) out[num_out++] = *piece;
+    }
+  }
+
+  return num_out;
+}
+
+// Locks the piece and clears lines, returns the new height
+static int place(Board *board, const Piece *piece, int height)
+{
+  board_place_piece(board, piece);
+
+  int rows[4];
+  int num_rows = board_full_rows(board, rows);
+  board_clear_rows(board, rows, num_rows);
+
+  return height - num_rows;
+}
+
+static PcResult search(PcSolver *solver, PcScratch *scratch, int task, const Board *board, int height,
+                       PieceType hold, int next, int depth)
+{
+  if(height == 0)
+  {
+    scratch->path_length = depth;
+    return PC_FOUND;
+  }
+  if(solver->solved_task.load(std::memory_order_relaxed) < task) return PC_ABORTED;
+
+  const PcSequence *sequence = &solver->sequence;
+  if(next >= sequence->length) return PC_NONE;
+
+  int pieces_left = sequence->length - next + (hold != NO_PIECE);
+  int column_pieces_left = sequence->suffix_column_imbalance[next] + (hold == NO_PIECE ? 0 : column_imbalance(hold));
+  if(!can_still_clear(board, height, pieces_left, column_pieces_left))
+  {
+    scratch->stats.pruned++;
+    return PC_NONE;
+  }
+
+  uint64_t key = position_key(board, height, hold, sequence, next);
+  uint64_t dead;
+  if(transposition_probe(&solver->dead_ends, key, &dead))
+  {
+    scratch->stats.memo_hits++;
+    return PC_NONE;
+  }
+
+  scratch->stats.nodes++;
+
+  // Play the next piece, swap it for the held one, or hold it and play the
+  // one after
+  PieceType current = sequence->pieces[next];
+  for(int option = 0; option < 3; option++)
+  {
+    PieceType type;
+    PieceType hold_after;
+    int next_after;
+
+    if(option == 0)
+    {
+      type = current;
+      hold_after = hold;
+      next_after = next + 1;
+    }
+    else if(option == 1)
+    {
+      if(hold == NO_PIECE || hold == current) continue;
+      type = hold;
+      hold_after = current;
+      next_after = next + 1;
+    }
+    else
+    {
+      if(hold != NO_PIECE || next + 1 >= sequence->length) continue;
+      type = sequence->pieces[next + 1];
+      hold_after = current;
+      next_after = next + 2;
+    }
+
+    Piece *candidates = scratch->candidates[depth];
+    int num_candidates = fitting_placements(scratch, board, type, height, candidates);
+    for(int i = 0; i < num_candidates; i++)
+    {
+      Board after = *board;
+      int height_after = place(&after, &candidates[i], height);
+
+      PcResult result = search(solver, scratch, task, &after, height_after, hold_after, next_after, depth + 1);
+      if(result == PC_NONE) continue;
+
+      if(result == PC_FOUND)
+      {
+        scratch->path[depth].hold = (option != 0);
+        scratch->path[depth].piece = candidates[i];
+      }
+      return result;
+    }
+  }
+
+  transposition_store(&solver->dead_ends, key, 1);
+  return PC_NONE;
+}
+
+// Searches on from one first move
+static void search_first_move(void *context, int task, int worker)
+{
+  PcSolver *solver = (PcSolver *)context;
+  PcScratch *scratch = &solver->scratch[worker];
+  const PcFirstMove *first = &solver->first_moves[task];
+
+  Board board = solver->board;
+  int height = place(&board, &first->move.piece, solver->height);
+
+  PcResult result = search(solver, scratch, task, &board, height, first->hold_after, first->next_after, 1);
+  if(result != PC_FOUND) return;
+
+  std::lock_guard<std::mutex> guard(solver->solution_lock);
+  if(task > solver->solved_task.load(std::memory_order_relaxed)) return;
+  solver->solved_task.store(task, std::memory_order_relaxed);
+
+  PcSolution *solution = &solver->solution;
+  solution->moves[0] = first->move;
+  for(int i = 1; i < scratch->path_length; i++) solution->moves[i] = scratch->path[i];
+  solution->num_moves = scratch->path_length;
+  solution->height = solver->height;
+}
+
+// Same three options as in search, with hold only if the game allows it
+static int generate_first_moves(PcSolver *solver, const PcProblem *problem)
+{
+  const PcSequence *sequence = &solver->sequence;
+  PcScratch *scratch = &solver->scratch[0];
+  Piece *candidates = scratch->candidates[0];
+
+  int num_first_moves = 0;
+  for(int option = 0; option < 3; option++)
+  {
+    PcFirstMove first;
+    PieceType type;
+
+    if(option == 0)
+    {
+      type = problem->current;
+      first.hold_after = problem->hold;
+      first.next_after = 1;
+    }
+    else if(option == 1)
+    {
+      if(!problem->can_hold || problem->hold == NO_PIECE || problem->hold == problem->current) continue;
+      type = problem->hold;
+      first.hold_after = problem->current;
+      first.next_after = 1;
+    }
+    else
+    {
+      if(!problem->can_hold || problem->hold != NO_PIECE || sequence->length < 2) continue;
+      type = sequence->pieces[1];
+      first.hold_after = problem->current;
+      first.next_after = 2;
+    }
+
+    int num_candidates = fitting_placements(scratch, &problem->board, type, solver->height, candidates);
+    for(int i = 0; i < num_candidates; i++)
+    {
+      first.move.hold = (option != 0);
+      first.move.piece = candidates[i];
+      solver->first_moves[num_first_moves++] = first;
+    }
+  }
+
+  return num_first_moves;
+}
+
+PcSolver *create_pc_solver(ThreadPool *pool, int memo_size_log2)
+{
+  PcSolver *solver = new PcSolver;
+  solver->pool = pool;
+  solver->scratch = (PcScratch *)malloc(sizeof(PcScratch) * thread_pool_size(pool));
+  solver->first_moves = (PcFirstMove *)malloc(sizeof(PcFirstMove) * 3 * MAX_PLACEMENTS);
+  init_transposition_table(&solver->dead_ends, memo_size_log2);
+  return solver;
+}
+
+void destroy_pc_solver(PcSolver *solver)
+{
+  if(!solver) return;
+
+  free(solver->scratch);
+  free(solver->first_moves);
+  free_transposition_table(&solver->dead_ends);
+  delete solver;
+}
+
+bool solve_perfect_clear(PcSolver *solver, const PcProblem *problem, int max_height, PcSolution *solution,
+                         PcStats *stats)
+{
+  int num_workers = thread_pool_size(solver->pool);
+  for(int i = 0; i < num_workers; i++) memset(&solver->scratch[i].stats, 0, sizeof(PcStats));
+
+  make_sequence(problem, &solver->sequence);
+  solver->board = problem->board;
+
+  if(max_height > MAX_PC_HEIGHT) max_height = MAX_PC_HEIGHT;
+
+  int filled = 0;
+  for(int row = 0; row < BOARD_ROWS; row++) filled += bit_count(problem->board.rows[row]);
+  int pieces = solver->sequence.length + (problem->hold != NO_PIECE);
+
+  int lowest = stack_height(&problem->board);
+  if(lowest == 0) lowest = 1;
+
+  bool found = false;
+  for(int height = lowest; height <= max_height && !found; height++)
+  {
+    int empty_cells = height * BOARD_COLUMNS - filled;
+    if(empty_cells % 4 || empty_cells / 4 > pieces) continue;
+
+    solver->height = height;
+    solver->solved_task.store(INT_MAX, std::memory_order_relaxed);
+
+    int num_first_moves = generate_first_moves(solver, problem);
+    run_tasks(solver->pool, search_first_move, solver, num_first_moves);
+
+    found = solver->solved_task.load(std::memory_order_relaxed) != INT_MAX;
+  }
+
+  if(found) *solution = solver->solution;
+
+  if(stats)
+  {
+    memset(stats, 0, sizeof(PcStats));
+    for(int i = 0; i < num_workers; i++)
+    {
+      stats->nodes += solver->scratch[i].stats.nodes;
+      stats->pruned += solver->scratch[i].stats.pruned;
+      stats->memo_hits += solver->scratch[i].stats.memo_hits;
+    }
+  }
+
+  return found;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Perfect clear solver. Given a low board, the falling piece, the held piece
+// and the queue, finds placements that leave the board completely empty,
+// using hold any way the game allows.
+//
+// The clear has to happen at some height h: enough rows for the stack, with
+// 10 * h minus the filled cells a multiple of 4. Heights are tried from the
+// lowest up. For each, a depth-first search places pieces only below h, and
+// drops a board as soon as it can't be finished:
+//   - the empty cells below h need more pieces than are left
+//   - the empty cells between two filled columns aren't a multiple of 4
+//   - even and odd columns have more empty cells between them than the
+//     pieces left could make up (column parity, the one colouring line
+//     clears don't shuffle)
+// Boards that were searched through without a clear are remembered in a
+// lock-free table all threads share, so orders of play that meet up again
+// are only searched once.
+//
+// Each first move is a task on the thread pool. The solution is always the
+// one from the earliest first move that has one, whatever the thread count.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+static const int MAX_PC_HEIGHT = 6;
+static const int MAX_PC_QUEUE = 16;
+static const int MAX_PC_MOVES = MAX_PC_QUEUE + 2; // Falling piece, held piece and the queue
+
+struct PcProblem
+{
+  Board board;
+  PieceType current;
+  PieceType hold;
+  bool can_hold;
+
+  PieceType queue[MAX_PC_QUEUE]; // queue[0] spawns next
+  int queue_length;
+};
+
+struct PcMove
+{
+  bool hold;   // Hold first, piece is the one that comes out
+  Piece piece; // Where it locks
+};
+
+struct PcSolution
+{
+  int num_moves;
+  PcMove moves[MAX_PC_MOVES];
+  int height;
+};
+
+struct PcStats
+{
+  uint64_t nodes;      // Boards the search placed a piece on
+  uint64_t pruned;     // Boards dropped by the checks above
+  uint64_t memo_hits;  // Boards already known to have no clear
+};
+
+struct ThreadPool;
+struct PcSolver;
+
+// Memo of 2^memo_size_log2 entries, 16 bytes each
+PcSolver *create_pc_solver(ThreadPool *pool, int memo_size_log2);
+void destroy_pc_solver(PcSolver *solver);
+
+// Tries heights up to max_height (at most MAX_PC_HEIGHT). stats can be null.
+bool solve_perfect_clear(PcSolver *solver, const PcProblem *problem, int max_height, PcSolution *solution,
+                         PcStats *stats);
@@ -0,0 +1,214 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Tetromino shapes and rotation rules (SRS), shared by the game and anything
+// that needs to move pieces around the same way the game does.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "my_math.h"
+
+enum PieceType
+{
+  I_PIECE,
+  J_PIECE,
+  L_PIECE,
+  O_PIECE,
+  S_PIECE,
+  T_PIECE,
+  Z_PIECE,
+
+  NO_PIECE
+};
+
+enum RotationState
+{
+  RS_0,
+  RS_R,
+  RS_2,
+  RS_L,
+};
+
+struct Piece
+{
+  PieceType type;
+
+  v2i position;
+  RotationState rotation;
+
+  v2i points[4];
+};
+
+static const int NUM_KICK_TESTS = 5;
+static v2i default_offset_data[20] =
+{
+  // 1         2         3         4         5
+  { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, // 0
+  { 0,  0}, { 1,  0}, { 1, -1}, { 0,  2}, { 1,  2}, // R
+  { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, // 2
+  { 0,  0}, {-1,  0}, {-1, -1}, { 0,  2}, {-1,  2}  // L
+};
+static v2i i_piece_offset_data[20] =
+{
+  // 1         2         3         4         5
+  { 0,  0}, {-1,  0}, { 2,  0}, {-1,  0}, { 2,  0}, // 0
+  {-1,  0}, { 0,  0}, { 0,  0}, { 0,  1}, { 0, -2}, // R
+  {-1,  1}, { 1,  1}, {-2,  1}, { 1,  0}, {-2,  0}, // 2
+  { 0,  1}, { 0,  1}, { 0,  1}, { 0, -1}, { 0,  2}  // L
+};
+
+static const int NUM_O_KICK_TESTS = 1;
+static v2i o_piece_offset_data[4] =
+{
+  { 0,  0},
+  { 0, -1},
+  {-1, -1},
+  {-1,  0}
+};
+
+
+
+static void make_i_piece(Piece *p)
+{
+  p->type = I_PIECE;
+  p->points[0] = v2i(-1, 0);
+  p->points[1] = v2i( 0, 0);
+  p->points[2] = v2i( 1, 0);
+  p->points[3] = v2i( 2, 0);
+}
+
+static void make_j_piece(Piece *p)
+{
+  p->type = J_PIECE;
+  p->points[0] = v2i(-1, 1);
+  p->points[1] = v2i(-1, 0);
+  p->points[2] = v2i( 0, 0);
+  p->points[3] = v2i( 1, 0);
+}
+
+static void make_l_piece(Piece *p)
+{
+  p->type = L_PIECE;
+  p->points[0] = v2i(-1, 0);
+  p->points[1] = v2i( 0, 0);
+  p->points[2] = v2i( 1, 0);
+  p->points[3] = v2i( 1, 1);
+}
+
+static void make_o_piece(Piece *p)
+{
+  p->type = O_PIECE;
+  p->points[0] = v2i( 0,  0);
+  p->points[1] = v2i( 1,  0);
+  p->points[2] = v2i( 1,  1);
+  p->points[3] = v2i( 0,  1);
+}
+
+static void make_s_piece(Piece *p)
+{
+  p->type = S_PIECE;
+  p->points[0] = v2i(-1,  0);
+  p->points[1] = v2i( 0,  0);
+  p->points[2] = v2i( 0,  1);
+  p->points[3] = v2i( 1,  1);
+}
+
+static void make_t_piece(Piece *p)
+{
+  p->type = T_PIECE;
+  p->points[0] = v2i( 0, 0);
+  p->points[1] = v2i(-1, 0);
+  p->points[2] = v2i( 1, 0);
+  p->points[3] = v2i( 0, 1);
+}
+
+static void make_z_piece(Piece *p)
+{
+  p->type = Z_PIECE;
+  p->points[0] = v2i(-1,  1);
+  p->points[1] = v2i( 0,  1);
+  p->points[2] = v2i( 0,  0);
+  p->points[3] = v2i( 1,  0);
+}
+
+static void make_piece(Piece *p, PieceType type)
+{
+  switch(type)
+  {
+    case I_PIECE: {make_i_piece(p); break;}
+    case J_PIECE: {make_j_piece(p); break;}
+    case L_PIECE: {make_l_piece(p); break;}
+    case O_PIECE: {make_o_piece(p); break;}
+    case S_PIECE: {make_s_piece(p); break;}
+    case T_PIECE: {make_t_piece(p); break;}
+    case Z_PIECE: {make_z_piece(p); break;}
+
+    default: {p->type = NO_PIECE; break;}
+  }
+}
+
+// Where new pieces appear
+static void make_spawned_piece(Piece *p, PieceType type)
+{
+  p->position = v2i(4, 16);
+  p->rotation = RS_0;
+  make_piece(p, type);
+}
+
+static void swap(int &a, int &b)
+{
+  a ^= b;
+  b ^= a;
+  a ^= b;
+}
+
+static void rotate_left(Piece *p)
+{
+  if(p->rotation == RS_0) p->rotation = RS_L;
+  else p->rotation = (RotationState)(p->rotation - 1);
+
+  for(int i = 0; i < 4; i++)
+  {
+    v2i &point = p->points[i];
+    swap(point.x, point.y);
+    point.x = -point.x;
+  }
+}
+
+static void rotate_right(Piece *p)
+{
+  p->rotation = (RotationState)((p->rotation + 1) % 4);
+  for(int i = 0; i < 4; i++)
+  {
+    v2i &point = p->points[i];
+    swap(point.x, point.y);
+    point.y = -point.y;
+  }
+}
+
+// -1 is counter-clockwise, 1 is clockwise
+static void rotate(Piece *p, int direction)
+{
+  if(direction == -1)     rotate_left(p);
+  else if(direction == 1) rotate_right(p);
+}
+
+static int num_kick_tests(PieceType type)
+{
+  return (type == O_PIECE) ? NUM_O_KICK_TESTS : NUM_KICK_TESTS;
+}
+
+// Offset to try for kick test i when a piece turns from prev to curr
+static v2i kick_offset(PieceType type, RotationState prev_rotation, RotationState curr_rotation, int test)
+{
+  int num_tests = num_kick_tests(type);
+  v2i *offset_data;
+  if(type == O_PIECE)      offset_data = o_piece_offset_data;
+  else if(type == I_PIECE) offset_data = i_piece_offset_data;
+  else                     offset_data = default_offset_data;
+
+  v2i prev_state_offset = offset_data[prev_rotation * num_tests + test];
+  v2i curr_state_offset = offset_data[curr_rotation * num_tests + test];
+
+  return prev_state_offset - curr_state_offset;
+}
+
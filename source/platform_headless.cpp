@@ -0,0 +1,24 @@
+////////////////////////////////////////////////////////////////////////////////
+// Platform implementation for programs that run the game without a window or
+// keyboard (the game server and tools): no input, nothing drawn, and a tick
+// every frame. Everything is weak, so a program defines just the functions it
+// needs to do something else and the rest come from here.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "input.h"
+#include "game_timer.h"
+#include "game_presentation.h"
+
+#define HEADLESS_DEFAULT __attribute__((weak))
+
+HEADLESS_DEFAULT void init_input() {}
+HEADLESS_DEFAULT bool button_toggled_down(unsigned char) { return false; }
+HEADLESS_DEFAULT bool button_toggled_up(unsigned char) { return false; }
+HEADLESS_DEFAULT bool button_state(unsigned char) { return false; }
+HEADLESS_DEFAULT uint64_t last_key_press_time() { return 0; }
+HEADLESS_DEFAULT float get_dt() { return TICK_TIME; }
+
+HEADLESS_DEFAULT void draw_cell(v2i, Color) {}
+HEADLESS_DEFAULT void draw_cell_in_left_bar(v2i, Color) {}
+HEADLESS_DEFAULT void draw_cell_in_right_bar(v2i, Color) {}
+HEADLESS_DEFAULT void present_frame_timing(uint64_t, uint64_t) {}
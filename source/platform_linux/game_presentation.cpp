@@ -7,12 +7,13 @@
 #include "game_presentation.h"
 
 #include "renderer.h"
+#include "network_client.h"
 
 void draw_cell(v2i position, Color color)
 {
   renderer_add_cell(position, color);
 
-  //network_add_cell(position, color);
+  network_add_cell(position, color);
 }
 
 void draw_cell_in_left_bar(v2i position, Color color)
@@ -25,4 +26,9 @@ void draw_cell_in_right_bar(v2i position, Color color)
   renderer_add_cell_in_right_bar(position, color);
 }
 
+void present_frame_timing(uint64_t input_time, uint64_t tick_time)
+{
+  network_set_frame_timing(input_time, tick_time);
+}
+
 
@@ -0,0 +1,859 @@
+////////////////////////////////////////////////////////////////////////////////
+// Authoritative game server. Hosts many players' games at once, runs them on
+// fixed ticks with the headless engine and sends every player its game, and
+// what happens in it to anyone watching, see game_protocol.h.
+//
+//   game_server.exe [-p port] [-s spectator port] [-j workers] [-g max games per worker]
+//                   [-v max spectators per worker]
+//
+// One worker process per core, pinned to it, each with its own epoll loop
+// over its own socket on the shared port (SO_REUSEPORT) and its own tick
+// timer. The kernel hashes a player's address to one of the sockets, so a
+// game stays on the worker that started it and workers share nothing.
+// Processes rather than threads because the engine is one global game.
+// Spectators come to the worker of the game they watch on its own port, and
+// a tick's events go out to all of a game's spectators from one buffer.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../tetris.h"
+#include "../input.h"
+#include "../game_timer.h"
+#include "../game_protocol.h"
+#include "../latency.h"
+#include "../spectator.h"
+
+#include <sched.h>      // sched_setaffinity
+#include <sys/epoll.h>
+#include <sys/socket.h> // Networking API, recvmmsg, sendmmsg
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <unistd.h>     // close, fork
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>     // atoi, malloc
+#include <string.h>     // memset, memcpy
+#include <getopt.h>
+#include <cstdio>
+
+#include <thread>
+#include <unordered_map>
+
+
+// Datagrams per syscall
+static const int RECEIVE_BATCH = 64;
+static const int SEND_BATCH = 64;
+
+// Changes waiting for a tick, a player that sends more than this a tick has
+// its newest ones merged
+static const int INPUT_QUEUE_LENGTH = 8;
+
+// Ticks a worker that fell behind runs back to back, the rest are dropped
+static const uint64_t MAX_CATCH_UP_TICKS = 4;
+
+static const float STATS_INTERVAL_MS = 10000.0f;
+
+struct ServerGame
+{
+  sockaddr_in address;
+  uint64_t last_heard; // latency_now_ns
+  uint32_t id;         // Worker in the top byte
+  uint32_t tick;       // Of the game, what the engine counts
+
+  uint32_t sequence;         // Of the last change taken
+  uint32_t applied_sequence; // Of the last change run
+  unsigned buttons;          // Held on the last tick
+
+  int num_queued;
+  uint32_t queued_sequences[INPUT_QUEUE_LENGTH];
+  unsigned queued_buttons[INPUT_QUEUE_LENGTH];
+
+  int num_spectators;
+  uint32_t next_event; // Number of the next one to happen
+  bool restarted;      // On the last tick, everyone watching needs a snapshot
+
+  // Of the last tick for the spectators, in the worker's buffers at the same
+  // index. The snapshot only when one was asked for on it.
+  size_t event_bytes;
+  size_t snapshot_bytes;
+  uint32_t snapshot_tick;
+};
+
+struct ServerSpectator
+{
+  sockaddr_in address;
+  uint64_t last_heard;
+  uint32_t game_id;
+  bool needs_snapshot;
+};
+
+struct ServerWorker
+{
+  int index;
+  int udp_socket;
+  int spectator_socket;
+  int tick_timer;
+  int epoll;
+
+  // Games are packed at the front, their engine state in states at the same
+  // index, headless_game_size() bytes each
+  int max_games;
+  int num_games;
+  ServerGame *games;
+  unsigned char *states;
+  size_t state_size;
+  std::unordered_map<uint64_t, int> game_by_address;
+  std::unordered_map<uint32_t, int> game_by_id;
+
+  // Buffers for each game's spectator datagrams
+  uint8_t *event_datagrams;
+  GameSnapshotPacket *snapshots;
+  GameEventList tick_events;
+
+  int max_spectators;
+  int num_spectators;
+  ServerSpectator *spectators;
+  std::unordered_map<uint64_t, int> spectator_by_address;
+
+  uint32_t tick;
+  uint64_t next_seed;
+  uint32_t next_game_serial;
+
+  mmsghdr receive_messages[RECEIVE_BATCH];
+  iovec receive_buffers[RECEIVE_BATCH];
+  sockaddr_in receive_addresses[RECEIVE_BATCH];
+  GameInputPacket inputs[RECEIVE_BATCH];
+
+  mmsghdr send_messages[SEND_BATCH];
+  iovec send_buffers[SEND_BATCH];
+  GameStatePacket outputs[SEND_BATCH];
+
+  // Point into the game's buffers, queued until a batch is full
+  int num_spectator_datagrams;
+  mmsghdr spectator_messages[SEND_BATCH];
+  iovec spectator_buffers[SEND_BATCH];
+
+  // Since the last stats line
+  uint64_t stats_start;
+  uint64_t packets_received;
+  uint64_t states_sent;
+  uint64_t states_dropped;
+  uint64_t spectator_datagrams_sent;
+  uint64_t spectator_datagrams_dropped;
+  uint64_t spectator_bytes_sent;
+  uint64_t games_started;
+  uint64_t games_ended;
+  uint64_t games_refused;
+  uint64_t ticks_run;
+  uint64_t ticks_dropped;
+  uint64_t tick_ns;
+  uint64_t slowest_tick_ns;
+};
+
+static volatile sig_atomic_t server_running = 1;
+
+
+
+static void handle_stop_signal(int signal_number)
+{
+  server_running = 0;
+}
+
+static void install_signal_handlers()
+{
+  // No SA_RESTART, epoll_wait has to return with EINTR so the loop can exit
+  struct sigaction action = {};
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+}
+
+static int create_server_socket(int port)
+{
+  int udp_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if(udp_socket == -1)
+  {
+    fprintf(stderr, "Error opening socket: %i\n", errno);
+    return udp_socket;
+  }
+
+  // Every worker binds the same port, the kernel spreads players over them
+  int on = 1;
+  setsockopt(udp_socket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+  // A tick's worth of input from thousands of players arrives at once
+  int buffer_bytes = 4 << 20;
+  setsockopt(udp_socket, SOL_SOCKET, SO_RCVBUF, &buffer_bytes, sizeof(buffer_bytes));
+  setsockopt(udp_socket, SOL_SOCKET, SO_SNDBUF, &buffer_bytes, sizeof(buffer_bytes));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(udp_socket, (const sockaddr *)&address, sizeof(address)) == -1)
+  {
+    fprintf(stderr, "Error binding to port %i: %i\n", port, errno);
+    close(udp_socket);
+    return -1;
+  }
+
+  return udp_socket;
+}
+
+static int create_tick_timer()
+{
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if(timer == -1)
+  {
+    fprintf(stderr, "Error creating tick timer: %i\n", errno);
+    return timer;
+  }
+
+  long interval_nanos = (long)(TICK_TIME * 1e6);
+  itimerspec spec = {};
+  spec.it_interval.tv_sec = interval_nanos / (long)1e9;
+  spec.it_interval.tv_nsec = interval_nanos % (long)1e9;
+  spec.it_value = spec.it_interval;
+  if(timerfd_settime(timer, 0, &spec, 0) == -1)
+  {
+    fprintf(stderr, "Error arming tick timer: %i\n", errno);
+  }
+
+  return timer;
+}
+
+static uint64_t address_key(const sockaddr_in *address)
+{
+  return (uint64_t)address->sin_addr.s_addr << 16 | address->sin_port;
+}
+
+static unsigned char *engine_state(ServerWorker *worker, int game)
+{
+  return worker->states + (size_t)game * worker->state_size;
+}
+
+static uint8_t *event_datagram(ServerWorker *worker, int game)
+{
+  return worker->event_datagrams + (size_t)game * MAX_GAME_EVENTS_DATAGRAM;
+}
+
+static uint64_t mix_seed(uint64_t z)
+{
+  z += 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+
+
+static bool sequence_after(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) > 0;
+}
+
+// Null if the worker is full
+static ServerGame *start_game(ServerWorker *worker, const sockaddr_in *address, uint64_t now)
+{
+  if(worker->num_games == worker->max_games)
+  {
+    worker->games_refused++;
+    return 0;
+  }
+
+  int index = worker->num_games++;
+  ServerGame *game = &worker->games[index];
+  memset(game, 0, sizeof(ServerGame));
+  game->address = *address;
+  game->last_heard = now;
+  game->id = (uint32_t)worker->index << 24 | (worker->next_game_serial++ & 0xffffff);
+  game->snapshot_tick = worker->tick - 1;
+
+  start_headless_game(engine_state(worker, index), mix_seed(worker->next_seed++));
+  worker->game_by_address[address_key(address)] = index;
+  worker->game_by_id[game->id] = index;
+  worker->games_started++;
+  return game;
+}
+
+// Its spectators stay until they give up on it
+static void end_game(ServerWorker *worker, int index)
+{
+  worker->game_by_address.erase(address_key(&worker->games[index].address));
+  worker->game_by_id.erase(worker->games[index].id);
+
+  // The last game fills the hole, its datagrams for this tick are already sent
+  int last = --worker->num_games;
+  if(index != last)
+  {
+    worker->games[index] = worker->games[last];
+    memcpy(engine_state(worker, index), engine_state(worker, last), worker->state_size);
+    worker->game_by_address[address_key(&worker->games[index].address)] = index;
+    worker->game_by_id[worker->games[index].id] = index;
+  }
+
+  worker->games_ended++;
+}
+
+static void take_input(ServerWorker *worker, const sockaddr_in *address, const GameInputPacket *packet, uint64_t now)
+{
+  ServerGame *game;
+  auto found = worker->game_by_address.find(address_key(address));
+  if(found != worker->game_by_address.end())
+  {
+    game = &worker->games[found->second];
+    if(!sequence_after(packet->sequence, game->sequence))
+    {
+      // A keepalive or a late duplicate
+      game->last_heard = now;
+      return;
+    }
+  }
+  else
+  {
+    game = start_game(worker, address, now);
+    if(!game) return;
+  }
+
+  game->last_heard = now;
+  game->sequence = packet->sequence;
+
+  int slot = game->num_queued;
+  if(slot == INPUT_QUEUE_LENGTH) slot--;
+  else game->num_queued++;
+  game->queued_sequences[slot] = packet->sequence;
+  game->queued_buttons[slot] = packet->buttons & ((1 << NUM_GAME_BUTTONS) - 1);
+}
+
+// Takes everything already queued on the socket
+static void receive_inputs(ServerWorker *worker)
+{
+  for(;;)
+  {
+    int count = recvmmsg(worker->udp_socket, worker->receive_messages, RECEIVE_BATCH, MSG_DONTWAIT, 0);
+    if(count == -1)
+    {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        fprintf(stderr, "Error receiving input: %i\n", errno);
+      }
+      return;
+    }
+
+    uint64_t now = latency_now_ns();
+    worker->packets_received += count;
+    for(int i = 0; i < count; i++)
+    {
+      const GameInputPacket *packet = &worker->inputs[i];
+      if(worker->receive_messages[i].msg_len != sizeof(GameInputPacket)) continue;
+      if(packet->magic != GAME_INPUT_MAGIC) continue;
+
+      take_input(worker, &worker->receive_addresses[i], packet, now);
+    }
+
+    if(count < RECEIVE_BATCH) return;
+  }
+}
+
+static void tick_games(ServerWorker *worker)
+{
+  GameEventList *events = &worker->tick_events;
+  for(int i = 0; i < worker->num_games; i++)
+  {
+    ServerGame *game = &worker->games[i];
+
+    // One change a tick, so each one is held for at least a tick
+    if(game->num_queued)
+    {
+      game->buttons = game->queued_buttons[0];
+      game->applied_sequence = game->queued_sequences[0];
+      game->num_queued--;
+      memmove(game->queued_buttons, game->queued_buttons + 1, sizeof(unsigned) * game->num_queued);
+      memmove(game->queued_sequences, game->queued_sequences + 1, sizeof(uint32_t) * game->num_queued);
+    }
+
+    tick_headless_game(engine_state(worker, i), game->buttons, events);
+    game->tick++;
+
+    // Events are numbered whether anyone watches or not
+    game->event_bytes = 0;
+    game->restarted = false;
+    if(!events->num_events) continue;
+
+    if(game->num_spectators)
+    {
+      game->event_bytes = encode_game_events(events, game->id, game->tick, game->next_event, event_datagram(worker, i));
+    }
+    game->next_event += events->num_events;
+    for(int e = 0; e < events->num_events; e++) game->restarted |= events->events[e].type == GAME_EVENT_RESTART;
+  }
+}
+
+static void fill_state_packet(ServerWorker *worker, int index, GameStatePacket *packet)
+{
+  HeadlessGameView view;
+  view_headless_game(engine_state(worker, index), &view);
+
+  packet->magic = GAME_STATE_MAGIC;
+  packet->tick = view.tick;
+  packet->input_sequence = worker->games[index].applied_sequence;
+  packet->game_id = worker->games[index].id;
+  packet->score = view.score;
+
+  for(int i = 0; i < BOARD_ROWS * BOARD_COLUMNS; i += 2)
+  {
+    packet->cells[i / 2] = (uint8_t)(view.cells[i] | view.cells[i + 1] << 4);
+  }
+
+  packet->falling_type = (int8_t)view.falling_piece.type;
+  packet->falling_rotation = (int8_t)view.falling_piece.rotation;
+  packet->falling_x = (int8_t)view.falling_piece.position.x;
+  packet->falling_y = (int8_t)view.falling_piece.position.y;
+  packet->held_piece = (int8_t)view.held_piece;
+  for(int i = 0; i < 6; i++) packet->next_pieces[i] = (int8_t)view.next_pieces[i];
+  packet->pad = 0;
+}
+
+static void send_states(ServerWorker *worker)
+{
+  for(int first = 0; first < worker->num_games; first += SEND_BATCH)
+  {
+    int count = worker->num_games - first;
+    if(count > SEND_BATCH) count = SEND_BATCH;
+
+    for(int i = 0; i < count; i++)
+    {
+      fill_state_packet(worker, first + i, &worker->outputs[i]);
+      worker->send_messages[i].msg_hdr.msg_name = &worker->games[first + i].address;
+      worker->send_messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+
+    // A full send buffer drops the rest of the batch, the next state replaces
+    // them anyway
+    int sent = sendmmsg(worker->udp_socket, worker->send_messages, count, MSG_DONTWAIT);
+    if(sent < 0) sent = 0;
+    worker->states_sent += sent;
+    worker->states_dropped += count - sent;
+  }
+}
+
+static void end_silent_games(ServerWorker *worker, uint64_t now)
+{
+  uint64_t timeout = (uint64_t)GAME_TIMEOUT_MS * 1000000ull;
+  for(int i = worker->num_games - 1; i >= 0; i--)
+  {
+    if(now - worker->games[i].last_heard > timeout) end_game(worker, i);
+  }
+}
+
+
+
+static void take_spectate(ServerWorker *worker, const sockaddr_in *address, const GameSpectatePacket *packet,
+                          uint64_t now)
+{
+  auto found = worker->spectator_by_address.find(address_key(address));
+  ServerSpectator *spectator = (found != worker->spectator_by_address.end()) ? &worker->spectators[found->second] : 0;
+  if(spectator && spectator->game_id == packet->game_id)
+  {
+    spectator->last_heard = now;
+    return;
+  }
+
+  // Only games that are still going can be watched
+  auto game = worker->game_by_id.find(packet->game_id);
+  if(game == worker->game_by_id.end()) return;
+
+  if(spectator)
+  {
+    // Watching another game now
+    auto old_game = worker->game_by_id.find(spectator->game_id);
+    if(old_game != worker->game_by_id.end()) worker->games[old_game->second].num_spectators--;
+  }
+  else
+  {
+    if(worker->num_spectators == worker->max_spectators) return;
+
+    int index = worker->num_spectators++;
+    spectator = &worker->spectators[index];
+    spectator->address = *address;
+    worker->spectator_by_address[address_key(address)] = index;
+  }
+
+  spectator->game_id = packet->game_id;
+  spectator->last_heard = now;
+  spectator->needs_snapshot = true;
+  worker->games[game->second].num_spectators++;
+}
+
+static void receive_spectates(ServerWorker *worker)
+{
+  for(;;)
+  {
+    int count = recvmmsg(worker->spectator_socket, worker->receive_messages, RECEIVE_BATCH, MSG_DONTWAIT, 0);
+    if(count == -1)
+    {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        fprintf(stderr, "Error receiving spectators: %i\n", errno);
+      }
+      return;
+    }
+
+    uint64_t now = latency_now_ns();
+    worker->packets_received += count;
+    for(int i = 0; i < count; i++)
+    {
+      GameSpectatePacket packet;
+      if(worker->receive_messages[i].msg_len != sizeof(GameSpectatePacket)) continue;
+      memcpy(&packet, &worker->inputs[i], sizeof(packet));
+      if(packet.magic != GAME_SPECTATE_MAGIC) continue;
+
+      take_spectate(worker, &worker->receive_addresses[i], &packet, now);
+    }
+
+    if(count < RECEIVE_BATCH) return;
+  }
+}
+
+static void flush_spectator_datagrams(ServerWorker *worker)
+{
+  int count = worker->num_spectator_datagrams;
+  if(!count) return;
+
+  // Like states, what doesn't fit is dropped. Spectators that miss events
+  // wait for a snapshot.
+  int sent = sendmmsg(worker->spectator_socket, worker->spectator_messages, count, MSG_DONTWAIT);
+  if(sent < 0) sent = 0;
+  for(int i = 0; i < sent; i++) worker->spectator_bytes_sent += worker->spectator_buffers[i].iov_len;
+  worker->spectator_datagrams_sent += sent;
+  worker->spectator_datagrams_dropped += count - sent;
+  worker->num_spectator_datagrams = 0;
+}
+
+static void queue_spectator_datagram(ServerWorker *worker, sockaddr_in *address, void *data, size_t size)
+{
+  int i = worker->num_spectator_datagrams++;
+  worker->spectator_buffers[i].iov_base = data;
+  worker->spectator_buffers[i].iov_len = size;
+  worker->spectator_messages[i].msg_hdr.msg_name = address;
+  worker->spectator_messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+  if(worker->num_spectator_datagrams == SEND_BATCH) flush_spectator_datagrams(worker);
+}
+
+// Built once a tick however many spectators get it
+static void build_snapshot(ServerWorker *worker, int index)
+{
+  ServerGame *game = &worker->games[index];
+  if(game->snapshot_tick == worker->tick) return;
+
+  HeadlessGameView view;
+  view_headless_game(engine_state(worker, index), &view);
+  game->snapshot_bytes = encode_game_snapshot(&view, game->id, game->next_event, &worker->snapshots[index]);
+  game->snapshot_tick = worker->tick;
+}
+
+static void send_spectators(ServerWorker *worker)
+{
+  for(int i = 0; i < worker->num_spectators; i++)
+  {
+    ServerSpectator *spectator = &worker->spectators[i];
+    auto found = worker->game_by_id.find(spectator->game_id);
+    if(found == worker->game_by_id.end()) continue;
+
+    int index = found->second;
+    ServerGame *game = &worker->games[index];
+    if(game->event_bytes)
+    {
+      queue_spectator_datagram(worker, &spectator->address, event_datagram(worker, index), game->event_bytes);
+    }
+
+    // Spread over the ticks so they don't all come at once
+    bool snapshot_due = (worker->tick + game->id) % GAME_SNAPSHOT_INTERVAL == 0;
+    if(spectator->needs_snapshot || game->restarted || snapshot_due)
+    {
+      build_snapshot(worker, index);
+      queue_spectator_datagram(worker, &spectator->address, &worker->snapshots[index], game->snapshot_bytes);
+      spectator->needs_snapshot = false;
+    }
+  }
+
+  flush_spectator_datagrams(worker);
+}
+
+static void end_silent_spectators(ServerWorker *worker, uint64_t now)
+{
+  uint64_t timeout = (uint64_t)GAME_TIMEOUT_MS * 1000000ull;
+  for(int i = worker->num_spectators - 1; i >= 0; i--)
+  {
+    ServerSpectator *spectator = &worker->spectators[i];
+    if(now - spectator->last_heard <= timeout) continue;
+
+    auto game = worker->game_by_id.find(spectator->game_id);
+    if(game != worker->game_by_id.end()) worker->games[game->second].num_spectators--;
+    worker->spectator_by_address.erase(address_key(&spectator->address));
+
+    int last = --worker->num_spectators;
+    if(i != last)
+    {
+      *spectator = worker->spectators[last];
+      worker->spectator_by_address[address_key(&spectator->address)] = i;
+    }
+  }
+}
+
+static void run_ticks(ServerWorker *worker)
+{
+  uint64_t expirations;
+  if(read(worker->tick_timer, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+
+  if(expirations > MAX_CATCH_UP_TICKS)
+  {
+    worker->ticks_dropped += expirations - MAX_CATCH_UP_TICKS;
+    expirations = MAX_CATCH_UP_TICKS;
+  }
+
+  for(uint64_t i = 0; i < expirations; i++)
+  {
+    uint64_t start = latency_now_ns();
+
+    tick_games(worker);
+    worker->tick++;
+    if(worker->tick % GAME_STATE_INTERVAL == 0) send_states(worker);
+    send_spectators(worker);
+
+    uint64_t took = latency_now_ns() - start;
+    worker->ticks_run++;
+    worker->tick_ns += took;
+    if(took > worker->slowest_tick_ns) worker->slowest_tick_ns = took;
+  }
+
+  uint64_t now = latency_now_ns();
+  end_silent_games(worker, now);
+  end_silent_spectators(worker, now);
+}
+
+static void print_stats(ServerWorker *worker, uint64_t now)
+{
+  double seconds = (now - worker->stats_start) * 1e-9;
+  double average_us = worker->ticks_run ? worker->tick_ns * 1e-3 / worker->ticks_run : 0.0;
+  printf("worker %d: %d games (+%llu -%llu, %llu refused), %.0f inputs/s, %.0f states/s (%llu dropped), "
+         "%d spectators %.0f datagrams/s %.0f KB/s (%llu dropped), tick %.0f us avg %.0f us max, %llu ticks dropped\n",
+         worker->index, worker->num_games, (unsigned long long)worker->games_started,
+         (unsigned long long)worker->games_ended, (unsigned long long)worker->games_refused,
+         worker->packets_received / seconds, worker->states_sent / seconds, (unsigned long long)worker->states_dropped,
+         worker->num_spectators, worker->spectator_datagrams_sent / seconds,
+         worker->spectator_bytes_sent / seconds / 1024.0, (unsigned long long)worker->spectator_datagrams_dropped,
+         average_us, worker->slowest_tick_ns * 1e-3, (unsigned long long)worker->ticks_dropped);
+  fflush(stdout);
+
+  worker->stats_start = now;
+  worker->packets_received = 0;
+  worker->states_sent = 0;
+  worker->states_dropped = 0;
+  worker->spectator_datagrams_sent = 0;
+  worker->spectator_datagrams_dropped = 0;
+  worker->spectator_bytes_sent = 0;
+  worker->games_started = 0;
+  worker->games_ended = 0;
+  worker->games_refused = 0;
+  worker->ticks_run = 0;
+  worker->ticks_dropped = 0;
+  worker->tick_ns = 0;
+  worker->slowest_tick_ns = 0;
+}
+
+
+
+// Holds std::unordered_maps, so this one is new'd rather than malloc'd
+static ServerWorker *create_worker(int index, int port, int spectator_port, int max_games, int max_spectators)
+{
+  ServerWorker *worker = new ServerWorker();
+  worker->index = index;
+  worker->max_games = max_games;
+  worker->games = (ServerGame *)malloc(sizeof(ServerGame) * max_games);
+  worker->state_size = headless_game_size();
+  worker->states = (unsigned char *)malloc(worker->state_size * max_games);
+  worker->game_by_address.reserve(max_games);
+  worker->game_by_id.reserve(max_games);
+  worker->event_datagrams = (uint8_t *)malloc(MAX_GAME_EVENTS_DATAGRAM * max_games);
+  worker->snapshots = (GameSnapshotPacket *)malloc(sizeof(GameSnapshotPacket) * max_games);
+  worker->max_spectators = max_spectators;
+  worker->spectators = (ServerSpectator *)malloc(sizeof(ServerSpectator) * max_spectators);
+  worker->spectator_by_address.reserve(max_spectators);
+  worker->next_seed = latency_now_ns() ^ (uint64_t)index << 48;
+  worker->next_game_serial = 1; // No game is 0
+
+  for(int i = 0; i < RECEIVE_BATCH; i++)
+  {
+    worker->receive_buffers[i].iov_base = &worker->inputs[i];
+    worker->receive_buffers[i].iov_len = sizeof(GameInputPacket);
+    worker->receive_messages[i].msg_hdr.msg_iov = &worker->receive_buffers[i];
+    worker->receive_messages[i].msg_hdr.msg_iovlen = 1;
+    worker->receive_messages[i].msg_hdr.msg_name = &worker->receive_addresses[i];
+    worker->receive_messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+  }
+
+  for(int i = 0; i < SEND_BATCH; i++)
+  {
+    worker->send_buffers[i].iov_base = &worker->outputs[i];
+    worker->send_buffers[i].iov_len = sizeof(GameStatePacket);
+    worker->send_messages[i].msg_hdr.msg_iov = &worker->send_buffers[i];
+    worker->send_messages[i].msg_hdr.msg_iovlen = 1;
+
+    worker->spectator_messages[i].msg_hdr.msg_iov = &worker->spectator_buffers[i];
+    worker->spectator_messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  worker->udp_socket = create_server_socket(port);
+  worker->spectator_socket = create_server_socket(spectator_port + index);
+  worker->tick_timer = create_tick_timer();
+  worker->epoll = epoll_create1(0);
+  if(worker->udp_socket == -1 || worker->spectator_socket == -1 || worker->tick_timer == -1 || worker->epoll == -1)
+  {
+    return worker;
+  }
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = worker->udp_socket;
+  epoll_ctl(worker->epoll, EPOLL_CTL_ADD, worker->udp_socket, &event);
+  event.data.fd = worker->spectator_socket;
+  epoll_ctl(worker->epoll, EPOLL_CTL_ADD, worker->spectator_socket, &event);
+  event.data.fd = worker->tick_timer;
+  epoll_ctl(worker->epoll, EPOLL_CTL_ADD, worker->tick_timer, &event);
+
+  return worker;
+}
+
+static void destroy_worker(ServerWorker *worker)
+{
+  if(worker->epoll != -1) close(worker->epoll);
+  if(worker->tick_timer != -1) close(worker->tick_timer);
+  if(worker->spectator_socket != -1) close(worker->spectator_socket);
+  if(worker->udp_socket != -1) close(worker->udp_socket);
+  free(worker->games);
+  free(worker->states);
+  free(worker->event_datagrams);
+  free(worker->snapshots);
+  free(worker->spectators);
+  delete worker;
+}
+
+static void pin_to_core(int core)
+{
+  cpu_set_t cores;
+  CPU_ZERO(&cores);
+  CPU_SET(core, &cores);
+  if(sched_setaffinity(0, sizeof(cores), &cores) == -1) fprintf(stderr, "Error pinning to core %i: %i\n", core, errno);
+}
+
+// Returns once the server is stopped, 1 if the worker couldn't start
+static int run_worker(int index, int port, int spectator_port, int max_games, int max_spectators)
+{
+  pin_to_core(index % (int)std::thread::hardware_concurrency());
+
+  ServerWorker *worker = create_worker(index, port, spectator_port, max_games, max_spectators);
+  if(worker->udp_socket == -1 || worker->spectator_socket == -1 || worker->tick_timer == -1 || worker->epoll == -1)
+  {
+    destroy_worker(worker);
+    return 1;
+  }
+
+  worker->stats_start = latency_now_ns();
+  uint64_t stats_interval = (uint64_t)(STATS_INTERVAL_MS * 1e6);
+
+  while(server_running)
+  {
+    epoll_event events[3];
+    int count = epoll_wait(worker->epoll, events, 3, -1);
+    if(count == -1)
+    {
+      if(errno != EINTR) fprintf(stderr, "Error waiting for events: %i\n", errno);
+      continue;
+    }
+
+    // Input first, so it makes the tick that's due along with it
+    for(int i = 0; i < count; i++)
+    {
+      if(events[i].data.fd == worker->udp_socket) receive_inputs(worker);
+      if(events[i].data.fd == worker->spectator_socket) receive_spectates(worker);
+    }
+    for(int i = 0; i < count; i++)
+    {
+      if(events[i].data.fd == worker->tick_timer) run_ticks(worker);
+    }
+
+    uint64_t now = latency_now_ns();
+    if(now - worker->stats_start >= stats_interval) print_stats(worker, now);
+  }
+
+  print_stats(worker, latency_now_ns());
+  destroy_worker(worker);
+  return 0;
+}
+
+
+
+int main(int argc, char **argv)
+{
+  int port = GAME_SERVER_PORT;
+  int spectator_port = GAME_SPECTATOR_PORT;
+  int num_workers = (int)std::thread::hardware_concurrency();
+  int max_games = 4096;
+  int max_spectators = 16384;
+
+  int option;
+  while((option = getopt(argc, argv, "p:s:j:g:v:")) != -1)
+  {
+    switch(option)
+    {
+      case 'p': { port = atoi(optarg); break; }
+      case 's': { spectator_port = atoi(optarg); break; }
+      case 'j': { num_workers = atoi(optarg); break; }
+      case 'g': { max_games = atoi(optarg); break; }
+      case 'v': { max_spectators = atoi(optarg); break; }
+      default:
+      {
+        fprintf(stderr, "Usage: %s [-p port] [-s spectator port] [-j workers] [-g max games per worker] "
+                        "[-v max spectators per worker]\n", argv[0]);
+        return 1;
+      }
+    }
+  }
+  if(num_workers < 1) num_workers = 1;
+  if(max_games < 1) max_games = 1;
+  if(max_spectators < 1) max_spectators = 1;
+
+  install_signal_handlers();
+
+  // Before forking so the workers share the finesse table
+  init_tetris();
+
+  printf("Serving games on port %i, spectators on %i up, %i workers of up to %i games\n", port, spectator_port,
+         num_workers, max_games);
+  fflush(stdout);
+
+  // The parent is worker 0, and stops the others when it stops
+  pid_t workers[256];
+  int num_children = 0;
+  for(int i = 1; i < num_workers && num_children < 256; i++)
+  {
+    pid_t pid = fork();
+    if(pid == 0) return run_worker(i, port, spectator_port, max_games, max_spectators);
+    if(pid > 0) workers[num_children++] = pid;
+  }
+
+  int result = run_worker(0, port, spectator_port, max_games, max_spectators);
+
+  for(int i = 0; i < num_children; i++) kill(workers[i], SIGTERM);
+  for(int i = 0; i < num_children; i++)
+  {
+    int status;
+    waitpid(workers[i], &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status)) result = 1;
+  }
+
+  return result;
+}
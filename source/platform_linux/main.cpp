@@ -1,13 +1,18 @@
 
 
 #include "renderer.h"
-//#include "network_client.h"
+#include "network_client.h"
 #include "input.h"
 #include "game_timer.h"
 #include "tetris.h"
+#include "bot.h"
+#include "remote_input.h"
 
 #include <stdio.h>
+#include <stdlib.h> // atoi, atof
+#include <string.h> // strchr
 #include <time.h>
+#include <unistd.h> // getopt
 
 
 static float dt = 0.0f;
@@ -20,13 +25,86 @@ float get_dt()
 
 int main(int argc, char* argv[])
 {
+    // tetris.exe [-a] [-b beam width] [-d depth] [-t ms per decision] [-f us per tick] [-r record to] [-p play back]
+    //            [-s seconds in] [-k remote input port] [-w ip address:port]... [ip address] [port]
+    //   -a lets the bot play, -b -d -t -f tune it, -r records the session, -p plays one back and -s starts it
+    //   that far in, -k takes input from remote_keys.exe as well as the keyboard, -w streams to another panel
+    //   of the same wall
+    bool autoplay = false;
+    const char *wall_panels[8];
+    int num_wall_panels = 0;
+    int remote_input_port = 0;
+    const char *record_path = 0;
+    const char *replay_path = 0;
+    float replay_start = 0.0f;
+    BotSettings bot_settings = default_bot_settings();
+    int option;
+    while((option = getopt(argc, argv, "ab:d:t:f:r:p:s:k:w:")) != -1)
+    {
+        switch(option)
+        {
+            case 'a': { autoplay = true; break; }
+            case 'b': { bot_settings.beam_width = atoi(optarg); break; }
+            case 'd': { bot_settings.depth = atoi(optarg); break; }
+            case 't': { bot_settings.time_budget = (float)atof(optarg); break; }
+            case 'f': { bot_settings.frame_budget = (float)atof(optarg); break; }
+            case 'r': { record_path = optarg; break; }
+            case 'p': { replay_path = optarg; break; }
+            case 's': { replay_start = (float)atof(optarg); break; }
+            case 'k': { remote_input_port = atoi(optarg); break; }
+            case 'w': { if(num_wall_panels < 8) wall_panels[num_wall_panels++] = optarg; break; }
+            default:
+            {
+                fprintf(stderr, "Usage: %s [-a] [-b beam width] [-d depth] [-t ms per decision] [-f us per tick] [-r record to] [-p play back] [-s seconds in] [-k remote input port] [-w ip address:port]... [ip address] [port]\n", argv[0]);
+                return 1;
+            }
+        }
+    }
+
     init_graphics();
 
+    // Stream to the LEDs only when given somewhere to stream to
+    if(optind < argc)
+    {
+        int port = (optind + 1 < argc) ? atoi(argv[optind + 1]) : 4242;
+        init_network_client(argv[optind], port, 16, 16);
+
+        for(int i = 0; i < num_wall_panels; i++)
+        {
+            char address[64];
+            snprintf(address, sizeof(address), "%s", wall_panels[i]);
+            char *colon = strchr(address, ':');
+            int panel_port = 4242;
+            if(colon)
+            {
+                *colon = 0;
+                panel_port = atoi(colon + 1);
+            }
+            network_add_receiver(address, panel_port);
+        }
+    }
+
     init_tetris();
+    if(autoplay) set_autoplay(&bot_settings);
+
+    RemoteInput *remote_input = remote_input_port ? create_remote_input(remote_input_port) : 0;
+    if(remote_input_port && !remote_input) return 1;
+
+    if(replay_path && !start_replay(replay_path))
+    {
+        fprintf(stderr, "Couldn't play back %s\n", replay_path);
+        return 1;
+    }
+    if(replay_path && replay_start > 0.0f) seek_replay((uint32_t)(replay_start * 1000.0f / TICK_TIME));
+    if(record_path && !start_recording(record_path))
+    {
+        fprintf(stderr, "Couldn't record to %s\n", record_path);
+        return 1;
+    }
 
     bool game_running = true;
-    timespec t0 = {0};
-    timespec t1 = {0};
+    timespec t0 = {};
+    timespec t1 = {};
     while(game_running)
     {
         platform_events();
@@ -43,11 +121,23 @@ int main(int argc, char* argv[])
         dt = diff_in_millis;
         t0 = t1;
 
+        if(remote_input) poll_remote_input(remote_input);
         update_tetris();
 
         render();
+
+        // The sender thread paces the actual sends
+        publish_network_frame();
     }
 
+    stop_recording();
+    if(remote_input) destroy_remote_input(remote_input);
+
+    FinesseStats finesse = finesse_stats();
+    printf("Finesse: %u of %u pieces took extra presses, %u in total\n", finesse.faults, finesse.pieces,
+           finesse.extra_presses);
+
+    shutdown_network_client();
     shutdown_graphics();
 }
 
@@ -1,56 +1,90 @@
-
 #include "network_client.h"
+#include "../frame_queue.h"
+#include "../led_protocol.h"
 
-#include <WinSock2.h> // Networking API
-#include <Ws2tcpip.h> // InetPton
+#include <sys/socket.h> // Networking API, sendmmsg
+#include <netinet/in.h>
+#include <arpa/inet.h>  // inet_pton
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <unistd.h>     // close, read
 
+#include <errno.h>
 #include <cstdio>
+#include <thread>
+
+// Panels of one wall, all sent the same frames
+static const int MAX_RECEIVERS = 8;
 
 struct NetworkData
 {
-  SOCKET udp_socket;
-  sockaddr_in address;
+  int udp_socket;
+
+  // Only ever added to, the sender thread picks up new ones through the count
+  sockaddr_in receivers[MAX_RECEIVERS];
+  std::atomic<int> num_receivers;
 
   unsigned grid_width;
   unsigned grid_height;
-  unsigned *grid;
+
+  // Frames go from the game thread to the sender thread through here. Each
+  // slot is a whole frame, LedFrameHeader then the LEDs.
+  FrameQueue frames;
+  uint32_t next_frame_id;
+
+  // A datagram per fragment of a frame, each its header and a slice of the
+  // frame straight out of its queue slot. Only the sender thread touches
+  // these, and shutdown once it's gone.
+  unsigned num_fragments;
+  LedFragmentHeader fragment_headers[LED_MAX_FRAGMENTS];
+  iovec fragment_buffers[LED_MAX_FRAGMENTS][2];
+  mmsghdr fragment_messages[LED_MAX_FRAGMENTS];
+
+  // The sender only sends the newest frame, so a key press stays stamped on
+  // every frame until one of them actually goes out
+  uint64_t pending_input_time;
+  uint64_t pending_tick_time;
+  uint32_t pending_frame_id;
+  std::atomic<uint32_t> sent_through_frame_id; // Last sent id + 1
+
+  std::thread sender_thread;
+  std::atomic<bool> sender_running;
+  int send_timer;
 };
 
 static NetworkData *network_data;
 static const unsigned MAX_BRIGHTNESS_VALUE = 10;
 
+// In ms
+static const float NETWORK_FREQUENCY = 33.33f;
 
+// How long after sending a frame the panels show it, in ms. Has to cover the
+// slowest panel getting and decoding it, and how far off its clock might be.
+static const float PRESENT_DELAY = 10.0f;
 
 
 
-static void init_winsock()
+static LedFrameHeader *frame_header(unsigned char *frame)
 {
-  // Initialize Winsock
-  WSADATA wsa_data;
-  int error = WSAStartup(MAKEWORD(2, 2), &wsa_data);
-  if(error) fprintf(stderr, "Error loading networking module: %i\n", WSAGetLastError());
+  return (LedFrameHeader *)frame;
 }
 
-static void shutdown_winsock()
+static unsigned *frame_leds(unsigned char *frame)
 {
-  // Shut down Winsock
-  int error = WSACleanup();
-  if(error == -1)
-  {
-    error = WSAGetLastError();
-    fprintf(stderr, "Error unloading networking module: %i\n", error);
-    return;
-  }
+  return (unsigned *)(frame + sizeof(LedFrameHeader));
 }
 
-static SOCKET create_udp_socket()
+
+
+
+
+static int create_udp_socket()
 {
   // Create a socket
-  SOCKET udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
-  if(udp_socket == INVALID_SOCKET)
+  int udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if(udp_socket == -1)
   {
-    int error = WSAGetLastError();
-    fprintf(stderr, "Error opening socket: %i\n", error);
+    fprintf(stderr, "Error opening socket: %i\n", errno);
   }
 
   return udp_socket;
@@ -59,36 +93,197 @@ static SOCKET create_udp_socket()
 void make_address(const char *ip_address_string, int port_number, sockaddr_in *out_address)
 {
   // Create a remote address
+  memset(out_address, 0, sizeof(*out_address));
   out_address->sin_family = AF_INET;
   out_address->sin_port = htons(port_number);
-  int error = InetPton(AF_INET, ip_address_string, &(out_address->sin_addr));
-  if((error != 0) && (error != 1))
+  int error = inet_pton(AF_INET, ip_address_string, &(out_address->sin_addr));
+  if(error != 1)
   {
-    error = WSAGetLastError();
-    fprintf(stderr, "Error creating an address: %i\n", error);
+    fprintf(stderr, "Error creating an address: %s\n", ip_address_string);
   }
 }
 
-void send_data(SOCKET socket, const void *data, unsigned bytes, const sockaddr_in *address)
+void send_data(int socket, const void *data, unsigned bytes, const sockaddr_in *address)
 {
   // Send data over UDP
   int bytes_queued;
   bytes_queued = sendto(socket, (const char *)data, bytes, 0, (const sockaddr *)(address), sizeof(*address));
   if(bytes_queued == -1)
   {
-    int error = WSAGetLastError();
-    fprintf(stderr, "Error sending data: %i\n", error);
+    fprintf(stderr, "Error sending data: %i\n", errno);
   }
 }
 
-void close_socket(SOCKET socket)
+void close_socket(int socket)
 {
   // Close the socket
-  int error = closesocket(socket);
+  int error = close(socket);
   if(error == -1)
   {
-    error = WSAGetLastError();
-    fprintf(stderr, "Error closing socket: %i\n", error);
+    fprintf(stderr, "Error closing socket: %i\n", errno);
+  }
+}
+
+static int create_send_timer()
+{
+  int timer = timerfd_create(CLOCK_MONOTONIC, 0);
+  if(timer == -1)
+  {
+    fprintf(stderr, "Error creating send timer: %i\n", errno);
+    return timer;
+  }
+
+  long interval_nanos = (long)(NETWORK_FREQUENCY * 1e6);
+  itimerspec spec = {};
+  spec.it_interval.tv_sec = interval_nanos / (long)1e9;
+  spec.it_interval.tv_nsec = interval_nanos % (long)1e9;
+  spec.it_value = spec.it_interval;
+  if(timerfd_settime(timer, 0, &spec, 0) == -1)
+  {
+    fprintf(stderr, "Error arming send timer: %i\n", errno);
+    close(timer);
+    return -1;
+  }
+
+  return timer;
+}
+
+static void init_fragments(unsigned frame_bytes)
+{
+  unsigned count = (frame_bytes + LED_FRAGMENT_BYTES - 1) / LED_FRAGMENT_BYTES;
+  network_data->num_fragments = count;
+
+  for(unsigned i = 0; i < count; i++)
+  {
+    LedFragmentHeader *header = &network_data->fragment_headers[i];
+    header->magic = LED_FRAGMENT_MAGIC;
+    header->frame_id = 0;
+    header->index = i;
+    header->count = count;
+    header->frame_bytes = frame_bytes;
+
+    unsigned start = i * LED_FRAGMENT_BYTES;
+    iovec *buffers = network_data->fragment_buffers[i];
+    buffers[0].iov_base = header;
+    buffers[0].iov_len = sizeof(LedFragmentHeader);
+    buffers[1].iov_base = 0;
+    buffers[1].iov_len = (frame_bytes - start < LED_FRAGMENT_BYTES) ? frame_bytes - start : LED_FRAGMENT_BYTES;
+
+    memset(&network_data->fragment_messages[i], 0, sizeof(mmsghdr));
+    msghdr *message = &network_data->fragment_messages[i].msg_hdr;
+    message->msg_namelen = sizeof(sockaddr_in);
+    message->msg_iov = buffers;
+    message->msg_iovlen = 2;
+  }
+}
+
+// Sends every receiver the frame in fragments, gathered by the kernel from the
+// fragment headers and the frame where it is
+static void send_frame(unsigned char *frame)
+{
+  unsigned count = network_data->num_fragments;
+  for(unsigned i = 0; i < count; i++)
+  {
+    network_data->fragment_headers[i].frame_id = frame_header(frame)->frame_id;
+    network_data->fragment_buffers[i][1].iov_base = frame + i * LED_FRAGMENT_BYTES;
+  }
+
+  int num_receivers = network_data->num_receivers.load(std::memory_order_acquire);
+  for(int r = 0; r < num_receivers; r++)
+  {
+    for(unsigned i = 0; i < count; i++)
+    {
+      network_data->fragment_messages[i].msg_hdr.msg_name = &(network_data->receivers[r]);
+    }
+
+    unsigned sent = 0;
+    while(sent < count)
+    {
+      int result = sendmmsg(network_data->udp_socket, network_data->fragment_messages + sent, count - sent, 0);
+      if(result == -1)
+      {
+        if(errno == EINTR) continue;
+        fprintf(stderr, "Error sending frame: %i\n", errno);
+        break;
+      }
+      sent += result;
+    }
+  }
+}
+
+// Receivers ask what time it is here to line their clocks up with this one,
+// see led_protocol.h. Answered from the sender thread so the answer doesn't
+// wait on a game frame.
+static void answer_clock_requests()
+{
+  for(;;)
+  {
+    LedClockPacket packet;
+    sockaddr_in from;
+    socklen_t from_size = sizeof(from);
+    ssize_t size = recvfrom(network_data->udp_socket, &packet, sizeof(packet), MSG_DONTWAIT, (sockaddr *)&from, &from_size);
+    uint64_t received = latency_now_ns();
+    if(size == -1)
+    {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        fprintf(stderr, "Error receiving clock requests: %i\n", errno);
+      }
+      return;
+    }
+
+    if(size != sizeof(packet) || packet.magic != LED_CLOCK_MAGIC) continue;
+
+    packet.received_ns = received;
+    packet.answered_ns = latency_now_ns();
+    send_data(network_data->udp_socket, &packet, sizeof(packet), &from);
+  }
+}
+
+// Runs on its own thread so a slow network stack never stalls the game
+static void sender_loop()
+{
+  uint64_t present_delay = (uint64_t)(PRESENT_DELAY * 1e6);
+
+  pollfd descriptors[2] = {};
+  descriptors[0].fd = network_data->send_timer;
+  descriptors[0].events = POLLIN;
+  descriptors[1].fd = network_data->udp_socket;
+  descriptors[1].events = POLLIN;
+
+  while(network_data->sender_running.load(std::memory_order_acquire))
+  {
+    if(poll(descriptors, 2, -1) == -1)
+    {
+      if(errno != EINTR) fprintf(stderr, "Error waiting on send timer: %i\n", errno);
+      continue;
+    }
+
+    if(descriptors[1].revents & POLLIN) answer_clock_requests();
+    if(!(descriptors[0].revents & POLLIN)) continue;
+
+    // The count is how many send ticks passed, missed ticks are not made up
+    // for
+    uint64_t expirations;
+    int bytes_read = read(network_data->send_timer, &expirations, sizeof(expirations));
+    if(bytes_read != sizeof(expirations))
+    {
+      if(errno != EINTR) fprintf(stderr, "Error waiting on send timer: %i\n", errno);
+      continue;
+    }
+
+    unsigned index;
+    unsigned char *frame = frame_queue_read_latest(&network_data->frames, &index);
+    if(!frame) continue;
+
+    // Every panel gets the same frame, to show at the same moment
+    LedFrameHeader *header = frame_header(frame);
+    header->stamps[LATENCY_SEND] = latency_now_ns();
+    header->present_ns = header->stamps[LATENCY_SEND] + present_delay;
+    send_frame(frame);
+    network_data->sent_through_frame_id.store(frame_header(frame)->frame_id + 1, std::memory_order_release);
+
+    frame_queue_release(&network_data->frames, index);
   }
 }
 
@@ -99,45 +294,126 @@ void close_socket(SOCKET socket)
 
 void init_network_client(const char *ip_address, int port, unsigned width, unsigned height)
 {
-  init_winsock();
+  unsigned bytes = sizeof(LedFrameHeader) + sizeof(unsigned) * width * height;
+  if(bytes > LED_MAX_FRAGMENTS * LED_FRAGMENT_BYTES)
+  {
+    fprintf(stderr, "Can't stream %ux%u LEDs, frames can only be %u bytes\n", width, height,
+            LED_MAX_FRAGMENTS * LED_FRAGMENT_BYTES);
+    return;
+  }
 
-  network_data = (NetworkData *)malloc(sizeof(NetworkData));
+  // Without a timer the sender would wait forever and never let shutdown join
+  // it, so nothing gets streamed at all
+  int send_timer = create_send_timer();
+  if(send_timer == -1)
+  {
+    fprintf(stderr, "Not streaming LED frames, no send timer\n");
+    return;
+  }
+
+  // Owns a thread and atomics, so this one is new'd rather than malloc'd
+  network_data = new NetworkData;
   network_data->grid_width = width;
   network_data->grid_height = height;
 
-  int bytes = sizeof(unsigned) * network_data->grid_width * network_data->grid_height; 
-  network_data->grid =(unsigned *)malloc(bytes);
-
-  memset(network_data->grid, 0, bytes);
+  init_frame_queue(&network_data->frames, bytes);
+  init_fragments(bytes);
+  network_data->next_frame_id = 0;
+  network_data->pending_input_time = 0;
+  network_data->sent_through_frame_id.store(0);
 
   network_data->udp_socket = create_udp_socket();
-  make_address(ip_address, port, &(network_data->address));
+  network_data->num_receivers.store(0);
+  network_add_receiver(ip_address, port);
+
+  network_data->send_timer = send_timer;
+  network_data->sender_running.store(true);
+  network_data->sender_thread = std::thread(sender_loop);
+}
+
+void network_add_receiver(const char *ip_address, int port)
+{
+  if(!network_data) return;
+
+  int count = network_data->num_receivers.load(std::memory_order_relaxed);
+  if(count == MAX_RECEIVERS)
+  {
+    fprintf(stderr, "Can only stream to %i receivers, not adding %s\n", MAX_RECEIVERS, ip_address);
+    return;
+  }
+
+  make_address(ip_address, port, &(network_data->receivers[count]));
+  network_data->num_receivers.store(count + 1, std::memory_order_release);
 }
 
-void send_network_data()
+void publish_network_frame()
 {
-  int bytes = sizeof(unsigned) * network_data->grid_width * network_data->grid_height;
-  send_data(network_data->udp_socket,
-            network_data->grid,
-            bytes,
-            &(network_data->address));
+  if(!network_data) return;
+
+  LedFrameHeader *header = frame_header(frame_queue_write_slot(&network_data->frames));
+  header->magic = LED_FRAME_MAGIC;
+  header->frame_id = network_data->next_frame_id++;
+  header->width = network_data->grid_width;
+  header->height = network_data->grid_height;
+  header->stamps[LATENCY_SNAPSHOT] = latency_now_ns();
 
-  memset(network_data->grid, 0, bytes);
+  frame_queue_publish(&network_data->frames);
+}
+
+void network_set_frame_timing(uint64_t input_time, uint64_t tick_time)
+{
+  if(!network_data) return;
+
+  if(network_data->pending_input_time)
+  {
+    uint32_t sent_through = network_data->sent_through_frame_id.load(std::memory_order_acquire);
+    if(sent_through > network_data->pending_frame_id) network_data->pending_input_time = 0;
+  }
+
+  if(!network_data->pending_input_time && input_time)
+  {
+    network_data->pending_input_time = input_time;
+    network_data->pending_tick_time = tick_time;
+    network_data->pending_frame_id = network_data->next_frame_id;
+  }
+
+  LedFrameHeader *header = frame_header(frame_queue_write_slot(&network_data->frames));
+  if(network_data->pending_input_time)
+  {
+    header->stamps[LATENCY_INPUT] = network_data->pending_input_time;
+    header->stamps[LATENCY_TICK] = network_data->pending_tick_time;
+  }
+  else
+  {
+    header->stamps[LATENCY_TICK] = tick_time;
+  }
 }
 
 void shutdown_network_client()
 {
-  // Send empty frame
-  int bytes = sizeof(unsigned) * network_data->grid_width * network_data->grid_height;
-  memset(network_data->grid, 0, bytes);
-  send_network_data();
+  if(!network_data) return;
+
+  // The sender notices on its next tick
+  network_data->sender_running.store(false, std::memory_order_release);
+  network_data->sender_thread.join();
 
+  // Send empty frame
+  unsigned bytes = network_data->frames.frame_bytes;
+  unsigned char *frame = frame_queue_write_slot(&network_data->frames);
+  memset(frame, 0, bytes);
+  frame_header(frame)->magic = LED_FRAME_MAGIC;
+  frame_header(frame)->frame_id = network_data->next_frame_id++;
+  frame_header(frame)->width = network_data->grid_width;
+  frame_header(frame)->height = network_data->grid_height;
+  send_frame(frame);
 
-  free(network_data->grid);
-  free(network_data);
 
+  close_socket(network_data->send_timer);
   close_socket(network_data->udp_socket);
-  shutdown_winsock();
+
+  shutdown_frame_queue(&network_data->frames);
+  delete network_data;
+  network_data = 0;
 }
 
 
@@ -145,13 +421,11 @@ void shutdown_network_client()
 
 void network_add_cell(v2i position, Color color)
 {
-  if(position.x < 0) return;
-  if(position.y < 0) return;
-  if(position.x >= network_data->grid_width)  return;
-  if(position.y >= network_data->grid_height) return;
-
-  if(position.y % 2 == 1) position.x = (network_data->grid_width - 1) - position.x;
+  if(!network_data) return;
 
+  // Frames go out in board order, the receivers know their own wiring
+  if((unsigned)position.x >= network_data->grid_width)  return;
+  if((unsigned)position.y >= network_data->grid_height) return;
 
   float alpha = color.a;
   unsigned r = MAX_BRIGHTNESS_VALUE * color.r * alpha;
@@ -160,7 +434,8 @@ void network_add_cell(v2i position, Color color)
   unsigned value = (b << 16) | (g << 8) | (r << 0);
 
 
-  (network_data->grid)[position.y * network_data->grid_width + position.x] = value;
+  unsigned *grid = frame_leds(frame_queue_write_slot(&network_data->frames));
+  grid[position.y * network_data->grid_width + position.x] = value;
 }
 
 void network_add_cell_in_left_bar(v2i position, Color color)
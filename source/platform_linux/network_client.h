@@ -3,12 +3,22 @@
 #include "../game_presentation.h"
 #include "../my_math.h"
 
+#include <stdint.h>
+
 void init_network_client(const char *ip_address, int port, unsigned width, unsigned height);
 
-void send_network_data();
+// Another panel of the same wall. Every receiver gets every frame and they all
+// show it at the same moment, see led_protocol.h.
+void network_add_receiver(const char *ip_address, int port);
+
+// Hands the frame drawn since the last call to the sender thread
+void publish_network_frame();
 
 void shutdown_network_client();
 
 void network_add_cell(v2i position, Color color);
 void network_add_cell_in_left_bar(v2i position, Color color);
 void network_add_cell_in_right_bar(v2i position, Color color);
+
+// Latency stamps for the frame being drawn, see latency.h
+void network_set_frame_timing(uint64_t input_time, uint64_t tick_time);
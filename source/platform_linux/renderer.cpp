@@ -7,6 +7,7 @@
 
 #include "renderer.h"
 #include "input.h"
+#include "latency.h"
 
 #include <stdio.h>  // printf
 #include <string.h> // string operations
@@ -59,6 +60,7 @@ struct Graphics
 
     bool keys_down[256];
     bool prev_keys_down[256];
+    uint64_t last_key_press;
 
     std::vector<CellData> cells_to_render;
     std::vector<CellData> left_bar_cells_to_render;
@@ -712,6 +714,7 @@ void platform_events()
                 }
                 //printf("Keycode: %d\n", e->keycode);
                 graphics->keys_down[e->keycode] = true;
+                graphics->last_key_press = latency_now_ns();
 #if 0
                 int symbol = 0;
                 Status status = 0;
@@ -892,4 +895,9 @@ bool button_state(unsigned char key)
     return graphics->keys_down[code];
 }
 
+uint64_t last_key_press_time()
+{
+    return graphics->last_key_press;
+}
+
 
@@ -0,0 +1,40 @@
+#include "led_library.h"
+
+#include <dlfcn.h>
+#include <stdlib.h> // getenv
+#include <cstdio>
+
+bool load_led_library(LedLibrary *library, const char *path)
+{
+  // Lets a stand-in driver (mock_led_renderer.so) replace the real one
+  const char *override_path = getenv("LED_RENDERER");
+  if(override_path) path = override_path;
+
+  library->handle = dlopen(path, RTLD_LAZY);
+  if(!library->handle)
+  {
+    fprintf(stderr, "Could not load led renderer dll: %s\n", dlerror());
+    return false;
+  }
+
+  library->init_led = (init_led_fn)dlsym(library->handle, "init_led");
+  library->render_to_led = (render_to_led_fn)dlsym(library->handle, "render_to_led");
+  library->clear_led = (clear_led_fn)dlsym(library->handle, "clear_led");
+  library->shutdown_led = (shutdown_led_fn)dlsym(library->handle, "shutdown_led");
+
+  if(!library->init_led || !library->render_to_led || !library->clear_led || !library->shutdown_led)
+  {
+    fprintf(stderr, "Led renderer dll is missing symbols\n");
+    dlclose(library->handle);
+    library->handle = 0;
+    return false;
+  }
+
+  return true;
+}
+
+void unload_led_library(LedLibrary *library)
+{
+  if(library->handle) dlclose(library->handle);
+  library->handle = 0;
+}
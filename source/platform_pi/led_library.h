@@ -0,0 +1,24 @@
+#pragma once
+
+// Interface of the LED strip driver library (led_renderer.dll), loaded at
+// runtime so the game and the receiver can share one driver build.
+
+typedef void (*init_led_fn)(int num_leds, unsigned **strip_buffer);
+typedef void (*render_to_led_fn)();
+typedef void (*clear_led_fn)();
+typedef void (*shutdown_led_fn)();
+
+struct LedLibrary
+{
+  void *handle;
+
+  init_led_fn init_led;
+  render_to_led_fn render_to_led;
+  clear_led_fn clear_led;
+  shutdown_led_fn shutdown_led;
+};
+
+// Returns false if the library or any of its symbols could not be found.
+// The LED_RENDERER environment variable overrides path.
+bool load_led_library(LedLibrary *library, const char *path);
+void unload_led_library(LedLibrary *library);
@@ -3,6 +3,10 @@
 
 #include "../input.h"
 #include "../tetris.h"
+#include "../latency.h"
+#include "../bot.h"
+#include "../remote_input.h"
+#include "../input_protocol.h"
 
 #include "stdlib.h" // malloc
 
@@ -11,6 +15,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <linux/input.h>
 #define BITS_PER_LONG (sizeof(long) * 8)
 #define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
@@ -25,8 +30,12 @@ struct PlatformState
 {
   bool game_running = false;
 
-  int keyboard_file;
+  int keyboard_file; // -1 without a keyboard
   bool keys_down[MAX_KEYS];
+  uint64_t last_key_press;
+
+  // Played from another machine when set
+  RemoteInput *remote_input;
 
   std::chrono::high_resolution_clock::time_point last_time;
   float dt = 0.0f;
@@ -38,6 +47,8 @@ PlatformState *state;
 // Input implementation
 void init_input()
 {
+  state->keyboard_file = -1;
+
   int keyboard_file;
   int version;
   unsigned short id[4];
@@ -67,6 +78,10 @@ void init_input()
   memset(bit, 0, sizeof(bit));
   ioctl(keyboard_file, EVIOCGBIT(0, EV_MAX), bit[0]);
 
+  // Have the kernel stamp events on the same clock as latency_now_ns()
+  int clock_id = CLOCK_MONOTONIC;
+  ioctl(keyboard_file, EVIOCSCLOCKID, &clock_id);
+
 
   // Set non blocking
   int flags = fcntl(keyboard_file, F_GETFL, 0) | O_NONBLOCK;
@@ -114,6 +129,8 @@ bool button_state(unsigned char key)
 
 static void read_input()
 {
+  if(state->keyboard_file == -1) return;
+
   struct input_event read_input_event[64];
   int bytes_read = read(state->keyboard_file, read_input_event, sizeof(struct input_event) * 64);
 
@@ -149,6 +166,9 @@ static void read_input()
           
           // TODO: I don't really know how this works. Maybe this is wrong?
           state->keys_down[read_input_event[i].code] = true;
+
+          timeval event_time = read_input_event[i].time;
+          state->last_key_press = (uint64_t)event_time.tv_sec * 1000000000ull + (uint64_t)event_time.tv_usec * 1000ull;
         }
         else if(read_input_event[i].value == 0)
         {
@@ -164,9 +184,16 @@ static void read_input()
     }
   }
 }
+uint64_t last_key_press_time()
+{
+  uint64_t remote_press = state->remote_input ? remote_key_press_time(state->remote_input) : 0;
+  return (remote_press > state->last_key_press) ? remote_press : state->last_key_press;
+}
+
 void shutdown_input()
 {
-  close(state->keyboard_file);
+  if(state->remote_input) destroy_remote_input(state->remote_input);
+  if(state->keyboard_file != -1) close(state->keyboard_file);
 }
 
 
@@ -187,18 +214,43 @@ float get_dt()
 int main(int argc, char **argv)
 {
   state = (PlatformState *)malloc(sizeof(PlatformState));
+  memset(state, 0, sizeof(PlatformState));
 
   // Initializtion
   init_input();
   init_renderer();
   init_tetris();
 
+  // tetris.exe [-a] [-r record to] [-k port]
+  //   -a lets the bot play, for leaving installations running, -r records the session, -k takes input from
+  //   remote_keys.exe on another machine as well as the keyboard, on REMOTE_INPUT_PORT by default
+  for(int i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "-a"))
+    {
+      BotSettings bot_settings = default_bot_settings();
+      set_autoplay(&bot_settings);
+    }
+    else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+    {
+      const char *path = argv[++i];
+      if(!start_recording(path)) printf("Couldn't record to %s\n", path);
+    }
+    else if(!strcmp(argv[i], "-k"))
+    {
+      int port = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : REMOTE_INPUT_PORT;
+      state->remote_input = create_remote_input(port);
+      if(state->remote_input) printf("Taking remote input on port %i\n", port);
+    }
+  }
+
   // Main loop
   state->game_running = true;
   while(state->game_running)
   {
     // Input
     read_input();
+    if(state->remote_input) poll_remote_input(state->remote_input);
     if(state->keys_down[1])
     {
       state->game_running = false;
@@ -225,6 +277,8 @@ int main(int argc, char **argv)
   }
 
 
+  stop_recording();
+
   shutdown_input();
   shutdown_renderer();
   free(state);
@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+// Stand-in for led_renderer.dll so the Pi programs can run on any Linux box.
+// Exports the same four symbols as the real driver and, instead of clocking
+// out to a WS2812 strip, records what it was asked to show.
+//
+// Configured through the environment:
+//   MOCK_LED_OUTPUT      File to record frames to. A path under /dev/shm
+//                        makes it shared memory for a live reader.
+//   MOCK_LED_US_PER_LED  Simulated transfer time per LED in microseconds.
+//                        A real WS2812 takes 30 (24 bits at 800kHz).
+//
+// Point the loaders at it with LED_RENDERER=./mock_led_renderer.so
+////////////////////////////////////////////////////////////////////////////////
+
+#include <time.h>
+#include <stdint.h>
+#include <stdlib.h> // getenv, atof
+#include <string.h> // memset
+#include <cstdio>
+
+
+// Every recorded frame starts with this, followed by num_leds words
+struct MockLedFrameRecord
+{
+  uint64_t timestamp_ns;
+  uint32_t frame_index;
+  uint32_t num_leds;
+};
+
+struct MockLedState
+{
+  int num_leds;
+  unsigned *strip;
+
+  FILE *output;
+  double transfer_ns_per_led;
+
+  uint32_t frames;
+  uint64_t first_render_ns;
+  uint64_t last_render_ns;
+  uint64_t min_interval_ns;
+  uint64_t max_interval_ns;
+  uint64_t total_render_ns;
+};
+
+static MockLedState *mock;
+
+// Time between the WS2812 data and the strip latching it
+static const uint64_t WS2812_RESET_NS = 50000;
+
+
+
+static uint64_t now_ns()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// Spun through at the end of a transfer, sleeps can wake this late
+static const uint64_t WAKE_MARGIN_NS = 200000;
+
+static void wait_until(uint64_t deadline_ns)
+{
+  // Sleeps through most of it, the DMA doesn't need the CPU, so panels
+  // sharing one machine in the latency harness don't hold each other up. The
+  // rest is spun so the transfer still ends on time.
+  if(deadline_ns > now_ns() + WAKE_MARGIN_NS)
+  {
+    uint64_t wake = deadline_ns - WAKE_MARGIN_NS;
+    timespec t;
+    t.tv_sec = wake / 1000000000ull;
+    t.tv_nsec = wake % 1000000000ull;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, 0);
+  }
+
+  while(now_ns() < deadline_ns) {}
+}
+
+
+
+extern "C" void init_led(int num_leds, unsigned **strip_buffer)
+{
+  mock = (MockLedState *)malloc(sizeof(MockLedState));
+  memset(mock, 0, sizeof(MockLedState));
+
+  mock->num_leds = num_leds;
+  mock->strip = (unsigned *)malloc(sizeof(unsigned) * num_leds);
+  memset(mock->strip, 0, sizeof(unsigned) * num_leds);
+  *strip_buffer = mock->strip;
+
+  const char *output_path = getenv("MOCK_LED_OUTPUT");
+  if(output_path)
+  {
+    mock->output = fopen(output_path, "wb");
+    if(!mock->output) fprintf(stderr, "Mock led could not open %s\n", output_path);
+  }
+
+  const char *us_per_led = getenv("MOCK_LED_US_PER_LED");
+  if(us_per_led) mock->transfer_ns_per_led = atof(us_per_led) * 1000.0;
+
+  mock->min_interval_ns = UINT64_MAX;
+}
+
+extern "C" void render_to_led()
+{
+  uint64_t start = now_ns();
+
+  if(mock->frames > 0)
+  {
+    uint64_t interval = start - mock->last_render_ns;
+    if(interval < mock->min_interval_ns) mock->min_interval_ns = interval;
+    if(interval > mock->max_interval_ns) mock->max_interval_ns = interval;
+  }
+  else
+  {
+    mock->first_render_ns = start;
+  }
+  mock->last_render_ns = start;
+
+  if(mock->output)
+  {
+    MockLedFrameRecord record;
+    record.timestamp_ns = start;
+    record.frame_index = mock->frames;
+    record.num_leds = mock->num_leds;
+    fwrite(&record, sizeof(record), 1, mock->output);
+    fwrite(mock->strip, sizeof(unsigned), mock->num_leds, mock->output);
+  }
+
+  if(mock->transfer_ns_per_led > 0.0)
+  {
+    uint64_t transfer_ns = (uint64_t)(mock->transfer_ns_per_led * mock->num_leds) + WS2812_RESET_NS;
+    wait_until(start + transfer_ns);
+  }
+
+  mock->frames++;
+  mock->total_render_ns += now_ns() - start;
+}
+
+extern "C" void clear_led()
+{
+  memset(mock->strip, 0, sizeof(unsigned) * mock->num_leds);
+}
+
+extern "C" void shutdown_led()
+{
+  if(mock->frames > 1)
+  {
+    double seconds = (mock->last_render_ns - mock->first_render_ns) * 1e-9;
+    printf("Mock led: %u frames in %.3fs (%.1f fps)\n", mock->frames, seconds, (mock->frames - 1) / seconds);
+    printf("Mock led: frame interval min %.3fms max %.3fms, render_to_led avg %.3fms\n",
+           mock->min_interval_ns * 1e-6,
+           mock->max_interval_ns * 1e-6,
+           (mock->total_render_ns / mock->frames) * 1e-6);
+  }
+  else
+  {
+    printf("Mock led: %u frames\n", mock->frames);
+  }
+
+  if(mock->output) fclose(mock->output);
+  free(mock->strip);
+  free(mock);
+  mock = 0;
+}
+
@@ -0,0 +1,651 @@
+////////////////////////////////////////////////////////////////////////////////
+// Display-only LED receiver. The desktop client runs the game and streams
+// frames over UDP, this just puts the newest one on the strip.
+//
+//   receiver.exe [-p port] [-n leds] [-m layout file] [-l latency log] [-o ms]
+//
+// -n is how many LEDs are on the strip, 256 unless told. The layout file
+// describes how this panel is wired, see led_layout.h. The latency log gets
+// one LatencyRecord per frame put on the strip.
+//
+// Big frames come in fragments, see led_protocol.h, and are put back together
+// here. A frame is shown once all of it is in, unless a newer one is complete
+// first.
+//
+// Frames go up when the sender says, not when they arrive, so panels of one
+// wall change together. The receiver keeps asking the sender what time it is
+// to know when that is on its own clock, see led_protocol.h. -o pretends this
+// panel's clock is that far off, for trying that out with every panel on one
+// machine. The latency log stays on the real clock.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "led_library.h"
+#include "../led_protocol.h"
+#include "../led_layout.h"
+
+#include <sys/socket.h> // Networking API, recvmmsg
+#include <netinet/in.h>
+#include <unistd.h>     // close
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/prctl.h>  // PR_SET_TIMERSLACK
+#include <time.h>
+#include <stdlib.h>     // atoi, atof
+#include <string.h>     // memset, memcpy
+#include <getopt.h>
+#include <cstdio>
+
+
+static const int DEFAULT_NUM_LEDS = 256;
+static const int DEFAULT_PORT = 4242;
+
+// Datagrams pulled out of the socket per syscall, a 64x64 frame is 12
+static const int RECEIVE_BATCH = 64;
+static const int MAX_DATAGRAM_BYTES = 2048;
+
+// Enough for a few of the biggest frames, while waiting on a present time
+static const int RECEIVE_BUFFER_BYTES = 1 << 20;
+
+// Frames being put back together at once. Fragments of the next frame can
+// overtake the end of this one.
+static const int REASSEMBLY_SLOTS = 4;
+
+// Clock answers the offset is picked from, the first ones go out a frame apart
+// and then one every CLOCK_REQUEST_INTERVAL ms, so it covers a few seconds
+static const int CLOCK_SAMPLES = 8;
+static const int CLOCK_REQUEST_INTERVAL = 500;
+
+// A frame to be shown further out than this, in ms, means the clocks have
+// stopped agreeing, e.g. the sender restarted. It goes up right away instead.
+static const int MAX_PRESENT_WAIT = 100;
+
+struct PartialFrame
+{
+  bool in_use;
+  uint32_t frame_id;
+  unsigned frame_bytes;
+  unsigned num_fragments;
+  unsigned fragments_left;
+  uint64_t started;
+
+  // Against duplicates
+  bool received[LED_MAX_FRAGMENTS];
+
+  // Grown to the biggest frame so far, plus a spare word for the layout's dark
+  // cell
+  unsigned char *bytes;
+  unsigned capacity;
+};
+
+struct ReceiverState
+{
+  int udp_socket;
+
+  LedLibrary led;
+  int num_leds;
+  unsigned *strip;
+
+  // Rebuilt whenever the sender's board size changes
+  const char *layout_description;
+  LedLayout layout;
+
+  // One spare word past the biggest datagram for the layout's dark cell
+  mmsghdr messages[RECEIVE_BATCH];
+  iovec buffers[RECEIVE_BATCH];
+  sockaddr_in senders[RECEIVE_BATCH];
+  unsigned char datagrams[RECEIVE_BATCH][MAX_DATAGRAM_BYTES + sizeof(unsigned)];
+
+  PartialFrame partial_frames[REASSEMBLY_SLOTS];
+
+  // Fragments of this frame and older ones are too late to matter
+  bool has_shown;
+  uint32_t last_shown_id;
+
+  // Where frames come from, and so where clock requests go
+  bool has_sender;
+  sockaddr_in sender;
+
+  // Sender's clock minus this one and the round trip it was measured over, for
+  // the latest answers
+  int64_t clock_offsets[CLOCK_SAMPLES];
+  int64_t round_trips[CLOCK_SAMPLES];
+  int num_clock_samples;
+  int next_clock_sample;
+  uint64_t next_clock_request;
+
+  // Only for -o
+  int64_t pretend_offset;
+
+  unsigned frames_received;
+  unsigned frames_dropped;
+  unsigned frames_late;
+  unsigned frames_incomplete;
+  unsigned fragments_received;
+
+  FILE *latency_log;
+};
+
+static ReceiverState *state;
+static volatile sig_atomic_t receiver_running = 1;
+
+
+
+static void handle_stop_signal(int signal_number)
+{
+  receiver_running = 0;
+}
+
+static void install_signal_handlers()
+{
+  // No SA_RESTART, recvmmsg has to return with EINTR so the loop can exit
+  struct sigaction action = {};
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+}
+
+static int create_listen_socket(int port)
+{
+  int udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if(udp_socket == -1)
+  {
+    fprintf(stderr, "Error opening socket: %i\n", errno);
+    return udp_socket;
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(udp_socket, (const sockaddr *)&address, sizeof(address)) == -1)
+  {
+    fprintf(stderr, "Error binding to port %i: %i\n", port, errno);
+    close(udp_socket);
+    return -1;
+  }
+
+  // The kernel caps this at net.core.rmem_max, raise that for big canvases
+  int buffer_bytes = RECEIVE_BUFFER_BYTES;
+  setsockopt(udp_socket, SOL_SOCKET, SO_RCVBUF, &buffer_bytes, sizeof(buffer_bytes));
+
+  return udp_socket;
+}
+
+static void init_receive_batch()
+{
+  for(int i = 0; i < RECEIVE_BATCH; i++)
+  {
+    state->buffers[i].iov_base = state->datagrams[i];
+    state->buffers[i].iov_len = MAX_DATAGRAM_BYTES;
+
+    memset(&state->messages[i], 0, sizeof(mmsghdr));
+    state->messages[i].msg_hdr.msg_name = &state->senders[i];
+    state->messages[i].msg_hdr.msg_iov = &state->buffers[i];
+    state->messages[i].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+// This panel's clock, what clock requests and present times are on
+static uint64_t panel_now()
+{
+  return latency_now_ns() + state->pretend_offset;
+}
+
+static void wait_until(uint64_t panel_time)
+{
+  uint64_t deadline = panel_time - state->pretend_offset;
+  timespec t;
+  t.tv_sec = deadline / 1000000000ull;
+  t.tv_nsec = deadline % 1000000000ull;
+
+  // A signal cuts it short, the frame just goes up early on the way out
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, 0);
+}
+
+static void send_clock_request()
+{
+  LedClockPacket packet = {};
+  packet.magic = LED_CLOCK_MAGIC;
+  packet.requested_ns = panel_now();
+  if(sendto(state->udp_socket, &packet, sizeof(packet), 0, (const sockaddr *)&state->sender, sizeof(state->sender)) == -1)
+  {
+    fprintf(stderr, "Error sending clock request: %i\n", errno);
+  }
+
+  uint64_t interval = (state->num_clock_samples < CLOCK_SAMPLES) ? 0 : CLOCK_REQUEST_INTERVAL * 1000000ull;
+  state->next_clock_request = packet.requested_ns + interval;
+}
+
+static void take_clock_answer(const LedClockPacket *packet, uint64_t returned)
+{
+  // Answers to requests from before a sender restart still line up, the
+  // times are all in the packet
+  if(packet->requested_ns > returned || packet->answered_ns < packet->received_ns) return;
+
+  int64_t round_trip = (int64_t)(returned - packet->requested_ns) - (int64_t)(packet->answered_ns - packet->received_ns);
+  if(round_trip < 0) return;
+
+  int64_t offset = ((int64_t)(packet->received_ns - packet->requested_ns) + (int64_t)(packet->answered_ns - returned)) / 2;
+
+  state->clock_offsets[state->next_clock_sample] = offset;
+  state->round_trips[state->next_clock_sample] = round_trip;
+  state->next_clock_sample = (state->next_clock_sample + 1) % CLOCK_SAMPLES;
+  if(state->num_clock_samples < CLOCK_SAMPLES) state->num_clock_samples++;
+}
+
+// Of the shortest round trip, that one waited least in queues. -1 if there's
+// none yet.
+static int best_clock_sample()
+{
+  int best = -1;
+  for(int i = 0; i < state->num_clock_samples; i++)
+  {
+    if(best == -1 || state->round_trips[i] < state->round_trips[best]) best = i;
+  }
+
+  return best;
+}
+
+static char *read_text_file(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if(!file) return 0;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char *text = (char *)malloc(size + 1);
+  size_t bytes_read = fread(text, 1, size, file);
+  text[bytes_read] = 0;
+  fclose(file);
+
+  return text;
+}
+
+// Maps the board-order cells of a frame onto the strip
+static bool decode_frame(unsigned char *datagram, unsigned bytes)
+{
+  if(bytes < sizeof(LedFrameHeader)) return false;
+
+  const LedFrameHeader *header = (const LedFrameHeader *)datagram;
+  if(header->magic != LED_FRAME_MAGIC) return false;
+
+  unsigned num_cells = header->width * header->height;
+  if(bytes - sizeof(LedFrameHeader) != num_cells * sizeof(unsigned)) return false;
+
+  if(header->width != state->layout.width || header->height != state->layout.height)
+  {
+    free_led_layout(&state->layout);
+    build_led_layout(&state->layout, state->layout_description, header->width, header->height, state->num_leds);
+  }
+
+  unsigned *cells = (unsigned *)(datagram + sizeof(LedFrameHeader));
+  cells[num_cells] = 0;
+  apply_led_layout(&state->layout, cells, state->strip);
+  return true;
+}
+
+// Until the frame's present time, if the clocks are known to line up
+static void wait_for_present_time(const LedFrameHeader *header)
+{
+  int best = best_clock_sample();
+  if(!header->present_ns || best == -1) return;
+
+  uint64_t present_at = header->present_ns - (uint64_t)state->clock_offsets[best];
+  uint64_t now = panel_now();
+  if(present_at <= now)
+  {
+    state->frames_late++;
+    return;
+  }
+  if(present_at - now > MAX_PRESENT_WAIT * 1000000ull) return;
+
+  wait_until(present_at);
+}
+
+static void show_frame(unsigned char *datagram)
+{
+  const LedFrameHeader *header = (const LedFrameHeader *)datagram;
+
+  if(!state->latency_log)
+  {
+    wait_for_present_time(header);
+    state->led.render_to_led();
+    return;
+  }
+
+  LatencyRecord record = {};
+  record.frame_id = header->frame_id;
+  memcpy(record.stamps, header->stamps, sizeof(record.stamps));
+  record.stamps[LATENCY_DECODE] = latency_now_ns();
+
+  wait_for_present_time(header);
+
+  record.stamps[LATENCY_LED] = latency_now_ns();
+  state->led.render_to_led();
+
+  fwrite(&record, sizeof(record), 1, state->latency_log);
+}
+
+static bool frame_after(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) > 0;
+}
+
+static void release_partial_frame(PartialFrame *frame, bool complete)
+{
+  if(!frame->in_use) return;
+
+  frame->in_use = false;
+  if(!complete) state->frames_incomplete++;
+}
+
+// A different sender starts everything over, its frame ids and clock are its
+// own
+static void take_sender(const sockaddr_in *from)
+{
+  if(state->has_sender && from->sin_addr.s_addr == state->sender.sin_addr.s_addr &&
+     from->sin_port == state->sender.sin_port)
+  {
+    return;
+  }
+
+  state->has_sender = true;
+  state->sender = *from;
+  state->num_clock_samples = 0;
+  state->next_clock_sample = 0;
+  state->next_clock_request = 0;
+  state->has_shown = false;
+  for(int i = 0; i < REASSEMBLY_SLOTS; i++) release_partial_frame(&state->partial_frames[i], false);
+}
+
+// The slot for a new frame, a free one or the one that's been waiting longest.
+// Never the complete frame the batch is about to show.
+static PartialFrame *start_partial_frame(const LedFragmentHeader *header, const PartialFrame *showing, uint64_t now)
+{
+  PartialFrame *frame = 0;
+  for(int i = 0; i < REASSEMBLY_SLOTS; i++)
+  {
+    PartialFrame *slot = &state->partial_frames[i];
+    if(slot == showing) continue;
+    if(!slot->in_use)
+    {
+      frame = slot;
+      break;
+    }
+    if(!frame || slot->started < frame->started) frame = slot;
+  }
+  release_partial_frame(frame, false);
+
+  unsigned capacity = header->frame_bytes + sizeof(unsigned);
+  if(frame->capacity < capacity)
+  {
+    free(frame->bytes);
+    frame->bytes = (unsigned char *)malloc(capacity);
+    frame->capacity = capacity;
+  }
+
+  frame->in_use = true;
+  frame->frame_id = header->frame_id;
+  frame->frame_bytes = header->frame_bytes;
+  frame->num_fragments = header->count;
+  frame->fragments_left = header->count;
+  frame->started = now;
+  memset(frame->received, 0, header->count * sizeof(bool));
+  return frame;
+}
+
+// Copies the fragment into its frame. Returns the frame if that completed it.
+static PartialFrame *take_fragment(const unsigned char *datagram, unsigned bytes, const PartialFrame *showing,
+                                   uint64_t now)
+{
+  if(bytes < sizeof(LedFragmentHeader)) return 0;
+  const LedFragmentHeader *header = (const LedFragmentHeader *)datagram;
+
+  // Too small to even say what frame it is
+  if(header->frame_bytes < sizeof(LedFrameHeader)) return 0;
+
+  // Every fragment but the last is full
+  unsigned count = header->count;
+  if(!count || count > LED_MAX_FRAGMENTS || header->index >= count) return 0;
+  if(header->frame_bytes <= (count - 1) * LED_FRAGMENT_BYTES || header->frame_bytes > count * LED_FRAGMENT_BYTES) return 0;
+
+  unsigned start = header->index * LED_FRAGMENT_BYTES;
+  unsigned length = header->frame_bytes - start;
+  if(length > LED_FRAGMENT_BYTES) length = LED_FRAGMENT_BYTES;
+  if(bytes - sizeof(LedFragmentHeader) != length) return 0;
+
+  state->fragments_received++;
+  if(state->has_shown && !frame_after(header->frame_id, state->last_shown_id)) return 0;
+
+  PartialFrame *frame = 0;
+  for(int i = 0; i < REASSEMBLY_SLOTS; i++)
+  {
+    PartialFrame *slot = &state->partial_frames[i];
+    if(slot->in_use && slot->frame_id == header->frame_id) frame = slot;
+  }
+
+  if(frame && (frame->frame_bytes != header->frame_bytes || frame->num_fragments != count)) return 0;
+  if(!frame) frame = start_partial_frame(header, showing, now);
+  if(frame->received[header->index]) return 0;
+
+  frame->received[header->index] = true;
+  memcpy(frame->bytes + start, datagram + sizeof(LedFragmentHeader), length);
+  frame->fragments_left--;
+  return frame->fragments_left ? 0 : frame;
+}
+
+// Blocks for the first datagram then takes whatever else is already queued.
+// Only the newest frame completed by a batch is worth showing.
+static void receive_frames()
+{
+  for(int i = 0; i < RECEIVE_BATCH; i++) state->messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+
+  int count = recvmmsg(state->udp_socket, state->messages, RECEIVE_BATCH, MSG_WAITFORONE, 0);
+  uint64_t received = panel_now();
+  if(count == -1)
+  {
+    if(errno != EINTR) fprintf(stderr, "Error receiving frames: %i\n", errno);
+    return;
+  }
+
+  // A whole frame, in a datagram or reassembled
+  unsigned char *newest = 0;
+  unsigned newest_bytes = 0;
+  PartialFrame *newest_partial = 0;
+
+  for(int i = 0; i < count; i++)
+  {
+    unsigned char *datagram = state->datagrams[i];
+    unsigned bytes = state->messages[i].msg_len;
+    if(bytes < sizeof(uint32_t)) continue;
+
+    uint32_t magic = *(const uint32_t *)datagram;
+    if(magic == LED_CLOCK_MAGIC)
+    {
+      if(bytes == sizeof(LedClockPacket)) take_clock_answer((const LedClockPacket *)datagram, received);
+      continue;
+    }
+
+    unsigned char *frame = 0;
+    unsigned frame_bytes = 0;
+    PartialFrame *partial = 0;
+    if(magic == LED_FRAGMENT_MAGIC)
+    {
+      take_sender(&state->senders[i]);
+      partial = take_fragment(datagram, bytes, newest_partial, received);
+      if(!partial) continue;
+
+      frame = partial->bytes;
+      frame_bytes = partial->frame_bytes;
+    }
+    else if(magic == LED_FRAME_MAGIC && bytes >= sizeof(LedFrameHeader))
+    {
+      take_sender(&state->senders[i]);
+      frame = datagram;
+      frame_bytes = bytes;
+    }
+    else
+    {
+      continue;
+    }
+
+    state->frames_received++;
+    uint32_t frame_id = ((const LedFrameHeader *)frame)->frame_id;
+    bool stale = (state->has_shown && !frame_after(frame_id, state->last_shown_id)) ||
+                 (newest && !frame_after(frame_id, ((const LedFrameHeader *)newest)->frame_id));
+    if(stale)
+    {
+      state->frames_dropped++;
+      release_partial_frame(partial, true);
+      continue;
+    }
+
+    if(newest)
+    {
+      state->frames_dropped++;
+      release_partial_frame(newest_partial, true);
+    }
+    newest = frame;
+    newest_bytes = frame_bytes;
+    newest_partial = partial;
+  }
+
+  // Missing fragments aren't coming any more
+  for(int i = 0; i < REASSEMBLY_SLOTS; i++)
+  {
+    PartialFrame *frame = &state->partial_frames[i];
+    if(frame->in_use && frame != newest_partial &&
+       received - frame->started > LED_REASSEMBLY_TIMEOUT_MS * 1000000ull)
+    {
+      release_partial_frame(frame, false);
+    }
+  }
+
+  if(!newest) return;
+
+  bool decoded = decode_frame(newest, newest_bytes);
+  if(decoded)
+  {
+    state->has_shown = true;
+    state->last_shown_id = ((const LedFrameHeader *)newest)->frame_id;
+    show_frame(newest);
+  }
+  else
+  {
+    state->frames_dropped++;
+  }
+  release_partial_frame(newest_partial, true);
+
+  // Anything older than what's up now will never be shown
+  for(int i = 0; i < REASSEMBLY_SLOTS; i++)
+  {
+    PartialFrame *frame = &state->partial_frames[i];
+    if(frame->in_use && state->has_shown && !frame_after(frame->frame_id, state->last_shown_id))
+    {
+      release_partial_frame(frame, false);
+    }
+  }
+
+  if(decoded && panel_now() >= state->next_clock_request) send_clock_request();
+}
+
+
+
+int main(int argc, char **argv)
+{
+  state = (ReceiverState *)malloc(sizeof(ReceiverState));
+  memset(state, 0, sizeof(ReceiverState));
+
+  int port = DEFAULT_PORT;
+  const char *layout_path = 0;
+  const char *latency_log_path = 0;
+  state->num_leds = DEFAULT_NUM_LEDS;
+
+  int option;
+  while((option = getopt(argc, argv, "p:n:m:l:o:")) != -1)
+  {
+    switch(option)
+    {
+      case 'p': { port = atoi(optarg); break; }
+      case 'n': { state->num_leds = atoi(optarg); break; }
+      case 'm': { layout_path = optarg; break; }
+      case 'l': { latency_log_path = optarg; break; }
+      case 'o': { state->pretend_offset = (int64_t)(atof(optarg) * 1e6); break; }
+      default:
+      {
+        fprintf(stderr, "Usage: %s [-p port] [-n leds] [-m layout file] [-l latency log] [-o ms]\n", argv[0]);
+        return 1;
+      }
+    }
+  }
+
+  // Serpentine unless told otherwise
+  state->layout_description = "";
+  if(layout_path)
+  {
+    char *text = read_text_file(layout_path);
+    if(text) state->layout_description = text;
+    else fprintf(stderr, "Could not open led layout %s\n", layout_path);
+  }
+
+  // Initialization
+  install_signal_handlers();
+
+  // Wake for present times to the microsecond rather than the default 50
+  prctl(PR_SET_TIMERSLACK, 1);
+
+  if(!load_led_library(&state->led, "./led_renderer.dll")) return 1;
+  state->led.init_led(state->num_leds, &state->strip);
+
+  state->udp_socket = create_listen_socket(port);
+  if(state->udp_socket == -1) return 1;
+
+  init_receive_batch();
+  printf("Listening for frames on port %i\n", port);
+
+  if(latency_log_path)
+  {
+    state->latency_log = fopen(latency_log_path, "wb");
+    if(!state->latency_log) fprintf(stderr, "Could not open latency log %s\n", latency_log_path);
+  }
+
+  // Main loop
+  while(receiver_running)
+  {
+    receive_frames();
+  }
+
+  printf("Received %u frames, skipped %u, %u shown late\n", state->frames_received, state->frames_dropped,
+         state->frames_late);
+  if(state->fragments_received)
+  {
+    printf("Received %u fragments, gave up on %u frames missing some\n", state->fragments_received,
+           state->frames_incomplete);
+  }
+
+  int best = best_clock_sample();
+  if(best != -1)
+  {
+    // Sender's clock minus this one, so this one is behind when it's positive
+    int64_t offset = state->clock_offsets[best];
+    printf("Clock %.3f ms %s the sender, measured over a %.3f ms round trip\n", (offset < 0 ? -offset : offset) * 1e-6,
+           offset < 0 ? "ahead of" : "behind", state->round_trips[best] * 1e-6);
+  }
+
+  if(state->latency_log) fclose(state->latency_log);
+
+  state->led.clear_led();
+  state->led.render_to_led();
+  state->led.shutdown_led();
+  unload_led_library(&state->led);
+
+  close(state->udp_socket);
+  for(int i = 0; i < REASSEMBLY_SLOTS; i++) free(state->partial_frames[i].bytes);
+  free_led_layout(&state->layout);
+  free(state);
+  return 0;
+}
+
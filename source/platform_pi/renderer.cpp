@@ -1,35 +1,36 @@
 
 
 #include "pi_renderer.h"
-#include "../game_renderer.h"
+#include "led_library.h"
+#include "../game_presentation.h"
+#include "../led_layout.h"
 
 #include "../my_math.h" // v2
 
 
-#include <dlfcn.h>
 #include <cstdio>
+#include <string.h> // memset
+#include <unistd.h> // access
 #include <assert.h>
 
-typedef void (*init_led_fn)(int num_leds, unsigned **strip_buffer);
-typedef void (*render_to_led_fn)();
-typedef void (*clear_led_fn)();
-typedef void (*shutdown_led_fn)();
-
 struct RendererData
 {
   int width, height;
   unsigned *light_data;
 
-  init_led_fn init_led;
-  render_to_led_fn render_to_led;
-  clear_led_fn clear_led;
-  shutdown_led_fn shutdown_led;
+  // Drawn to in board order, mapped onto light_data when rendering. One spare
+  // zero word at the end for LEDs without a cell.
+  unsigned *board;
+  LedLayout layout;
+
+  LedLibrary led;
 };
 
 static RendererData *renderer_data;
 
 static const int NUM_LEDS_ON_STRIP = 256;
 static const unsigned MAX_BRIGHTNESS_VALUE = 10;  
+static const char *LAYOUT_PATH = "./led_layout.txt";
 
 
 // Platform specific implementation
@@ -40,36 +41,48 @@ void init_renderer()
   renderer_data->height = 16;
 
   // Load led renderer dll
-  void *dll_handle = dlopen("./led_renderer.dll", RTLD_LAZY);
-  if(!dll_handle)
+  if(!load_led_library(&renderer_data->led, "./led_renderer.dll"))
   {
-    fprintf(stderr, "Could not load led renderer dll\n");
     assert(0);
   }
 
-  renderer_data->init_led = (init_led_fn)dlsym(dll_handle, "init_led");
-  renderer_data->render_to_led = (render_to_led_fn)dlsym(dll_handle, "render_to_led");
-  renderer_data->clear_led = (clear_led_fn)dlsym(dll_handle, "clear_led");
-  renderer_data->shutdown_led = (shutdown_led_fn)dlsym(dll_handle, "shutdown_led");
 
 
+  renderer_data->led.init_led(NUM_LEDS_ON_STRIP, &(renderer_data->light_data));
+
+  int board_bytes = sizeof(unsigned) * (renderer_data->width * renderer_data->height + 1);
+  renderer_data->board = (unsigned *)malloc(board_bytes);
+  memset(renderer_data->board, 0, board_bytes);
 
-  renderer_data->init_led(NUM_LEDS_ON_STRIP, &(renderer_data->light_data));
+  // Serpentine unless the panel says otherwise
+  if(access(LAYOUT_PATH, F_OK) == 0)
+  {
+    load_led_layout(&renderer_data->layout, LAYOUT_PATH, renderer_data->width, renderer_data->height, NUM_LEDS_ON_STRIP);
+  }
+  else
+  {
+    build_led_layout(&renderer_data->layout, "", renderer_data->width, renderer_data->height, NUM_LEDS_ON_STRIP);
+  }
 }
 
 void render()
 {
-  renderer_data->render_to_led();
+  apply_led_layout(&renderer_data->layout, renderer_data->board, renderer_data->light_data);
+  renderer_data->led.render_to_led();
 }
 
 void swap_frame()
 {
-  renderer_data->clear_led();
+  renderer_data->led.clear_led();
+  memset(renderer_data->board, 0, sizeof(unsigned) * renderer_data->width * renderer_data->height);
 }
 
 void shutdown_renderer()
 {
-  renderer_data->shutdown_led();
+  renderer_data->led.shutdown_led();
+  free_led_layout(&renderer_data->layout);
+  free(renderer_data->board);
+  unload_led_library(&renderer_data->led);
   free(renderer_data);
 }
 
@@ -88,12 +101,8 @@ void draw_cell(v2i position, Color color)
   int column = position.x;
   int row = position.y;
 
-  if(column < 0) return;
-  if(row    < 0) return;
-  if(column >= renderer_data->width)  return;
-  if(row    >= renderer_data->height) return;
-
-  if(row % 2 == 1) column = (renderer_data->width - 1) - column;
+  if((unsigned)column >= (unsigned)renderer_data->width)  return;
+  if((unsigned)row    >= (unsigned)renderer_data->height) return;
 
   float alpha = color.a;
   int r = MAX_BRIGHTNESS_VALUE * color.r * alpha;
@@ -102,7 +111,7 @@ void draw_cell(v2i position, Color color)
 
   unsigned value = (b << 16) | (g << 8) | (r << 0);
 
-  renderer_data->light_data[row * renderer_data->width + column] = value;
+  renderer_data->board[row * renderer_data->width + column] = value;
 }
 
 void draw_cell_in_left_bar(v2i position, Color color)
@@ -113,4 +122,9 @@ void draw_cell_in_right_bar(v2i position, Color color)
 {
 }
 
+void present_frame_timing(uint64_t input_time, uint64_t tick_time)
+{
+  // Drawn straight to the strip, nothing to carry the stamps to
+}
+
 
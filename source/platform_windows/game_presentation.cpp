@@ -25,4 +25,9 @@ void draw_cell_in_right_bar(v2i position, Color color)
   renderer_add_cell_in_right_bar(position, color);
 }
 
+void present_frame_timing(uint64_t input_time, uint64_t tick_time)
+{
+  network_set_frame_timing(input_time, tick_time);
+}
+
 
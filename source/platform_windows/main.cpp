@@ -2,6 +2,7 @@
 #include "network_client.h"
 #include "input.h"
 #include "tetris.h"
+#include "latency.h"
 
 #include "imgui.h"
 #include "imgui_impl_dx11.h"
@@ -21,12 +22,10 @@ static float dt;
 
 static bool running;
 
-static const float NETWORK_FREQUENCY = 33.33f;
-static float network_timer = 0.0f;
-
 
 #define MAX_BUTTONS 256
 static bool keyStates[MAX_BUTTONS] = {};
+static uint64_t last_key_press = 0;
 static bool mouseStates[8] = {};
 
 static v2 mouseWindowPosition;
@@ -61,6 +60,11 @@ bool button_state(unsigned char button)
   return keyStates[button];
 }
 
+uint64_t last_key_press_time()
+{
+  return last_key_press;
+}
+
 bool MouseDown(unsigned button)
 {
   if(button < 0 || button > 8) return false;
@@ -128,6 +132,7 @@ LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lPa
     case WM_KEYDOWN: 
     {
       if(wParam >= 0 && wParam < MAX_BUTTONS) keyStates[wParam] = true;
+      last_key_press = latency_now_ns();
     }
     break;
 
@@ -229,13 +234,8 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     render();
     swap_frame();
 
-    network_timer += get_dt();
-    if(network_timer >= NETWORK_FREQUENCY)
-    {
-      printf("Sending at network time = %f\n", network_timer);
-      send_network_data();
-      network_timer -= NETWORK_FREQUENCY;
-    }
+    // The sender thread paces the actual sends
+    publish_network_frame();
   }
 
   shutdown();
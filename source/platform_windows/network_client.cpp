@@ -1,10 +1,13 @@
 
 #include "network_client.h"
+#include "../frame_queue.h"
+#include "../led_protocol.h"
 
 #include <WinSock2.h> // Networking API
 #include <Ws2tcpip.h> // InetPton
 
 #include <cstdio>
+#include <thread>
 
 struct NetworkData
 {
@@ -13,12 +16,42 @@ struct NetworkData
 
   unsigned grid_width;
   unsigned grid_height;
-  unsigned *grid;
+
+  // Frames go from the game thread to the sender thread through here. Each
+  // slot is a whole datagram, LedFrameHeader then the LEDs.
+  FrameQueue frames;
+  uint32_t next_frame_id;
+
+  // The sender only sends the newest frame, so a key press stays stamped on
+  // every frame until one of them actually goes out
+  uint64_t pending_input_time;
+  uint64_t pending_tick_time;
+  uint32_t pending_frame_id;
+  std::atomic<uint32_t> sent_through_frame_id; // Last sent id + 1
+
+  std::thread sender_thread;
+  std::atomic<bool> sender_running;
+  HANDLE send_timer;
 };
 
 static NetworkData *network_data;
 static const unsigned MAX_BRIGHTNESS_VALUE = 10;
 
+// In ms
+static const float NETWORK_FREQUENCY = 33.33f;
+
+
+
+static LedFrameHeader *frame_header(unsigned char *frame)
+{
+  return (LedFrameHeader *)frame;
+}
+
+static unsigned *frame_leds(unsigned char *frame)
+{
+  return (unsigned *)(frame + sizeof(LedFrameHeader));
+}
+
 
 
 
@@ -92,6 +125,53 @@ void close_socket(SOCKET socket)
   }
 }
 
+static HANDLE create_send_timer()
+{
+  HANDLE timer = CreateWaitableTimer(0, FALSE, 0);
+  if(!timer)
+  {
+    fprintf(stderr, "Error creating send timer: %i\n", (int)GetLastError());
+    return timer;
+  }
+
+  // Due time is relative, in 100ns units
+  LARGE_INTEGER due_time;
+  due_time.QuadPart = -(LONGLONG)(NETWORK_FREQUENCY * 10000.0f);
+  if(!SetWaitableTimer(timer, &due_time, (LONG)NETWORK_FREQUENCY, 0, 0, FALSE))
+  {
+    fprintf(stderr, "Error arming send timer: %i\n", (int)GetLastError());
+    CloseHandle(timer);
+    return 0;
+  }
+
+  return timer;
+}
+
+// Runs on its own thread so a slow network stack never stalls the game
+static void sender_loop()
+{
+  unsigned frame_bytes = network_data->frames.frame_bytes;
+
+  while(network_data->sender_running.load(std::memory_order_acquire))
+  {
+    // Blocks until the next send tick, missed ticks are not made up for.
+    // Without a timer sleeping is close enough, waiting on a null handle fails
+    // straight away and would spin.
+    if(network_data->send_timer) WaitForSingleObject(network_data->send_timer, INFINITE);
+    else                         Sleep((DWORD)NETWORK_FREQUENCY);
+
+    unsigned index;
+    unsigned char *frame = frame_queue_read_latest(&network_data->frames, &index);
+    if(!frame) continue;
+
+    frame_header(frame)->stamps[LATENCY_SEND] = latency_now_ns();
+    send_data(network_data->udp_socket, frame, frame_bytes, &(network_data->address));
+    network_data->sent_through_frame_id.store(frame_header(frame)->frame_id + 1, std::memory_order_release);
+
+    frame_queue_release(&network_data->frames, index);
+  }
+}
+
 
 
 
@@ -101,42 +181,87 @@ void init_network_client(const char *ip_address, int port, unsigned width, unsig
 {
   init_winsock();
 
-  network_data = (NetworkData *)malloc(sizeof(NetworkData));
+  // Owns a thread and atomics, so this one is new'd rather than malloc'd
+  network_data = new NetworkData;
   network_data->grid_width = width;
   network_data->grid_height = height;
 
-  int bytes = sizeof(unsigned) * network_data->grid_width * network_data->grid_height; 
-  network_data->grid =(unsigned *)malloc(bytes);
-
-  memset(network_data->grid, 0, bytes);
+  int bytes = sizeof(LedFrameHeader) + sizeof(unsigned) * network_data->grid_width * network_data->grid_height;
+  init_frame_queue(&network_data->frames, bytes);
+  network_data->next_frame_id = 0;
+  network_data->pending_input_time = 0;
+  network_data->sent_through_frame_id.store(0);
 
   network_data->udp_socket = create_udp_socket();
   make_address(ip_address, port, &(network_data->address));
+
+  network_data->send_timer = create_send_timer();
+  network_data->sender_running.store(true);
+  network_data->sender_thread = std::thread(sender_loop);
 }
 
-void send_network_data()
+void publish_network_frame()
 {
-  int bytes = sizeof(unsigned) * network_data->grid_width * network_data->grid_height;
-  send_data(network_data->udp_socket,
-            network_data->grid,
-            bytes,
-            &(network_data->address));
+  LedFrameHeader *header = frame_header(frame_queue_write_slot(&network_data->frames));
+  header->magic = LED_FRAME_MAGIC;
+  header->frame_id = network_data->next_frame_id++;
+  header->width = network_data->grid_width;
+  header->height = network_data->grid_height;
+  header->stamps[LATENCY_SNAPSHOT] = latency_now_ns();
+
+  frame_queue_publish(&network_data->frames);
+}
+
+void network_set_frame_timing(uint64_t input_time, uint64_t tick_time)
+{
+  if(network_data->pending_input_time)
+  {
+    uint32_t sent_through = network_data->sent_through_frame_id.load(std::memory_order_acquire);
+    if(sent_through > network_data->pending_frame_id) network_data->pending_input_time = 0;
+  }
+
+  if(!network_data->pending_input_time && input_time)
+  {
+    network_data->pending_input_time = input_time;
+    network_data->pending_tick_time = tick_time;
+    network_data->pending_frame_id = network_data->next_frame_id;
+  }
 
-  memset(network_data->grid, 0, bytes);
+  LedFrameHeader *header = frame_header(frame_queue_write_slot(&network_data->frames));
+  if(network_data->pending_input_time)
+  {
+    header->stamps[LATENCY_INPUT] = network_data->pending_input_time;
+    header->stamps[LATENCY_TICK] = network_data->pending_tick_time;
+  }
+  else
+  {
+    header->stamps[LATENCY_TICK] = tick_time;
+  }
 }
 
 void shutdown_network_client()
 {
-  // Send empty frame
-  int bytes = sizeof(unsigned) * network_data->grid_width * network_data->grid_height;
-  memset(network_data->grid, 0, bytes);
-  send_network_data();
+  // The sender notices on its next tick
+  network_data->sender_running.store(false, std::memory_order_release);
+  network_data->sender_thread.join();
 
+  // Send empty frame
+  unsigned bytes = network_data->frames.frame_bytes;
+  unsigned char *frame = frame_queue_write_slot(&network_data->frames);
+  memset(frame, 0, bytes);
+  frame_header(frame)->magic = LED_FRAME_MAGIC;
+  frame_header(frame)->frame_id = network_data->next_frame_id++;
+  frame_header(frame)->width = network_data->grid_width;
+  frame_header(frame)->height = network_data->grid_height;
+  send_data(network_data->udp_socket, frame, bytes, &(network_data->address));
 
-  free(network_data->grid);
-  free(network_data);
 
+  if(network_data->send_timer) CloseHandle(network_data->send_timer);
   close_socket(network_data->udp_socket);
+
+  shutdown_frame_queue(&network_data->frames);
+  delete network_data;
+
   shutdown_winsock();
 }
 
@@ -145,13 +270,9 @@ void shutdown_network_client()
 
 void network_add_cell(v2i position, Color color)
 {
-  if(position.x < 0) return;
-  if(position.y < 0) return;
-  if(position.x >= network_data->grid_width)  return;
-  if(position.y >= network_data->grid_height) return;
-
-  if(position.y % 2 == 1) position.x = (network_data->grid_width - 1) - position.x;
-
+  // Frames go out in board order, the receivers know their own wiring
+  if((unsigned)position.x >= network_data->grid_width)  return;
+  if((unsigned)position.y >= network_data->grid_height) return;
 
   float alpha = color.a;
   unsigned r = MAX_BRIGHTNESS_VALUE * color.r * alpha;
@@ -160,7 +281,8 @@ void network_add_cell(v2i position, Color color)
   unsigned value = (b << 16) | (g << 8) | (r << 0);
 
 
-  (network_data->grid)[position.y * network_data->grid_width + position.x] = value;
+  unsigned *grid = frame_leds(frame_queue_write_slot(&network_data->frames));
+  grid[position.y * network_data->grid_width + position.x] = value;
 }
 
 void network_add_cell_in_left_bar(v2i position, Color color)
@@ -0,0 +1,169 @@
+#include "remote_input.h"
+
+#include "input_protocol.h"
+#include "input.h"
+#include "tetris.h"
+#include "latency.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h> // close
+
+#include <errno.h>
+#include <stdlib.h> // malloc
+#include <string.h> // memset
+#include <cstdio>
+
+
+// Packets the clock offset is taken over, a few seconds of keepalives, so
+// it follows the clocks drifting apart
+static const int OFFSET_SAMPLES = 32;
+
+struct RemoteInput
+{
+  int udp_socket;
+
+  // The controller, until it goes silent
+  bool has_controller;
+  sockaddr_in controller;
+  uint64_t last_heard;
+
+  uint32_t sequence;
+  unsigned buttons;
+  uint64_t last_press;
+
+  // Receive minus send time of the latest packets
+  int64_t offsets[OFFSET_SAMPLES];
+  int num_offsets;
+  int next_offset;
+};
+
+static bool sequence_after(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) > 0;
+}
+
+static bool same_address(const sockaddr_in *a, const sockaddr_in *b)
+{
+  return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+RemoteInput *create_remote_input(int port)
+{
+  int udp_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if(udp_socket == -1)
+  {
+    fprintf(stderr, "Error opening remote input socket: %i\n", errno);
+    return 0;
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(udp_socket, (const sockaddr *)&address, sizeof(address)) == -1)
+  {
+    fprintf(stderr, "Error binding remote input to port %i: %i\n", port, errno);
+    close(udp_socket);
+    return 0;
+  }
+
+  RemoteInput *input = (RemoteInput *)malloc(sizeof(RemoteInput));
+  memset(input, 0, sizeof(RemoteInput));
+  input->udp_socket = udp_socket;
+  return input;
+}
+
+void destroy_remote_input(RemoteInput *input)
+{
+  // Nothing stays held down after it's gone
+  if(input->buttons) set_remote_buttons(0, latency_now_ns());
+
+  close(input->udp_socket);
+  free(input);
+}
+
+static int64_t clock_offset(const RemoteInput *input)
+{
+  int64_t offset = input->offsets[0];
+  for(int i = 1; i < input->num_offsets; i++)
+  {
+    if(input->offsets[i] < offset) offset = input->offsets[i];
+  }
+
+  return offset;
+}
+
+static void take_packet(RemoteInput *input, const sockaddr_in *from, const RemoteButtonsPacket *packet, uint64_t now)
+{
+  // One controller at a time
+  if(input->has_controller && !same_address(from, &input->controller)) return;
+
+  if(!input->has_controller)
+  {
+    input->has_controller = true;
+    input->controller = *from;
+    input->sequence = packet->sequence - 1;
+    input->num_offsets = 0;
+    input->next_offset = 0;
+  }
+
+  input->last_heard = now;
+  input->offsets[input->next_offset] = (int64_t)(now - packet->sent_ns);
+  input->next_offset = (input->next_offset + 1) % OFFSET_SAMPLES;
+  if(input->num_offsets < OFFSET_SAMPLES) input->num_offsets++;
+
+  // A keepalive or a late duplicate
+  if(!sequence_after(packet->sequence, input->sequence)) return;
+  input->sequence = packet->sequence;
+
+  unsigned buttons = packet->buttons & ((1 << NUM_GAME_BUTTONS) - 1);
+  if(buttons == input->buttons) return;
+
+  // Never later than now, the offset can lag a clock that stepped
+  uint64_t changed_at = packet->changed_ns + (uint64_t)clock_offset(input);
+  if(changed_at > now) changed_at = now;
+
+  if(buttons & ~input->buttons) input->last_press = changed_at;
+  input->buttons = buttons;
+  set_remote_buttons(buttons, changed_at);
+}
+
+void poll_remote_input(RemoteInput *input)
+{
+  for(;;)
+  {
+    RemoteButtonsPacket packet;
+    sockaddr_in from;
+    socklen_t from_size = sizeof(from);
+    ssize_t size = recvfrom(input->udp_socket, &packet, sizeof(packet), 0, (sockaddr *)&from, &from_size);
+    if(size == -1)
+    {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        fprintf(stderr, "Error receiving remote input: %i\n", errno);
+      }
+      break;
+    }
+
+    if(size != sizeof(packet) || packet.magic != REMOTE_BUTTONS_MAGIC) continue;
+    take_packet(input, &from, &packet, latency_now_ns());
+  }
+
+  // A controller that went away lets go of everything
+  uint64_t now = latency_now_ns();
+  if(input->has_controller && now - input->last_heard > (uint64_t)REMOTE_TIMEOUT_MS * 1000000ull)
+  {
+    input->has_controller = false;
+    if(input->buttons)
+    {
+      input->buttons = 0;
+      set_remote_buttons(0, now);
+    }
+  }
+}
+
+uint64_t remote_key_press_time(const RemoteInput *input)
+{
+  return input->last_press;
+}
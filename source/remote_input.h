@@ -0,0 +1,29 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// The game's end of remote input (input_protocol.h). Takes the controller's
+// packets off a UDP socket once a frame and hands its buttons to the game,
+// with when each change happened moved onto this machine's clock, so the game
+// can put it on the tick it was pressed for (set_remote_buttons).
+//
+// The clocks are matched by the packets themselves: receive time minus send
+// time is the clock offset plus how long the trip took, so the smallest of
+// the recent ones is the offset plus the quickest trip. Changes are placed
+// that much after they were made, a packet that was held up on the way
+// arrives late but lands on the same tick as one that wasn't.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+struct RemoteInput;
+
+// 0 if the port can't be opened
+RemoteInput *create_remote_input(int port);
+void destroy_remote_input(RemoteInput *input);
+
+// Takes everything that arrived, call once a frame before update_tetris
+void poll_remote_input(RemoteInput *input);
+
+// When the controller's newest press happened, on the latency_now_ns()
+// clock, 0 if there hasn't been one
+uint64_t remote_key_press_time(const RemoteInput *input);
@@ -0,0 +1,476 @@
+#include "replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum ReplayEventKind
+{
+  REPLAY_BUTTONS,
+  REPLAY_END,
+  REPLAY_KEYFRAME,
+  REPLAY_CHECKSUM,
+};
+
+static const int INDEX_ENTRY_SIZE = 12;
+
+struct ReplayRecorder
+{
+  FILE *file;
+  uint64_t offset; // Bytes written so far
+  uint32_t last_tick;
+
+  uint32_t keyframe_size;
+  uint32_t keyframe_interval;
+  uint32_t checksum_interval;
+  int num_keyframes;
+  int max_keyframes;
+  ReplayKeyframe *keyframes;
+};
+
+static int write_varint(uint8_t *out, uint64_t value)
+{
+  int size = 0;
+  while(value >= 0x80)
+  {
+    out[size++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[size++] = (uint8_t)value;
+
+  return size;
+}
+
+// False if the varint runs past end
+static bool read_varint(const uint8_t *data, size_t end, size_t *offset, uint64_t *value)
+{
+  *value = 0;
+  for(int shift = 0; shift < 64 && *offset < end; shift += 7)
+  {
+    uint8_t byte = data[(*offset)++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if(!(byte & 0x80)) return true;
+  }
+
+  return false;
+}
+
+static void write_u32(uint8_t *out, uint32_t value)
+{
+  for(int i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void write_u64(uint8_t *out, uint64_t value)
+{
+  for(int i = 0; i < 8; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t read_u32(const uint8_t *in)
+{
+  uint32_t value = 0;
+  for(int i = 0; i < 4; i++) value |= (uint32_t)in[i] << (8 * i);
+  return value;
+}
+
+static uint64_t read_u64(const uint8_t *in)
+{
+  uint64_t value = 0;
+  for(int i = 0; i < 8; i++) value |= (uint64_t)in[i] << (8 * i);
+  return value;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Recording
+////////////////////////////////////////////////////////////////////////////////
+
+static void write_bytes(ReplayRecorder *recorder, const void *data, size_t size)
+{
+  // Buffered by the FILE, this is a memcpy most of the time
+  fwrite(data, size, 1, recorder->file);
+  recorder->offset += size;
+}
+
+static void write_event(ReplayRecorder *recorder, uint32_t tick, int kind)
+{
+  uint8_t event[10];
+  int size = write_varint(event, (uint64_t)(tick - recorder->last_tick) << 2 | kind);
+  write_bytes(recorder, event, size);
+  recorder->last_tick = tick;
+}
+
+ReplayRecorder *create_replay_recorder(const char *path, uint64_t seed, uint32_t keyframe_size,
+                                       uint32_t keyframe_interval, uint32_t checksum_interval)
+{
+  FILE *file = fopen(path, "wb");
+  if(!file) return 0;
+
+  ReplayRecorder *recorder = (ReplayRecorder *)malloc(sizeof(ReplayRecorder));
+  recorder->file = file;
+  recorder->offset = 0;
+  recorder->last_tick = 0;
+  recorder->keyframe_size = keyframe_size;
+  recorder->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+  recorder->checksum_interval = checksum_interval ? checksum_interval : 1;
+  recorder->num_keyframes = 0;
+  recorder->max_keyframes = 64;
+  recorder->keyframes = (ReplayKeyframe *)malloc(sizeof(ReplayKeyframe) * recorder->max_keyframes);
+
+  uint8_t header[REPLAY_HEADER_SIZE];
+  memcpy(header, REPLAY_MAGIC, 4);
+  write_u32(header + 4, REPLAY_VERSION);
+  write_u64(header + 8, seed);
+  write_u32(header + 16, keyframe_size);
+  write_u32(header + 20, recorder->keyframe_interval);
+  write_u32(header + 24, recorder->checksum_interval);
+  write_bytes(recorder, header, sizeof(header));
+
+  return recorder;
+}
+
+bool replay_keyframe_due(const ReplayRecorder *recorder, uint32_t tick)
+{
+  return tick % recorder->keyframe_interval == 0;
+}
+
+bool replay_checksum_due(const ReplayRecorder *recorder, uint32_t tick)
+{
+  return tick % recorder->checksum_interval == 0;
+}
+
+void record_replay_keyframe(ReplayRecorder *recorder, uint32_t tick, const void *keyframe)
+{
+  write_event(recorder, tick, REPLAY_KEYFRAME);
+
+  if(recorder->num_keyframes == recorder->max_keyframes)
+  {
+    recorder->max_keyframes *= 2;
+    recorder->keyframes =
+      (ReplayKeyframe *)realloc(recorder->keyframes, sizeof(ReplayKeyframe) * recorder->max_keyframes);
+  }
+  recorder->keyframes[recorder->num_keyframes].tick = tick;
+  recorder->keyframes[recorder->num_keyframes].offset = recorder->offset;
+  recorder->num_keyframes++;
+
+  write_bytes(recorder, keyframe, recorder->keyframe_size);
+}
+
+void record_replay_checksum(ReplayRecorder *recorder, uint32_t tick, uint32_t checksum)
+{
+  write_event(recorder, tick, REPLAY_CHECKSUM);
+
+  uint8_t value[4];
+  write_u32(value, checksum);
+  write_bytes(recorder, value, sizeof(value));
+}
+
+void record_replay_buttons(ReplayRecorder *recorder, uint32_t tick, unsigned buttons)
+{
+  write_event(recorder, tick, REPLAY_BUTTONS);
+
+  uint8_t mask = (uint8_t)buttons;
+  write_bytes(recorder, &mask, 1);
+}
+
+void destroy_replay_recorder(ReplayRecorder *recorder, uint32_t end_tick)
+{
+  if(!recorder) return;
+
+  write_event(recorder, end_tick, REPLAY_END);
+
+  uint64_t index_offset = recorder->offset;
+  for(int i = 0; i < recorder->num_keyframes; i++)
+  {
+    uint8_t entry[INDEX_ENTRY_SIZE];
+    write_u32(entry, recorder->keyframes[i].tick);
+    write_u64(entry + 4, recorder->keyframes[i].offset);
+    write_bytes(recorder, entry, sizeof(entry));
+  }
+
+  uint8_t trailer[REPLAY_TRAILER_SIZE];
+  write_u64(trailer, index_offset);
+  write_u32(trailer + 8, recorder->num_keyframes);
+  write_u32(trailer + 12, end_tick);
+  memcpy(trailer + 16, REPLAY_INDEX_MAGIC, 4);
+  write_bytes(recorder, trailer, sizeof(trailer));
+
+  fclose(recorder->file);
+  free(recorder->keyframes);
+  free(recorder);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Playback
+////////////////////////////////////////////////////////////////////////////////
+
+static const uint8_t *map_file(const char *path, size_t *size)
+{
+#ifdef _WIN32
+  FILE *file = fopen(path, "rb");
+  if(!file) return 0;
+
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  uint8_t *data = (uint8_t *)malloc(*size ? *size : 1);
+  bool read = fread(data, 1, *size, file) == *size;
+  fclose(file);
+  if(read) return data;
+
+  free(data);
+  return 0;
+#else
+  int file = open(path, O_RDONLY);
+  if(file < 0) return 0;
+
+  struct stat info;
+  void *data = MAP_FAILED;
+  if(fstat(file, &info) == 0 && info.st_size > 0)
+  {
+    *size = info.st_size;
+    data = mmap(0, *size, PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  close(file);
+
+  return (data == MAP_FAILED) ? 0 : (const uint8_t *)data;
+#endif
+}
+
+static void unmap_file(const uint8_t *data, size_t size)
+{
+#ifdef _WIN32
+  free((void *)data);
+#else
+  munmap((void *)data, size);
+#endif
+}
+
+// Reads the index from the trailer, false if the file doesn't have one
+static bool read_index(Replay *replay)
+{
+  const uint8_t *data = replay->file_data;
+  size_t size = replay->file_size;
+  if(size < (size_t)REPLAY_HEADER_SIZE + REPLAY_TRAILER_SIZE) return false;
+
+  const uint8_t *trailer = data + size - REPLAY_TRAILER_SIZE;
+  if(memcmp(trailer + 16, REPLAY_INDEX_MAGIC, 4)) return false;
+
+  uint64_t index_offset = read_u64(trailer);
+  uint32_t count = read_u32(trailer + 8);
+  if(index_offset < (uint64_t)REPLAY_HEADER_SIZE ||
+     index_offset + (uint64_t)count * INDEX_ENTRY_SIZE + REPLAY_TRAILER_SIZE != size)
+  {
+    return false;
+  }
+
+  replay->events_end = index_offset;
+  replay->end_tick = read_u32(trailer + 12);
+  replay->num_keyframes = count;
+  replay->keyframes = (ReplayKeyframe *)malloc(sizeof(ReplayKeyframe) * (count ? count : 1));
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    const uint8_t *entry = data + index_offset + i * INDEX_ENTRY_SIZE;
+    replay->keyframes[i].tick = read_u32(entry);
+    replay->keyframes[i].offset = read_u64(entry + 4);
+    if(replay->keyframes[i].offset + replay->keyframe_size > index_offset) return false;
+  }
+
+  return true;
+}
+
+// Rebuilds the index of a file cut short by walking all of its events
+static void scan_events(Replay *replay)
+{
+  replay->events_end = replay->file_size;
+  replay->num_keyframes = 0;
+  int max_keyframes = 64;
+  free(replay->keyframes);
+  replay->keyframes = (ReplayKeyframe *)malloc(sizeof(ReplayKeyframe) * max_keyframes);
+
+  ReplayCursor cursor;
+  start_replay_cursor(&cursor, replay);
+  while(cursor.next_kind != REPLAY_END)
+  {
+    if(cursor.next_kind == REPLAY_KEYFRAME)
+    {
+      if(replay->num_keyframes == max_keyframes)
+      {
+        max_keyframes *= 2;
+        replay->keyframes = (ReplayKeyframe *)realloc(replay->keyframes, sizeof(ReplayKeyframe) * max_keyframes);
+      }
+
+      // The snapshot follows the varint replay_buttons is about to step over
+      size_t offset = cursor.offset;
+      uint64_t event;
+      read_varint(replay->file_data, replay->events_end, &offset, &event);
+
+      replay->keyframes[replay->num_keyframes].tick = cursor.next_tick;
+      replay->keyframes[replay->num_keyframes].offset = offset;
+      replay->num_keyframes++;
+    }
+
+    replay_buttons(&cursor, cursor.next_tick);
+  }
+
+  replay->end_tick = cursor.next_tick;
+}
+
+Replay *load_replay(const char *path)
+{
+  size_t size = 0;
+  const uint8_t *data = map_file(path, &size);
+  if(!data) return 0;
+
+  if(size < (size_t)REPLAY_HEADER_SIZE || memcmp(data, REPLAY_MAGIC, 4) || read_u32(data + 4) != REPLAY_VERSION)
+  {
+    unmap_file(data, size);
+    return 0;
+  }
+
+  Replay *replay = (Replay *)malloc(sizeof(Replay));
+  replay->seed = read_u64(data + 8);
+  replay->keyframe_size = read_u32(data + 16);
+  replay->keyframe_interval = read_u32(data + 20);
+  replay->checksum_interval = read_u32(data + 24);
+  replay->file_data = data;
+  replay->file_size = size;
+  replay->events_begin = REPLAY_HEADER_SIZE;
+  replay->keyframes = 0;
+
+  if(!read_index(replay)) scan_events(replay);
+
+  return replay;
+}
+
+void free_replay(Replay *replay)
+{
+  if(!replay) return;
+
+  unmap_file(replay->file_data, replay->file_size);
+  free(replay->keyframes);
+  free(replay);
+}
+
+int replay_keyframe_before(const Replay *replay, uint32_t tick)
+{
+  // Past the last keyframe at or before tick
+  int low = 0;
+  int high = replay->num_keyframes;
+  while(low < high)
+  {
+    int middle = (low + high) / 2;
+    if(replay->keyframes[middle].tick <= tick) low = middle + 1;
+    else high = middle;
+  }
+
+  return low - 1;
+}
+
+const void *replay_keyframe_data(const Replay *replay, int keyframe)
+{
+  return replay->file_data + replay->keyframes[keyframe].offset;
+}
+
+static size_t event_payload(const Replay *replay, int kind)
+{
+  switch(kind)
+  {
+    case REPLAY_BUTTONS:  return 1;
+    case REPLAY_KEYFRAME: return replay->keyframe_size;
+    case REPLAY_CHECKSUM: return 4;
+  }
+
+  return 0;
+}
+
+// Reads the kind and tick of the event at the cursor's offset. If the data
+// runs out the recording ends just after the last event.
+static void read_next_event(ReplayCursor *cursor)
+{
+  const Replay *replay = cursor->replay;
+
+  uint64_t event;
+  size_t offset = cursor->offset;
+  if(!read_varint(replay->file_data, replay->events_end, &offset, &event))
+  {
+    if(cursor->offset > replay->events_begin) cursor->next_tick++;
+    cursor->next_kind = REPLAY_END;
+    return;
+  }
+
+  cursor->next_tick += (uint32_t)(event >> 2);
+  cursor->next_kind = (int)(event & 3);
+
+  if(offset + event_payload(replay, cursor->next_kind) > replay->events_end) cursor->next_kind = REPLAY_END;
+}
+
+void start_replay_cursor(ReplayCursor *cursor, const Replay *replay)
+{
+  cursor->replay = replay;
+  cursor->offset = replay->events_begin;
+  cursor->next_tick = 0;
+  cursor->buttons = 0;
+  cursor->has_checksum = false;
+  cursor->has_keyframe = false;
+
+  read_next_event(cursor);
+}
+
+void seek_replay_cursor(ReplayCursor *cursor, const Replay *replay, int keyframe, unsigned buttons)
+{
+  cursor->replay = replay;
+  cursor->offset = replay->keyframes[keyframe].offset + replay->keyframe_size;
+  cursor->next_tick = replay->keyframes[keyframe].tick;
+  cursor->buttons = buttons;
+  cursor->has_checksum = false;
+  cursor->has_keyframe = false;
+
+  read_next_event(cursor);
+}
+
+unsigned replay_buttons(ReplayCursor *cursor, uint32_t tick)
+{
+  const Replay *replay = cursor->replay;
+
+  while(cursor->next_kind != REPLAY_END && cursor->next_tick <= tick)
+  {
+    // Past the varint read_next_event already decoded
+    uint64_t event;
+    read_varint(replay->file_data, replay->events_end, &cursor->offset, &event);
+
+    const uint8_t *payload = replay->file_data + cursor->offset;
+    if(cursor->next_kind == REPLAY_BUTTONS)
+    {
+      cursor->buttons = payload[0];
+    }
+    else if(cursor->next_kind == REPLAY_KEYFRAME)
+    {
+      cursor->has_keyframe = true;
+      cursor->keyframe_tick = cursor->next_tick;
+      cursor->keyframe = payload;
+    }
+    else
+    {
+      cursor->has_checksum = true;
+      cursor->checksum_tick = cursor->next_tick;
+      cursor->checksum = read_u32(payload);
+    }
+    cursor->offset += event_payload(replay, cursor->next_kind);
+
+    read_next_event(cursor);
+  }
+
+  return cursor->buttons;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Replays. The game runs on fixed ticks and deals its pieces from a seed, so
+// a session is fully described by that seed and the GameButton mask at every
+// tick. The mask only changes when a key goes down or up, so only changes
+// are stored. Every so often the recorder also embeds a keyframe, a full
+// snapshot of the game at the start of a tick, so a player can jump to the
+// keyframe before any tick and simulate forward from there instead of from
+// the start.
+//
+// The game also keeps a rolling checksum, folding in its whole state after
+// every tick, and the recorder stores it every checksum interval. A replay
+// that plays out differently from how it was recorded (a change to the game,
+// a compiler, a platform) shows up as the first stored checksum that doesn't
+// match.
+//
+//   header    "TRPL", version (u32), seed (u64), keyframe size (u32),
+//             keyframe interval in ticks (u32), checksum interval in ticks (u32)
+//   events    varint(ticks since the previous event << 2 | kind), then
+//               kind 0: the new mask (1 byte)
+//               kind 1: nothing, the recording ends on this tick
+//               kind 2: a keyframe (keyframe size bytes)
+//               kind 3: the checksum at the start of this tick (u32)
+//   index     per keyframe: tick (u32), file offset of its snapshot (u64)
+//   trailer   index offset (u64), keyframe count (u32), end tick (u32), "TIDX"
+//
+// Numbers are little endian, varints 7 bits a byte, low bits first. A few
+// presses a piece at a byte or two of delta each comes to well under 20 bytes
+// a piece, plus a keyframe and a checksum every interval. The index and
+// trailer are written when recording stops; a file without them (the game
+// crashed) is scanned on load instead and plays up to its last event.
+//
+// The replay module doesn't know what's in a keyframe, the game fills and
+// reads them. Files are memory-mapped, so loading one doesn't read the
+// events and a seek only touches the pages it lands on.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stddef.h>
+
+static const char REPLAY_MAGIC[4] = {'T', 'R', 'P', 'L'};
+static const char REPLAY_INDEX_MAGIC[4] = {'T', 'I', 'D', 'X'};
+static const uint32_t REPLAY_VERSION = 4;
+static const int REPLAY_HEADER_SIZE = 28;
+static const int REPLAY_TRAILER_SIZE = 20;
+
+struct ReplayRecorder;
+
+// Writes the header, null if the file can't be opened. Keyframes are all
+// keyframe_size bytes and come every keyframe_interval ticks, checksums every
+// checksum_interval ticks.
+ReplayRecorder *create_replay_recorder(const char *path, uint64_t seed, uint32_t keyframe_size,
+                                       uint32_t keyframe_interval, uint32_t checksum_interval);
+
+// True on ticks a keyframe or checksum is due, before the tick is recorded
+// or run
+bool replay_keyframe_due(const ReplayRecorder *recorder, uint32_t tick);
+bool replay_checksum_due(const ReplayRecorder *recorder, uint32_t tick);
+void record_replay_keyframe(ReplayRecorder *recorder, uint32_t tick, const void *keyframe);
+void record_replay_checksum(ReplayRecorder *recorder, uint32_t tick, uint32_t checksum);
+
+// The mask changed to buttons on tick. Ticks only go up.
+void record_replay_buttons(ReplayRecorder *recorder, uint32_t tick, unsigned buttons);
+
+// Writes the end at end_tick, the index and the trailer, and closes the file
+void destroy_replay_recorder(ReplayRecorder *recorder, uint32_t end_tick);
+
+struct ReplayKeyframe
+{
+  uint32_t tick;
+  uint64_t offset; // Of the snapshot, from the start of the file
+};
+
+struct Replay
+{
+  uint64_t seed;
+  uint32_t end_tick; // First tick past the recording
+  uint32_t keyframe_size;
+  uint32_t keyframe_interval;
+  uint32_t checksum_interval;
+
+  const uint8_t *file_data; // Mapped
+  size_t file_size;
+  size_t events_begin;
+  size_t events_end;
+
+  int num_keyframes;
+  ReplayKeyframe *keyframes; // By tick
+};
+
+// Null if the file can't be read or isn't a replay
+Replay *load_replay(const char *path);
+void free_replay(Replay *replay);
+
+// The last keyframe at or before tick, -1 if there is none
+int replay_keyframe_before(const Replay *replay, uint32_t tick);
+const void *replay_keyframe_data(const Replay *replay, int keyframe);
+
+// Reads a replay tick by tick. The newest checksum and keyframe it went past
+// are kept for checking the game against.
+struct ReplayCursor
+{
+  const Replay *replay;
+  size_t offset;      // Of the next event
+  uint32_t next_tick; // When the next event happens
+  int next_kind;
+  unsigned buttons;
+
+  bool has_checksum;
+  uint32_t checksum_tick;
+  uint32_t checksum;
+
+  bool has_keyframe;
+  uint32_t keyframe_tick;
+  const void *keyframe;
+};
+
+void start_replay_cursor(ReplayCursor *cursor, const Replay *replay);
+
+// Continues from a keyframe, with the mask that was held on the tick before it
+void seek_replay_cursor(ReplayCursor *cursor, const Replay *replay, int keyframe, unsigned buttons);
+
+// The mask on tick. Ticks have to be asked for in order.
+unsigned replay_buttons(ReplayCursor *cursor, uint32_t tick);
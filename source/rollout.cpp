@@ -0,0 +1,172 @@
+#include "rollout.h"
+
+#include "sim_policy.h"
+#include "thread_pool.h"
+
+#include <stdlib.h> // malloc
+#include <string.h>
+
+struct RolloutOutcome
+{
+  float score;
+  int lines;
+  bool topped_out;
+};
+
+struct RolloutEngine
+{
+  ThreadPool *pool;
+  RolloutSettings settings;
+
+  SimPolicyScratch *scratch; // One per worker
+
+  // The batch run_rollouts hands to the pool
+  const SimState *root;
+  const RolloutMove *moves;
+  RolloutOutcome *outcomes; // rollouts_per_move per move
+};
+
+RolloutSettings default_rollout_settings()
+{
+  RolloutSettings settings;
+  settings.rollouts_per_move = 64;
+  settings.rollout_depth = 8;
+  settings.seed = 1;
+  settings.top_out_score = -100.0f;
+  settings.weights = default_evaluator_weights();
+  return settings;
+}
+
+RolloutEngine *create_rollout_engine(ThreadPool *pool, const RolloutSettings *settings)
+{
+  RolloutEngine *engine = (RolloutEngine *)malloc(sizeof(RolloutEngine));
+  memset(engine, 0, sizeof(RolloutEngine));
+  engine->pool = pool;
+  engine->settings = *settings;
+  if(engine->settings.rollouts_per_move < 1) engine->settings.rollouts_per_move = 1;
+  if(engine->settings.rollout_depth < 0) engine->settings.rollout_depth = 0;
+
+  int num_workers = thread_pool_size(pool);
+  engine->scratch = (SimPolicyScratch *)malloc(sizeof(SimPolicyScratch) * num_workers);
+  engine->outcomes = (RolloutOutcome *)malloc(sizeof(RolloutOutcome) * MAX_ROLLOUT_MOVES *
+                                              engine->settings.rollouts_per_move);
+
+  return engine;
+}
+
+void destroy_rollout_engine(RolloutEngine *engine)
+{
+  if(!engine) return;
+
+  free(engine->scratch);
+  free(engine->outcomes);
+  free(engine);
+}
+
+int generate_rollout_moves(RolloutEngine *engine, const SimState *state, RolloutMove *moves, int max_moves)
+{
+  SimPolicyScratch *scratch = &engine->scratch[0];
+
+  int num_moves = 0;
+  for(int hold = 0; hold < 2; hold++)
+  {
+    if(hold && !state->can_hold) break;
+
+    // Holding a piece of the same type changes nothing
+    PieceType type = sim_move_piece(state, hold != 0);
+    if(hold && type == state->current) break;
+
+    Piece start;
+    make_spawned_piece(&start, type);
+
+    int num_placements = generate_lock_positions(&state->board, &start, scratch->pieces, MAX_PLACEMENTS);
+    for(int i = 0; i < num_placements && num_moves < max_moves; i++)
+    {
+      moves[num_moves].hold = (hold != 0);
+      moves[num_moves].piece = scratch->pieces[i];
+      num_moves++;
+    }
+  }
+
+  return num_moves;
+}
+
+bool rollout_policy_move(RolloutEngine *engine, SimState *state)
+{
+  return play_greedy_move(state, &engine->settings.weights, false, &engine->scratch[0]);
+}
+
+static uint64_t rollout_seed(uint64_t seed, int rollout)
+{
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull * (uint64_t)(rollout + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static void run_rollout(void *context, int task, int worker)
+{
+  RolloutEngine *engine = (RolloutEngine *)context;
+  const RolloutSettings *settings = &engine->settings;
+  SimPolicyScratch *scratch = &engine->scratch[worker];
+
+  int move_index = task / settings->rollouts_per_move;
+  int rollout = task % settings->rollouts_per_move;
+  const RolloutMove *move = &engine->moves[move_index];
+
+  // Reseeded before the move, so even the piece it deals depends only on k
+  SimState state = *engine->root;
+  seed_sim_random(&state.random, rollout_seed(settings->seed, rollout), state.random.last_piece);
+
+  sim_apply_move(&state, move->hold, &move->piece);
+  for(int i = 0; i < settings->rollout_depth && !state.topped_out; i++)
+  {
+    if(!play_greedy_move(&state, &settings->weights, false, scratch)) state.topped_out = true;
+  }
+
+  RolloutOutcome *outcome = &engine->outcomes[task];
+  outcome->lines = state.lines_cleared - engine->root->lines_cleared;
+  outcome->topped_out = state.topped_out;
+
+  if(state.topped_out)
+  {
+    outcome->score = settings->top_out_score;
+  }
+  else
+  {
+    float line_weight = settings->weights.weights[FEATURE_COMPLETED_LINES];
+    outcome->score = line_weight * outcome->lines + evaluate_board(&state.board, &settings->weights);
+  }
+}
+
+void run_rollouts(RolloutEngine *engine, const SimState *state, const RolloutMove *moves, int num_moves,
+                  RolloutResult *results)
+{
+  if(num_moves > MAX_ROLLOUT_MOVES) num_moves = MAX_ROLLOUT_MOVES;
+
+  int rollouts = engine->settings.rollouts_per_move;
+  engine->root = state;
+  engine->moves = moves;
+  run_tasks(engine->pool, run_rollout, engine, num_moves * rollouts);
+
+  // Summed in task order on this thread, so the floats come out the same
+  // however the tasks were scheduled
+  for(int move = 0; move < num_moves; move++)
+  {
+    const RolloutOutcome *outcomes = &engine->outcomes[move * rollouts];
+
+    float score = 0.0f;
+    int lines = 0;
+    int top_outs = 0;
+    for(int i = 0; i < rollouts; i++)
+    {
+      score += outcomes[i].score;
+      lines += outcomes[i].lines;
+      top_outs += outcomes[i].topped_out;
+    }
+
+    results[move].mean_score = score / rollouts;
+    results[move].mean_lines = (float)lines / rollouts;
+    results[move].top_out_rate = (float)top_outs / rollouts;
+  }
+}
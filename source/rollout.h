@@ -0,0 +1,62 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Monte Carlo rollouts, for looking further ahead than the preview shows. Each
+// candidate move is played out rollouts_per_move times on its own copy of the
+// game, with random pieces past the preview and a fast greedy policy (best
+// evaluate_board for the falling piece, no hold) placing them. A rollout
+// scores the lines it cleared plus its final board, or top_out_score if it
+// died.
+//
+// Rollout k of every move deals the same pieces, so moves are compared on the
+// same futures rather than on luck. Pieces only depend on the seed, the move
+// and k, never on which thread ran what, so results are the same for a seed
+// whatever the thread count.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "sim_state.h"
+#include "move_generator.h"
+#include "board_evaluator.h"
+
+static const int MAX_ROLLOUT_MOVES = 2 * MAX_PLACEMENTS; // Every placement, with and without hold
+
+struct RolloutSettings
+{
+  int rollouts_per_move;
+  int rollout_depth; // Pieces placed by the policy after the move
+  uint64_t seed;
+  float top_out_score;
+  EvaluatorWeights weights;
+};
+
+RolloutSettings default_rollout_settings();
+
+struct RolloutMove
+{
+  bool hold;   // Hold first, piece is the one that comes out
+  Piece piece; // Where it locks
+};
+
+struct RolloutResult
+{
+  float mean_score;
+  float mean_lines;
+  float top_out_rate;
+};
+
+struct ThreadPool;
+struct RolloutEngine;
+
+RolloutEngine *create_rollout_engine(ThreadPool *pool, const RolloutSettings *settings);
+void destroy_rollout_engine(RolloutEngine *engine);
+
+// Every distinct placement of the falling piece, and of the one hold would
+// bring out
+int generate_rollout_moves(RolloutEngine *engine, const SimState *state, RolloutMove *moves, int max_moves);
+
+// One move of the default policy. False if the falling piece has nowhere to go.
+bool rollout_policy_move(RolloutEngine *engine, SimState *state);
+
+// results[i] is for moves[i]
+void run_rollouts(RolloutEngine *engine, const SimState *state, const RolloutMove *moves, int num_moves,
+                  RolloutResult *results);
@@ -0,0 +1,56 @@
+#include "sim_policy.h"
+
+// Adds every placement of type to the candidates, returns the new count
+static int add_candidates(const SimState *state, PieceType type, SimPolicyScratch *scratch, int num_candidates)
+{
+  Piece start;
+  make_spawned_piece(&start, type);
+
+  int num_placements = generate_lock_positions(&state->board, &start, &scratch->pieces[num_candidates], MAX_PLACEMENTS);
+  for(int i = 0; i < num_placements; i++)
+  {
+    scratch->boards[num_candidates] = state->board;
+    board_place_piece(&scratch->boards[num_candidates], &scratch->pieces[num_candidates]);
+    num_candidates++;
+  }
+
+  return num_candidates;
+}
+
+bool choose_greedy_move(const SimState *state, const EvaluatorWeights *weights, bool use_hold,
+                        SimPolicyScratch *scratch, bool *hold, Piece *piece)
+{
+  int num_current = add_candidates(state, state->current, scratch, 0);
+
+  // Holding a piece of the same type changes nothing
+  int num_candidates = num_current;
+  if(use_hold && state->can_hold)
+  {
+    PieceType held = sim_move_piece(state, true);
+    if(held != state->current) num_candidates = add_candidates(state, held, scratch, num_current);
+  }
+  if(num_candidates == 0) return false;
+
+  evaluate_boards(scratch->boards, num_candidates, weights, scratch->scores);
+
+  // First best wins ties, the same as any other run
+  int best = 0;
+  for(int i = 1; i < num_candidates; i++)
+  {
+    if(scratch->scores[i] > scratch->scores[best]) best = i;
+  }
+
+  *hold = best >= num_current;
+  *piece = scratch->pieces[best];
+  return true;
+}
+
+bool play_greedy_move(SimState *state, const EvaluatorWeights *weights, bool use_hold, SimPolicyScratch *scratch)
+{
+  bool hold;
+  Piece piece;
+  if(!choose_greedy_move(state, weights, use_hold, scratch, &hold, &piece)) return false;
+
+  sim_apply_move(state, hold, &piece);
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Fast greedy play for simulations: every placement of the falling piece (and
+// of the held one, if asked) goes through one evaluate_boards call and the
+// best locks. No lookahead, so it plays thousands of pieces a second per
+// thread, for rollouts and for headless games.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "sim_state.h"
+#include "move_generator.h"
+#include "board_evaluator.h"
+
+// What one thread needs to run the policy, too big for the stack
+struct SimPolicyScratch
+{
+  Board boards[2 * MAX_PLACEMENTS];
+  Piece pieces[2 * MAX_PLACEMENTS];
+  float scores[2 * MAX_PLACEMENTS];
+};
+
+// The move the policy would play, false if the falling piece has nowhere to go
+bool choose_greedy_move(const SimState *state, const EvaluatorWeights *weights, bool use_hold,
+                        SimPolicyScratch *scratch, bool *hold, Piece *piece);
+
+// Plays one move. False if the falling piece had nowhere to go.
+bool play_greedy_move(SimState *state, const EvaluatorWeights *weights, bool use_hold, SimPolicyScratch *scratch);
@@ -0,0 +1,119 @@
+#include "sim_state.h"
+#include "bot.h"
+
+#include <string.h> // memset
+
+// splitmix64, small and good enough for dealing pieces
+static uint64_t next_random(SimRandom *random)
+{
+  uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+int sim_random_below(SimRandom *random, int n)
+{
+  return (int)(((next_random(random) >> 32) * (uint64_t)n) >> 32);
+}
+
+static int random_piece_number(SimRandom *random)
+{
+  return sim_random_below(random, NO_PIECE);
+}
+
+void seed_sim_random(SimRandom *random, uint64_t seed, int last_piece)
+{
+  random->state = seed;
+  random->last_piece = last_piece;
+}
+
+PieceType next_sim_piece(SimRandom *random)
+{
+  int num = random_piece_number(random);
+
+  // If repeated piece, roll again
+  if(num == random->last_piece) num = random_piece_number(random);
+  random->last_piece = num;
+
+  return (PieceType)num;
+}
+
+void init_sim_state(SimState *state, uint64_t seed)
+{
+  memset(state, 0, sizeof(SimState));
+  clear_board(&state->board);
+
+  seed_sim_random(&state->random, seed, NO_PIECE);
+  for(int i = 0; i < SIM_QUEUE_LENGTH; i++) state->queue[i] = next_sim_piece(&state->random);
+
+  state->current = next_sim_piece(&state->random);
+  state->hold = NO_PIECE;
+  state->can_hold = true;
+}
+
+void sim_spawned_piece(const SimState *state, Piece *piece)
+{
+  make_spawned_piece(piece, state->current);
+}
+
+PieceType sim_move_piece(const SimState *state, bool hold)
+{
+  if(!hold) return state->current;
+  return (state->hold == NO_PIECE) ? state->queue[0] : state->hold;
+}
+
+static PieceType pop_queue(SimState *state)
+{
+  PieceType next = state->queue[0];
+  for(int i = 0; i < SIM_QUEUE_LENGTH - 1; i++) state->queue[i] = state->queue[i + 1];
+  state->queue[SIM_QUEUE_LENGTH - 1] = next_sim_piece(&state->random);
+
+  return next;
+}
+
+int sim_apply_move(SimState *state, bool hold, const Piece *placed)
+{
+  if(hold)
+  {
+    PieceType held = state->hold;
+    state->hold = state->current;
+    state->current = (held == NO_PIECE) ? pop_queue(state) : held;
+  }
+
+  board_place_piece(&state->board, placed);
+
+  int rows[4];
+  int num_rows = board_full_rows(&state->board, rows);
+  board_clear_rows(&state->board, rows, num_rows);
+
+  state->lines_cleared += num_rows;
+  state->pieces_placed++;
+
+  state->current = pop_queue(state);
+  state->can_hold = true;
+
+  Piece spawned;
+  sim_spawned_piece(state, &spawned);
+  if(board_collides(&state->board, &spawned)) state->topped_out = true;
+
+  return num_rows;
+}
+
+void sim_state_from_view(SimState *state, const BotView *view, uint64_t seed)
+{
+  memset(state, 0, sizeof(SimState));
+  state->board = view->board;
+
+  state->current = view->falling_piece.type;
+  state->hold = view->held_piece;
+  state->can_hold = view->can_hold;
+
+  // The game rerolls against the last piece it dealt, the back of the queue
+  int known = view->queue_length < SIM_QUEUE_LENGTH ? view->queue_length : SIM_QUEUE_LENGTH;
+  int last_piece = known ? view->queue[known - 1] : NO_PIECE;
+  seed_sim_random(&state->random, seed, last_piece);
+
+  for(int i = 0; i < known; i++) state->queue[i] = view->queue[i];
+  for(int i = known; i < SIM_QUEUE_LENGTH; i++) state->queue[i] = next_sim_piece(&state->random);
+}
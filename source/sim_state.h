@@ -0,0 +1,63 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// A game reduced to what decides how it plays out: board, pieces, queue and
+// the piece generator. Plain data, so copying one is a memcpy and every copy
+// can run on its own.
+//
+// The piece generator follows the game's rule (uniform, with one reroll when a
+// piece would repeat), but runs on its own seedable state, so a simulation
+// from a seed always deals the same pieces.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+#include <stdint.h>
+
+static const int SIM_QUEUE_LENGTH = 6; // Same as the game's preview
+
+struct SimRandom
+{
+  uint64_t state;
+  int last_piece;
+};
+
+struct SimState
+{
+  Board board;
+
+  PieceType current;
+  PieceType hold;
+  bool can_hold;
+
+  PieceType queue[SIM_QUEUE_LENGTH]; // queue[0] spawns next
+  SimRandom random;
+
+  int pieces_placed;
+  int lines_cleared;
+  bool topped_out;
+};
+
+void seed_sim_random(SimRandom *random, uint64_t seed, int last_piece);
+PieceType next_sim_piece(SimRandom *random);
+
+// 0..n-1, for anything else a simulation needs to roll
+int sim_random_below(SimRandom *random, int n);
+
+// Fresh game with an empty board
+void init_sim_state(SimState *state, uint64_t seed);
+
+// The falling piece at its spawn, where moves are generated from
+void sim_spawned_piece(const SimState *state, Piece *piece);
+
+// Which piece a move plays, the current one or the one hold brings out
+PieceType sim_move_piece(const SimState *state, bool hold);
+
+// Holds if asked, locks the piece where given, clears lines and spawns the
+// next piece. Returns the number of lines cleared.
+int sim_apply_move(SimState *state, bool hold, const Piece *placed);
+
+struct BotView;
+
+// The game as the bot sees it. Pieces past the preview come from seed.
+void sim_state_from_view(SimState *state, const BotView *view, uint64_t seed);
@@ -0,0 +1,360 @@
+#include "spectator.h"
+
+#include <string.h>
+
+
+// Events on the wire: a byte of GameEventType, and for a clear the number of
+// rows in its top half, then
+//   spawn:           piece | revealed << 4
+//   move, lock:      piece type | rotation << 4, x, y
+//   clear:           the rows
+//   hold, restart:   nothing
+
+static bool sequence_after(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) > 0;
+}
+
+// Turns the piece's points with it, the way the game does
+static void set_pose(Piece *piece, PieceType type, int rotation, int x, int y)
+{
+  piece->type = type;
+  while(piece->rotation != (RotationState)rotation) rotate(piece, 1);
+  piece->position = v2i(x, y);
+}
+
+static size_t encode_event(const GameEvent *event, uint8_t *out)
+{
+  const Piece *piece = &event->piece;
+  switch(event->type)
+  {
+    case GAME_EVENT_SPAWN:
+    {
+      out[0] = (uint8_t)event->type;
+      out[1] = (uint8_t)(piece->type | event->revealed << 4);
+      return 2;
+    }
+
+    case GAME_EVENT_MOVE:
+    case GAME_EVENT_LOCK:
+    {
+      out[0] = (uint8_t)event->type;
+      out[1] = (uint8_t)(piece->type | piece->rotation << 4);
+      out[2] = (uint8_t)(int8_t)piece->position.x;
+      out[3] = (uint8_t)(int8_t)piece->position.y;
+      return 4;
+    }
+
+    case GAME_EVENT_CLEAR:
+    {
+      out[0] = (uint8_t)(event->type | event->num_rows << 4);
+      for(int i = 0; i < event->num_rows; i++) out[1 + i] = (uint8_t)event->rows[i];
+      return 1 + event->num_rows;
+    }
+
+    default:
+    {
+      out[0] = (uint8_t)event->type;
+      return 1;
+    }
+  }
+}
+
+size_t encode_game_events(const GameEventList *events, uint32_t game_id, uint32_t tick, uint32_t first_event,
+                          uint8_t datagram[MAX_GAME_EVENTS_DATAGRAM])
+{
+  GameEventsHeader header = {};
+  header.magic = GAME_EVENTS_MAGIC;
+  header.game_id = game_id;
+  header.tick = tick;
+  header.first_event = first_event;
+  header.num_events = (uint8_t)events->num_events;
+  memcpy(datagram, &header, sizeof(header));
+
+  size_t size = sizeof(header);
+  for(int i = 0; i < events->num_events; i++) size += encode_event(&events->events[i], datagram + size);
+  return size;
+}
+
+size_t encode_game_snapshot(const HeadlessGameView *view, uint32_t game_id, uint32_t next_event,
+                            GameSnapshotPacket *packet)
+{
+  packet->magic = GAME_SNAPSHOT_MAGIC;
+  packet->game_id = game_id;
+  packet->tick = view->tick;
+  packet->next_event = next_event;
+  packet->score = view->score;
+
+  packet->falling_type = (int8_t)view->falling_piece.type;
+  packet->falling_rotation = (int8_t)view->falling_piece.rotation;
+  packet->falling_x = (int8_t)view->falling_piece.position.x;
+  packet->falling_y = (int8_t)view->falling_piece.position.y;
+  packet->held_piece = (int8_t)view->held_piece;
+  for(int i = 0; i < 6; i++) packet->next_pieces[i] = (int8_t)view->next_pieces[i];
+
+  // Colors only show where the board is filled, so everything above the top
+  // filled row can go
+  int num_rows = 0;
+  for(int row = 0; row < BOARD_ROWS; row++)
+  {
+    if(view->board.rows[row]) num_rows = row + 1;
+  }
+
+  packet->num_rows = (uint8_t)num_rows;
+  for(int row = 0; row < num_rows; row++)
+  {
+    GameSnapshotRow *out = &packet->rows[row];
+    const uint8_t *cells = &view->cells[row * BOARD_COLUMNS];
+    out->filled[0] = (uint8_t)view->board.rows[row];
+    out->filled[1] = (uint8_t)(view->board.rows[row] >> 8);
+    for(int column = 0; column < BOARD_COLUMNS; column += 2)
+    {
+      out->cells[column / 2] = (uint8_t)(cells[column] | cells[column + 1] << 4);
+    }
+  }
+
+  return offsetof(GameSnapshotPacket, rows) + sizeof(GameSnapshotRow) * num_rows;
+}
+
+
+
+void init_spectator_game(SpectatorGame *game, uint32_t game_id)
+{
+  *game = SpectatorGame();
+  game->game_id = game_id;
+  game->held_piece = NO_PIECE;
+  make_spawned_piece(&game->falling_piece, NO_PIECE);
+  memset(game->cells, NO_PIECE, sizeof(game->cells));
+  for(int i = 0; i < 6; i++) game->next_pieces[i] = NO_PIECE;
+}
+
+// False if it isn't a whole snapshot
+static bool read_snapshot(const void *data, size_t size, SpectatorGame *game)
+{
+  GameSnapshotPacket packet;
+  size_t header_size = offsetof(GameSnapshotPacket, rows);
+  if(size < header_size || size > sizeof(packet)) return false;
+
+  memcpy(&packet, data, size);
+  if(packet.num_rows > BOARD_ROWS || size != header_size + sizeof(GameSnapshotRow) * packet.num_rows) return false;
+  if(packet.falling_type < 0 || packet.falling_type > NO_PIECE || packet.falling_rotation & ~3) return false;
+
+  game->tick = packet.tick;
+  game->next_event = packet.next_event;
+  game->score = packet.score;
+
+  make_spawned_piece(&game->falling_piece, (PieceType)packet.falling_type);
+  set_pose(&game->falling_piece, (PieceType)packet.falling_type, packet.falling_rotation, packet.falling_x,
+           packet.falling_y);
+  game->held_piece = (PieceType)(packet.held_piece & 7);
+  for(int i = 0; i < 6; i++) game->next_pieces[i] = (PieceType)(packet.next_pieces[i] & 7);
+
+  clear_board(&game->board);
+  memset(game->cells, NO_PIECE, sizeof(game->cells));
+  for(int row = 0; row < packet.num_rows; row++)
+  {
+    const GameSnapshotRow *in = &packet.rows[row];
+    game->board.rows[row] = (uint16_t)((in->filled[0] | in->filled[1] << 8) & FULL_ROW);
+    for(int column = 0; column < BOARD_COLUMNS; column += 2)
+    {
+      game->cells[row * BOARD_COLUMNS + column] = in->cells[column / 2] & 15;
+      game->cells[row * BOARD_COLUMNS + column + 1] = in->cells[column / 2] >> 4;
+    }
+  }
+
+  return true;
+}
+
+// Whether the events got the spectator to where the snapshot says the game is.
+// Colors are compared where they show, in filled cells, but not in rows being
+// cleared: the game takes those away a column at a time and the spectator all
+// at once.
+static bool same_game(const SpectatorGame *a, const SpectatorGame *b)
+{
+  if(a->score != b->score || a->held_piece != b->held_piece) return false;
+  if(memcmp(a->next_pieces, b->next_pieces, sizeof(a->next_pieces))) return false;
+  if(memcmp(&a->board, &b->board, sizeof(Board))) return false;
+
+  const Piece *p = &a->falling_piece;
+  const Piece *q = &b->falling_piece;
+  if(p->type != q->type) return false;
+  if(p->type != NO_PIECE &&
+     (p->rotation != q->rotation || p->position.x != q->position.x || p->position.y != q->position.y))
+  {
+    return false;
+  }
+
+  for(int row = 0; row < BOARD_ROWS; row++)
+  {
+    if(a->board.rows[row] == FULL_ROW) continue;
+
+    for(int column = 0; column < BOARD_COLUMNS; column++)
+    {
+      int cell = row * BOARD_COLUMNS + column;
+      if(((a->board.rows[row] >> column) & 1) && a->cells[cell] != b->cells[cell]) return false;
+    }
+  }
+
+  return true;
+}
+
+static void take_snapshot(SpectatorGame *game, const void *data, size_t size)
+{
+  SpectatorGame snapshot = *game;
+  if(!read_snapshot(data, size, &snapshot)) return;
+
+  // One from before the events already played
+  if(game->synced && sequence_after(game->next_event, snapshot.next_event)) return;
+
+  if(game->synced && snapshot.next_event == game->next_event && !same_game(game, &snapshot)) snapshot.desyncs++;
+
+  *game = snapshot;
+  game->synced = true;
+  game->snapshots++;
+}
+
+static void lock_piece(SpectatorGame *game)
+{
+  const Piece *piece = &game->falling_piece;
+  board_place_piece(&game->board, piece);
+  for(int i = 0; i < 4; i++)
+  {
+    v2i p = piece->position + piece->points[i];
+    if(p.x < 0 || p.x >= BOARD_COLUMNS || p.y < 0 || p.y >= BOARD_ROWS) continue;
+
+    game->cells[p.y * BOARD_COLUMNS + p.x] = (uint8_t)piece->type;
+  }
+
+  int rows[4];
+  game->score += board_full_rows(&game->board, rows) * SCORE_PER_ROW;
+  game->falling_piece.type = NO_PIECE;
+}
+
+static void clear_rows(SpectatorGame *game, const int *rows, int num_rows)
+{
+  board_clear_rows(&game->board, rows, num_rows);
+
+  // Top-most first, like the game
+  for(int i = num_rows - 1; i >= 0; i--)
+  {
+    uint8_t *row = &game->cells[rows[i] * BOARD_COLUMNS];
+    memmove(row, row + BOARD_COLUMNS, (BOARD_ROWS - 1 - rows[i]) * BOARD_COLUMNS);
+    memset(&game->cells[(BOARD_ROWS - 1) * BOARD_COLUMNS], NO_PIECE, BOARD_COLUMNS);
+  }
+}
+
+// Plays one event from data, returns its size or 0 if it can't be read or
+// can't be followed
+static size_t play_event(SpectatorGame *game, const uint8_t *data, size_t size)
+{
+  if(size < 1) return 0;
+
+  Piece *piece = &game->falling_piece;
+  switch(data[0] & 15)
+  {
+    case GAME_EVENT_SPAWN:
+    {
+      if(size < 2) return 0;
+
+      PieceType type = (PieceType)(data[1] & 7);
+      PieceType revealed = (PieceType)(data[1] >> 4 & 7);
+      make_spawned_piece(piece, type);
+
+      // Out of the queue
+      if(revealed != NO_PIECE)
+      {
+        if(game->next_pieces[0] != type) return 0;
+
+        memmove(game->next_pieces, game->next_pieces + 1, sizeof(PieceType) * 5);
+        game->next_pieces[5] = revealed;
+      }
+      return 2;
+    }
+
+    case GAME_EVENT_MOVE:
+    case GAME_EVENT_LOCK:
+    {
+      if(size < 4) return 0;
+
+      set_pose(piece, (PieceType)(data[1] & 7), data[1] >> 4 & 3, (int8_t)data[2], (int8_t)data[3]);
+      if((data[0] & 15) == GAME_EVENT_LOCK) lock_piece(game);
+      return 4;
+    }
+
+    case GAME_EVENT_HOLD:
+    {
+      game->held_piece = piece->type;
+      return 1;
+    }
+
+    case GAME_EVENT_CLEAR:
+    {
+      int num_rows = data[0] >> 4;
+      if(num_rows > 4 || size < (size_t)(1 + num_rows)) return 0;
+
+      int rows[4];
+      for(int i = 0; i < num_rows; i++)
+      {
+        rows[i] = data[1 + i];
+        if(rows[i] >= BOARD_ROWS) return 0;
+      }
+      clear_rows(game, rows, num_rows);
+      return 1 + num_rows;
+    }
+
+    // A restart, or something this spectator doesn't know, only a snapshot
+    // can follow
+    default: return 0;
+  }
+}
+
+static void take_events(SpectatorGame *game, const uint8_t *data, size_t size)
+{
+  GameEventsHeader header;
+  if(size < sizeof(header)) return;
+  memcpy(&header, data, sizeof(header));
+
+  if(!game->synced) return;
+
+  // Already played, or some went missing
+  if(header.first_event != game->next_event)
+  {
+    if(sequence_after(header.first_event, game->next_event))
+    {
+      game->synced = false;
+      game->gaps++;
+    }
+    return;
+  }
+
+  size_t offset = sizeof(header);
+  for(int i = 0; i < header.num_events; i++)
+  {
+    size_t used = play_event(game, data + offset, size - offset);
+    if(!used)
+    {
+      game->synced = false;
+      return;
+    }
+
+    offset += used;
+    game->next_event++;
+    game->events++;
+  }
+
+  game->tick = header.tick;
+}
+
+bool take_spectator_datagram(SpectatorGame *game, const void *data, size_t size)
+{
+  uint32_t magic_and_id[2];
+  if(size < sizeof(magic_and_id)) return false;
+  memcpy(magic_and_id, data, sizeof(magic_and_id));
+  if(magic_and_id[1] != game->game_id) return false;
+
+  if(magic_and_id[0] == GAME_SNAPSHOT_MAGIC) take_snapshot(game, data, size);
+  else if(magic_and_id[0] == GAME_EVENTS_MAGIC) take_events(game, (const uint8_t *)data, size);
+  else return false;
+
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Watching games on the game server without being sent the whole game every
+// tick. A spectator starts its own copy of the board, pieces and score from a
+// snapshot and plays the server's events on it with the same board code the
+// game uses, which costs a few bytes a tick instead of a full state. See
+// game_protocol.h for how they're sent.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "game_protocol.h"
+#include "tetris.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct SpectatorGame
+{
+  uint32_t game_id;
+
+  // Events are only played from a snapshot on, and in order
+  bool synced;
+  uint32_t next_event;
+  uint32_t tick;
+
+  unsigned score;
+  Board board;
+  uint8_t cells[BOARD_ROWS * BOARD_COLUMNS]; // As in HeadlessGameView, only meaningful where board is filled
+  Piece falling_piece;
+  PieceType held_piece;
+  PieceType next_pieces[6];
+
+  // Since init, for tools
+  uint32_t events;
+  uint32_t snapshots;
+  uint32_t gaps;    // Times events were missed and the game waited for a snapshot
+  uint32_t desyncs; // Snapshots that didn't match what the events had made
+};
+
+void init_spectator_game(SpectatorGame *game, uint32_t game_id);
+
+// Takes a snapshot or events datagram from the server. False if it isn't one
+// for this game.
+bool take_spectator_datagram(SpectatorGame *game, const void *data, size_t size);
+
+
+// Server side, both return the size of the datagram to send. A clear of four
+// rows is the longest event, at 5 bytes.
+static const size_t MAX_GAME_EVENTS_DATAGRAM = sizeof(GameEventsHeader) + MAX_TICK_EVENTS * 5;
+
+size_t encode_game_events(const GameEventList *events, uint32_t game_id, uint32_t tick, uint32_t first_event,
+                          uint8_t datagram[MAX_GAME_EVENTS_DATAGRAM]);
+
+size_t encode_game_snapshot(const HeadlessGameView *view, uint32_t game_id, uint32_t next_event,
+                            GameSnapshotPacket *packet);
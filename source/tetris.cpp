@@ -1,74 +1,61 @@
 #include "tetris.h"
 
+#include "piece.h"
+#include "board.h"
+#include "zobrist.h"
+#include "finesse.h"
+#include "sim_state.h"
+#include "replay.h"
+#include "bot.h"
 #include "game_presentation.h"
 #include "input.h"
 #include "game_timer.h"
+#include "latency.h"
 
 #include <chrono> // For seeding random
-#include <random>
 #include <cstring> // memset
+#include <cstddef> // offsetof
+#include <cstdio> // snprintf
+#include <type_traits> // is_trivially_copyable
 
 static const int NUM_NEXT_PIECES = 6;
-static const float FALL_INTERVAL = 200.0f;
-static const float SPEED_UP_MODIFIER = 5.0f;
 static const float LOCK_TIME = 500.0f;
 static const float LOCK_TOLERANCE = 2000.0f;
+static const uint32_t KEYFRAME_INTERVAL = 30 * 60; // Ticks, replays seek to within 30 seconds
+static const uint32_t CHECKSUM_INTERVAL = 60;       // Ticks, divergence is found to within a second
 
-enum PieceType
-{
-  I_PIECE,
-  J_PIECE,
-  L_PIECE,
-  O_PIECE,
-  S_PIECE,
-  T_PIECE,
-  Z_PIECE,
-
-  NO_PIECE
-};
-
-enum RotationState
-{
-  RS_0,
-  RS_R,
-  RS_2,
-  RS_L,
-};
-
-struct Piece
-{
-  PieceType type;
-
-  v2i position;
-  RotationState rotation;
-
-  v2i points[4];
-};
 
+// Only which piece filled it for its color, which cells are filled lives in
+// GameState::board. NO_PIECE draws black.
 struct Cell
 {
-  bool filled = false;
-  Color color = Color(0.0f, 0.0f, 0.0f, 1.0f);
+  uint8_t type = NO_PIECE;
 };
 
 struct Grid
 {
-  int rows, columns;
+  static const int rows = BOARD_ROWS;
+  static const int columns = BOARD_COLUMNS;
 
-  Cell *cells;
+  Cell cells[BOARD_ROWS * BOARD_COLUMNS];
 
   Cell &operator[](v2i point) { return cells[point.y * columns + point.x]; }
 };
 
+// Everything that plays out from one tick to the next. Plain data with no
+// pointers, so a snapshot for a replay keyframe or a rollback is a copy of
+// the whole thing.
 struct GameState
 {
   // Game grid
+  Board board;
+  uint64_t board_hash = 0; // zobrist_board(&board), kept up to date as pieces lock and rows clear
   Grid grid;
 
 
-  // Piece generation
-  std::default_random_engine *generator;
-  std::uniform_int_distribution<int> *distribution;
+  // Piece generation, the same rule and generator as simulations
+  uint64_t seed = 0;
+  SimRandom random;
   int next_piece_index = 0;
   PieceType next_pieces[NUM_NEXT_PIECES];
 
@@ -80,8 +67,10 @@ struct GameState
 
   // Falling piece
   Piece falling_piece;
+  unsigned piece_number = 0;
   float lock_delay_timer = LOCK_TIME;
   float lock_tolerance_timer = LOCK_TOLERANCE;
+  unsigned piece_presses = 0; // Movement buttons pressed since it spawned
 
 
   // Grid cells to clear
@@ -92,6 +81,61 @@ struct GameState
   bool freeze = false;
 
   unsigned score = 0;
+  FinesseStats finesse = {};
+
+
+  // Input and timers, stepped once a tick
+  unsigned buttons_down = 0;
+  float delay_counter = 0.0f;
+  float move_counter = 0.0f;
+  float fall_counter = 0.0f;
+  float clear_timer = 0.0f;
+  int clear_column = 0;
+
+
+  // Fixed ticks
+  uint32_t tick = 0;
+  uint64_t checksum = 0; // Of the state after every tick so far
+};
+
+static_assert(std::is_trivially_copyable<GameState>::value, "snapshots are a memcpy");
+static_assert(sizeof(HeadlessGameView::next_pieces) == sizeof(GameState::next_pieces), "views show the whole queue");
+
+static const int ROLLBACK_TICKS = 8;
+static const int MAX_TICKS_PER_FRAME = ROLLBACK_TICKS;
+
+// Where the ticks come from and go to, outside of the game itself
+struct GameSession
+{
+  // Run as many ticks as the frame time adds up to
+  float tick_time_left = 0.0f;
+
+
+  // Replays, the game is recorded while recorder is set and plays back
+  // replay's buttons while it is set
+  ReplayRecorder *recorder = 0;
+  unsigned recorded_buttons = 0;
+  Replay *replay = 0;
+  ReplayCursor replay_cursor;
+
+
+  // Rollback, the game at the start of each of the last ROLLBACK_TICKS ticks
+  // and the buttons it ran on, by tick % ROLLBACK_TICKS. Ticks before
+  // rollback_start are from another game.
+  GameState rollback_states[ROLLBACK_TICKS];
+  unsigned rollback_buttons[ROLLBACK_TICKS];
+  uint32_t rollback_start = 0;
+
+  // Remote input, held along with this machine's. The local buttons and when
+  // each tick ran (latency_now_ns) go with the rollback slots, so a late
+  // remote change can be put back on the tick it should have made.
+  unsigned remote_buttons = 0;
+  unsigned rollback_local_buttons[ROLLBACK_TICKS];
+  uint64_t rollback_tick_times[ROLLBACK_TICKS];
+
+
+  // Autoplay, plays instead of the keyboard when set
+  Bot *bot = 0;
 };
 
 
@@ -99,33 +143,15 @@ struct GameState
 
 // GLOBALS
 static GameState game_state;
+static GameSession session;
 
-static const int NUM_KICK_TESTS = 5;
-static v2i default_offset_data[20] =
-{
-  // 1         2         3         4         5
-  { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, // 0
-  { 0,  0}, { 1,  0}, { 1, -1}, { 0,  2}, { 1,  2}, // R
-  { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, { 0,  0}, // 2
-  { 0,  0}, {-1,  0}, {-1, -1}, { 0,  2}, {-1,  2}  // L
-};
-static v2i i_piece_offset_data[20] =
-{
-  // 1         2         3         4         5
-  { 0,  0}, {-1,  0}, { 2,  0}, {-1,  0}, { 2,  0}, // 0
-  {-1,  0}, { 0,  0}, { 0,  0}, { 0,  1}, { 0, -2}, // R
-  {-1,  1}, { 1,  1}, {-2,  1}, { 1,  0}, {-2,  0}, // 2
-  { 0,  1}, { 0,  1}, { 0,  1}, { 0, -1}, { 0,  2}  // L
-};
+// Where tick_game says what happened, 0 when nobody is following. Headless
+// games only.
+static GameEventList *tick_events;
+
+// The falling piece as the events so far this tick left it
+static Piece reported_piece;
 
-static const int NUM_O_KICK_TESTS = 1;
-static v2i o_piece_offset_data[4] =
-{
-  { 0,  0},
-  { 0, -1},
-  {-1, -1},
-  {-1,  0}
-};
 
 
 
@@ -155,68 +181,6 @@ static v2i mouse_grid_position()
 
 
 
-static void make_i_piece(Piece *p)
-{
-  p->type = I_PIECE;
-  p->points[0] = v2i(-1, 0);
-  p->points[1] = v2i( 0, 0);
-  p->points[2] = v2i( 1, 0);
-  p->points[3] = v2i( 2, 0);
-}
-
-static void make_j_piece(Piece *p)
-{
-  p->type = J_PIECE;
-  p->points[0] = v2i(-1, 1);
-  p->points[1] = v2i(-1, 0);
-  p->points[2] = v2i( 0, 0);
-  p->points[3] = v2i( 1, 0);
-}
-
-static void make_l_piece(Piece *p)
-{
-  p->type = L_PIECE;
-  p->points[0] = v2i(-1, 0);
-  p->points[1] = v2i( 0, 0);
-  p->points[2] = v2i( 1, 0);
-  p->points[3] = v2i( 1, 1);
-}
-
-static void make_o_piece(Piece *p)
-{
-  p->type = O_PIECE;
-  p->points[0] = v2i( 0,  0);
-  p->points[1] = v2i( 1,  0);
-  p->points[2] = v2i( 1,  1);
-  p->points[3] = v2i( 0,  1);
-}
-
-static void make_s_piece(Piece *p)
-{
-  p->type = S_PIECE;
-  p->points[0] = v2i(-1,  0);
-  p->points[1] = v2i( 0,  0);
-  p->points[2] = v2i( 0,  1);
-  p->points[3] = v2i( 1,  1);
-}
-
-static void make_t_piece(Piece *p)
-{
-  p->type = T_PIECE;
-  p->points[0] = v2i( 0, 0);
-  p->points[1] = v2i(-1, 0);
-  p->points[2] = v2i( 1, 0);
-  p->points[3] = v2i( 0, 1);
-}
-
-static void make_z_piece(Piece *p)
-{
-  p->type = Z_PIECE;
-  p->points[0] = v2i(-1,  1);
-  p->points[1] = v2i( 0,  1);
-  p->points[2] = v2i( 0,  0);
-  p->points[3] = v2i( 1,  0);
-}
 
 static Color piece_color(PieceType type)
 {
@@ -229,26 +193,17 @@ static Color piece_color(PieceType type)
     case S_PIECE: { return Color(0.0f, 1.0f, 0.0f, 1.0f); }
     case T_PIECE: { return Color(1.0f, 0.0f, 1.0f, 1.0f); }
     case Z_PIECE: { return Color(1.0f, 0.0f, 0.0f, 1.0f); }
+    case NO_PIECE: { return Color(0.0f, 0.0f, 0.0f, 0.0f); }
   }
 
-  return Color();
+  return Color(0.0f, 0.0f, 0.0f, 0.0f);
 }
 
 static void draw_piece(PieceType type, v2i position, float opaqueness, int screen_position = 0)
 {
   Piece piece;
-  switch(type)
-  {
-    case 0: {make_i_piece(&piece); break;}
-    case 1: {make_j_piece(&piece); break;}
-    case 2: {make_l_piece(&piece); break;}
-    case 3: {make_o_piece(&piece); break;}
-    case 4: {make_s_piece(&piece); break;}
-    case 5: {make_t_piece(&piece); break;}
-    case 6: {make_z_piece(&piece); break;}
-
-    default: return;
-  }
+  make_piece(&piece, type);
+  if(piece.type == NO_PIECE) return;
 
   for(int i = 0; i < 4; i++)
   {
@@ -280,96 +235,102 @@ static void draw_piece(Piece *piece, v2i position, float opaqueness, int screen_
 
 static bool animate_filled_rows()
 {
-  static float timer = 0.0f;
-  static int current_column = 0;
-
   static const float animation_interval = 40.0f;
   float animation_threshold = animation_interval;
 
-  timer += get_dt();
+  game_state.clear_timer += TICK_TIME;
 
   Grid *grid = &game_state.grid;
-  if(timer >= animation_threshold)
+  if(game_state.clear_timer >= animation_threshold)
   {
     for(int i = 0; i < game_state.num_rows_to_clear; i++)
     {
-      v2i cell = v2i(current_column, game_state.rows_to_clear[i]);
-      (*grid)[cell].color = Color(0.0f, 0.0f, 0.0f, 1.0f);
+      v2i cell = v2i(game_state.clear_column, game_state.rows_to_clear[i]);
+      (*grid)[cell].type = NO_PIECE;
     }
 
-    current_column++;
+    game_state.clear_column++;
 
-    timer -= animation_threshold;
+    game_state.clear_timer -= animation_threshold;
   }
 
-  if(current_column >= grid->columns)
+  if(game_state.clear_column >= grid->columns)
   {
-    current_column = 0;
+    game_state.clear_column = 0;
     return true;
   }
 
   return false;
 }
 
-static void spawn_piece(PieceType type)
+static GameEvent *report_event(GameEventType type)
 {
-  Piece *falling_piece = &game_state.falling_piece;
+  GameEventList *list = tick_events;
+  if(!list) return 0;
+
+  // Too much for the list, a snapshot says what the rest was
+  if(list->num_events == MAX_TICK_EVENTS)
+  {
+    list->events[MAX_TICK_EVENTS - 1].type = GAME_EVENT_RESTART;
+    return 0;
+  }
 
-  falling_piece->position = v2i(4, 16);
-  falling_piece->rotation = RS_0;
+  GameEvent *event = &list->events[list->num_events++];
+  event->type = type;
+  event->piece = game_state.falling_piece;
+  event->revealed = NO_PIECE;
+  event->num_rows = 0;
+  reported_piece = game_state.falling_piece;
+  return event;
+}
 
-  switch(type)
+static void report_moved_piece()
+{
+  const Piece *piece = &game_state.falling_piece;
+  if(!tick_events) return;
+
+  if(piece->type != reported_piece.type || piece->rotation != reported_piece.rotation ||
+     piece->position.x != reported_piece.position.x || piece->position.y != reported_piece.position.y)
   {
-    case 0: {make_i_piece(falling_piece); break;}
-    case 1: {make_j_piece(falling_piece); break;}
-    case 2: {make_l_piece(falling_piece); break;}
-    case 3: {make_o_piece(falling_piece); break;}
-    case 4: {make_s_piece(falling_piece); break;}
-    case 5: {make_t_piece(falling_piece); break;}
-    case 6: {make_z_piece(falling_piece); break;}
+    report_event(GAME_EVENT_MOVE);
   }
 }
 
-static void spawn_next_piece()
+// revealed is the piece that joined the queue for it, NO_PIECE if none did
+static void spawn_piece(PieceType type, PieceType revealed)
 {
+  make_spawned_piece(&game_state.falling_piece, type);
+  game_state.piece_number++;
+  game_state.piece_presses = 0;
 
-  static int last_num;
-  int num = (*game_state.distribution)(*game_state.generator);
+  GameEvent *event = report_event(GAME_EVENT_SPAWN);
+  if(event) event->revealed = revealed;
+}
 
-  // If repeated piece, roll again
-  if(num == last_num) num = (*game_state.distribution)(*game_state.generator);
-  last_num = num;
+static void spawn_next_piece()
+{
+  // Uniform, rolled again once if it repeats
+  PieceType num = next_sim_piece(&game_state.random);
 
-  spawn_piece((PieceType)game_state.next_pieces[game_state.next_piece_index]);
-  game_state.next_pieces[game_state.next_piece_index] = (PieceType)num;
+  spawn_piece((PieceType)game_state.next_pieces[game_state.next_piece_index], num);
+  game_state.next_pieces[game_state.next_piece_index] = num;
   game_state.next_piece_index++;
   game_state.next_piece_index %= NUM_NEXT_PIECES;
 }
 
 static void reset_next_pieces()
 {
-  static int last_num;
-  for(int i = 0; i < NUM_NEXT_PIECES; i++)
-  {
-    int num = (*game_state.distribution)(*game_state.generator);
-
-    // If repeated piece, roll again
-    if(num == last_num) num = (*game_state.distribution)(*game_state.generator);
-    last_num = num;
-
-    game_state.next_pieces[i] = (PieceType)num;
-  }
+  for(int i = 0; i < NUM_NEXT_PIECES; i++) game_state.next_pieces[i] = next_sim_piece(&game_state.random);
 
   game_state.next_piece_index = 0;
 }
 
 static void restart_game()
 {
-  Grid *grid = &game_state.grid;
-  for(int i = 0; i < grid->rows * grid->columns; i++)
-  {
-    grid->cells[i].filled = false;
-  }
+  report_event(GAME_EVENT_RESTART);
+
+  clear_board(&game_state.board);
+  game_state.board_hash = 0;
 
   game_state.held_piece = NO_PIECE;
 
@@ -378,51 +339,140 @@ static void restart_game()
   spawn_next_piece();
 }
 
-static void swap(int &a, int &b)
+// Everything that plays out differently from one tick to the next back to
+// how a game starts, dealt from seed. Recording and playback start here.
+static void new_game(uint64_t seed)
 {
-  a ^= b;
-  b ^= a;
-  a ^= b;
+  game_state.seed = seed;
+  seed_sim_random(&game_state.random, seed, NO_PIECE);
+
+  Grid *grid = &game_state.grid;
+  for(int i = 0; i < grid->rows * grid->columns; i++) grid->cells[i] = Cell();
+
+  game_state.swapped_piece_this_turn = false;
+  game_state.piece_number = 0;
+  game_state.lock_delay_timer = LOCK_TIME;
+  game_state.lock_tolerance_timer = LOCK_TOLERANCE;
+  game_state.piece_presses = 0;
+  game_state.num_rows_to_clear = 0;
+  memset(game_state.rows_to_clear, 0, sizeof(game_state.rows_to_clear));
+  game_state.freeze = false;
+  game_state.score = 0;
+
+  game_state.buttons_down = 0;
+  game_state.delay_counter = 0.0f;
+  game_state.move_counter = 0.0f;
+  game_state.fall_counter = 0.0f;
+  game_state.clear_timer = 0.0f;
+  game_state.clear_column = 0;
+  game_state.tick = 0;
+  game_state.checksum = 0;
+  session.rollback_start = 0;
+
+  restart_game();
 }
 
-static bool valid_point(v2i p)
+// Keyframes are written to files as they are. game_state starts zeroed and
+// is only ever copied whole from snapshots of itself, so its padding stays
+// zero and keyframes come out the same run to run.
+static void save_snapshot(GameState *snapshot)
 {
-  if(p.x < 0 || p.x >= game_state.grid.columns ||
-     p.y < 0 || p.y >= game_state.grid.rows) return false;
-  return true;
+  memcpy(snapshot, &game_state, sizeof(GameState));
 }
 
-static void mark_filled_rows()
+static void restore_snapshot(const GameState *snapshot)
 {
-  Grid *grid = &game_state.grid;
+  memcpy(&game_state, snapshot, sizeof(GameState));
+}
 
-  int num_marked_rows = 0;
-  int rows_to_clear[4] = {};
+// Finesse counts from before recording started and is left out of
+// checksums and keyframe comparisons, everything else has to match. Only the
+// bytes that hold values, so padding never counts: fields with padding of
+// their own are listed member by member.
+#define SNAPSHOT_FIELD(name) {#name, offsetof(GameState, name), sizeof(((GameState *)0)->name)}
+static const struct
+{
+  const char *name;
+  size_t offset;
+  size_t size;
+} SNAPSHOT_FIELDS[] =
+{
+  SNAPSHOT_FIELD(board), SNAPSHOT_FIELD(board_hash), SNAPSHOT_FIELD(grid),
+  SNAPSHOT_FIELD(seed), SNAPSHOT_FIELD(random.state), SNAPSHOT_FIELD(random.last_piece),
+  SNAPSHOT_FIELD(next_piece_index),
+  SNAPSHOT_FIELD(next_pieces), SNAPSHOT_FIELD(held_piece), SNAPSHOT_FIELD(swapped_piece_this_turn),
+  SNAPSHOT_FIELD(falling_piece), SNAPSHOT_FIELD(piece_number), SNAPSHOT_FIELD(lock_delay_timer),
+  SNAPSHOT_FIELD(lock_tolerance_timer), SNAPSHOT_FIELD(piece_presses),
+  SNAPSHOT_FIELD(num_rows_to_clear), SNAPSHOT_FIELD(rows_to_clear), SNAPSHOT_FIELD(freeze),
+  SNAPSHOT_FIELD(score),
+  SNAPSHOT_FIELD(buttons_down), SNAPSHOT_FIELD(delay_counter), SNAPSHOT_FIELD(move_counter),
+  SNAPSHOT_FIELD(fall_counter), SNAPSHOT_FIELD(clear_timer), SNAPSHOT_FIELD(clear_column),
+  SNAPSHOT_FIELD(tick), SNAPSHOT_FIELD(checksum),
+};
+#undef SNAPSHOT_FIELD
 
-  // Go through cells and find filled row
-  for(int row = 0; row < grid->rows; row++)
+// The first field that differs, null if none does
+static const char *snapshot_difference(const GameState *a, const GameState *b)
+{
+  for(size_t i = 0; i < sizeof(SNAPSHOT_FIELDS) / sizeof(SNAPSHOT_FIELDS[0]); i++)
   {
-    bool found_gap = false;
-    for(int column = 0; column < grid->columns; column++)
+    size_t offset = SNAPSHOT_FIELDS[i].offset;
+    if(memcmp((const char *)a + offset, (const char *)b + offset, SNAPSHOT_FIELDS[i].size))
     {
-      if((*grid)[v2i(column, row)].filled == false)
-      {
-        found_gap = true;
-        break;
-      }
+      return SNAPSHOT_FIELDS[i].name;
+    }
+  }
+
+  return 0;
+}
+
+static uint64_t hash_word(uint64_t hash, uint64_t word)
+{
+  hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+  return hash ^ (hash >> 29);
+}
+
+// Folds the state the last tick left into the rolling checksum, field by
+// field from SNAPSHOT_FIELDS. A word at a time, a tick costs a few hundred
+// nanoseconds.
+static void update_checksum()
+{
+  const uint8_t *bytes = (const uint8_t *)&game_state;
+  uint64_t hash = game_state.checksum;
+  for(size_t i = 0; i < sizeof(SNAPSHOT_FIELDS) / sizeof(SNAPSHOT_FIELDS[0]); i++)
+  {
+    size_t offset = SNAPSHOT_FIELDS[i].offset;
+    size_t size = SNAPSHOT_FIELDS[i].size;
+    if(offset == offsetof(GameState, checksum)) continue;
+
+    size_t at = 0;
+    for(; at + 8 <= size; at += 8)
+    {
+      uint64_t word;
+      memcpy(&word, bytes + offset + at, 8);
+      hash = hash_word(hash, word);
     }
 
-    if(!found_gap)
+    if(at < size)
     {
-      rows_to_clear[num_marked_rows] = row;
-      num_marked_rows++;
+      uint64_t word = 0;
+      memcpy(&word, bytes + offset + at, size - at);
+      hash = hash_word(hash, word);
     }
   }
 
+  game_state.checksum = hash;
+}
+
+static void mark_filled_rows()
+{
+  int rows_to_clear[4] = {};
+  int num_marked_rows = board_full_rows(&game_state.board, rows_to_clear);
+
   game_state.num_rows_to_clear = num_marked_rows;
   for(int i = 0; i < num_marked_rows; i++) game_state.rows_to_clear[i] = rows_to_clear[i];
 
-  int score_increase = num_marked_rows * 10;
+  int score_increase = num_marked_rows * SCORE_PER_ROW;
   //if(num_marked_rows == 4) score_increase *= 4;
   game_state.score += score_increase;
 }
@@ -432,6 +482,16 @@ static void clear_marked_rows()
   Grid *grid = &game_state.grid;
   int num_rows = game_state.num_rows_to_clear;
 
+  game_state.board_hash = zobrist_clear_rows(&game_state.board, game_state.board_hash, game_state.rows_to_clear, num_rows);
+
+  GameEvent *event = report_event(GAME_EVENT_CLEAR);
+  if(event)
+  {
+    event->num_rows = num_rows;
+    for(int i = 0; i < num_rows; i++) event->rows[i] = game_state.rows_to_clear[i];
+  }
+
+  // Colors follow the same way
   while(num_rows)
   {
     // NOTE:
@@ -440,7 +500,7 @@ static void clear_marked_rows()
     int to_copy = target + 1;
 
     // Clear the top-most row
-    memset(&(grid->cells[(grid->rows - 1) * grid->columns]), 0, sizeof(Cell) * grid->columns);
+    for(int column = 0; column < grid->columns; column++) grid->cells[(grid->rows - 1) * grid->columns + column] = Cell();
 
     // Move all rows from the target row down one
     while(target != grid->rows - 1)
@@ -460,18 +520,38 @@ static void clear_marked_rows()
   game_state.num_rows_to_clear = 0;
 }
 
+// Compares the presses it took to place the piece with the fewest it could
+// have taken, once per piece so the frames themselves only count presses
+static void record_finesse(const Piece *piece)
+{
+  FinessePath path;
+  if(!finesse_path(&game_state.board, piece, &path)) return;
+
+  FinesseStats *stats = &game_state.finesse;
+  stats->pieces++;
+  if(game_state.piece_presses > (unsigned)path.num_inputs)
+  {
+    stats->faults++;
+    stats->extra_presses += game_state.piece_presses - path.num_inputs;
+  }
+}
+
 static void lock_piece(Piece *piece)
 {
   Grid *grid = &game_state.grid;
 
+  record_finesse(piece);
+  report_event(GAME_EVENT_LOCK);
+
   // Lock grid pieces
+  game_state.board_hash ^= zobrist_piece(&game_state.board, piece);
+  board_place_piece(&game_state.board, piece);
   for(int i = 0; i < 4; i++)
   {
     v2i p = piece->position + piece->points[i];
-    if(!valid_point(p)) continue;
+    if(p.x < 0 || p.x >= grid->columns || p.y < 0 || p.y >= grid->rows) continue;
 
-    (*grid)[p].filled = true;
-    (*grid)[p].color = piece_color(piece->type);
+    (*grid)[p].type = (uint8_t)piece->type;
   }
 
   // Check for rows to mark
@@ -484,120 +564,48 @@ static void lock_piece(Piece *piece)
   game_state.falling_piece.type = NO_PIECE;
 }
 
-static bool hit_side(Piece *p)
+// Returns true if successfully kicked piece into valid position, false otherwise
+static bool try_kick(Piece *piece, RotationState prev_rotation)
 {
-  Grid *grid = &game_state.grid;
-
-  for(int i = 0; i < 4; i++)
-  {
-    v2i point = p->position + p->points[i];
-    if(point.x < 0 || point.x >= grid->columns) return true;
-  }
-
-  return false;
+  return board_try_kick(&game_state.board, piece, prev_rotation);
 }
 
-static bool below_bottom(Piece *p)
-{
-  Grid *grid = &game_state.grid;
 
-  for(int i = 0; i < 4; i++)
-  {
-    v2i point = p->position + p->points[i];
-    if(point.y < 0) return true;
-  }
 
-  return false;
-}
 
-static bool hit_block(Piece *p)
-{
-  Grid *grid = &game_state.grid;
 
-  for(int i = 0; i < 4; i++)
-  {
-    v2i point = p->position + p->points[i];
-    if(!valid_point(point)) continue;
-    if((*grid)[point].filled) return true;
-  }
 
-  return false;
-}
 
-static void rotate_left(Piece *p)
+// GameButton bits held down for the next tick. The keyboard is read once a
+// frame, but the bot is asked every tick: its taps are one tick long, and a
+// frame that runs no tick would drop them.
+static unsigned autoplay_buttons()
 {
-  if(p->rotation == RS_0) p->rotation = RS_L;
-  else p->rotation = (RotationState)(p->rotation - 1);
-
-  for(int i = 0; i < 4; i++)
-  {
-    v2i &point = p->points[i];
-    swap(point.x, point.y);
-    point.x = -point.x;
-  }
-}
-
-static void rotate_right(Piece *p)
-{
-  p->rotation = (RotationState)((p->rotation + 1) % 4);
-  for(int i = 0; i < 4; i++)
+  BotView view;
+  view.board = game_state.board;
+  view.board_hash = game_state.board_hash;
+  view.falling_piece = game_state.falling_piece;
+  view.held_piece = game_state.held_piece;
+  view.can_hold = !game_state.swapped_piece_this_turn;
+  view.queue_length = NUM_NEXT_PIECES;
+  for(int i = 0; i < NUM_NEXT_PIECES; i++)
   {
-    v2i &point = p->points[i];
-    swap(point.x, point.y);
-    point.y = -point.y;
+    view.queue[i] = game_state.next_pieces[(game_state.next_piece_index + i) % NUM_NEXT_PIECES];
   }
-}
+  view.piece_number = game_state.piece_number;
 
-// -1 is counter-clockwise, 1 is clockwise
-static void rotate(Piece *p, int direction)
-{
-  if(direction == -1)     rotate_left(p);
-  else if(direction == 1) rotate_right(p);
+  return bot_buttons(session.bot, &view);
 }
 
-// Returns true if successfully kicked piece into valid position, false otherwise
-static bool try_kick(Piece *piece, RotationState prev_rotation)
+static unsigned read_keyboard_buttons()
 {
-  RotationState curr_rotation = piece->rotation;
-
-  int num_tests = NUM_KICK_TESTS;
-  v2i *offset_data;
-  if(piece->type == O_PIECE)
-  {
-    num_tests = NUM_O_KICK_TESTS;
-    offset_data = o_piece_offset_data;
-  }
-  else if(piece->type == I_PIECE)
+  unsigned buttons = 0;
+  for(int i = 0; i < NUM_GAME_BUTTONS; i++)
   {
-    offset_data = i_piece_offset_data;
+    if(button_state(GAME_BUTTON_KEYS[i])) buttons |= 1 << i;
   }
-  else
-  {
-    offset_data = default_offset_data;
-  }
-
-  bool success = false;
-  for(int i = 0; i < num_tests; i++)
-  {
-    v2i prev_state_offset = offset_data[prev_rotation * num_tests + i];
-    v2i curr_state_offset = offset_data[curr_rotation * num_tests + i];
-
-    v2i test_offset = prev_state_offset - curr_state_offset;
 
-    piece->position += test_offset;
-    if(hit_block(piece) || hit_side(piece) || below_bottom(piece))
-    {
-      piece->position -= test_offset;
-      continue;
-    }
-    else
-    {
-      success = true;
-      break;
-    }
-  }
-
-  return success;
+  return buttons;
 }
 
 
@@ -606,85 +614,37 @@ static bool try_kick(Piece *piece, RotationState prev_rotation)
 
 
 
-void init_tetris()
+// One fixed tick of the game with buttons held, returns the ones that went
+// down on it. Nothing in here looks at the clock or draws, so the same
+// buttons from the same seed always play out the same.
+static unsigned tick_game(unsigned buttons)
 {
-  game_state.grid.columns = 10;
-  game_state.grid.rows = 24;
-  game_state.grid.cells = new Cell[game_state.grid.rows * game_state.grid.columns];
-
-  unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-  game_state.generator = new std::default_random_engine(seed);
-  game_state.distribution = new std::uniform_int_distribution<int>(0, 6);
-
-  restart_game();
-}
-
-void update_tetris()
-{
-  /*
-  static v2i pos = v2i();
-  pos.x++;
-  if(pos.x >= 16)
-  {
-    pos.x = 0;
-    pos.y++;
-  }
-  if(pos.y >= 16)
-  {
-    pos.y = 0;
-  }
-  draw_cell(pos, Color(0, 0, 1, 1));
-  */
-
-
-#if 1
-  Grid *grid = &game_state.grid;
   Piece *falling_piece = &game_state.falling_piece;
+  reported_piece = *falling_piece;
 
   // Record input
-  bool w_toggled = false;
-  bool a_toggled = false;
-  bool s_toggled = false;
-  bool d_toggled = false;
-  bool j_toggled = false;
-  bool l_toggled = false;
-  bool r_toggled = false;
-  bool space_toggled = false;
-  {
-    static bool w_down = false;
-    static bool a_down = false;
-    static bool s_down = false;
-    static bool d_down = false;
-    static bool j_down = false;
-    static bool l_down = false;
-    static bool r_down = false;
-    static bool space_down = false;
-
-    if(button_state('W') && !w_down) w_toggled = true;
-    if(button_state('A') && !a_down) a_toggled = true; 
-    if(button_state('S') && !s_down) s_toggled = true;
-    if(button_state('D') && !d_down) d_toggled = true;
-    if(button_state('J') && !j_down) j_toggled = true; 
-    if(button_state('L') && !l_down) l_toggled = true;
-    if(button_state('R') && !r_down) r_toggled = true;
-    if(button_state(' ') && !space_down) space_toggled = true;
-
-    w_down = button_state('W');
-    a_down = button_state('A');
-    s_down = button_state('S');
-    d_down = button_state('D');
-    j_down = button_state('J');
-    l_down = button_state('L');
-    r_down = button_state('R');
-    space_down = button_state(' ');
-  }
+  unsigned toggled = buttons & ~game_state.buttons_down;
+  game_state.buttons_down = buttons;
+
+  // Finesse counts presses of the buttons that move the piece
+  const unsigned movement_buttons = BUTTON_HARD_DROP | BUTTON_LEFT | BUTTON_SOFT_DROP | BUTTON_RIGHT |
+                                    BUTTON_ROTATE_CCW | BUTTON_ROTATE_CW;
+  for(unsigned pressed = toggled & movement_buttons; pressed; pressed &= pressed - 1) game_state.piece_presses++;
+
+  bool w_toggled = toggled & BUTTON_HARD_DROP;
+  bool a_toggled = toggled & BUTTON_LEFT;
+  bool d_toggled = toggled & BUTTON_RIGHT;
+  bool j_toggled = toggled & BUTTON_ROTATE_CCW;
+  bool l_toggled = toggled & BUTTON_ROTATE_CW;
+  bool r_toggled = toggled & BUTTON_RESTART;
+  bool space_toggled = toggled & BUTTON_HOLD;
 
   if(r_toggled)
   {
     restart_game();
   }
 
-  float dt = get_dt();
+  float dt = TICK_TIME;
 
 
   int want_to_move = 0;
@@ -692,21 +652,19 @@ void update_tetris()
   if(d_toggled) want_to_move =  1;
   if(a_toggled && d_toggled) want_to_move = 0;
 
-  static float delay_counter = 0;
-  static float move_counter = 0;
-  const static float move_interval = 50.0f;
-  const static float delay_time = 125.0f;
+  float &delay_counter = game_state.delay_counter;
+  float &move_counter = game_state.move_counter;
 
-  if(button_state('A') && button_state('D'))
+  if((buttons & BUTTON_LEFT) && (buttons & BUTTON_RIGHT))
   {
     move_counter = 0;
     delay_counter = 0;
   }
-  if(button_state('A'))
+  if(buttons & BUTTON_LEFT)
   {
     delay_counter -= dt;
   }
-  else if(button_state('D'))
+  else if(buttons & BUTTON_RIGHT)
   {
     delay_counter += dt;
   }
@@ -718,25 +676,25 @@ void update_tetris()
 
 
 
-  if(delay_counter <= -delay_time)
+  if(delay_counter <= -DAS_DELAY)
   {
     move_counter += dt;
 
-    if(move_counter >= move_interval)
+    if(move_counter >= AUTO_REPEAT_INTERVAL)
     {
       want_to_move = -1;
-      move_counter -= move_interval;
+      move_counter -= AUTO_REPEAT_INTERVAL;
     }
   }
 
-  if(delay_counter >= delay_time)
+  if(delay_counter >= DAS_DELAY)
   {
     move_counter += dt;
 
-    if(move_counter >= move_interval)
+    if(move_counter >= AUTO_REPEAT_INTERVAL)
     {
       want_to_move = 1;
-      move_counter -= move_interval;
+      move_counter -= AUTO_REPEAT_INTERVAL;
     }
   }
 
@@ -747,9 +705,10 @@ void update_tetris()
   {
     PieceType type = game_state.held_piece;
     game_state.held_piece = falling_piece->type;
+    report_event(GAME_EVENT_HOLD);
 
     if(type == NO_PIECE) spawn_next_piece();
-    else spawn_piece(type);
+    else spawn_piece(type, NO_PIECE);
 
     game_state.swapped_piece_this_turn = true;
   }
@@ -765,7 +724,7 @@ void update_tetris()
   int going_to_rotate = 0;
   v2i kick_offset = v2i(0, 0);
   bool want_to_lock_piece = false;
-  bool want_to_fall_faster = button_state('S');
+  bool want_to_fall_faster = buttons & BUTTON_SOFT_DROP;
   bool want_to_hard_drop = w_toggled;
 
   // Collision checks
@@ -784,9 +743,7 @@ void update_tetris()
 
     // Check if collision when moving horizontally
     future_piece.position.x += want_to_move;
-    bool outside = hit_side(&future_piece);
-    bool inside_block = hit_block(&future_piece);
-    if(!outside && !inside_block)
+    if(!board_collides(&game_state.board, &future_piece))
     {
       going_to_move = want_to_move;
     }
@@ -802,9 +759,7 @@ void update_tetris()
 
     // Check if collision when moving vertically
     future_piece.position.y -= 1;
-    bool at_bottom = below_bottom(&future_piece);
-    bool just_above_block = hit_block(&future_piece);
-    if(at_bottom || just_above_block)
+    if(board_collides(&game_state.board, &future_piece))
     {
       want_to_lock_piece = true;
     }
@@ -816,12 +771,11 @@ void update_tetris()
 
 
   // Move falling piece
-  Piece ghost_piece;
   bool locked_piece = false;
   {
     // Piece moves down after time interval
 
-    static float fall_counter = 0.0f;
+    float &fall_counter = game_state.fall_counter;
 
     // Move based on input
     if(going_to_move && !game_state.freeze)
@@ -868,29 +822,11 @@ void update_tetris()
 
 
     // Hard drop
-    ghost_piece = *falling_piece;
+    if(want_to_hard_drop && !game_state.freeze)
     {
-      bool hit_somthing = false;
-      while(!hit_somthing)
-      {
-        ghost_piece.position.y -= 1;
-
-        bool at_bottom = below_bottom(&ghost_piece);
-        bool just_above_block = hit_block(&ghost_piece);
-        if(at_bottom || just_above_block)
-        {
-          hit_somthing = true;
-        }
-      }
-      ghost_piece.position.y += 1;
-      
-
-      if(want_to_hard_drop && !game_state.freeze)
-      {
-        falling_piece->position = ghost_piece.position;
-        lock_piece(falling_piece);
-        locked_piece = true;
-      }
+      board_hard_drop(&game_state.board, falling_piece);
+      lock_piece(falling_piece);
+      locked_piece = true;
     }
   }
 
@@ -915,44 +851,29 @@ void update_tetris()
     if(locked_piece) spawn_next_piece();
   }
 
+  report_moved_piece();
 
+  return toggled;
+}
 
-
-  // Debugging
-  /*
-  if(MouseDown(0))
-  {
-    v2i mouse_pos = mouse_grid_position();
-    (*grid)[mouse_pos].filled = true;
-    (*grid)[mouse_pos].color = Color(0.5f, 0.5f, 0.5f, 1.0f);
-  }
-  if(MouseDown(1))
-  {
-    v2i mouse_pos = mouse_grid_position();
-    (*grid)[mouse_pos].filled = false;
-  }
-  */
-
-  //draw_rect(v3(mouse_world_position(), 0.0f), v2(1.0f, 1.0f), 0.0f, Color(1, 1, 1, 1));
-
-
-
-
-
-
-  // Draw calls
+static void draw_game()
+{
+  Grid *grid = &game_state.grid;
+  Piece *falling_piece = &game_state.falling_piece;
 
   // Draw ghost piece
+  Piece ghost_piece = *falling_piece;
+  board_hard_drop(&game_state.board, &ghost_piece);
   draw_piece(&ghost_piece, ghost_piece.position, 0.25f);
 
   for(int row = 0; row < grid->rows; row++)
   {
     for(int column = 0; column < grid->columns; column++)
     {
-      Cell *cell = &(*grid)[v2i(column, row)];
-      if(cell->filled)
+      if(board_cell_filled(&game_state.board, v2i(column, row)))
       {
-        draw_cell(v2i(column, row), cell->color);
+        PieceType type = (PieceType)(*grid)[v2i(column, row)].type;
+        draw_cell(v2i(column, row), (type == NO_PIECE) ? Color(0.0f, 0.0f, 0.0f, 1.0f) : piece_color(type));
       }
     }
   }
@@ -973,6 +894,354 @@ void update_tetris()
     int index = (game_state.next_piece_index + piece) % NUM_NEXT_PIECES;
     draw_piece(game_state.next_pieces[index], v2i(0, -piece * 2 * spacing + begin_height), 1.0f, 1);
   }
-#endif
 }
 
+// Runs the next tick, on the replay's buttons while one plays and recording
+// them while recording
+static unsigned run_tick(unsigned buttons)
+{
+  if(session.replay)
+  {
+    buttons = replay_buttons(&session.replay_cursor, game_state.tick);
+    if(game_state.tick >= session.replay->end_tick)
+    {
+      // The keyboard takes over from here
+      free_replay(session.replay);
+      session.replay = 0;
+      buttons = 0;
+    }
+  }
+
+  if(session.recorder && replay_keyframe_due(session.recorder, game_state.tick))
+  {
+    record_replay_keyframe(session.recorder, game_state.tick, &game_state);
+  }
+
+  if(session.recorder && replay_checksum_due(session.recorder, game_state.tick))
+  {
+    record_replay_checksum(session.recorder, game_state.tick, (uint32_t)game_state.checksum);
+  }
+
+  if(session.recorder && buttons != session.recorded_buttons)
+  {
+    record_replay_buttons(session.recorder, game_state.tick, buttons);
+    session.recorded_buttons = buttons;
+  }
+
+  int slot = game_state.tick % ROLLBACK_TICKS;
+  save_snapshot(&session.rollback_states[slot]);
+  session.rollback_buttons[slot] = buttons;
+
+  unsigned toggled = tick_game(buttons);
+  game_state.tick++;
+  update_checksum();
+
+  return toggled;
+}
+
+
+
+
+
+
+
+FinesseStats finesse_stats()
+{
+  return game_state.finesse;
+}
+
+void set_autoplay(const BotSettings *settings)
+{
+  destroy_bot(session.bot);
+  session.bot = settings ? create_bot(settings) : 0;
+}
+
+void init_tetris()
+{
+  // Builds the empty field finesse table now rather than on the first lock
+  finesse_table_path(I_PIECE, RS_0, 0);
+
+  new_game(std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+void update_tetris()
+{
+  uint64_t tick_time = latency_now_ns();
+
+  // Ticks run a hair early so a loop at exactly the tick rate gets one tick
+  // every frame whatever the float rounding. At most the rollback window's
+  // worth of ticks catch up in a frame and time past that is dropped, or
+  // frames too slow to keep up (the bot thinks every tick) would only fall
+  // further behind.
+  unsigned keyboard_buttons = read_keyboard_buttons();
+  unsigned toggled = 0;
+  session.tick_time_left += get_dt();
+  for(int ticks = 0; session.tick_time_left >= TICK_TIME - 0.01f; ticks++)
+  {
+    if(ticks == MAX_TICKS_PER_FRAME)
+    {
+      session.tick_time_left = 0.0f;
+      break;
+    }
+
+    // The replay has its own buttons, a tick at a time
+    unsigned buttons = 0;
+    if(!session.replay) buttons = session.bot ? autoplay_buttons() : keyboard_buttons;
+
+    int slot = game_state.tick % ROLLBACK_TICKS;
+    session.rollback_local_buttons[slot] = buttons;
+    session.rollback_tick_times[slot] = tick_time;
+
+    toggled |= run_tick(buttons | session.remote_buttons);
+    session.tick_time_left -= TICK_TIME;
+  }
+
+  // Autoplay presses its buttons on the tick
+  uint64_t input_time = session.bot ? tick_time : last_key_press_time();
+  present_frame_timing(toggled ? input_time : 0, tick_time);
+
+  draw_game();
+}
+
+bool start_recording(const char *path)
+{
+  stop_recording();
+
+  uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+  session.recorder =
+    create_replay_recorder(path, seed, sizeof(GameState), KEYFRAME_INTERVAL, CHECKSUM_INTERVAL);
+  if(!session.recorder) return false;
+
+  new_game(seed);
+  session.recorded_buttons = 0;
+  return true;
+}
+
+void stop_recording()
+{
+  if(!session.recorder) return;
+
+  destroy_replay_recorder(session.recorder, game_state.tick);
+  session.recorder = 0;
+}
+
+bool start_replay(const char *path)
+{
+  Replay *replay = load_replay(path);
+  if(!replay) return false;
+
+  free_replay(session.replay);
+  session.replay = replay;
+  start_replay_cursor(&session.replay_cursor, replay);
+
+  new_game(replay->seed);
+  return true;
+}
+
+bool replay_playing()
+{
+  return session.replay != 0;
+}
+
+uint32_t replay_length()
+{
+  return session.replay ? session.replay->end_tick : 0;
+}
+
+uint32_t game_tick()
+{
+  return game_state.tick;
+}
+
+bool seek_replay(uint32_t tick)
+{
+  Replay *replay = session.replay;
+  if(!replay || session.recorder || replay->end_tick == 0) return false;
+  if(tick >= replay->end_tick) tick = replay->end_tick - 1;
+
+  // Keyframes from another build of the game don't fit, those replays seek
+  // from the start
+  int keyframe = -1;
+  if(replay->keyframe_size == sizeof(GameState)) keyframe = replay_keyframe_before(replay, tick);
+  uint32_t keyframe_tick = (keyframe >= 0) ? replay->keyframes[keyframe].tick : 0;
+
+  // Going forward past no keyframe, the game is already the closest start
+  if(tick < game_state.tick || keyframe_tick > game_state.tick)
+  {
+    if(keyframe >= 0)
+    {
+      // Mapped files don't keep it aligned
+      GameState snapshot;
+      memcpy(&snapshot, replay_keyframe_data(replay, keyframe), sizeof(snapshot));
+      restore_snapshot(&snapshot);
+      session.rollback_start = game_state.tick;
+      seek_replay_cursor(&session.replay_cursor, replay, keyframe, game_state.buttons_down);
+    }
+    else
+    {
+      new_game(replay->seed);
+      start_replay_cursor(&session.replay_cursor, replay);
+    }
+  }
+
+  while(game_state.tick < tick) run_tick(0);
+  return true;
+}
+
+// The ticks from tick on, again on their rollback buttons
+static void run_again_from(uint32_t tick)
+{
+  uint32_t now = game_state.tick;
+  restore_snapshot(&session.rollback_states[tick % ROLLBACK_TICKS]);
+  while(game_state.tick < now) run_tick(session.rollback_buttons[game_state.tick % ROLLBACK_TICKS]);
+}
+
+bool correct_buttons(uint32_t tick, unsigned buttons)
+{
+  // Recordings and replays only go forward
+  if(session.recorder || session.replay) return false;
+
+  uint32_t now = game_state.tick;
+  if(tick >= now || tick < session.rollback_start || now - tick > ROLLBACK_TICKS) return false;
+
+  for(uint32_t i = tick; i < now; i++) session.rollback_buttons[i % ROLLBACK_TICKS] = buttons;
+
+  run_again_from(tick);
+  return true;
+}
+
+void set_remote_buttons(unsigned buttons, uint64_t changed_at)
+{
+  session.remote_buttons = buttons;
+
+  // Recordings and replays only go forward, there it makes the next tick
+  if(session.recorder || session.replay) return;
+
+  // Back to the first tick that ran after the change
+  uint32_t now = game_state.tick;
+  uint32_t tick = now;
+  while(tick > session.rollback_start && now - tick < ROLLBACK_TICKS &&
+        session.rollback_tick_times[(tick - 1) % ROLLBACK_TICKS] >= changed_at)
+  {
+    tick--;
+  }
+  if(tick == now) return;
+
+  for(uint32_t i = tick; i < now; i++)
+  {
+    int slot = i % ROLLBACK_TICKS;
+    session.rollback_buttons[slot] = session.rollback_local_buttons[slot] | buttons;
+  }
+
+  run_again_from(tick);
+}
+
+bool verify_replay(const char *path, ReplayVerification *result)
+{
+  memset(result, 0, sizeof(ReplayVerification));
+
+  Replay *replay = load_replay(path);
+  if(!replay) return false;
+
+  new_game(replay->seed);
+  ReplayCursor cursor;
+  start_replay_cursor(&cursor, replay);
+  bool keyframes_fit = replay->keyframe_size == sizeof(GameState);
+
+  for(uint32_t tick = 0; tick < replay->end_tick; tick++)
+  {
+    unsigned buttons = replay_buttons(&cursor, tick);
+
+    if(cursor.has_checksum && cursor.checksum_tick == tick)
+    {
+      result->checksums++;
+      bool match = cursor.checksum == (uint32_t)game_state.checksum;
+      if(!result->diverged && match) result->matched_tick = tick;
+      if(!result->diverged && !match)
+      {
+        result->diverged = true;
+        result->diverged_tick = tick;
+      }
+    }
+
+    if(keyframes_fit && cursor.has_keyframe && cursor.keyframe_tick == tick)
+    {
+      // Mapped files don't keep it aligned
+      GameState recorded;
+      GameState played;
+      memcpy(&recorded, cursor.keyframe, sizeof(recorded));
+      save_snapshot(&played);
+
+      result->keyframes++;
+      const char *field = snapshot_difference(&recorded, &played);
+      if(!result->diverged && !field) result->matched_tick = tick;
+      if(field)
+      {
+        if(!result->diverged) result->diverged_tick = tick;
+        result->diverged = true;
+        snprintf(result->field, sizeof(result->field), "%s", field);
+        result->field_tick = tick;
+      }
+
+      // Nothing more to learn once the keyframe after a divergence is in
+      if(result->diverged) break;
+    }
+
+    // Without keyframes to look at there's nothing more to learn either
+    if(result->diverged && !keyframes_fit) break;
+
+    tick_game(buttons);
+    game_state.tick++;
+    update_checksum();
+    result->ticks++;
+  }
+
+  free_replay(replay);
+  return true;
+}
+
+size_t headless_game_size()
+{
+  return sizeof(GameState);
+}
+
+void start_headless_game(void *game, uint64_t seed)
+{
+  new_game(seed);
+  memcpy(game, &game_state, sizeof(GameState));
+}
+
+unsigned tick_headless_game(void *game, unsigned buttons, GameEventList *events)
+{
+  memcpy(&game_state, game, sizeof(GameState));
+
+  if(events) events->num_events = 0;
+  tick_events = events;
+  unsigned toggled = tick_game(buttons);
+  tick_events = 0;
+
+  game_state.tick++;
+  update_checksum();
+
+  memcpy(game, &game_state, sizeof(GameState));
+  return toggled;
+}
+
+void view_headless_game(const void *game, HeadlessGameView *view)
+{
+  // Callers don't keep it aligned
+  GameState state;
+  memcpy(&state, game, sizeof(GameState));
+
+  view->tick = state.tick;
+  view->score = state.score;
+  view->board = state.board;
+  for(int i = 0; i < BOARD_ROWS * BOARD_COLUMNS; i++) view->cells[i] = state.grid.cells[i].type;
+
+  view->falling_piece = state.falling_piece;
+  view->held_piece = state.held_piece;
+  for(int i = 0; i < NUM_NEXT_PIECES; i++)
+  {
+    view->next_pieces[i] = state.next_pieces[(state.next_piece_index + i) % NUM_NEXT_PIECES];
+  }
+}
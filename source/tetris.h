@@ -1,6 +1,146 @@
 #pragma once
 
+#include "board.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct BotSettings;
+
 void init_tetris();
 
 void update_tetris();
 
+// Lets the bot play instead of the keyboard, pass 0 to take over again
+void set_autoplay(const BotSettings *settings);
+
+
+// Replays (see replay.h). Recording starts a new game and writes its seed and
+// every change of the buttons to path until stop_recording. Playback starts
+// the recorded game over and plays its buttons; the keyboard takes over when
+// it ends. Both are false if the file can't be opened.
+bool start_recording(const char *path);
+void stop_recording();
+
+bool start_replay(const char *path);
+bool replay_playing();
+
+// Ticks in the replay playing, 0 if none is
+uint32_t replay_length();
+uint32_t game_tick();
+
+// Jumps the replay playing to tick: restores the keyframe before it and runs
+// the ticks from there without drawing. False if no replay is playing.
+bool seek_replay(uint32_t tick);
+
+
+// Rollback for online play. Input that arrives late (from the network, say)
+// says buttons were held from a past tick on: the game goes back to that
+// tick and runs the ticks up to now again on them, within the frame. Ticks
+// up to 8 back can be corrected. False for older ones, ones from before the
+// game started, and while recording or playing a replay.
+bool correct_buttons(uint32_t tick, unsigned buttons);
+
+// Buttons pressed on another machine (remote_input.h), held along with this
+// one's from now on. changed_at is when they changed on the latency_now_ns()
+// clock: the ticks that ran since, up to 8 of them, run again with them the
+// way correct_buttons does, so a late packet still lands on the tick a local
+// press would have. Not to be mixed with correct_buttons, which overrides
+// all input.
+void set_remote_buttons(unsigned buttons, uint64_t changed_at);
+
+// Plays a replay through as fast as it runs, without drawing, and checks the
+// game against every checksum and keyframe in it. For tools, it takes over
+// the game being played. False if the file can't be read.
+struct ReplayVerification
+{
+  uint32_t ticks;     // Run
+  uint32_t checksums; // Checked
+  uint32_t keyframes;
+
+  // The game went another way somewhere after matched_tick and by
+  // diverged_tick, the last and first check that matched and didn't
+  bool diverged;
+  uint32_t matched_tick;
+  uint32_t diverged_tick;
+
+  // The first part of the game that differs from the keyframe at field_tick,
+  // empty if no keyframe came before the verification stopped
+  char field[32];
+  uint32_t field_tick;
+};
+
+bool verify_replay(const char *path, ReplayVerification *result);
+
+
+// Headless games, many to a process, for servers. The caller keeps each
+// game's state, headless_game_size() bytes of plain data anywhere in memory.
+// A tick copies it in as the game, runs it and copies it back out, so games
+// take turns being the one game this module has. One thread of games a
+// process, and it takes over the game being played.
+size_t headless_game_size();
+void start_headless_game(void *game, uint64_t seed);
+
+// What happened on a tick, in order, so spectators can follow a game by
+// playing the same events on their own board (see spectator.h)
+enum GameEventType
+{
+  GAME_EVENT_SPAWN,   // piece came in at the spawn pose, revealed joined the end of the queue
+  GAME_EVENT_MOVE,    // The falling piece moved, turned or fell to piece's pose, on the tick's end
+  GAME_EVENT_HOLD,    // The falling piece went into hold, a spawn follows
+  GAME_EVENT_LOCK,    // The falling piece locked at piece's pose
+  GAME_EVENT_CLEAR,   // rows were taken out and everything above dropped
+  GAME_EVENT_RESTART, // Everything started over, only a snapshot can say how
+};
+
+struct GameEvent
+{
+  GameEventType type;
+  Piece piece;
+  PieceType revealed; // NO_PIECE when the spawn came out of hold
+
+  int num_rows;
+  int rows[4]; // Bottom-up
+};
+
+// A tick that does more than this ends its list with a restart instead
+static const int MAX_TICK_EVENTS = 16;
+
+struct GameEventList
+{
+  int num_events;
+  GameEvent events[MAX_TICK_EVENTS];
+};
+
+// Each row a lock fills scores this much
+static const unsigned SCORE_PER_ROW = 10;
+
+// One fixed tick with buttons held, returns the ones that went down on it.
+// events, if not 0, gets what happened.
+unsigned tick_headless_game(void *game, unsigned buttons, GameEventList *events);
+
+// A headless game as a player would see it
+struct HeadlessGameView
+{
+  uint32_t tick;
+  unsigned score;
+
+  Board board;                               // Rows being cleared stay filled until they go
+  uint8_t cells[BOARD_ROWS * BOARD_COLUMNS]; // PieceType, NO_PIECE where empty, bottom row first
+
+  Piece falling_piece;
+  PieceType held_piece;
+  PieceType next_pieces[6]; // Spawn order
+};
+
+void view_headless_game(const void *game, HeadlessGameView *view);
+
+
+struct FinesseStats
+{
+  unsigned pieces;        // Placed since the game started, restarts included
+  unsigned faults;        // Pieces that took more presses than they needed
+  unsigned extra_presses; // Summed over those pieces
+};
+
+FinesseStats finesse_stats();
@@ -0,0 +1,203 @@
+#include "tetris_env.h"
+
+#include "sim_state.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TETRIS_ENV_API extern "C" __attribute__((visibility("default")))
+
+static_assert(TETRIS_ENV_ROWS == BOARD_ROWS && TETRIS_ENV_COLUMNS == BOARD_COLUMNS, "env board matches the game's");
+static_assert(TETRIS_ENV_QUEUE_LENGTH == SIM_QUEUE_LENGTH, "env queue matches the simulation's");
+
+struct TetrisEnv
+{
+  int num_envs;
+  uint64_t seed;
+
+  SimState *states;
+  unsigned *episodes;
+};
+
+static uint64_t episode_seed(uint64_t seed, int game, unsigned episode)
+{
+  uint64_t z = seed ^ ((uint64_t)game << 32 | episode);
+  z += 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static void start_episode(TetrisEnv *env, int game)
+{
+  init_sim_state(&env->states[game], episode_seed(env->seed, game, env->episodes[game]));
+  env->episodes[game]++;
+}
+
+static int leftmost_point(const Piece *piece)
+{
+  int left = piece->points[0].x;
+  for(int i = 1; i < 4; i++)
+  {
+    if(piece->points[i].x < left) left = piece->points[i].x;
+  }
+
+  return left;
+}
+
+// The piece rotated at its spawn, false if it doesn't fit there
+static bool rotated_at_spawn(const SimState *state, bool hold, int rotation, Piece *piece)
+{
+  if(hold && !state->can_hold) return false;
+
+  make_spawned_piece(piece, sim_move_piece(state, hold));
+  for(int i = 0; i < rotation; i++) rotate(piece, 1);
+  return !board_collides(&state->board, piece);
+}
+
+// Where the action puts the piece, false if it can't be taken
+static bool action_piece(const SimState *state, int action, Piece *piece)
+{
+  if(action < 0 || action >= TETRIS_ENV_NUM_ACTIONS) return false;
+
+  bool hold = action >= 4 * BOARD_COLUMNS;
+  int rotation = (action / BOARD_COLUMNS) % 4;
+  int column = action % BOARD_COLUMNS;
+  if(!rotated_at_spawn(state, hold, rotation, piece)) return false;
+
+  // One column at a time, so nothing in the way is skipped over
+  int target = column - leftmost_point(piece);
+  int direction = (target < piece->position.x) ? -1 : 1;
+  while(piece->position.x != target)
+  {
+    piece->position.x += direction;
+    if(board_collides(&state->board, piece)) return false;
+  }
+
+  board_hard_drop(&state->board, piece);
+  return true;
+}
+
+// Every column a rotation can slide to is one run either side of the spawn,
+// so the mask takes two slides per rotation rather than one per action
+static void mask_actions(const SimState *state, uint8_t *mask)
+{
+  memset(mask, 0, TETRIS_ENV_NUM_ACTIONS);
+  if(state->topped_out) return;
+
+  for(int hold = 0; hold < 2; hold++)
+  {
+    for(int rotation = 0; rotation < 4; rotation++)
+    {
+      Piece piece;
+      if(!rotated_at_spawn(state, hold, rotation, &piece)) continue;
+
+      int spawn_x = piece.position.x;
+      int left = spawn_x;
+      for(piece.position.x = spawn_x - 1; !board_collides(&state->board, &piece); piece.position.x--) left--;
+      int right = spawn_x;
+      for(piece.position.x = spawn_x + 1; !board_collides(&state->board, &piece); piece.position.x++) right++;
+
+      int offset = leftmost_point(&piece);
+      uint8_t *actions = mask + (hold * 4 + rotation) * BOARD_COLUMNS;
+      for(int x = left; x <= right; x++) actions[x + offset] = 1;
+    }
+  }
+}
+
+static void observe_game(const TetrisEnv *env, int game, const TetrisEnvObservation *obs)
+{
+  const SimState *state = &env->states[game];
+
+  if(obs->board)
+  {
+    uint8_t *cells = obs->board + game * BOARD_ROWS * BOARD_COLUMNS;
+    for(int row = 0; row < BOARD_ROWS; row++)
+    {
+      for(int column = 0; column < BOARD_COLUMNS; column++)
+      {
+        cells[row * BOARD_COLUMNS + column] = (state->board.rows[row] >> column) & 1;
+      }
+    }
+  }
+
+  if(obs->current) obs->current[game] = (int8_t)state->current;
+  if(obs->hold) obs->hold[game] = (int8_t)state->hold;
+  if(obs->queue)
+  {
+    for(int i = 0; i < SIM_QUEUE_LENGTH; i++) obs->queue[game * SIM_QUEUE_LENGTH + i] = (int8_t)state->queue[i];
+  }
+
+  if(obs->action_mask) mask_actions(state, obs->action_mask + game * TETRIS_ENV_NUM_ACTIONS);
+}
+
+TETRIS_ENV_API TetrisEnv *tetris_env_create(int n_envs, uint64_t seed)
+{
+  if(n_envs < 1) return 0;
+
+  TetrisEnv *env = (TetrisEnv *)malloc(sizeof(TetrisEnv));
+  env->num_envs = n_envs;
+  env->seed = seed;
+  env->states = (SimState *)malloc(sizeof(SimState) * n_envs);
+  env->episodes = (unsigned *)calloc(n_envs, sizeof(unsigned));
+
+  for(int i = 0; i < n_envs; i++) start_episode(env, i);
+  return env;
+}
+
+TETRIS_ENV_API void tetris_env_destroy(TetrisEnv *env)
+{
+  if(!env) return;
+
+  free(env->states);
+  free(env->episodes);
+  free(env);
+}
+
+TETRIS_ENV_API int tetris_env_size(const TetrisEnv *env)
+{
+  return env->num_envs;
+}
+
+TETRIS_ENV_API void tetris_env_observe(const TetrisEnv *env, TetrisEnvObservation *obs)
+{
+  if(!obs) return;
+  for(int i = 0; i < env->num_envs; i++) observe_game(env, i, obs);
+}
+
+TETRIS_ENV_API void tetris_env_step(TetrisEnv *env, const int32_t *actions, TetrisEnvObservation *obs_out,
+                                    float *reward_out, uint8_t *done_out)
+{
+  for(int i = 0; i < env->num_envs; i++)
+  {
+    SimState *state = &env->states[i];
+
+    int lines = 0;
+    if(!state->topped_out)
+    {
+      Piece piece;
+      if(action_piece(state, actions[i], &piece))
+      {
+        bool hold = actions[i] >= 4 * BOARD_COLUMNS;
+        lines = sim_apply_move(state, hold, &piece);
+      }
+      else
+      {
+        state->topped_out = true;
+      }
+    }
+
+    if(reward_out) reward_out[i] = (float)lines;
+    if(done_out) done_out[i] = state->topped_out;
+    if(obs_out) observe_game(env, i, obs_out);
+  }
+}
+
+TETRIS_ENV_API void tetris_env_reset_masked(TetrisEnv *env, const uint8_t *mask, TetrisEnvObservation *obs_out)
+{
+  for(int i = 0; i < env->num_envs; i++)
+  {
+    if(!mask || mask[i]) start_episode(env, i);
+    if(obs_out) observe_game(env, i, obs_out);
+  }
+}
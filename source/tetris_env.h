@@ -0,0 +1,74 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Vectorized environment for training loops, as a C ABI so anything that can
+// load a shared library (ctypes, cffi, a C++ trainer) can drive it. One call
+// steps every game in the batch, in process, on the headless simulation the
+// bot's rollouts use.
+//
+// An action picks where the falling piece goes:
+//   action = hold * 4 * BOARD_COLUMNS + rotation * BOARD_COLUMNS + column
+// The piece (or the one hold brings out) is rotated at its spawn, slid along
+// the spawn row until its leftmost cell is in column, and hard dropped.
+// Actions the piece can't make are cleared in the action mask. Taking one
+// anyway ends the game as a top out.
+//
+// Observations go straight into struct-of-arrays buffers the caller owns, n
+// entries each; any of them can be null to skip it:
+//   board        uint8  [n][rows][columns]  1 where filled, row 0 the bottom
+//   current      int8   [n]                 Piece type, 0-6 is IJLOSTZ
+//   hold         int8   [n]                 7 when empty
+//   queue        int8   [n][queue length]   queue[0] spawns next
+//   action_mask  uint8  [n][actions]        1 where the action can be taken
+//
+// The reward is the lines the move cleared. A game that is done stays done,
+// stepping it does nothing, until tetris_env_reset_masked starts it again.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+  TETRIS_ENV_ROWS = 24,
+  TETRIS_ENV_COLUMNS = 10,
+  TETRIS_ENV_QUEUE_LENGTH = 6,
+  TETRIS_ENV_NUM_ACTIONS = 2 * 4 * TETRIS_ENV_COLUMNS,
+};
+
+struct TetrisEnvObservation
+{
+  uint8_t *board;
+  int8_t *current;
+  int8_t *hold;
+  int8_t *queue;
+  uint8_t *action_mask;
+};
+
+struct TetrisEnv;
+
+// n_envs fresh games. Game i's k-th episode is dealt from (seed, i, k), so a
+// seed always plays out the same for the same actions.
+struct TetrisEnv *tetris_env_create(int n_envs, uint64_t seed);
+void tetris_env_destroy(struct TetrisEnv *env);
+
+int tetris_env_size(const struct TetrisEnv *env);
+
+// Writes the current observation of every game
+void tetris_env_observe(const struct TetrisEnv *env, struct TetrisEnvObservation *obs);
+
+// One action per game. reward_out and done_out get one entry per game and
+// can be null.
+void tetris_env_step(struct TetrisEnv *env, const int32_t *actions, struct TetrisEnvObservation *obs_out,
+                     float *reward_out, uint8_t *done_out);
+
+// Starts a new episode in every game whose mask entry is nonzero, all of them
+// if mask is null, then writes the observation of every game
+void tetris_env_reset_masked(struct TetrisEnv *env, const uint8_t *mask, struct TetrisEnvObservation *obs_out);
+
+#ifdef __cplusplus
+}
+#endif
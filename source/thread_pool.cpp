@@ -0,0 +1,198 @@
+#include "thread_pool.h"
+
+#include <stdlib.h> // posix_memalign
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>      // placement new
+#include <thread>
+
+static const size_t CACHE_LINE_BYTES = 64;
+
+// One per worker, on its own cache line so owners and thieves don't fight
+// over their neighbours' ranges. new ignores the alignment before C++17, see
+// create_task_ranges.
+struct alignas(CACHE_LINE_BYTES) TaskRange
+{
+  std::mutex lock;
+  int begin;
+  int end;
+};
+
+struct ThreadPool
+{
+  int num_workers; // Including the thread calling run_tasks, worker 0
+  std::thread *threads;
+  TaskRange *ranges;
+
+  std::mutex lock;
+  std::condition_variable start;
+  std::condition_variable finished;
+  unsigned batch; // Goes up with every run_tasks
+  int busy_workers;
+  bool quit;
+
+  TaskFunction function;
+  void *context;
+};
+
+static bool take_task(TaskRange *range, int *task)
+{
+  std::lock_guard<std::mutex> guard(range->lock);
+  if(range->begin >= range->end) return false;
+
+  *task = range->begin++;
+  return true;
+}
+
+// Moves the back half of some other worker's range into ours
+static bool steal_tasks(ThreadPool *pool, int worker)
+{
+  for(int i = 1; i < pool->num_workers; i++)
+  {
+    TaskRange *victim = &pool->ranges[(worker + i) % pool->num_workers];
+
+    int begin, end;
+    {
+      std::lock_guard<std::mutex> guard(victim->lock);
+      int remaining = victim->end - victim->begin;
+      if(remaining <= 0) continue;
+
+      end = victim->end;
+      begin = end - (remaining + 1) / 2;
+      victim->end = begin;
+    }
+
+    TaskRange *own = &pool->ranges[worker];
+    std::lock_guard<std::mutex> guard(own->lock);
+    own->begin = begin;
+    own->end = end;
+    return true;
+  }
+
+  return false;
+}
+
+static void run_batch(ThreadPool *pool, int worker, TaskFunction function, void *context)
+{
+  TaskRange *own = &pool->ranges[worker];
+
+  // Nothing is added during a batch, so once a whole steal round comes up
+  // empty all that's left is tasks other workers are already running
+  do
+  {
+    int task;
+    while(take_task(own, &task)) function(context, task, worker);
+  } while(steal_tasks(pool, worker));
+}
+
+static void worker_loop(ThreadPool *pool, int worker)
+{
+  unsigned seen_batch = 0;
+
+  for(;;)
+  {
+    TaskFunction function;
+    void *context;
+    {
+      std::unique_lock<std::mutex> guard(pool->lock);
+      pool->start.wait(guard, [&]{ return pool->quit || pool->batch != seen_batch; });
+      if(pool->quit) return;
+
+      seen_batch = pool->batch;
+      function = pool->function;
+      context = pool->context;
+    }
+
+    run_batch(pool, worker, function, context);
+
+    std::lock_guard<std::mutex> guard(pool->lock);
+    if(--pool->busy_workers == 0) pool->finished.notify_one();
+  }
+}
+
+static TaskRange *create_task_ranges(int count)
+{
+  void *memory = 0;
+  if(posix_memalign(&memory, CACHE_LINE_BYTES, sizeof(TaskRange) * count) != 0) return 0;
+
+  TaskRange *ranges = (TaskRange *)memory;
+  for(int i = 0; i < count; i++) new(&ranges[i]) TaskRange;
+  return ranges;
+}
+
+static void destroy_task_ranges(TaskRange *ranges, int count)
+{
+  for(int i = 0; i < count; i++) ranges[i].~TaskRange();
+  free(ranges);
+}
+
+ThreadPool *create_thread_pool(int num_threads)
+{
+  if(num_threads <= 0) num_threads = (int)std::thread::hardware_concurrency();
+  if(num_threads <= 0) num_threads = 1;
+
+  ThreadPool *pool = new ThreadPool;
+  pool->num_workers = num_threads;
+  pool->ranges = create_task_ranges(num_threads);
+  pool->batch = 0;
+  pool->busy_workers = 0;
+  pool->quit = false;
+  pool->function = 0;
+  pool->context = 0;
+
+  pool->threads = new std::thread[num_threads];
+  for(int i = 1; i < num_threads; i++) pool->threads[i] = std::thread(worker_loop, pool, i);
+
+  return pool;
+}
+
+void destroy_thread_pool(ThreadPool *pool)
+{
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->quit = true;
+  }
+  pool->start.notify_all();
+
+  for(int i = 1; i < pool->num_workers; i++) pool->threads[i].join();
+
+  delete[] pool->threads;
+  destroy_task_ranges(pool->ranges, pool->num_workers);
+  delete pool;
+}
+
+int thread_pool_size(const ThreadPool *pool)
+{
+  return pool->num_workers;
+}
+
+void run_tasks(ThreadPool *pool, TaskFunction function, void *context, int num_tasks)
+{
+  if(num_tasks <= 0) return;
+
+  // Contiguous ranges, so neighbouring tasks share caches until stolen
+  for(int i = 0; i < pool->num_workers; i++)
+  {
+    TaskRange *range = &pool->ranges[i];
+    std::lock_guard<std::mutex> guard(range->lock);
+    range->begin = (int)((long long)num_tasks * i / pool->num_workers);
+    range->end = (int)((long long)num_tasks * (i + 1) / pool->num_workers);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    pool->function = function;
+    pool->context = context;
+    pool->busy_workers = pool->num_workers - 1;
+    pool->batch++;
+  }
+  pool->start.notify_all();
+
+  run_batch(pool, 0, function, context);
+
+  // Every worker has to be out of run_batch before the ranges can be reused
+  std::unique_lock<std::mutex> guard(pool->lock);
+  pool->finished.wait(guard, [&]{ return pool->busy_workers == 0; });
+}
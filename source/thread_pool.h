@@ -0,0 +1,28 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Work-stealing thread pool for batches of small, independent tasks.
+//
+// run_tasks splits the task indices into one contiguous range per worker. A
+// worker runs its own range front to back, and once it runs dry it steals the
+// back half of another worker's range, so uneven tasks still keep every core
+// busy to the end. The thread calling run_tasks works too, as worker 0, and
+// returns once the whole batch is done. One batch at a time per pool.
+//
+// Which worker runs a task is up to the scheduler. Tasks that need the same
+// result every run should depend only on their index, and use the worker index
+// for nothing but picking scratch memory.
+////////////////////////////////////////////////////////////////////////////////
+
+// task is 0..num_tasks-1, worker is 0..thread_pool_size-1
+typedef void (*TaskFunction)(void *context, int task, int worker);
+
+struct ThreadPool;
+
+// 0 threads means one per core
+ThreadPool *create_thread_pool(int num_threads);
+void destroy_thread_pool(ThreadPool *pool);
+
+int thread_pool_size(const ThreadPool *pool);
+
+void run_tasks(ThreadPool *pool, TaskFunction function, void *context, int num_tasks);
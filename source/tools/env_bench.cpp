@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+// Steps a batch of environments with random legal actions, the way a training
+// loop would drive libtetris_env.so, and reports steps per second.
+//
+//   env_bench.exe [-n envs] [-t steps per env] [-s seed]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../tetris_env.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <stdlib.h>
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+  int num_envs = 64;
+  int num_steps = 10000;
+  uint64_t seed = 1;
+
+  int option;
+  while((option = getopt(argc, argv, "n:t:s:")) != -1)
+  {
+    switch(option)
+    {
+      case 'n': num_envs = atoi(optarg); break;
+      case 't': num_steps = atoi(optarg); break;
+      case 's': seed = strtoull(optarg, 0, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-n envs] [-t steps per env] [-s seed]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  TetrisEnv *env = tetris_env_create(num_envs, seed);
+  if(!env) return 1;
+
+  TetrisEnvObservation obs;
+  obs.board = (uint8_t *)malloc(num_envs * TETRIS_ENV_ROWS * TETRIS_ENV_COLUMNS);
+  obs.current = (int8_t *)malloc(num_envs);
+  obs.hold = (int8_t *)malloc(num_envs);
+  obs.queue = (int8_t *)malloc(num_envs * TETRIS_ENV_QUEUE_LENGTH);
+  obs.action_mask = (uint8_t *)malloc(num_envs * TETRIS_ENV_NUM_ACTIONS);
+
+  int32_t *actions = (int32_t *)malloc(sizeof(int32_t) * num_envs);
+  float *rewards = (float *)malloc(sizeof(float) * num_envs);
+  uint8_t *done = (uint8_t *)malloc(num_envs);
+
+  tetris_env_reset_masked(env, 0, &obs);
+
+  uint64_t episodes = 0;
+  double lines = 0.0;
+  uint64_t start = latency_now_ns();
+
+  for(int step = 0; step < num_steps; step++)
+  {
+    for(int i = 0; i < num_envs; i++)
+    {
+      const uint8_t *mask = obs.action_mask + i * TETRIS_ENV_NUM_ACTIONS;
+
+      // A random legal one, the mask always has some unless the game is done
+      int action = rand() % TETRIS_ENV_NUM_ACTIONS;
+      for(int j = 0; j < TETRIS_ENV_NUM_ACTIONS && !mask[action]; j++) action = (action + 1) % TETRIS_ENV_NUM_ACTIONS;
+      actions[i] = action;
+    }
+
+    tetris_env_step(env, actions, &obs, rewards, done);
+
+    for(int i = 0; i < num_envs; i++)
+    {
+      lines += rewards[i];
+      episodes += done[i];
+    }
+    tetris_env_reset_masked(env, done, &obs);
+  }
+
+  double seconds = (latency_now_ns() - start) * 1e-9;
+  double steps = (double)num_envs * num_steps;
+  printf("%d envs x %d steps in %.2f s: %.0f steps/s, %.2f us a step with observations\n", num_envs, num_steps, seconds,
+         steps / seconds, seconds * 1e6 / steps);
+  printf("%llu episodes, %.0f lines\n", (unsigned long long)episodes, lines);
+
+  free(obs.board);
+  free(obs.current);
+  free(obs.hold);
+  free(obs.queue);
+  free(obs.action_mask);
+  free(actions);
+  free(rewards);
+  free(done);
+  tetris_env_destroy(env);
+  return 0;
+}
@@ -0,0 +1,312 @@
+////////////////////////////////////////////////////////////////////////////////
+// Loopback input to LED latency harness. Runs the real game and network
+// client against a receiver.exe child process driving the mock LED library,
+// with a thread mashing keys like a player would. Prints per-stage latency
+// percentiles from the receiver's latency log.
+//
+//   latency_harness.exe [seconds] [port] [panels] [canvas size]
+//
+// With more than one panel, receivers go on the ports after the first, each
+// pretending its clock is further off than the last, as a wall of separate
+// machines would be. Also prints how far apart the panels put each frame up.
+// The canvas is 16x16 unless given a size, the game only lights its corner of
+// a bigger one but every frame still goes out whole, in fragments.
+//
+// Expects receiver.exe and mock_led_renderer.so in the working directory
+// (make latency builds all three).
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../tetris.h"
+#include "../input.h"
+#include "../game_timer.h"
+#include "../game_presentation.h"
+#include "../latency.h"
+#include "../platform_linux/network_client.h"
+
+#include <spawn.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdlib.h> // atoi, rand
+#include <string.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern char **environ;
+
+
+// In ms
+static const float FRAME_TIME = 1000.0f / 60.0f;
+
+static const char KEYS[] = "ADJL";
+static const int NUM_KEYS = sizeof(KEYS) - 1;
+
+struct HarnessState
+{
+  std::atomic<int> key_down; // Index into KEYS, -1 for none
+  std::atomic<uint64_t> last_key_press;
+  std::atomic<bool> running;
+};
+
+static HarnessState harness;
+
+
+
+// Platform implementation for the game, the rest is platform_headless.cpp's
+bool button_state(unsigned char key)
+{
+  int down = harness.key_down.load(std::memory_order_acquire);
+  return down >= 0 && KEYS[down] == key;
+}
+
+uint64_t last_key_press_time()
+{
+  return harness.last_key_press.load(std::memory_order_acquire);
+}
+
+float get_dt()
+{
+  return FRAME_TIME;
+}
+
+void draw_cell(v2i position, Color color)
+{
+  network_add_cell(position, color);
+}
+
+void present_frame_timing(uint64_t input_time, uint64_t tick_time)
+{
+  network_set_frame_timing(input_time, tick_time);
+}
+
+
+
+static void sleep_ms(int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Presses keys at random moments, independent of the frame loop
+static void key_masher()
+{
+  srand(42);
+  while(harness.running.load())
+  {
+    sleep_ms(50 + rand() % 200);
+
+    harness.last_key_press.store(latency_now_ns(), std::memory_order_release);
+    harness.key_down.store(rand() % NUM_KEYS, std::memory_order_release);
+
+    sleep_ms(30 + rand() % 50);
+    harness.key_down.store(-1, std::memory_order_release);
+  }
+}
+
+// How far apart the panels pretend their clocks are, in ms
+static const float PANEL_CLOCK_SPREAD = 250.0f;
+static const int MAX_PANELS = 8;
+
+static pid_t spawn_receiver(const char *port, const char *log_path, const char *clock_offset)
+{
+  std::vector<char *> env;
+  for(char **e = environ; *e; e++) env.push_back(*e);
+  env.push_back((char *)"LED_RENDERER=./mock_led_renderer.so");
+  env.push_back((char *)"MOCK_LED_US_PER_LED=30");
+  env.push_back(0);
+
+  char *argv[] = { (char *)"./receiver.exe", (char *)"-p", (char *)port, (char *)"-l", (char *)log_path,
+                   (char *)"-o", (char *)clock_offset, 0 };
+
+  pid_t pid;
+  int error = posix_spawn(&pid, argv[0], 0, 0, argv, env.data());
+  if(error)
+  {
+    fprintf(stderr, "Could not start %s: %i\n", argv[0], error);
+    return -1;
+  }
+
+  return pid;
+}
+
+static void print_percentiles(const char *name, std::vector<double> &samples)
+{
+  if(samples.empty())
+  {
+    printf("%-20s %8s\n", name, "no data");
+    return;
+  }
+
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  printf("%-20s %8.3f %8.3f %8.3f %8.3f %8zu\n", name,
+         samples[n / 2],
+         samples[(n * 90) / 100],
+         samples[(n * 99) / 100],
+         samples[n - 1],
+         n);
+}
+
+static bool read_latency_log(const char *log_path, std::vector<LatencyRecord> *records)
+{
+  FILE *log = fopen(log_path, "rb");
+  if(!log)
+  {
+    fprintf(stderr, "Receiver wrote no latency log %s\n", log_path);
+    return false;
+  }
+
+  LatencyRecord record;
+  while(fread(&record, sizeof(record), 1, log) == 1) records->push_back(record);
+  fclose(log);
+  return true;
+}
+
+static void report(const char *log_path)
+{
+  std::vector<LatencyRecord> records;
+  if(!read_latency_log(log_path, &records)) return;
+
+  printf("\n%u frames displayed, latencies in ms\n", (unsigned)records.size());
+  printf("%-20s %8s %8s %8s %8s %8s\n", "stage", "p50", "p90", "p99", "max", "count");
+
+  for(int stage = LATENCY_INPUT; stage < LATENCY_LED; stage++)
+  {
+    std::vector<double> samples;
+    for(unsigned i = 0; i < records.size(); i++)
+    {
+      uint64_t from = records[i].stamps[stage];
+      uint64_t to = records[i].stamps[stage + 1];
+      if(from && to) samples.push_back((to - from) * 1e-6);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s -> %s", LATENCY_STAGE_NAMES[stage], LATENCY_STAGE_NAMES[stage + 1]);
+    print_percentiles(name, samples);
+  }
+
+  std::vector<double> total;
+  for(unsigned i = 0; i < records.size(); i++)
+  {
+    if(records[i].stamps[LATENCY_INPUT]) total.push_back((records[i].stamps[LATENCY_LED] - records[i].stamps[LATENCY_INPUT]) * 1e-6);
+  }
+  print_percentiles("input -> led", total);
+}
+
+// Latest minus earliest LED stamp of every frame all panels put up
+static void report_skew(char log_paths[][64], int num_panels)
+{
+  std::vector<LatencyRecord> logs[MAX_PANELS];
+  for(int i = 0; i < num_panels; i++)
+  {
+    if(!read_latency_log(log_paths[i], &logs[i])) return;
+  }
+
+  // Logs are in frame id order, walk them together
+  std::vector<double> skews;
+  size_t next[MAX_PANELS] = {};
+  for(size_t r = 0; r < logs[0].size(); r++)
+  {
+    uint32_t frame_id = logs[0][r].frame_id;
+    uint64_t earliest = logs[0][r].stamps[LATENCY_LED];
+    uint64_t latest = earliest;
+
+    bool everywhere = true;
+    for(int i = 1; i < num_panels && everywhere; i++)
+    {
+      while(next[i] < logs[i].size() && logs[i][next[i]].frame_id < frame_id) next[i]++;
+      if(next[i] == logs[i].size() || logs[i][next[i]].frame_id != frame_id)
+      {
+        everywhere = false;
+        break;
+      }
+
+      uint64_t shown = logs[i][next[i]].stamps[LATENCY_LED];
+      if(shown < earliest) earliest = shown;
+      if(shown > latest) latest = shown;
+    }
+
+    if(everywhere) skews.push_back((latest - earliest) * 1e-6);
+  }
+
+  int within = 0;
+  for(unsigned i = 0; i < skews.size(); i++) within += skews[i] <= 1.0;
+
+  printf("\n%d panels, skew between the first and last to show a frame in ms\n", num_panels);
+  printf("%-20s %8s %8s %8s %8s %8s\n", "", "p50", "p90", "p99", "max", "count");
+  print_percentiles("led skew", skews);
+  if(!skews.empty()) printf("%.1f%% of frames within 1 ms\n", 100.0 * within / skews.size());
+}
+
+
+
+int main(int argc, char **argv)
+{
+  int seconds = (argc > 1) ? atoi(argv[1]) : 5;
+  int port = (argc > 2) ? atoi(argv[2]) : 4343;
+  int num_panels = (argc > 3) ? atoi(argv[3]) : 1;
+  if(num_panels < 1) num_panels = 1;
+  if(num_panels > MAX_PANELS) num_panels = MAX_PANELS;
+  unsigned canvas_size = (argc > 4) ? atoi(argv[4]) : 16;
+
+  pid_t receivers[MAX_PANELS];
+  char log_paths[MAX_PANELS][64];
+  for(int i = 0; i < num_panels; i++)
+  {
+    char panel_port[16];
+    char clock_offset[32];
+    snprintf(panel_port, sizeof(panel_port), "%i", port + i);
+    snprintf(clock_offset, sizeof(clock_offset), "%f", i * PANEL_CLOCK_SPREAD);
+    snprintf(log_paths[i], sizeof(log_paths[i]), "/tmp/latency_harness_%i_%i.bin", (int)getpid(), i);
+
+    receivers[i] = spawn_receiver(panel_port, log_paths[i], clock_offset);
+    if(receivers[i] == -1) return 1;
+  }
+  sleep_ms(200);
+
+  init_network_client("127.0.0.1", port, canvas_size, canvas_size);
+  for(int i = 1; i < num_panels; i++) network_add_receiver("127.0.0.1", port + i);
+  init_tetris();
+
+  harness.key_down.store(-1);
+  harness.last_key_press.store(0);
+  harness.running.store(true);
+  std::thread masher(key_masher);
+
+  // Fixed 60Hz frame loop like a vsynced display
+  timespec next_frame;
+  clock_gettime(CLOCK_MONOTONIC, &next_frame);
+  int num_frames = (int)(seconds * 1000.0f / FRAME_TIME);
+  for(int frame = 0; frame < num_frames; frame++)
+  {
+    update_tetris();
+    publish_network_frame();
+
+    long frame_nanos = (long)(FRAME_TIME * 1e6);
+    next_frame.tv_nsec += frame_nanos;
+    while(next_frame.tv_nsec >= (long)1e9)
+    {
+      next_frame.tv_nsec -= (long)1e9;
+      next_frame.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_frame, 0);
+  }
+
+  harness.running.store(false);
+  masher.join();
+  shutdown_network_client();
+
+  sleep_ms(100);
+  for(int i = 0; i < num_panels; i++) kill(receivers[i], SIGINT);
+  for(int i = 0; i < num_panels; i++) waitpid(receivers[i], 0, 0);
+
+  report(log_paths[0]);
+  if(num_panels > 1) report_skew(log_paths, num_panels);
+  for(int i = 0; i < num_panels; i++) unlink(log_paths[i]);
+  return 0;
+}
+
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+// Move generator benchmark, on two sets of boards: ones the greedy policy
+// leaves as it plays, like rollouts see, and messy ones from random pieces
+// dropped in random places with random holes and overhangs knocked into them.
+// For every board and piece checks that generate_lock_positions finds exactly
+// the cells generate_placements does, and prints calls per second for both.
+//
+//   movegen_bench.exe [-b boards per set] [-r repeats] [-s seed]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../move_generator.h"
+#include "../sim_policy.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <stdlib.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+#include <vector>
+
+static const char *PIECE_NAMES = "IJLOSTZ";
+
+static Placement placements[MAX_PLACEMENTS];
+static Piece positions[MAX_PLACEMENTS];
+
+// The cells a piece covers, in an order that doesn't depend on its rotation
+static uint64_t cells_of(const Piece *piece)
+{
+  uint16_t cells[4];
+  for(int i = 0; i < 4; i++)
+  {
+    v2i p = piece->position + piece->points[i];
+    cells[i] = (uint16_t)((p.y + 8) * 16 + p.x + 8);
+  }
+  std::sort(cells, cells + 4);
+
+  return ((uint64_t)cells[0] << 48) | ((uint64_t)cells[1] << 32) | ((uint64_t)cells[2] << 16) | cells[3];
+}
+
+static void make_messy_board(Board *board, SimRandom *random)
+{
+  clear_board(board);
+
+  int num_pieces = sim_random_below(random, 40);
+  for(int i = 0; i < num_pieces; i++)
+  {
+    Piece start;
+    make_spawned_piece(&start, next_sim_piece(random));
+    int count = generate_lock_positions(board, &start, positions, MAX_PLACEMENTS);
+    if(count == 0) break;
+
+    board_place_piece(board, &positions[sim_random_below(random, count)]);
+
+    int rows[4];
+    int num_rows = board_full_rows(board, rows);
+    board_clear_rows(board, rows, num_rows);
+  }
+
+  // Holes and overhangs, for tucks and spins
+  int num_flips = sim_random_below(random, 12);
+  for(int i = 0; i < num_flips; i++)
+  {
+    int row = sim_random_below(random, 12);
+    board->rows[row] ^= (uint16_t)(1 << sim_random_below(random, BOARD_COLUMNS));
+    board->rows[row] &= FULL_ROW;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int num_boards = 2000;
+  int repeats = 20;
+  uint64_t seed = 1;
+
+  int option;
+  while((option = getopt(argc, argv, "b:r:s:")) != -1)
+  {
+    switch(option)
+    {
+      case 'b': num_boards = atoi(optarg); break;
+      case 'r': repeats = atoi(optarg); break;
+      case 's': seed = strtoull(optarg, 0, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-b boards per set] [-r repeats] [-s seed]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(num_boards < 1) num_boards = 1;
+  if(repeats < 1) repeats = 1;
+
+  std::vector<Board> played;
+  static SimPolicyScratch scratch;
+  EvaluatorWeights weights = default_evaluator_weights();
+  for(uint64_t game = seed; (int)played.size() < num_boards; game++)
+  {
+    SimState state;
+    init_sim_state(&state, game);
+    while((int)played.size() < num_boards && !state.topped_out)
+    {
+      if(!play_greedy_move(&state, &weights, true, &scratch)) break;
+      played.push_back(state.board);
+    }
+  }
+
+  SimRandom random;
+  seed_sim_random(&random, seed, NO_PIECE);
+
+  std::vector<Board> messy;
+  while((int)messy.size() < num_boards)
+  {
+    Board board;
+    make_messy_board(&board, &random);
+
+    // Pieces have to be able to spawn on it
+    bool open = true;
+    for(int type = 0; type < NO_PIECE && open; type++)
+    {
+      Piece start;
+      make_spawned_piece(&start, (PieceType)type);
+      open = !board_collides(&board, &start);
+    }
+    if(open) messy.push_back(board);
+  }
+
+  int mismatches = 0;
+  for(int set = 0; set < 2; set++)
+  {
+    const std::vector<Board> &boards = set ? messy : played;
+
+    // Same cells from both
+    long total_positions = 0;
+    for(size_t b = 0; b < boards.size(); b++)
+    {
+      for(int type = 0; type < NO_PIECE; type++)
+      {
+        Piece start;
+        make_spawned_piece(&start, (PieceType)type);
+
+        int num_placements = generate_placements(&boards[b], &start, placements, MAX_PLACEMENTS);
+        int num_positions = generate_lock_positions(&boards[b], &start, positions, MAX_PLACEMENTS);
+        total_positions += num_positions;
+
+        std::vector<uint64_t> expected, found;
+        for(int i = 0; i < num_placements; i++) expected.push_back(cells_of(&placements[i].piece));
+        for(int i = 0; i < num_positions; i++) found.push_back(cells_of(&positions[i]));
+        std::sort(expected.begin(), expected.end());
+        std::sort(found.begin(), found.end());
+
+        if(expected != found)
+        {
+          if(mismatches < 10) fprintf(stderr, "%s board %d piece %c: %d placements, %d lock positions\n", set ? "messy" : "played",
+                                      (int)b, PIECE_NAMES[type], num_placements, num_positions);
+          mismatches++;
+        }
+      }
+    }
+
+    printf("%d %s boards, %.1f positions per piece\n", num_boards, set ? "messy" : "played", (double)total_positions / (num_boards * NO_PIECE));
+
+    long calls = (long)repeats * num_boards * NO_PIECE;
+    for(int fast = 0; fast < 2; fast++)
+    {
+      long checksum = 0;
+      uint64_t begin = latency_now_ns();
+      for(int r = 0; r < repeats; r++)
+      {
+        for(size_t b = 0; b < boards.size(); b++)
+        {
+          for(int type = 0; type < NO_PIECE; type++)
+          {
+            Piece start;
+            make_spawned_piece(&start, (PieceType)type);
+            checksum += fast ? generate_lock_positions(&boards[b], &start, positions, MAX_PLACEMENTS)
+                             : generate_placements(&boards[b], &start, placements, MAX_PLACEMENTS);
+          }
+        }
+      }
+      double seconds = (latency_now_ns() - begin) * 1e-9;
+
+      printf("  %-24s %8.0f ns per call  %10.0f calls/s  (%ld)\n", fast ? "generate_lock_positions" : "generate_placements",
+             seconds * 1e9 / calls, calls / seconds, checksum);
+    }
+  }
+
+  if(mismatches)
+  {
+    printf("%d board and piece pairs differ\n", mismatches);
+    return 1;
+  }
+
+  return 0;
+}
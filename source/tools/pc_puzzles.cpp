@@ -0,0 +1,154 @@
+////////////////////////////////////////////////////////////////////////////////
+// Perfect clear puzzle generator. Drops a few random pieces low on an empty
+// board, deals a random hold and queue, and keeps the positions the solver can
+// clear. Prints each puzzle with its solution, then how long solving took.
+//
+//   pc_puzzles.exe [-n puzzles] [-s seed] [-g garbage pieces] [-q queue length] [-m max height] [-j threads]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../pc_solver.h"
+#include "../sim_state.h"
+#include "../move_generator.h"
+#include "../thread_pool.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <stdlib.h>
+#include <cstdio>
+
+static const char *PIECE_NAMES = "IJLOSTZ";
+
+static Piece positions[MAX_PLACEMENTS];
+
+// A random low placement of a random piece, false if there is none
+static bool drop_garbage(Board *board, SimRandom *random, int max_height)
+{
+  Piece start;
+  make_spawned_piece(&start, next_sim_piece(random));
+
+  int num_positions = generate_lock_positions(board, &start, positions, MAX_PLACEMENTS);
+
+  int num_low = 0;
+  for(int i = 0; i < num_positions; i++)
+  {
+    const Piece *piece = &positions[i];
+
+    bool low = true;
+    for(int j = 0; j < 4; j++) low = low && piece->position.y + piece->points[j].y < max_height;
+    if(low) positions[num_low++] = positions[i];
+  }
+  if(num_low == 0) return false;
+
+  Board placed = *board;
+  board_place_piece(&placed, &positions[sim_random_below(random, num_low)]);
+
+  // No full rows, they would just make it a lower puzzle
+  int rows[4];
+  if(board_full_rows(&placed, rows)) return false;
+
+  *board = placed;
+  return true;
+}
+
+static void print_board(const Board *board, int height)
+{
+  for(int row = height - 1; row >= 0; row--)
+  {
+    printf("    |");
+    for(int column = 0; column < BOARD_COLUMNS; column++) printf("%c", ((board->rows[row] >> column) & 1) ? '#' : '.');
+    printf("|\n");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int num_puzzles = 10;
+  uint64_t seed = 1;
+  int garbage_pieces = 3;
+  int queue_length = 6;
+  int max_height = 4;
+  int threads = 0;
+
+  int option;
+  while((option = getopt(argc, argv, "n:s:g:q:m:j:")) != -1)
+  {
+    switch(option)
+    {
+      case 'n': num_puzzles = atoi(optarg); break;
+      case 's': seed = strtoull(optarg, 0, 10); break;
+      case 'g': garbage_pieces = atoi(optarg); break;
+      case 'q': queue_length = atoi(optarg); break;
+      case 'm': max_height = atoi(optarg); break;
+      case 'j': threads = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n puzzles] [-s seed] [-g garbage pieces] [-q queue length] [-m max height] [-j threads]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if(queue_length > MAX_PC_QUEUE) queue_length = MAX_PC_QUEUE;
+
+  ThreadPool *pool = create_thread_pool(threads);
+  PcSolver *solver = create_pc_solver(pool, 20);
+
+  SimRandom random;
+  seed_sim_random(&random, seed, NO_PIECE);
+
+  int found = 0;
+  int attempts = 0;
+  double total_ms = 0.0;
+  double slowest_ms = 0.0;
+  PcStats total_stats = {};
+
+  while(found < num_puzzles && attempts < num_puzzles * 100)
+  {
+    attempts++;
+
+    PcProblem problem;
+    clear_board(&problem.board);
+    for(int i = 0; i < garbage_pieces; i++) drop_garbage(&problem.board, &random, 2);
+
+    problem.current = next_sim_piece(&random);
+    problem.hold = next_sim_piece(&random);
+    problem.can_hold = true;
+    problem.queue_length = queue_length;
+    for(int i = 0; i < queue_length; i++) problem.queue[i] = next_sim_piece(&random);
+
+    PcSolution solution;
+    PcStats stats;
+    uint64_t start = latency_now_ns();
+    bool solved = solve_perfect_clear(solver, &problem, max_height, &solution, &stats);
+    double ms = (latency_now_ns() - start) * 1e-6;
+
+    total_ms += ms;
+    if(ms > slowest_ms) slowest_ms = ms;
+    total_stats.nodes += stats.nodes;
+    total_stats.pruned += stats.pruned;
+    total_stats.memo_hits += stats.memo_hits;
+
+    if(!solved) continue;
+    found++;
+
+    printf("puzzle %d: %c, hold %c, queue ", found, PIECE_NAMES[problem.current], PIECE_NAMES[problem.hold]);
+    for(int i = 0; i < problem.queue_length; i++) printf("%c", PIECE_NAMES[problem.queue[i]]);
+    printf(", %d line clear in %d moves (%.2f ms)\n", solution.height, solution.num_moves, ms);
+
+    print_board(&problem.board, solution.height);
+    for(int i = 0; i < solution.num_moves; i++)
+    {
+      const PcMove *move = &solution.moves[i];
+      printf("    %s%c at (%d, %d) r%d\n", move->hold ? "hold, " : "", PIECE_NAMES[move->piece.type],
+             move->piece.position.x, move->piece.position.y, move->piece.rotation);
+    }
+  }
+
+  printf("\n%d of %d positions have a clear, %d threads\n", found, attempts, thread_pool_size(pool));
+  printf("%.2f ms per position, slowest %.2f ms\n", total_ms / attempts, slowest_ms);
+  printf("%llu nodes, %llu pruned, %llu memo hits\n", (unsigned long long)total_stats.nodes,
+         (unsigned long long)total_stats.pruned, (unsigned long long)total_stats.memo_hits);
+
+  destroy_pc_solver(solver);
+  destroy_thread_pool(pool);
+  return 0;
+}
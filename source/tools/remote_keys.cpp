@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////
+// Plays a game on another machine (tetris.exe -k) from this one's keyboard.
+// Reads the keyboard straight from its input device, so it needs neither X11
+// nor a terminal, and sends the game buttons every time they change along
+// with when the kernel saw the key, see input_protocol.h.
+//
+//   remote_keys.exe [-d input device] [-p port] [-m] [-l ms] game address
+//
+// -m mashes keys instead of reading a keyboard, like the latency harness, for
+// trying it out. -l says each change happened that long before it was sent,
+// to see the game put late input back on its tick. Escape quits.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../input_protocol.h"
+#include "../input.h"
+#include "../game_timer.h"
+#include "../latency.h"
+
+#include <linux/input.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // inet_pton
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <signal.h>
+#include <unistd.h>    // getopt, read, close
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstdio>
+
+
+// Input device key code for each GameButton bit, in order
+static const int BUTTON_KEY_CODES[NUM_GAME_BUTTONS] = { KEY_W, KEY_A, KEY_S, KEY_D, KEY_J, KEY_L, KEY_R, KEY_SPACE };
+
+struct RemoteKeys
+{
+  int udp_socket;
+  sockaddr_in game;
+
+  uint32_t sequence;
+  unsigned buttons;
+  uint64_t changed_ns;
+  uint64_t last_sent;
+};
+
+static volatile sig_atomic_t keys_running = 1;
+
+static void handle_stop_signal(int signal_number)
+{
+  keys_running = 0;
+}
+
+static void send_buttons(RemoteKeys *keys)
+{
+  RemoteButtonsPacket packet = {};
+  packet.magic = REMOTE_BUTTONS_MAGIC;
+  packet.sequence = keys->sequence;
+  packet.buttons = keys->buttons;
+  packet.changed_ns = keys->changed_ns;
+  packet.sent_ns = latency_now_ns();
+  sendto(keys->udp_socket, &packet, sizeof(packet), 0, (const sockaddr *)&keys->game, sizeof(keys->game));
+  keys->last_sent = packet.sent_ns;
+}
+
+static void change_buttons(RemoteKeys *keys, unsigned buttons, uint64_t changed_ns)
+{
+  if(buttons == keys->buttons) return;
+
+  keys->buttons = buttons;
+  keys->changed_ns = changed_ns;
+  keys->sequence++;
+  send_buttons(keys);
+}
+
+// -1 if it can't be read
+static int open_keyboard(const char *path)
+{
+  int keyboard = open(path, O_RDONLY | O_NONBLOCK);
+  if(keyboard == -1)
+  {
+    fprintf(stderr, "Can't open %s: %i\n", path, errno);
+    return -1;
+  }
+
+  // Event times on the same clock as latency_now_ns()
+  int clock_id = CLOCK_MONOTONIC;
+  ioctl(keyboard, EVIOCSCLOCKID, &clock_id);
+  return keyboard;
+}
+
+static void read_keyboard(RemoteKeys *keys, int keyboard)
+{
+  input_event events[64];
+  ssize_t bytes = read(keyboard, events, sizeof(events));
+  if(bytes <= 0) return;
+
+  for(size_t i = 0; i < bytes / sizeof(input_event); i++)
+  {
+    const input_event *event = &events[i];
+
+    // Key repeats don't change what's held
+    if(event->type != EV_KEY || event->value == 2) continue;
+
+    if(event->code == KEY_ESC)
+    {
+      keys_running = 0;
+      return;
+    }
+
+    for(int b = 0; b < NUM_GAME_BUTTONS; b++)
+    {
+      if(event->code != BUTTON_KEY_CODES[b]) continue;
+
+      unsigned buttons = event->value ? keys->buttons | 1 << b : keys->buttons & ~(1u << b);
+      uint64_t changed_ns = (uint64_t)event->time.tv_sec * 1000000000ull + (uint64_t)event->time.tv_usec * 1000ull;
+      change_buttons(keys, buttons, changed_ns);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *device = "/dev/input/event0";
+  int port = REMOTE_INPUT_PORT;
+  bool mash = false;
+  uint64_t late_ns = 0;
+
+  int option;
+  while((option = getopt(argc, argv, "d:p:ml:")) != -1)
+  {
+    switch(option)
+    {
+      case 'd': device = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 'm': mash = true; break;
+      case 'l': late_ns = (uint64_t)(atof(optarg) * 1e6); break;
+      default:
+        fprintf(stderr, "usage: %s [-d input device] [-p port] [-m] [-l ms] game address\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind >= argc)
+  {
+    fprintf(stderr, "usage: %s [-d input device] [-p port] [-m] [-l ms] game address\n", argv[0]);
+    return 1;
+  }
+
+  RemoteKeys keys = {};
+  keys.game.sin_family = AF_INET;
+  keys.game.sin_port = htons(port);
+  if(inet_pton(AF_INET, argv[optind], &keys.game.sin_addr) != 1)
+  {
+    fprintf(stderr, "Bad game address %s\n", argv[optind]);
+    return 1;
+  }
+
+  keys.udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if(keys.udp_socket == -1)
+  {
+    fprintf(stderr, "Error opening socket: %i\n", errno);
+    return 1;
+  }
+
+  int keyboard = mash ? -1 : open_keyboard(device);
+  if(!mash && keyboard == -1) return 1;
+
+  struct sigaction action = {};
+  action.sa_handler = handle_stop_signal;
+  sigaction(SIGINT, &action, 0);
+  sigaction(SIGTERM, &action, 0);
+
+  // Restart and hold stay up, the mashing would only restart the game
+  const unsigned mashed = BUTTON_HARD_DROP | BUTTON_LEFT | BUTTON_SOFT_DROP | BUTTON_RIGHT | BUTTON_ROTATE_CCW |
+                          BUTTON_ROTATE_CW;
+
+  uint64_t keepalive = (uint64_t)REMOTE_KEEPALIVE_MS * 1000000ull;
+  uint64_t tick_ns = (uint64_t)(TICK_TIME * 1e6);
+  uint64_t next_mash = latency_now_ns();
+
+  // Says hello so the game knows whose input it takes
+  keys.changed_ns = latency_now_ns();
+  send_buttons(&keys);
+
+  while(keys_running)
+  {
+    uint64_t now = latency_now_ns();
+    uint64_t wake = keys.last_sent + keepalive;
+    if(mash && next_mash < wake) wake = next_mash;
+    int timeout_ms = (wake > now) ? (int)((wake - now + 999999) / 1000000) : 0;
+
+    pollfd descriptor = { keyboard, POLLIN, 0 };
+    int ready = poll(&descriptor, keyboard == -1 ? 0 : 1, timeout_ms);
+    if(ready > 0) read_keyboard(&keys, keyboard);
+
+    now = latency_now_ns();
+    if(mash && now >= next_mash)
+    {
+      // A press or release every few ticks, like a player
+      if(rand() % 8 == 0)
+      {
+        change_buttons(&keys, (keys.buttons ^ 1 << (rand() % NUM_GAME_BUTTONS)) & mashed, now - late_ns);
+      }
+      next_mash += tick_ns;
+    }
+
+    if(now - keys.last_sent >= keepalive) send_buttons(&keys);
+  }
+
+  // Lets go of everything on the way out
+  change_buttons(&keys, 0, latency_now_ns());
+  printf("%u changes sent\n", keys.sequence);
+
+  if(keyboard != -1) close(keyboard);
+  close(keys.udp_socket);
+  return 0;
+}
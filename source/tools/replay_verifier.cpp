@@ -0,0 +1,227 @@
+////////////////////////////////////////////////////////////////////////////////
+// Plays recorded replays back as fast as the game runs and checks every
+// checksum and keyframe in them, so a change that makes the game play out
+// differently from a recording is caught. Each replay is reported on a line,
+// and the exit status is 1 if any diverged or couldn't be read.
+//
+//   replay_verifier.exe [-j workers] replay or directory...
+//
+// Directories add every .trpl file in them. The game is one global, so the
+// workers are processes, one per core by default, taking the longest replays
+// first.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../tetris.h"
+#include "../game_timer.h"
+#include "../latency.h"
+
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct ReplayFile
+{
+  std::string path;
+  off_t size;
+};
+
+struct VerifyResult
+{
+  bool loaded;
+  ReplayVerification verification;
+};
+
+// Shared with the workers, which take replays off next_file until it runs out
+struct VerifyJobs
+{
+  std::atomic<int> next_file;
+  VerifyResult results[1];
+};
+
+static bool ends_with(const char *name, const char *suffix)
+{
+  size_t name_length = strlen(name);
+  size_t suffix_length = strlen(suffix);
+  return name_length >= suffix_length && !strcmp(name + name_length - suffix_length, suffix);
+}
+
+// False if path can't be read
+static bool add_path(const char *path, std::vector<ReplayFile> *files)
+{
+  struct stat info;
+  if(stat(path, &info)) return false;
+
+  if(!S_ISDIR(info.st_mode))
+  {
+    files->push_back(ReplayFile{path, info.st_size});
+    return true;
+  }
+
+  DIR *directory = opendir(path);
+  if(!directory) return false;
+
+  while(dirent *entry = readdir(directory))
+  {
+    if(!ends_with(entry->d_name, ".trpl")) continue;
+
+    std::string file = std::string(path) + "/" + entry->d_name;
+    if(stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode)) files->push_back(ReplayFile{file, info.st_size});
+  }
+
+  closedir(directory);
+  return true;
+}
+
+static void verify_files(const std::vector<ReplayFile> &files, VerifyJobs *jobs)
+{
+  for(;;)
+  {
+    int file = jobs->next_file.fetch_add(1);
+    if(file >= (int)files.size()) return;
+
+    VerifyResult *result = &jobs->results[file];
+    result->loaded = verify_replay(files[file].path.c_str(), &result->verification);
+  }
+}
+
+static void print_time(uint32_t tick)
+{
+  unsigned tenths = (unsigned)(tick * TICK_TIME / 100.0f);
+  printf("%u:%02u.%u", tenths / 600, tenths / 10 % 60, tenths % 10);
+}
+
+// False if the replay failed
+static bool report(const ReplayFile &file, const VerifyResult &result)
+{
+  const ReplayVerification &verification = result.verification;
+  if(!result.loaded)
+  {
+    printf("UNREADABLE  %s\n", file.path.c_str());
+    return false;
+  }
+
+  if(!verification.diverged)
+  {
+    printf("ok          %s  %u ticks, %u checksums, %u keyframes\n", file.path.c_str(), verification.ticks,
+           verification.checksums, verification.keyframes);
+    return true;
+  }
+
+  // Both checks on one tick only when the first one failed
+  printf("DIVERGED    %s  ", file.path.c_str());
+  if(verification.matched_tick < verification.diverged_tick)
+  {
+    printf("after tick %u (", verification.matched_tick);
+    print_time(verification.matched_tick);
+    printf("), ");
+  }
+  printf("by tick %u (", verification.diverged_tick);
+  print_time(verification.diverged_tick);
+  printf(")");
+  if(verification.field[0]) printf(", %s differs at tick %u", verification.field, verification.field_tick);
+  printf("\n");
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  int num_workers = (int)std::thread::hardware_concurrency();
+
+  int option;
+  while((option = getopt(argc, argv, "j:")) != -1)
+  {
+    switch(option)
+    {
+      case 'j': num_workers = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-j workers] replay or directory...\n", argv[0]);
+        return 1;
+    }
+  }
+
+  std::vector<ReplayFile> files;
+  for(int i = optind; i < argc; i++)
+  {
+    if(!add_path(argv[i], &files)) fprintf(stderr, "Can't read %s\n", argv[i]);
+  }
+  if(files.empty())
+  {
+    fprintf(stderr, "No replays to verify\n");
+    return 1;
+  }
+
+  // Longest first so no worker is left with a long one at the end, then by
+  // name so reports come out in the same order every night
+  std::sort(files.begin(), files.end(), [](const ReplayFile &a, const ReplayFile &b) {
+    return (a.size != b.size) ? a.size > b.size : a.path < b.path;
+  });
+
+  init_tetris();
+
+  if(num_workers < 1) num_workers = 1;
+  if(num_workers > (int)files.size()) num_workers = (int)files.size();
+
+  size_t jobs_size = sizeof(VerifyJobs) + sizeof(VerifyResult) * files.size();
+  void *shared = mmap(0, jobs_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(shared == MAP_FAILED) return 1;
+  VerifyJobs *jobs = (VerifyJobs *)shared;
+  jobs->next_file.store(0);
+
+  uint64_t start = latency_now_ns();
+
+  // The parent is worker 0
+  std::vector<pid_t> workers;
+  for(int i = 1; i < num_workers; i++)
+  {
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+      verify_files(files, jobs);
+      _exit(0);
+    }
+    if(pid > 0) workers.push_back(pid);
+  }
+  verify_files(files, jobs);
+
+  bool workers_ok = true;
+  for(pid_t pid : workers)
+  {
+    int status;
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status)) workers_ok = false;
+  }
+
+  double seconds = (latency_now_ns() - start) * 1e-9;
+
+  int failed = 0;
+  uint64_t ticks = 0;
+  for(size_t i = 0; i < files.size(); i++)
+  {
+    if(!report(files[i], jobs->results[i])) failed++;
+    ticks += jobs->results[i].verification.ticks;
+  }
+
+  // A worker that crashed leaves its replay unreported, and unloaded
+  if(!workers_ok) fprintf(stderr, "A worker crashed\n");
+
+  printf("%d of %d replays failed, %llu ticks in %.2f s on %d workers, %.0f ticks/s (%.0fx real time)\n", failed,
+         (int)files.size(), (unsigned long long)ticks, seconds, num_workers, ticks / seconds,
+         ticks * TICK_TIME / 1000.0 / seconds);
+
+  munmap(shared, jobs_size);
+  return (failed || !workers_ok) ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////
+// Times rollback the way online play would use it. Runs the real game a frame
+// at a time with keys mashed at random, and every frame says the keys held
+// now actually went down 8 ticks ago, so the game rolls back and runs those
+// ticks again. Prints percentiles of the time a rollback takes against the
+// frame it has to fit in.
+//
+//   rollback_bench.exe [-n frames] [-s seed]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../tetris.h"
+#include "../input.h"
+#include "../game_timer.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <stdlib.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+#include <vector>
+
+
+static const uint32_t ROLLBACK = 8;
+
+static unsigned held_buttons;
+
+
+
+// Platform implementation for the game, the rest is platform_headless.cpp's
+bool button_state(unsigned char key)
+{
+  for(int i = 0; i < NUM_GAME_BUTTONS; i++)
+  {
+    if(GAME_BUTTON_KEYS[i] == key) return held_buttons & (1 << i);
+  }
+
+  return false;
+}
+
+
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+  return sorted[(size_t)(fraction * (sorted.size() - 1))];
+}
+
+int main(int argc, char **argv)
+{
+  int num_frames = 100000;
+  unsigned seed = 1;
+
+  int option;
+  while((option = getopt(argc, argv, "n:s:")) != -1)
+  {
+    switch(option)
+    {
+      case 'n': num_frames = atoi(optarg); break;
+      case 's': seed = (unsigned)atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n frames] [-s seed]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  init_tetris();
+  srand(seed);
+
+  // Restart and hold stay up, the mashing would only restart the game
+  const unsigned mashed = BUTTON_HARD_DROP | BUTTON_LEFT | BUTTON_SOFT_DROP | BUTTON_RIGHT | BUTTON_ROTATE_CCW |
+                          BUTTON_ROTATE_CW;
+
+  std::vector<double> times;
+  times.reserve(num_frames);
+
+  for(int frame = 0; frame < num_frames; frame++)
+  {
+    // A press or release every few frames, like a player
+    if(rand() % 4 == 0) held_buttons ^= 1 << (rand() % NUM_GAME_BUTTONS);
+    held_buttons &= mashed;
+
+    update_tetris();
+
+    uint64_t start = latency_now_ns();
+    bool rolled_back = correct_buttons(game_tick() - ROLLBACK, held_buttons);
+    if(rolled_back) times.push_back((latency_now_ns() - start) * 1e-3);
+  }
+
+  if(times.empty())
+  {
+    fprintf(stderr, "Nothing rolled back\n");
+    return 1;
+  }
+
+  std::sort(times.begin(), times.end());
+  double frame_us = TICK_TIME * 1000.0;
+  printf("%d rollbacks of %u ticks, us: p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", (int)times.size(), ROLLBACK,
+         percentile(times, 0.5), percentile(times, 0.99), percentile(times, 0.999), times.back());
+  printf("worst case is %.2f%% of a %.1f ms frame\n", 100.0 * times.back() / frame_us, TICK_TIME);
+  return 0;
+}
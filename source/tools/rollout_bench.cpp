@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+// Rollout engine benchmark. Plays a game from a seed with the default policy
+// up to a midgame position, then rolls out every move there with 1, 2, 4, ...
+// threads. Prints rollouts per second for each thread count, checks that every
+// thread count gives exactly the same results, and shows the best moves.
+//
+//   rollout_bench.exe [-r rollouts per move] [-d depth] [-s seed] [-p pieces] [-j max threads]
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../rollout.h"
+#include "../thread_pool.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <stdlib.h>
+#include <string.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+#include <thread>
+
+static const char *PIECE_NAMES = "IJLOSTZ";
+
+int main(int argc, char **argv)
+{
+  RolloutSettings settings = default_rollout_settings();
+  int opening_pieces = 30;
+  int max_threads = (int)std::thread::hardware_concurrency();
+
+  int option;
+  while((option = getopt(argc, argv, "r:d:s:p:j:")) != -1)
+  {
+    switch(option)
+    {
+      case 'r': settings.rollouts_per_move = atoi(optarg); break;
+      case 'd': settings.rollout_depth = atoi(optarg); break;
+      case 's': settings.seed = strtoull(optarg, 0, 10); break;
+      case 'p': opening_pieces = atoi(optarg); break;
+      case 'j': max_threads = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-r rollouts per move] [-d depth] [-s seed] [-p pieces] [-j max threads]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(max_threads < 1) max_threads = 1;
+  if(settings.rollouts_per_move < 1) settings.rollouts_per_move = 1;
+
+  // Opening, so the rollouts start from a board with some shape to it
+  ThreadPool *setup_pool = create_thread_pool(1);
+  RolloutEngine *setup = create_rollout_engine(setup_pool, &settings);
+
+  SimState state;
+  init_sim_state(&state, settings.seed);
+  for(int i = 0; i < opening_pieces && !state.topped_out; i++)
+  {
+    if(!rollout_policy_move(setup, &state)) break;
+  }
+
+  static RolloutMove moves[MAX_ROLLOUT_MOVES];
+  int num_moves = generate_rollout_moves(setup, &state, moves, MAX_ROLLOUT_MOVES);
+
+  destroy_rollout_engine(setup);
+  destroy_thread_pool(setup_pool);
+
+  printf("%d pieces in, %d lines, %c falling, %d moves, %d rollouts of %d pieces each\n",
+         state.pieces_placed, state.lines_cleared, PIECE_NAMES[state.current], num_moves,
+         settings.rollouts_per_move, settings.rollout_depth);
+  if(num_moves == 0) return 1;
+
+  static RolloutResult reference[MAX_ROLLOUT_MOVES];
+  static RolloutResult results[MAX_ROLLOUT_MOVES];
+  double single_rate = 0.0;
+  bool reproducible = true;
+
+  for(int threads = 1; ; threads *= 2)
+  {
+    if(threads > max_threads) threads = max_threads;
+
+    ThreadPool *pool = create_thread_pool(threads);
+    RolloutEngine *engine = create_rollout_engine(pool, &settings);
+
+    uint64_t start = latency_now_ns();
+    run_rollouts(engine, &state, moves, num_moves, results);
+    uint64_t elapsed = latency_now_ns() - start;
+
+    destroy_rollout_engine(engine);
+    destroy_thread_pool(pool);
+
+    double rate = (double)num_moves * settings.rollouts_per_move / (elapsed * 1e-9);
+    if(threads == 1)
+    {
+      single_rate = rate;
+      memcpy(reference, results, sizeof(RolloutResult) * num_moves);
+    }
+
+    bool same = memcmp(reference, results, sizeof(RolloutResult) * num_moves) == 0;
+    reproducible = reproducible && same;
+
+    printf("%3d threads: %8.0f rollouts/s  %5.2fx  %s\n", threads, rate, rate / single_rate,
+           same ? "same results" : "RESULTS DIFFER");
+
+    if(threads == max_threads) break;
+  }
+
+  int order[MAX_ROLLOUT_MOVES];
+  for(int i = 0; i < num_moves; i++) order[i] = i;
+  std::sort(order, order + num_moves, [](int a, int b) { return reference[a].mean_score > reference[b].mean_score; });
+
+  printf("\nbest moves:\n");
+  for(int i = 0; i < num_moves && i < 5; i++)
+  {
+    const RolloutMove *move = &moves[order[i]];
+    const RolloutResult *result = &reference[order[i]];
+    printf("  %s%c at (%d, %d) r%d: score %7.2f  lines %.2f  top out %.0f%%\n", move->hold ? "hold, " : "",
+           PIECE_NAMES[move->piece.type], move->piece.position.x, move->piece.position.y, move->piece.rotation,
+           result->mean_score, result->mean_lines, result->top_out_rate * 100.0f);
+  }
+
+  return reproducible ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////////////////
+// Self-play dataset generator. Plays headless games with the greedy policy on
+// every core and streams a record per move to a dataset file (see dataset.h).
+// Each game's records are kept until it ends, since the outcome fields need
+// the rest of the game, then go to the writer together.
+//
+// Games are dealt from the seed, so a seed always plays the same games. They
+// land in the file in whatever order the threads finish them.
+//
+//   selfplay.exe [-o file] [-n games] [-m max pieces] [-s seed] [-j threads] [-w w0,w1,..] [-H]
+//
+// -w takes evaluator weights in BOARD_FEATURE_NAMES order, as weight_tuner
+// prints them. -H plays without hold.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../dataset.h"
+#include "../sim_policy.h"
+#include "../thread_pool.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <stdlib.h>
+#include <cstdio>
+
+static const int GAMES_PER_BATCH = 256;
+
+struct SelfplaySettings
+{
+  int max_pieces;
+  uint64_t seed;
+  bool use_hold;
+  EvaluatorWeights weights;
+};
+
+struct SelfplayBatch
+{
+  const SelfplaySettings *settings;
+  DatasetWriter *writer;
+  int first_game;
+
+  SimPolicyScratch *scratch;  // One per worker
+  DatasetRecord **records;    // One game's worth per worker
+};
+
+static uint64_t game_seed(uint64_t seed, int game)
+{
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull * (uint64_t)(game + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static void play_game(void *context, int task, int worker)
+{
+  SelfplayBatch *batch = (SelfplayBatch *)context;
+  const SelfplaySettings *settings = batch->settings;
+  DatasetRecord *records = batch->records[worker];
+
+  SimState state;
+  init_sim_state(&state, game_seed(settings->seed, batch->first_game + task));
+
+  int num_records = 0;
+  while(num_records < settings->max_pieces)
+  {
+    bool hold;
+    Piece piece;
+    if(!choose_greedy_move(&state, &settings->weights, settings->use_hold, &batch->scratch[worker], &hold, &piece))
+    {
+      state.topped_out = true;
+      break;
+    }
+
+    DatasetRecord *record = &records[num_records++];
+    dataset_record_position(record, &state);
+    record->flags = hold ? DATASET_HOLD : 0;
+    record->x = (int8_t)piece.position.x;
+    record->y = (int8_t)piece.position.y;
+    record->rotation = (uint8_t)piece.rotation;
+    record->lines = (uint8_t)sim_apply_move(&state, hold, &piece);
+
+    if(state.topped_out) break;
+  }
+
+  // Outcomes, back from the end
+  int lines_to_go = 0;
+  for(int i = num_records - 1; i >= 0; i--)
+  {
+    lines_to_go += records[i].lines;
+    records[i].lines_to_go = (uint16_t)(lines_to_go < 0xFFFF ? lines_to_go : 0xFFFF);
+    if(state.topped_out) records[i].flags |= DATASET_TOPPED_OUT;
+  }
+
+  dataset_write(batch->writer, records, num_records);
+}
+
+static bool parse_weights(const char *text, EvaluatorWeights *weights)
+{
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++)
+  {
+    char *end;
+    weights->weights[i] = strtof(text, &end);
+    if(end == text) return false;
+
+    text = end;
+    if(*text == ',') text++;
+  }
+
+  return *text == 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = "selfplay.dat";
+  int num_games = 1000;
+  int threads = 0;
+
+  SelfplaySettings settings;
+  settings.max_pieces = 1000;
+  settings.seed = 1;
+  settings.use_hold = true;
+  settings.weights = default_evaluator_weights();
+
+  int option;
+  while((option = getopt(argc, argv, "o:n:m:s:j:w:H")) != -1)
+  {
+    switch(option)
+    {
+      case 'o': path = optarg; break;
+      case 'n': num_games = atoi(optarg); break;
+      case 'm': settings.max_pieces = atoi(optarg); break;
+      case 's': settings.seed = strtoull(optarg, 0, 10); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'w':
+        if(parse_weights(optarg, &settings.weights)) break;
+        fprintf(stderr, "-w needs %d comma separated weights\n", NUM_BOARD_FEATURES);
+        return 1;
+      case 'H': settings.use_hold = false; break;
+      default:
+        fprintf(stderr, "usage: %s [-o file] [-n games] [-m max pieces] [-s seed] [-j threads] [-w w0,w1,..] [-H]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if(settings.max_pieces < 1) settings.max_pieces = 1;
+
+  // 64k records, 4 MB, a buffer
+  DatasetWriter *writer = create_dataset_writer(path, settings.seed, 1 << 16);
+  if(!writer)
+  {
+    fprintf(stderr, "couldn't open %s\n", path);
+    return 1;
+  }
+
+  ThreadPool *pool = create_thread_pool(threads);
+  int num_workers = thread_pool_size(pool);
+
+  SelfplayBatch batch;
+  batch.settings = &settings;
+  batch.writer = writer;
+  batch.scratch = (SimPolicyScratch *)malloc(sizeof(SimPolicyScratch) * num_workers);
+  batch.records = (DatasetRecord **)malloc(sizeof(DatasetRecord *) * num_workers);
+  for(int i = 0; i < num_workers; i++)
+  {
+    batch.records[i] = (DatasetRecord *)malloc(sizeof(DatasetRecord) * settings.max_pieces);
+  }
+
+  printf("%d games of up to %d pieces to %s, %s hold, %d threads\n", num_games, settings.max_pieces, path,
+         settings.use_hold ? "with" : "without", num_workers);
+
+  uint64_t start = latency_now_ns();
+  for(int game = 0; game < num_games; game += GAMES_PER_BATCH)
+  {
+    int count = num_games - game;
+    if(count > GAMES_PER_BATCH) count = GAMES_PER_BATCH;
+
+    batch.first_game = game;
+    run_tasks(pool, play_game, &batch, count);
+
+    double seconds = (latency_now_ns() - start) * 1e-9;
+    uint64_t samples = dataset_records_written(writer);
+    printf("\r%d games, %llu samples, %.0f samples/s", game + count, (unsigned long long)samples, samples / seconds);
+    fflush(stdout);
+  }
+
+  uint64_t samples = dataset_records_written(writer);
+  bool ok = destroy_dataset_writer(writer);
+  double seconds = (latency_now_ns() - start) * 1e-9;
+
+  printf("\n%llu samples (%.1f MB) in %.1f s, %.0f samples/s, %.1f M samples/hour\n", (unsigned long long)samples,
+         samples * sizeof(DatasetRecord) / 1e6, seconds, samples / seconds, samples / seconds * 3600.0 * 1e-6);
+  if(!ok) fprintf(stderr, "writing %s failed\n", path);
+
+  for(int i = 0; i < num_workers; i++) free(batch.records[i]);
+  free(batch.records);
+  free(batch.scratch);
+  destroy_thread_pool(pool);
+  return ok ? 0 : 1;
+}
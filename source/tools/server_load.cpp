@@ -0,0 +1,352 @@
+////////////////////////////////////////////////////////////////////////////////
+// Load test for game_server.exe. Plays as many players at once, each from its
+// own socket so the server sees them as separate addresses, mashing keys the
+// way the latency harness does. Reports how many states came back against
+// how many should have, and how long a change took to show up in one.
+// Spectators watch the players' games, one each round the players, and
+// report what watching costs and whether the games they pieced together
+// from events ever disagreed with the snapshots.
+//
+//   server_load.exe [-c players] [-v spectators] [-t seconds] [-a server address] [-p port]
+//                   [-s spectator port]
+//
+// Start the server first: make server server_load, ./game_server.exe &
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../game_protocol.h"
+#include "../game_timer.h"
+#include "../input.h"
+#include "../latency.h"
+#include "../spectator.h"
+
+#include <sys/epoll.h>
+#include <sys/resource.h> // setrlimit
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>    // inet_pton
+#include <unistd.h>       // getopt, close, read
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+#include <vector>
+
+
+struct LoadPlayer
+{
+  int udp_socket;
+
+  uint32_t sequence;
+  unsigned buttons;
+  uint64_t last_sent;
+
+  // The change waiting to show up in a state, 0 once it has
+  uint64_t change_time;
+
+  uint32_t states;
+  uint32_t last_tick;
+  uint32_t game_id; // 0 until a state says
+};
+
+struct LoadSpectator
+{
+  int udp_socket;
+  int player; // Whose game it watches
+  uint64_t last_sent;
+  uint64_t bytes;
+  SpectatorGame game;
+};
+
+static int connect_player(const sockaddr_in *server)
+{
+  int udp_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if(udp_socket == -1) return -1;
+
+  // Only the server's packets come through
+  if(connect(udp_socket, (const sockaddr *)server, sizeof(*server)) == -1)
+  {
+    close(udp_socket);
+    return -1;
+  }
+
+  return udp_socket;
+}
+
+static void send_input(LoadPlayer *player, uint64_t now)
+{
+  GameInputPacket packet;
+  packet.magic = GAME_INPUT_MAGIC;
+  packet.sequence = player->sequence;
+  packet.buttons = player->buttons;
+  send(player->udp_socket, &packet, sizeof(packet), 0);
+  player->last_sent = now;
+}
+
+static void receive_states(LoadPlayer *player, std::vector<double> *latencies)
+{
+  GameStatePacket packet;
+  while(recv(player->udp_socket, &packet, sizeof(packet), 0) == (ssize_t)sizeof(packet))
+  {
+    if(packet.magic != GAME_STATE_MAGIC) continue;
+
+    player->states++;
+    player->last_tick = packet.tick;
+    player->game_id = packet.game_id;
+    if(player->change_time && packet.input_sequence == player->sequence)
+    {
+      latencies->push_back((latency_now_ns() - player->change_time) * 1e-6);
+      player->change_time = 0;
+    }
+  }
+}
+
+static void send_spectate(LoadSpectator *spectator, const sockaddr_in *server, int spectator_port, uint64_t now)
+{
+  GameSpectatePacket packet;
+  packet.magic = GAME_SPECTATE_MAGIC;
+  packet.game_id = spectator->game.game_id;
+
+  sockaddr_in address = *server;
+  address.sin_port = htons(spectator_port + (packet.game_id >> 24));
+  sendto(spectator->udp_socket, &packet, sizeof(packet), 0, (const sockaddr *)&address, sizeof(address));
+  spectator->last_sent = now;
+}
+
+static void receive_spectated(LoadSpectator *spectator)
+{
+  GameSnapshotPacket datagram;
+  for(;;)
+  {
+    ssize_t size = recv(spectator->udp_socket, &datagram, sizeof(datagram), 0);
+    if(size <= 0) return;
+
+    spectator->bytes += size;
+    take_spectator_datagram(&spectator->game, &datagram, size);
+  }
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+  return sorted.empty() ? 0.0 : sorted[(size_t)(fraction * (sorted.size() - 1))];
+}
+
+int main(int argc, char **argv)
+{
+  int num_players = 1000;
+  int num_spectators = 0;
+  int seconds = 10;
+  const char *server_ip = "127.0.0.1";
+  int port = GAME_SERVER_PORT;
+  int spectator_port = GAME_SPECTATOR_PORT;
+
+  int option;
+  while((option = getopt(argc, argv, "c:v:t:a:p:s:")) != -1)
+  {
+    switch(option)
+    {
+      case 'c': num_players = atoi(optarg); break;
+      case 'v': num_spectators = atoi(optarg); break;
+      case 't': seconds = atoi(optarg); break;
+      case 'a': server_ip = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 's': spectator_port = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-c players] [-v spectators] [-t seconds] [-a server address] [-p port] "
+                        "[-s spectator port]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(num_players < 1) num_players = 1;
+
+  // A socket a player and a spectator
+  rlimit files;
+  getrlimit(RLIMIT_NOFILE, &files);
+  files.rlim_cur = files.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &files);
+
+  sockaddr_in server = {};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  if(inet_pton(AF_INET, server_ip, &server.sin_addr) != 1)
+  {
+    fprintf(stderr, "Bad server address %s\n", server_ip);
+    return 1;
+  }
+
+  int epoll = epoll_create1(0);
+  std::vector<LoadPlayer> players(num_players);
+  for(int i = 0; i < num_players; i++)
+  {
+    LoadPlayer *player = &players[i];
+    memset(player, 0, sizeof(LoadPlayer));
+    player->udp_socket = connect_player(&server);
+    if(player->udp_socket == -1)
+    {
+      fprintf(stderr, "Could only open %d sockets: %i\n", i, errno);
+      return 1;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = i;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, player->udp_socket, &event);
+  }
+
+  // Players press keys on ticks, like the game reads them
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  itimerspec spec = {};
+  spec.it_interval.tv_nsec = (long)(TICK_TIME * 1e6);
+  spec.it_value = spec.it_interval;
+  timerfd_settime(timer, 0, &spec, 0);
+  epoll_event timer_event = {};
+  timer_event.events = EPOLLIN;
+  timer_event.data.u32 = (uint32_t)num_players;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timer_event);
+
+  // After the timer in the epoll indices
+  std::vector<LoadSpectator> spectators(num_spectators);
+  for(int i = 0; i < num_spectators; i++)
+  {
+    LoadSpectator *spectator = &spectators[i];
+    *spectator = LoadSpectator();
+    spectator->udp_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    spectator->player = i % num_players;
+    if(spectator->udp_socket == -1)
+    {
+      fprintf(stderr, "Could only open %d spectator sockets: %i\n", i, errno);
+      return 1;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t)(num_players + 1 + i);
+    epoll_ctl(epoll, EPOLL_CTL_ADD, spectator->udp_socket, &event);
+  }
+
+  // Restart and hold stay up, the mashing would only restart the game
+  const unsigned mashed = BUTTON_HARD_DROP | BUTTON_LEFT | BUTTON_SOFT_DROP | BUTTON_RIGHT | BUTTON_ROTATE_CCW |
+                          BUTTON_ROTATE_CW;
+
+  std::vector<double> latencies;
+  uint64_t keepalive = (uint64_t)GAME_KEEPALIVE_MS * 1000000ull;
+  uint64_t start = latency_now_ns();
+  uint64_t end = start + (uint64_t)seconds * 1000000000ull;
+  uint64_t changes = 0;
+
+  // Everyone says hello so the games start together
+  for(int i = 0; i < num_players; i++) send_input(&players[i], start);
+
+  srand(1);
+  std::vector<epoll_event> events(256);
+  for(uint64_t now = start; now < end; now = latency_now_ns())
+  {
+    int count = epoll_wait(epoll, events.data(), (int)events.size(), 10);
+    for(int e = 0; e < count; e++)
+    {
+      uint32_t index = events[e].data.u32;
+      if(index < (uint32_t)num_players)
+      {
+        receive_states(&players[index], &latencies);
+        continue;
+      }
+      if(index > (uint32_t)num_players)
+      {
+        receive_spectated(&spectators[index - num_players - 1]);
+        continue;
+      }
+
+      uint64_t expirations;
+      if(read(timer, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+
+      now = latency_now_ns();
+      for(int i = 0; i < num_players; i++)
+      {
+        LoadPlayer *player = &players[i];
+
+        // A press or release every few ticks, like a player
+        if(rand() % 8 == 0)
+        {
+          player->buttons = (player->buttons ^ 1 << (rand() % NUM_GAME_BUTTONS)) & mashed;
+          player->sequence++;
+          player->change_time = now;
+          changes++;
+          send_input(player, now);
+        }
+        else if(now - player->last_sent >= keepalive)
+        {
+          send_input(player, now);
+        }
+      }
+
+      // Watching starts once the server has said what the game is
+      for(int i = 0; i < num_spectators; i++)
+      {
+        LoadSpectator *spectator = &spectators[i];
+        uint32_t game_id = players[spectator->player].game_id;
+        if(!game_id) continue;
+
+        if(game_id != spectator->game.game_id)
+        {
+          init_spectator_game(&spectator->game, game_id);
+          send_spectate(spectator, &server, spectator_port, now);
+        }
+        else if(now - spectator->last_sent >= keepalive)
+        {
+          send_spectate(spectator, &server, spectator_port, now);
+        }
+      }
+    }
+  }
+
+  double elapsed = (latency_now_ns() - start) * 1e-9;
+  uint64_t states = 0;
+  int silent = 0;
+  for(int i = 0; i < num_players; i++)
+  {
+    states += players[i].states;
+    if(!players[i].states) silent++;
+    close(players[i].udp_socket);
+  }
+
+  int synced = 0;
+  uint64_t spectated_bytes = 0, events_played = 0, snapshots = 0, gaps = 0, desyncs = 0;
+  for(int i = 0; i < num_spectators; i++)
+  {
+    const SpectatorGame *game = &spectators[i].game;
+    if(game->synced) synced++;
+    spectated_bytes += spectators[i].bytes;
+    events_played += game->events;
+    snapshots += game->snapshots;
+    gaps += game->gaps;
+    desyncs += game->desyncs;
+    close(spectators[i].udp_socket);
+  }
+
+  close(timer);
+  close(epoll);
+
+  // Changes that never showed up are left out of the latency
+  std::sort(latencies.begin(), latencies.end());
+  double expected = num_players * elapsed * 1000.0 / (TICK_TIME * GAME_STATE_INTERVAL);
+  printf("%d players for %.1f s, %d never got a state\n", num_players, elapsed, silent);
+  printf("%llu changes sent, %llu states received of about %.0f (%.1f%%), %.0f states/s\n",
+         (unsigned long long)changes, (unsigned long long)states, expected, 100.0 * states / expected, states / elapsed);
+  printf("change to state ms: p50 %.1f  p99 %.1f  max %.1f  (%d measured)\n", percentile(latencies, 0.5),
+         percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back(), (int)latencies.size());
+
+  if(num_spectators)
+  {
+    // Against getting the player's states, which would be the other way to watch
+    double state_bytes = sizeof(GameStatePacket) * 1000.0 / (TICK_TIME * GAME_STATE_INTERVAL);
+    printf("%d spectators, %d following their game at the end: %llu events, %llu snapshots, %llu gaps, "
+           "%llu desyncs\n", num_spectators, synced, (unsigned long long)events_played,
+           (unsigned long long)snapshots, (unsigned long long)gaps, (unsigned long long)desyncs);
+    printf("%.0f bytes/s per spectator, states would be %.0f\n", spectated_bytes / elapsed / num_spectators,
+           state_bytes);
+  }
+  return (num_spectators && desyncs) ? 1 : 0;
+}
@@ -0,0 +1,301 @@
+////////////////////////////////////////////////////////////////////////////////
+// Evaluator weight tuner. A genetic algorithm over EvaluatorWeights, scoring
+// every candidate by the lines it clears in headless games played by the
+// greedy simulation policy. Games run on every core, and all candidates of a
+// generation play the same seeds, so they are compared on the same pieces.
+//
+// A game ends when the stack grows past the ceiling or after max pieces. A
+// low ceiling makes weak weights die early, which is what separates them.
+//
+// Weights only matter up to scale for picking moves, so every candidate is
+// kept at unit length.
+//
+//   weight_tuner.exe [-p population] [-g generations] [-n games] [-m max pieces] [-c ceiling] [-s seed] [-j threads] [-H]
+//
+// -H plays without hold.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "../sim_policy.h"
+#include "../thread_pool.h"
+#include "../latency.h"
+
+#include <unistd.h> // getopt
+
+#include <math.h>
+#include <stdlib.h>
+#include <cstdio>
+
+#include <algorithm> // sort
+
+struct TunerSettings
+{
+  int population;
+  int generations;
+  int games;      // Per candidate per generation
+  int max_pieces;
+  int ceiling;    // Rows
+  uint64_t seed;
+  bool use_hold;
+};
+
+struct Candidate
+{
+  EvaluatorWeights weights;
+  float fitness; // Mean lines per game
+};
+
+// The batch of games one generation hands to the pool
+struct Generation
+{
+  const TunerSettings *settings;
+  const Candidate *candidates;
+  uint64_t seed;
+
+  int *lines;       // games per candidate
+  int *pieces;
+  SimPolicyScratch *scratch; // One per worker
+};
+
+static uint64_t mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static int stack_height(const Board *board)
+{
+  int height = BOARD_ROWS;
+  while(height > 0 && !board->rows[height - 1]) height--;
+  return height;
+}
+
+static void play_game(void *context, int task, int worker)
+{
+  Generation *generation = (Generation *)context;
+  const TunerSettings *settings = generation->settings;
+
+  // Game i of every candidate deals the same pieces
+  int candidate = task / settings->games;
+  int game = task % settings->games;
+  const EvaluatorWeights *weights = &generation->candidates[candidate].weights;
+
+  SimState state;
+  init_sim_state(&state, mix(generation->seed + game));
+
+  while(state.pieces_placed < settings->max_pieces)
+  {
+    if(!play_greedy_move(&state, weights, settings->use_hold, &generation->scratch[worker])) break;
+    if(state.topped_out || stack_height(&state.board) > settings->ceiling) break;
+  }
+
+  generation->lines[task] = state.lines_cleared;
+  generation->pieces[task] = state.pieces_placed;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Genetic algorithm
+////////////////////////////////////////////////////////////////////////////////
+
+static float random_float(SimRandom *random)
+{
+  return sim_random_below(random, 1 << 24) / (float)(1 << 24);
+}
+
+static float random_gaussian(SimRandom *random)
+{
+  float u = random_float(random) + 1e-7f;
+  float v = random_float(random);
+  return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+static void normalize(EvaluatorWeights *weights)
+{
+  float length = 0.0f;
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++) length += weights->weights[i] * weights->weights[i];
+
+  length = sqrtf(length);
+  if(length == 0.0f) return;
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++) weights->weights[i] /= length;
+}
+
+// Best of three random picks
+static const Candidate *tournament(const Candidate *candidates, int population, SimRandom *random)
+{
+  const Candidate *best = &candidates[sim_random_below(random, population)];
+  for(int i = 1; i < 3; i++)
+  {
+    const Candidate *other = &candidates[sim_random_below(random, population)];
+    if(other->fitness > best->fitness) best = other;
+  }
+
+  return best;
+}
+
+// Candidates sorted best first in, next generation out. The best eighth
+// carries over as is, the rest are fitness weighted blends of two
+// tournament winners, some with one weight nudged.
+static void breed(Candidate *candidates, Candidate *next, int population, SimRandom *random)
+{
+  int elite = population / 8;
+  if(elite < 1) elite = 1;
+  for(int i = 0; i < elite; i++) next[i] = candidates[i];
+
+  for(int i = elite; i < population; i++)
+  {
+    const Candidate *a = tournament(candidates, population, random);
+    const Candidate *b = tournament(candidates, population, random);
+
+    // Shifted so a parent that cleared nothing still counts a little
+    float fitness_a = a->fitness + 1.0f;
+    float fitness_b = b->fitness + 1.0f;
+
+    Candidate *child = &next[i];
+    for(int j = 0; j < NUM_BOARD_FEATURES; j++)
+    {
+      child->weights.weights[j] = (a->weights.weights[j] * fitness_a + b->weights.weights[j] * fitness_b) /
+                                  (fitness_a + fitness_b);
+    }
+
+    if(sim_random_below(random, 5) == 0)
+    {
+      child->weights.weights[sim_random_below(random, NUM_BOARD_FEATURES)] += 0.2f * random_gaussian(random);
+    }
+
+    normalize(&child->weights);
+    child->fitness = 0.0f;
+  }
+}
+
+static void print_weights(const EvaluatorWeights *weights)
+{
+  for(int i = 0; i < NUM_BOARD_FEATURES; i++)
+  {
+    printf("  %-20s %+.4f\n", BOARD_FEATURE_NAMES[i], weights->weights[i]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  TunerSettings settings;
+  settings.population = 32;
+  settings.generations = 20;
+  settings.games = 16;
+  settings.max_pieces = 500;
+  settings.ceiling = 10;
+  settings.seed = 1;
+  settings.use_hold = true;
+  int threads = 0;
+
+  int option;
+  while((option = getopt(argc, argv, "p:g:n:m:c:s:j:H")) != -1)
+  {
+    switch(option)
+    {
+      case 'p': settings.population = atoi(optarg); break;
+      case 'g': settings.generations = atoi(optarg); break;
+      case 'n': settings.games = atoi(optarg); break;
+      case 'm': settings.max_pieces = atoi(optarg); break;
+      case 'c': settings.ceiling = atoi(optarg); break;
+      case 's': settings.seed = strtoull(optarg, 0, 10); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'H': settings.use_hold = false; break;
+      default:
+        fprintf(stderr, "usage: %s [-p population] [-g generations] [-n games] [-m max pieces] [-c ceiling] [-s seed] "
+                        "[-j threads] [-H]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(settings.population < 2) settings.population = 2;
+  if(settings.games < 1) settings.games = 1;
+
+  ThreadPool *pool = create_thread_pool(threads);
+
+  int population = settings.population;
+  Candidate *candidates = (Candidate *)malloc(sizeof(Candidate) * population);
+  Candidate *next = (Candidate *)malloc(sizeof(Candidate) * population);
+
+  Generation generation;
+  generation.settings = &settings;
+  generation.lines = (int *)malloc(sizeof(int) * population * settings.games);
+  generation.pieces = (int *)malloc(sizeof(int) * population * settings.games);
+  generation.scratch = (SimPolicyScratch *)malloc(sizeof(SimPolicyScratch) * thread_pool_size(pool));
+
+  // The current weights and random ones
+  SimRandom random;
+  seed_sim_random(&random, settings.seed, NO_PIECE);
+
+  candidates[0].weights = default_evaluator_weights();
+  normalize(&candidates[0].weights);
+  for(int i = 1; i < population; i++)
+  {
+    for(int j = 0; j < NUM_BOARD_FEATURES; j++) candidates[i].weights.weights[j] = 2.0f * random_float(&random) - 1.0f;
+    normalize(&candidates[i].weights);
+  }
+
+  printf("%d candidates x %d games, up to %d pieces under %d rows, %s hold, %d threads\n", population, settings.games,
+         settings.max_pieces, settings.ceiling, settings.use_hold ? "with" : "without", thread_pool_size(pool));
+
+  uint64_t total_games = 0;
+  uint64_t total_pieces = 0;
+  uint64_t start = latency_now_ns();
+
+  for(int g = 0; g < settings.generations; g++)
+  {
+    generation.candidates = candidates;
+    generation.seed = mix(settings.seed ^ mix(g + 1));
+
+    uint64_t generation_start = latency_now_ns();
+    int num_games = population * settings.games;
+    run_tasks(pool, play_game, &generation, num_games);
+    double seconds = (latency_now_ns() - generation_start) * 1e-9;
+
+    // Summed in order, so a seed gives the same run on any thread count
+    uint64_t pieces = 0;
+    for(int i = 0; i < population; i++)
+    {
+      int lines = 0;
+      for(int game = 0; game < settings.games; game++)
+      {
+        lines += generation.lines[i * settings.games + game];
+        pieces += generation.pieces[i * settings.games + game];
+      }
+      candidates[i].fitness = (float)lines / settings.games;
+    }
+    total_games += num_games;
+    total_pieces += pieces;
+
+    std::stable_sort(candidates, candidates + population,
+                     [](const Candidate &a, const Candidate &b) { return a.fitness > b.fitness; });
+
+    float mean = 0.0f;
+    for(int i = 0; i < population; i++) mean += candidates[i].fitness;
+    mean /= population;
+
+    printf("generation %2d: best %7.1f lines, mean %7.1f, %6.0f games/hour, %7.0f pieces/s\n", g, candidates[0].fitness,
+           mean, num_games / seconds * 3600.0, pieces / seconds);
+
+    if(g + 1 < settings.generations)
+    {
+      breed(candidates, next, population, &random);
+      std::swap(candidates, next);
+    }
+  }
+
+  double seconds = (latency_now_ns() - start) * 1e-9;
+  printf("\n%llu games in %.1f s, %.0f games/hour, %.0f pieces/s\n", (unsigned long long)total_games, seconds,
+         total_games / seconds * 3600.0, total_pieces / seconds);
+
+  printf("best weights, %.1f lines per game:\n", candidates[0].fitness);
+  print_weights(&candidates[0].weights);
+
+  free(candidates);
+  free(next);
+  free(generation.lines);
+  free(generation.pieces);
+  free(generation.scratch);
+  destroy_thread_pool(pool);
+  return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Lock-free, fixed-size hash table from a 64 bit key to 64 bits of data, for
+// search results that any number of threads can share.
+//
+// Each slot is two words: the data and the data XORed with the key. Writers
+// just overwrite both. A reader that catches a slot halfway through a write
+// sees the two words disagree with its key and counts it as a miss, so there
+// are no locks and no torn entries, only the odd lost one. Colliding keys
+// replace each other.
+//
+// Empty slots read as key 0 with data 0, so don't use 0 as a key.
+////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <stdint.h>
+
+struct TranspositionSlot
+{
+  std::atomic<uint64_t> check; // key ^ data
+  std::atomic<uint64_t> data;
+};
+
+struct TranspositionTable
+{
+  TranspositionSlot *slots;
+  uint64_t mask;
+};
+
+static void init_transposition_table(TranspositionTable *table, int size_log2)
+{
+  uint64_t num_slots = 1ull << size_log2;
+  table->slots = new TranspositionSlot[num_slots];
+  table->mask = num_slots - 1;
+
+  for(uint64_t i = 0; i < num_slots; i++)
+  {
+    table->slots[i].check.store(0, std::memory_order_relaxed);
+    table->slots[i].data.store(0, std::memory_order_relaxed);
+  }
+}
+
+static void free_transposition_table(TranspositionTable *table)
+{
+  delete[] table->slots;
+  table->slots = 0;
+}
+
+static void transposition_store(TranspositionTable *table, uint64_t key, uint64_t data)
+{
+  TranspositionSlot *slot = &table->slots[key & table->mask];
+  slot->check.store(key ^ data, std::memory_order_relaxed);
+  slot->data.store(data, std::memory_order_relaxed);
+}
+
+static bool transposition_probe(TranspositionTable *table, uint64_t key, uint64_t *data)
+{
+  TranspositionSlot *slot = &table->slots[key & table->mask];
+  uint64_t found_data = slot->data.load(std::memory_order_relaxed);
+  uint64_t check = slot->check.load(std::memory_order_relaxed);
+  if((check ^ found_data) != key) return false;
+
+  *data = found_data;
+  return true;
+}
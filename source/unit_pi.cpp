@@ -1,8 +1,19 @@
 
 // Game
 #include "tetris.cpp"
+#include "board.cpp"
+#include "move_generator.cpp"
+#include "board_evaluator.cpp"
+#include "zobrist.cpp"
+#include "finesse.cpp"
+#include "sim_state.cpp"
+#include "replay.cpp"
+#include "bot.cpp"
+#include "led_layout.cpp"
+#include "remote_input.cpp"
 
 // Platform specific
+#include "platform_pi/led_library.cpp"
 #include "platform_pi/renderer.cpp"
 #include "platform_pi/main_pi.cpp"
 
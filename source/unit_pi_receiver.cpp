@@ -0,0 +1,7 @@
+
+#include "led_layout.cpp"
+
+// Platform specific
+#include "platform_pi/led_library.cpp"
+#include "platform_pi/receiver_pi.cpp"
+
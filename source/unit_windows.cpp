@@ -1,6 +1,14 @@
 
 // Game
 #include "tetris.cpp"
+#include "board.cpp"
+#include "move_generator.cpp"
+#include "board_evaluator.cpp"
+#include "zobrist.cpp"
+#include "finesse.cpp"
+#include "sim_state.cpp"
+#include "replay.cpp"
+#include "bot.cpp"
 
 // Platform specific
 #include "platform_windows/main.cpp"
@@ -0,0 +1,104 @@
+#include "zobrist.h"
+
+static uint64_t split_mix(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static ZobristKeys make_zobrist_keys()
+{
+  ZobristKeys keys;
+  uint64_t state = 0x7E7215;
+
+  for(int row = 0; row < BOARD_ROWS; row++)
+  {
+    for(int column = 0; column < BOARD_COLUMNS; column++) keys.cells[row][column] = split_mix(&state);
+  }
+
+  // NO_PIECE gets a key too, an empty hold is different from a held I
+  for(int type = 0; type <= NO_PIECE; type++)
+  {
+    keys.current[type] = split_mix(&state);
+    keys.hold[type] = split_mix(&state);
+    for(int i = 0; i < ZOBRIST_QUEUE_LENGTH; i++) keys.queue[i][type] = split_mix(&state);
+  }
+  keys.can_hold = split_mix(&state);
+
+  return keys;
+}
+
+const ZobristKeys *zobrist_keys()
+{
+  static ZobristKeys keys = make_zobrist_keys();
+  return &keys;
+}
+
+uint64_t zobrist_rows(const Board *board, int from_row)
+{
+  const ZobristKeys *keys = zobrist_keys();
+
+  uint64_t hash = 0;
+  for(int row = from_row; row < BOARD_ROWS; row++)
+  {
+    uint32_t bits = board->rows[row];
+    if(!bits) continue;
+
+    for(int column = 0; column < BOARD_COLUMNS; column++)
+    {
+      if((bits >> column) & 1) hash ^= keys->cells[row][column];
+    }
+  }
+
+  return hash;
+}
+
+uint64_t zobrist_board(const Board *board)
+{
+  return zobrist_rows(board, 0);
+}
+
+uint64_t zobrist_piece(const Board *board, const Piece *piece)
+{
+  const ZobristKeys *keys = zobrist_keys();
+
+  uint64_t hash = 0;
+  for(int i = 0; i < 4; i++)
+  {
+    v2i p = piece->position + piece->points[i];
+    if(p.x < 0 || p.x >= BOARD_COLUMNS || p.y < 0 || p.y >= BOARD_ROWS) continue;
+    if((board->rows[p.y] >> p.x) & 1) continue;
+
+    hash ^= keys->cells[p.y][p.x];
+  }
+
+  return hash;
+}
+
+uint64_t zobrist_clear_rows(Board *board, uint64_t hash, const int *rows, int num_rows)
+{
+  if(num_rows == 0) return hash;
+
+  // Everything from the lowest cleared row up moves, rehash just that part
+  hash ^= zobrist_rows(board, rows[0]);
+  board_clear_rows(board, rows, num_rows);
+  hash ^= zobrist_rows(board, rows[0]);
+
+  return hash;
+}
+
+uint64_t zobrist_state(uint64_t board_hash, PieceType current, PieceType hold, bool can_hold,
+                       const PieceType *queue, int queue_length)
+{
+  const ZobristKeys *keys = zobrist_keys();
+
+  uint64_t hash = board_hash ^ keys->current[current] ^ keys->hold[hold];
+  if(can_hold) hash ^= keys->can_hold;
+
+  if(queue_length > ZOBRIST_QUEUE_LENGTH) queue_length = ZOBRIST_QUEUE_LENGTH;
+  for(int i = 0; i < queue_length; i++) hash ^= keys->queue[i][queue[i]];
+
+  return hash;
+}
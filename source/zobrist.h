@@ -0,0 +1,46 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+// Zobrist hashes of boards and game states. Every cell, and every piece in
+// every slot (falling, held, each queue position), has a random 64 bit key. A
+// hash is the XOR of the keys of what is there, so placing a piece XORs in its
+// cells and clearing rows only touches the rows that moved.
+//
+// The keys come from a fixed seed, so hashes are the same between runs and
+// between threads.
+////////////////////////////////////////////////////////////////////////////////
+
+#include "board.h"
+
+#include <stdint.h>
+
+static const int ZOBRIST_QUEUE_LENGTH = 8;
+
+struct ZobristKeys
+{
+  uint64_t cells[BOARD_ROWS][BOARD_COLUMNS];
+
+  uint64_t current[NO_PIECE + 1];
+  uint64_t hold[NO_PIECE + 1];
+  uint64_t queue[ZOBRIST_QUEUE_LENGTH][NO_PIECE + 1];
+  uint64_t can_hold;
+};
+
+const ZobristKeys *zobrist_keys();
+
+uint64_t zobrist_board(const Board *board);
+
+// Only rows from_row and up
+uint64_t zobrist_rows(const Board *board, int from_row);
+
+// What locking the piece XORs into the board hash: the cells it fills that
+// are inside the board and still empty
+uint64_t zobrist_piece(const Board *board, const Piece *piece);
+
+// Clears the rows (ordered bottom-up) and returns the updated board hash
+uint64_t zobrist_clear_rows(Board *board, uint64_t hash, const int *rows, int num_rows);
+
+// Board hash plus everything else that decides how the game goes on. Queue
+// pieces past ZOBRIST_QUEUE_LENGTH are left out.
+uint64_t zobrist_state(uint64_t board_hash, PieceType current, PieceType hold, bool can_hold,
+                       const PieceType *queue, int queue_length);